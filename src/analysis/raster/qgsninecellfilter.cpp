@@ -18,6 +18,9 @@
 #include "qgsninecellfilter.h"
 #include "cpl_string.h"
 #include <QProgressDialog>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8(x) (x).toUtf8().constData()
@@ -25,6 +28,26 @@
 #define TO8(x) (x).toLocal8Bit().constData()
 #endif
 
+/**Consecutive rows of a block calculated by one worker thread*/
+struct QgsNineCellFilterJob
+{
+  QgsNineCellFilter* filter;
+  /**input rows including the row above and below*/
+  float* input;
+  float* output;
+  int rows;
+  int xSize;
+};
+
+static void processNineCellFilterJob( QgsNineCellFilterJob& job )
+{
+  for ( int i = 0; i < job.rows; ++i )
+  {
+    float* scanLine = job.input + i * job.xSize;
+    job.filter->processRow( scanLine, scanLine + job.xSize, scanLine + 2 * job.xSize, job.output + i * job.xSize, job.xSize );
+  }
+}
+
 QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile ), mOutputFile( outputFile ), mOutputFormat( outputFormat ), mCellSizeX( -1 ), mCellSizeY( -1 ),
     mInputNodataValue( -1 ), mOutputNodataValue( -1 ), mZFactor( 1.0 )
@@ -95,24 +118,34 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
-  //keep only three scanlines in memory at a time
-  float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  //the rows are processed in blocks. While the worker threads calculate a block, the main thread writes
+  //the previous block and reads the next one, so GDAL is only ever accessed from the main thread
+  int nThreads = qMax( 1, QThread::idealThreadCount() );
+  int blockRows = qMin( ySize, qMax( 4 * nThreads, BlockSize / xSize ) );
 
-  float* resultLine = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  //every input block has an additional row above and below (the halo)
+  float* inputBlock[2];
+  float* outputBlock[2];
+  for ( int i = 0; i < 2; ++i )
+  {
+    inputBlock[i] = ( float * ) CPLMalloc( sizeof( float ) * xSize * ( blockRows + 2 ) );
+    outputBlock[i] = ( float * ) CPLMalloc( sizeof( float ) * xSize * blockRows );
+  }
 
   if ( p )
   {
     p->setMaximum( ySize );
   }
 
-  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
-  for ( int i = 0; i < ySize; ++i )
+  readBlock( rasterBand, 0, blockRows, xSize, ySize, inputBlock[0] );
+
+  int block = 0;
+  int previousRows = 0;
+  for ( int firstRow = 0; firstRow < ySize; firstRow += blockRows, ++block )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( firstRow );
     }
 
     if ( p && p->wasCanceled() )
@@ -120,56 +153,42 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
       break;
     }
 
-    if ( i == 0 )
-    {
-      //fill scanline 1 with (input) nodata for the values above the first row and feed scanline2 with the first row
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine1[a] = mInputNodataValue;
-      }
-      GDALRasterIO( rasterBand, GF_Read, 0, 0, xSize, 1, scanLine2, xSize, 1, GDT_Float32, 0, 0 );
-    }
-    else
+    int rows = qMin( blockRows, ySize - firstRow );
+    float* input = inputBlock[block % 2];
+    float* output = outputBlock[block % 2];
+
+    //split the block into one job per thread
+    QVector<QgsNineCellFilterJob> jobs;
+    int jobRows = ( rows + nThreads - 1 ) / nThreads;
+    for ( int row = 0; row < rows; row += jobRows )
     {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
-      scanLine1 = scanLine2;
-      scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      QgsNineCellFilterJob job;
+      job.filter = this;
+      job.input = input + row * xSize;
+      job.output = output + row * xSize;
+      job.rows = qMin( jobRows, rows - row );
+      job.xSize = xSize;
+      jobs.append( job );
     }
+    QFuture<void> future = QtConcurrent::map( jobs, processNineCellFilterJob );
 
-    if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
+    //write the previous block (in order) and read the next one meanwhile
+    if ( previousRows > 0 )
     {
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine3[a] = mInputNodataValue;
-      }
+      GDALRasterIO( outputRasterBand, GF_Write, 0, firstRow - previousRows, xSize, previousRows, outputBlock[( block + 1 ) % 2], xSize, previousRows, GDT_Float32, 0, 0 );
     }
-    else
+    if ( firstRow + rows < ySize )
     {
-      GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 );
+      readBlock( rasterBand, firstRow + rows, qMin( blockRows, ySize - firstRow - rows ), xSize, ySize, inputBlock[( block + 1 ) % 2] );
     }
 
-    for ( int j = 0; j < xSize; ++j )
-    {
-      if ( j == 0 )
-      {
-        resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
-                                               &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
-                                               &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
-      }
-      else
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
-                                               &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
-      }
-    }
+    future.waitForFinished();
+    previousRows = rows;
+  }
 
-    GDALRasterIO( outputRasterBand, GF_Write, 0, i, xSize, 1, resultLine, xSize, 1, GDT_Float32, 0, 0 );
+  if ( previousRows > 0 && !( p && p->wasCanceled() ) )
+  {
+    GDALRasterIO( outputRasterBand, GF_Write, 0, ySize - previousRows, xSize, previousRows, outputBlock[( block + 1 ) % 2], xSize, previousRows, GDT_Float32, 0, 0 );
   }
 
   if ( p )
@@ -177,10 +196,11 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     p->setValue( ySize );
   }
 
-  CPLFree( resultLine );
-  CPLFree( scanLine1 );
-  CPLFree( scanLine2 );
-  CPLFree( scanLine3 );
+  for ( int i = 0; i < 2; ++i )
+  {
+    CPLFree( inputBlock[i] );
+    CPLFree( outputBlock[i] );
+  }
 
   GDALClose( inputDataset );
 
@@ -195,6 +215,56 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   return 0;
 }
 
+void QgsNineCellFilter::processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
+  for ( int j = 0; j < xSize; ++j )
+  {
+    if ( j == 0 )
+    {
+      resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
+                                             &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
+    }
+    else if ( j == xSize - 1 )
+    {
+      resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
+                                             &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
+    }
+    else
+    {
+      resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
+                                             &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
+    }
+  }
+}
+
+void QgsNineCellFilter::readBlock( GDALRasterBandH rasterBand, int firstRow, int rows, int xSize, int ySize, float* block )
+{
+  //rows above the first and below the last row of the raster are filled with (input) nodata values
+  int firstReadRow = qMax( 0, firstRow - 1 );
+  int lastReadRow = qMin( ySize - 1, firstRow + rows );
+  float* readStart = block + ( firstReadRow - firstRow + 1 ) * xSize;
+
+  if ( firstRow == 0 )
+  {
+    for ( int a = 0; a < xSize; ++a )
+    {
+      block[a] = mInputNodataValue;
+    }
+  }
+  if ( firstRow + rows == ySize )
+  {
+    float* lastLine = block + ( rows + 1 ) * xSize;
+    for ( int a = 0; a < xSize; ++a )
+    {
+      lastLine[a] = mInputNodataValue;
+    }
+  }
+
+  int readRows = lastReadRow - firstReadRow + 1;
+  GDALRasterIO( rasterBand, GF_Read, 0, firstReadRow, xSize, readRows, readStart, xSize, readRows, GDT_Float32, 0, 0 );
+}
+
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
 {
   GDALDatasetH inputDataset = GDALOpen( TO8( mInputFile ), GA_ReadOnly );
@@ -57,6 +57,11 @@ class ANALYSIS_EXPORT QgsNineCellFilter
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /**Calculates one output row from the rows above, at and below it. Rows are processed in parallel,
+      so processNineCellWindow must not change the state of the filter
+      @note added in 1.9*/
+    void processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize );
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -69,6 +74,11 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     /**Opens the output file and sets the same geotransform and CRS as the input data
       @return the output dataset or NULL in case of error*/
     GDALDatasetH openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver );
+    /**Reads the given rows and the rows above and below them into block (rows + 2 lines of xSize values)*/
+    void readBlock( GDALRasterBandH rasterBand, int firstRow, int rows, int xSize, int ySize, float* block );
+
+    /**Approximate number of cells of a block of rows processed in parallel*/
+    static const int BlockSize = 1024 * 1024;
 
   protected:
 
@@ -68,6 +68,22 @@ class ANALYSIS_EXPORT QgsRasterCalcNode
 
     Type type() const { return mType; }
 
+    /**Operator of an operator node
+      @note added in 1.9*/
+    Operator operatorType() const { return mOperator; }
+    /**Left operand of an operator node
+      @note added in 1.9*/
+    const QgsRasterCalcNode* left() const { return mLeft; }
+    /**Right operand of an operator node (0 for functions with one argument)
+      @note added in 1.9*/
+    const QgsRasterCalcNode* right() const { return mRight; }
+    /**Value of a number node
+      @note added in 1.9*/
+    double number() const { return mNumber; }
+    /**Referenced raster of a raster reference node
+      @note added in 1.9*/
+    QString rasterName() const { return mRasterName; }
+
     //set left node
     void setLeft( QgsRasterCalcNode* left ) { delete mLeft; mLeft = left; }
     void setRight( QgsRasterCalcNode* right ) { delete mRight; mRight = right; }
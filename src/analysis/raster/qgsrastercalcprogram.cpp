@@ -0,0 +1,445 @@
+/***************************************************************************
+                          qgsrastercalcprogram.cpp
+            Raster calculator expression compiled to row operations
+                          --------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    email                : qgis-developer at lists dot osgeo dot org
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrastercalcprogram.h"
+#include "qgsrastermatrix.h"
+
+#include <cfloat>
+#include <cmath>
+
+//Operations on two values which are not nodata. They return nodataValue if the result is undefined.
+//The semantics are the ones of QgsRasterMatrix
+
+struct QgsRasterCalcPlus
+{
+  double operator()( double v1, double v2, double ) const { return v1 + v2; }
+};
+
+struct QgsRasterCalcMinus
+{
+  double operator()( double v1, double v2, double ) const { return v1 - v2; }
+};
+
+struct QgsRasterCalcMul
+{
+  double operator()( double v1, double v2, double ) const { return v1 * v2; }
+};
+
+struct QgsRasterCalcDiv
+{
+  double operator()( double v1, double v2, double nodataValue ) const { return v2 == 0 ? nodataValue : v1 / v2; }
+};
+
+struct QgsRasterCalcPow
+{
+  double operator()( double v1, double v2, double nodataValue ) const
+  {
+    if (( v1 == 0 && v2 < 0 ) || ( v2 < 0 && ( v2 - floor( v2 ) ) > 0 ) )
+    {
+      return nodataValue;
+    }
+    return pow( v1, v2 );
+  }
+};
+
+struct QgsRasterCalcEqual
+{
+  double operator()( double v1, double v2, double ) const { return v1 == v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcNotEqual
+{
+  double operator()( double v1, double v2, double ) const { return v1 == v2 ? 0.0 : 1.0; }
+};
+
+struct QgsRasterCalcGreaterThan
+{
+  double operator()( double v1, double v2, double ) const { return v1 > v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcLesserThan
+{
+  double operator()( double v1, double v2, double ) const { return v1 < v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcGreaterEqual
+{
+  double operator()( double v1, double v2, double ) const { return v1 >= v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcLesserEqual
+{
+  double operator()( double v1, double v2, double ) const { return v1 <= v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcAnd
+{
+  double operator()( double v1, double v2, double ) const { return v1 && v2 ? 1.0 : 0.0; }
+};
+
+struct QgsRasterCalcOr
+{
+  double operator()( double v1, double v2, double ) const { return v1 || v2 ? 1.0 : 0.0; }
+};
+
+//Operations on one value which is not nodata
+
+struct QgsRasterCalcSqrt
+{
+  double operator()( double v, double nodataValue ) const { return v < 0 ? nodataValue : sqrt( v ); }
+};
+
+struct QgsRasterCalcSin
+{
+  double operator()( double v, double ) const { return sin( v ); }
+};
+
+struct QgsRasterCalcCos
+{
+  double operator()( double v, double ) const { return cos( v ); }
+};
+
+struct QgsRasterCalcTan
+{
+  double operator()( double v, double ) const { return tan( v ); }
+};
+
+struct QgsRasterCalcAsin
+{
+  double operator()( double v, double ) const { return asin( v ); }
+};
+
+struct QgsRasterCalcAcos
+{
+  double operator()( double v, double ) const { return acos( v ); }
+};
+
+struct QgsRasterCalcAtan
+{
+  double operator()( double v, double ) const { return atan( v ); }
+};
+
+struct QgsRasterCalcSign
+{
+  double operator()( double v, double ) const { return -v; }
+};
+
+//The loops over the values. The operator is resolved once per instruction and inlined,
+//so the loops contain no dispatch and can be vectorized by the compiler
+
+template <class F>
+static void binaryOperation( const float* left, double leftNodata, const float* right, double rightNodata,
+                             float* result, double resultNodata, int nValues, F f )
+{
+  for ( int i = 0; i < nValues; ++i )
+  {
+    double value1 = left[i];
+    double value2 = right[i];
+    result[i] = static_cast<float>(( value1 == leftNodata || value2 == rightNodata ) ? resultNodata : f( value1, value2, resultNodata ) );
+  }
+}
+
+template <class F>
+static void unaryOperation( const float* values, double nodataValue, float* result, int nValues, F f )
+{
+  for ( int i = 0; i < nValues; ++i )
+  {
+    double value = values[i];
+    result[i] = value == nodataValue ? values[i] : static_cast<float>( f( value, nodataValue ) );
+  }
+}
+
+QgsRasterCalcProgram::QgsRasterCalcProgram( const QgsRasterCalcNode* node, const QMap<QString, double>& rasterNodataValues )
+    : mValid( true ), mNumRegisters( 0 )
+{
+  mResult = compile( node, rasterNodataValues );
+}
+
+QgsRasterCalcProgram::~QgsRasterCalcProgram()
+{
+}
+
+void QgsRasterCalcProgram::run( const QVector<float*>& inputs, int nValues, float* result, float outputNodataValue, float* scratch ) const
+{
+  if ( !mValid )
+  {
+    return;
+  }
+
+  QVector<Instruction>::const_iterator it = mInstructions.constBegin();
+  for ( ; it != mInstructions.constEnd(); ++it )
+  {
+    float* r = scratch + it->result * nValues;
+    if ( it->fill )
+    {
+      for ( int i = 0; i < nValues; ++i )
+      {
+        r[i] = it->value;
+      }
+      continue;
+    }
+
+    const float* l = it->left.index >= 0 ? inputs[it->left.index] : scratch + ( -it->left.index - 1 ) * nValues;
+    double ln = it->left.nodataValue;
+
+    if ( isUnary( it->op ) )
+    {
+      switch ( it->op )
+      {
+        case QgsRasterCalcNode::opSQRT:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcSqrt() );
+          break;
+        case QgsRasterCalcNode::opSIN:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcSin() );
+          break;
+        case QgsRasterCalcNode::opCOS:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcCos() );
+          break;
+        case QgsRasterCalcNode::opTAN:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcTan() );
+          break;
+        case QgsRasterCalcNode::opASIN:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcAsin() );
+          break;
+        case QgsRasterCalcNode::opACOS:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcAcos() );
+          break;
+        case QgsRasterCalcNode::opATAN:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcAtan() );
+          break;
+        case QgsRasterCalcNode::opSIGN:
+          unaryOperation( l, ln, r, nValues, QgsRasterCalcSign() );
+          break;
+        default:
+          break;
+      }
+      continue;
+    }
+
+    const float* rv = it->right.index >= 0 ? inputs[it->right.index] : scratch + ( -it->right.index - 1 ) * nValues;
+    double rn = it->right.nodataValue;
+    double n = it->nodataValue;
+
+    switch ( it->op )
+    {
+      case QgsRasterCalcNode::opPLUS:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcPlus() );
+        break;
+      case QgsRasterCalcNode::opMINUS:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcMinus() );
+        break;
+      case QgsRasterCalcNode::opMUL:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcMul() );
+        break;
+      case QgsRasterCalcNode::opDIV:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcDiv() );
+        break;
+      case QgsRasterCalcNode::opPOW:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcPow() );
+        break;
+      case QgsRasterCalcNode::opEQ:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcEqual() );
+        break;
+      case QgsRasterCalcNode::opNE:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcNotEqual() );
+        break;
+      case QgsRasterCalcNode::opGT:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcGreaterThan() );
+        break;
+      case QgsRasterCalcNode::opLT:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcLesserThan() );
+        break;
+      case QgsRasterCalcNode::opGE:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcGreaterEqual() );
+        break;
+      case QgsRasterCalcNode::opLE:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcLesserEqual() );
+        break;
+      case QgsRasterCalcNode::opAND:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcAnd() );
+        break;
+      case QgsRasterCalcNode::opOR:
+        binaryOperation( l, ln, rv, rn, r, n, nValues, QgsRasterCalcOr() );
+        break;
+      default:
+        break;
+    }
+  }
+
+  //replace the nodata values of the result with output nodata
+  const float* values = mResult.index >= 0 ? inputs[mResult.index] : scratch + ( -mResult.index - 1 ) * nValues;
+  for ( int i = 0; i < nValues; ++i )
+  {
+    result[i] = values[i] == mResult.nodataValue ? outputNodataValue : values[i];
+  }
+}
+
+QgsRasterCalcProgram::Operand QgsRasterCalcProgram::compile( const QgsRasterCalcNode* node, const QMap<QString, double>& rasterNodataValues )
+{
+  Operand operand;
+  operand.index = 0;
+  operand.nodataValue = -FLT_MAX;
+
+  if ( !node )
+  {
+    mValid = false;
+    return operand;
+  }
+
+  //evaluate constant subtrees once and fill a register with the number
+  if ( isConstant( node ) )
+  {
+    QMap<QString, QgsRasterMatrix*> noRasterData;
+    QgsRasterMatrix number;
+    if ( !node->calculate( noRasterData, number ) || !number.isNumber() )
+    {
+      mValid = false;
+      return operand;
+    }
+
+    Instruction instruction;
+    instruction.fill = true;
+    instruction.value = static_cast<float>( number.number() );
+    instruction.op = QgsRasterCalcNode::opPLUS;
+    instruction.left = operand;
+    instruction.right = operand;
+    instruction.result = allocateRegister();
+    instruction.nodataValue = number.nodataValue();
+    mInstructions.append( instruction );
+
+    operand.index = -instruction.result - 1;
+    operand.nodataValue = number.nodataValue();
+    return operand;
+  }
+
+  if ( node->type() == QgsRasterCalcNode::tRasterRef )
+  {
+    QString name = node->rasterName();
+    if ( !rasterNodataValues.contains( name ) )
+    {
+      mValid = false;
+      return operand;
+    }
+
+    int index = mRasterRefs.indexOf( name );
+    if ( index < 0 )
+    {
+      mRasterRefs.append( name );
+      index = mRasterRefs.size() - 1;
+    }
+    operand.index = index;
+    operand.nodataValue = rasterNodataValues.value( name );
+    return operand;
+  }
+
+  if ( node->type() != QgsRasterCalcNode::tOperator )
+  {
+    mValid = false;
+    return operand;
+  }
+
+  Instruction instruction;
+  instruction.fill = false;
+  instruction.value = 0;
+  instruction.op = node->operatorType();
+  instruction.left = compile( node->left(), rasterNodataValues );
+  instruction.right = operand;
+
+  if ( isUnary( instruction.op ) )
+  {
+    //compute in place if the operand is a register
+    instruction.result = instruction.left.index < 0 ? -instruction.left.index - 1 : allocateRegister();
+    instruction.nodataValue = instruction.left.nodataValue;
+  }
+  else
+  {
+    instruction.right = compile( node->right(), rasterNodataValues );
+
+    //a number takes the nodata value of the matrix it is combined with
+    instruction.nodataValue = isConstant( node->left() ) ? instruction.right.nodataValue : instruction.left.nodataValue;
+
+    if ( instruction.left.index < 0 )
+    {
+      instruction.result = -instruction.left.index - 1;
+      releaseRegister( instruction.right );
+    }
+    else if ( instruction.right.index < 0 )
+    {
+      instruction.result = -instruction.right.index - 1;
+    }
+    else
+    {
+      instruction.result = allocateRegister();
+    }
+  }
+  mInstructions.append( instruction );
+
+  operand.index = -instruction.result - 1;
+  operand.nodataValue = instruction.nodataValue;
+  return operand;
+}
+
+int QgsRasterCalcProgram::allocateRegister()
+{
+  if ( !mFreeRegisters.isEmpty() )
+  {
+    int reg = mFreeRegisters.last();
+    mFreeRegisters.pop_back();
+    return reg;
+  }
+  return mNumRegisters++;
+}
+
+void QgsRasterCalcProgram::releaseRegister( const Operand& operand )
+{
+  if ( operand.index < 0 )
+  {
+    mFreeRegisters.append( -operand.index - 1 );
+  }
+}
+
+bool QgsRasterCalcProgram::isConstant( const QgsRasterCalcNode* node )
+{
+  if ( !node )
+  {
+    return true;
+  }
+  if ( node->type() == QgsRasterCalcNode::tRasterRef )
+  {
+    return false;
+  }
+  return isConstant( node->left() ) && isConstant( node->right() );
+}
+
+bool QgsRasterCalcProgram::isUnary( QgsRasterCalcNode::Operator op )
+{
+  switch ( op )
+  {
+    case QgsRasterCalcNode::opSQRT:
+    case QgsRasterCalcNode::opSIN:
+    case QgsRasterCalcNode::opCOS:
+    case QgsRasterCalcNode::opTAN:
+    case QgsRasterCalcNode::opASIN:
+    case QgsRasterCalcNode::opACOS:
+    case QgsRasterCalcNode::opATAN:
+    case QgsRasterCalcNode::opSIGN:
+      return true;
+    default:
+      return false;
+  }
+}
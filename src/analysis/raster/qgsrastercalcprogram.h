@@ -0,0 +1,99 @@
+/***************************************************************************
+                          qgsrastercalcprogram.h
+            Raster calculator expression compiled to row operations
+                          --------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    email                : qgis-developer at lists dot osgeo dot org
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERCALCPROGRAM_H
+#define QGSRASTERCALCPROGRAM_H
+
+#include "qgsrastercalcnode.h"
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**A raster calculator expression tree lowered to a flat list of instructions. Every instruction applies
+one operator to whole arrays of values (rows or blocks of rows) held in registers, so that no temporary
+matrices are allocated during the calculation. Subtrees without raster references are evaluated once
+at compile time. The program is not changed by run(), so several threads may run it at the same time
+on different buffers.
+@note added in 1.9*/
+class ANALYSIS_EXPORT QgsRasterCalcProgram
+{
+  public:
+    /**Compiles the expression tree
+      @param node root of the expression tree
+      @param rasterNodataValues nodata value of every raster reference*/
+    QgsRasterCalcProgram( const QgsRasterCalcNode* node, const QMap<QString, double>& rasterNodataValues );
+    ~QgsRasterCalcProgram();
+
+    /**False if the expression references unknown rasters or uses unknown operators*/
+    bool isValid() const { return mValid; }
+
+    /**Raster references in the order their values are passed to run()*/
+    QStringList rasterRefs() const { return mRasterRefs; }
+
+    /**Number of floats of scratch space run() needs to process nValues values*/
+    int scratchSize( int nValues ) const { return mNumRegisters * nValues; }
+
+    /**Evaluates the expression for nValues values
+      @param inputs one array of nValues values for each entry of rasterRefs()
+      @param nValues number of values to process
+      @param result receives the result values
+      @param outputNodataValue value written for cells that evaluate to nodata
+      @param scratch buffer of scratchSize( nValues ) floats*/
+    void run( const QVector<float*>& inputs, int nValues, float* result, float outputNodataValue, float* scratch ) const;
+
+  private:
+    /**Operand of an instruction. Index is the index of an input array if >= 0, the register -index - 1 otherwise*/
+    struct Operand
+    {
+      int index;
+      double nodataValue;
+    };
+
+    struct Instruction
+    {
+      /**true if the instruction fills the result register with value instead of applying op*/
+      bool fill;
+      float value;
+      QgsRasterCalcNode::Operator op;
+      Operand left;
+      /**ignored for one argument operators*/
+      Operand right;
+      /**register receiving the result*/
+      int result;
+      /**nodata value of the result*/
+      double nodataValue;
+    };
+
+    /**Appends the instructions for node and returns the operand holding its result*/
+    Operand compile( const QgsRasterCalcNode* node, const QMap<QString, double>& rasterNodataValues );
+    /**Returns an unused register*/
+    int allocateRegister();
+    void releaseRegister( const Operand& operand );
+    static bool isConstant( const QgsRasterCalcNode* node );
+    static bool isUnary( QgsRasterCalcNode::Operator op );
+
+    bool mValid;
+    QStringList mRasterRefs;
+    QVector<Instruction> mInstructions;
+    QVector<int> mFreeRegisters;
+    int mNumRegisters;
+    Operand mResult;
+};
+
+#endif // QGSRASTERCALCPROGRAM_H
@@ -17,10 +17,12 @@
 
 #include "qgsrastercalculator.h"
 #include "qgsrastercalcnode.h"
+#include "qgsrastercalcprogram.h"
 #include "qgsrasterlayer.h"
-#include "qgsrastermatrix.h"
 #include "cpl_string.h"
 #include <QProgressDialog>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #include "gdalwarper.h"
 #include <ogr_srs_api.h>
@@ -31,6 +33,22 @@
 #define TO8(x) (x).toLocal8Bit().constData()
 #endif
 
+/**Part of a block of rows calculated by one worker thread*/
+struct QgsRasterCalculatorJob
+{
+  const QgsRasterCalcProgram* program;
+  QVector<float*> inputs;
+  int nValues;
+  float* result;
+  float outputNodataValue;
+  float* scratch;
+};
+
+static void runRasterCalculatorJob( QgsRasterCalculatorJob& job )
+{
+  job.program->run( job.inputs, job.nValues, job.result, job.outputNodataValue, job.scratch );
+}
+
 QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QString& outputFile, const QString& outputFormat,
     const QgsRectangle& outputExtent, int nOutputColumns, int nOutputRows, const QVector<QgsRasterCalculatorEntry>& rasterEntries ): mFormulaString( formulaString ), mOutputFile( outputFile ), mOutputFormat( outputFormat ),
     mOutputRectangle( outputExtent ), mNumOutputColumns( nOutputColumns ), mNumOutputRows( nOutputRows ), mRasterEntries( rasterEntries )
@@ -43,20 +61,26 @@ QgsRasterCalculator::~QgsRasterCalculator()
 
 int QgsRasterCalculator::processCalculation( QProgressDialog* p )
 {
+  //the rows are read and calculated in blocks of whole rows
+  if ( mNumOutputColumns < 1 || mNumOutputRows < 1 )
+  {
+    return 5;
+  }
+
   //prepare search string / tree
   QString errorString;
   QgsRasterCalcNode* calcNode = QgsRasterCalcNode::parseRasterCalcString( mFormulaString, errorString );
   if ( !calcNode )
   {
-    //error
+    return 4;
   }
 
   double targetGeoTransform[6];
   outputGeoTransform( targetGeoTransform );
 
   //open all input rasters for reading
-  QMap< QString, GDALRasterBandH > mInputRasterBands; //raster references and corresponding scanline data
-  QMap< QString, QgsRasterMatrix* > inputScanLineData; //stores raster references and corresponding scanline data
+  QMap< QString, GDALRasterBandH > mInputRasterBands; //raster references and corresponding raster bands
+  QMap< QString, double > inputNodataValues; //raster references and corresponding nodata values
   QVector< GDALDatasetH > mInputDatasets; //raster references and corresponding dataset
 
   QVector<QgsRasterCalculatorEntry>::const_iterator it = mRasterEntries.constBegin();
@@ -64,11 +88,13 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   {
     if ( !it->raster ) // no raster layer in entry
     {
+      delete calcNode;
       return 2;
     }
     GDALDatasetH inputDataset = GDALOpen( TO8( it->raster->source() ), GA_ReadOnly );
     if ( inputDataset == NULL )
     {
+      delete calcNode;
       return 2;
     }
 
@@ -94,6 +120,7 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     GDALRasterBandH inputRasterBand = GDALGetRasterBand( inputDataset, it->bandNumber );
     if ( inputRasterBand == NULL )
     {
+      delete calcNode;
       return 2;
     }
 
@@ -101,7 +128,20 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     double nodataValue = GDALGetRasterNoDataValue( inputRasterBand, &nodataSuccess );
 
     mInputRasterBands.insert( it->ref, inputRasterBand );
-    inputScanLineData.insert( it->ref, new QgsRasterMatrix( mNumOutputColumns, 1, new float[mNumOutputColumns], nodataValue ) );
+    inputNodataValues.insert( it->ref, nodataValue );
+  }
+
+  //lower the expression tree to operations on whole blocks of values
+  QgsRasterCalcProgram program( calcNode, inputNodataValues );
+  delete calcNode;
+  if ( !program.isValid() )
+  {
+    QVector< GDALDatasetH >::iterator datasetIt = mInputDatasets.begin();
+    for ( ; datasetIt != mInputDatasets.end(); ++ datasetIt )
+    {
+      GDALClose( *datasetIt );
+    }
+    return 4;
   }
 
   //open output dataset for writing
@@ -140,21 +180,47 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   float outputNodataValue = -FLT_MAX;
   GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue );
 
-  float* resultScanLine = ( float * ) CPLMalloc( sizeof( float ) * mNumOutputColumns );
+  //the rows are calculated in blocks. While the worker threads calculate a block, the main thread writes
+  //the previous block and reads the next one, so GDAL is only ever accessed from the main thread
+  int nThreads = qMax( 1, QThread::idealThreadCount() );
+  int blockRows = qMin( mNumOutputRows, qMax( 1, BlockSize / mNumOutputColumns ) );
+  int blockValues = blockRows * mNumOutputColumns;
+  int jobValues = ( blockValues + nThreads - 1 ) / nThreads;
+
+  QStringList rasterRefs = program.rasterRefs();
+  QVector<float*> inputBlocks[2];
+  float* resultBlocks[2];
+  for ( int i = 0; i < 2; ++i )
+  {
+    for ( int j = 0; j < rasterRefs.size(); ++j )
+    {
+      inputBlocks[i].append(( float * ) CPLMalloc( sizeof( float ) * blockValues ) );
+    }
+    resultBlocks[i] = ( float * ) CPLMalloc( sizeof( float ) * blockValues );
+  }
+  QVector<float*> scratchBuffers;
+  for ( int i = 0; i < nThreads; ++i )
+  {
+    scratchBuffers.append(( float * ) CPLMalloc( sizeof( float ) * qMax( 1, program.scratchSize( jobValues ) ) ) );
+  }
 
   if ( p )
   {
     p->setMaximum( mNumOutputRows );
   }
 
-  QgsRasterMatrix resultMatrix;
+  if ( blockRows > 0 )
+  {
+    readBlock( rasterRefs, mInputRasterBands, targetGeoTransform, 0, blockRows, inputBlocks[0] );
+  }
 
-  //read / write line by line
-  for ( int i = 0; i < mNumOutputRows; ++i )
+  int block = 0;
+  int previousRows = 0;
+  for ( int firstRow = 0; firstRow < mNumOutputRows; firstRow += blockRows, ++block )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( firstRow );
     }
 
     if ( p && p->wasCanceled() )
@@ -162,56 +228,44 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
       break;
     }
 
-    //fill buffers
-    QMap< QString, QgsRasterMatrix* >::iterator bufferIt = inputScanLineData.begin();
-    for ( ; bufferIt != inputScanLineData.end(); ++bufferIt )
-    {
-      double sourceTransformation[6];
-      GDALRasterBandH sourceRasterBand = mInputRasterBands[bufferIt.key()];
-      GDALGetGeoTransform( GDALGetBandDataset( sourceRasterBand ), sourceTransformation );
-      //the function readRasterPart calls GDALRasterIO (and ev. does some conversion if raster transformations are not the same)
-      readRasterPart( targetGeoTransform, 0, i, mNumOutputColumns, 1, sourceTransformation, sourceRasterBand, bufferIt.value()->data() );
-    }
+    int rows = qMin( blockRows, mNumOutputRows - firstRow );
+    int nValues = rows * mNumOutputColumns;
 
-    if ( calcNode->calculate( inputScanLineData, resultMatrix ) )
+    //split the block into one job per thread
+    QVector<QgsRasterCalculatorJob> jobs;
+    for ( int offset = 0; offset < nValues; offset += jobValues )
     {
-      bool resultIsNumber = resultMatrix.isNumber();
-      float* calcData;
-
-      if ( resultIsNumber ) //scalar result. Insert number for every pixel
-      {
-        calcData = new float[mNumOutputColumns];
-        for ( int j = 0; j < mNumOutputColumns; ++j )
-        {
-          calcData[j] = resultMatrix.number();
-        }
-      }
-      else //result is real matrix
-      {
-        calcData = resultMatrix.data();
-      }
-
-      //replace all matrix nodata values with output nodatas
-      for ( int j = 0; j < mNumOutputColumns; ++j )
-      {
-        if ( calcData[j] == resultMatrix.nodataValue() )
-        {
-          calcData[j] = outputNodataValue;
-        }
-      }
-
-      //write scanline to the dataset
-      if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, mNumOutputColumns, 1, calcData, mNumOutputColumns, 1, GDT_Float32, 0, 0 ) != CE_None )
+      QgsRasterCalculatorJob job;
+      job.program = &program;
+      for ( int j = 0; j < rasterRefs.size(); ++j )
       {
-        qWarning( "RasterIO error!" );
+        job.inputs.append( inputBlocks[block % 2][j] + offset );
       }
+      job.nValues = qMin( jobValues, nValues - offset );
+      job.result = resultBlocks[block % 2] + offset;
+      job.outputNodataValue = outputNodataValue;
+      job.scratch = scratchBuffers[jobs.size()];
+      jobs.append( job );
+    }
+    QFuture<void> future = QtConcurrent::map( jobs, runRasterCalculatorJob );
 
-      if ( resultIsNumber )
-      {
-        delete[] calcData;
-      }
+    //write the previous block (in order) and read the next one meanwhile
+    if ( previousRows > 0 )
+    {
+      writeBlock( outputRasterBand, firstRow - previousRows, previousRows, resultBlocks[( block + 1 ) % 2] );
+    }
+    if ( firstRow + rows < mNumOutputRows )
+    {
+      readBlock( rasterRefs, mInputRasterBands, targetGeoTransform, firstRow + rows, qMin( blockRows, mNumOutputRows - firstRow - rows ), inputBlocks[( block + 1 ) % 2] );
     }
 
+    future.waitForFinished();
+    previousRows = rows;
+  }
+
+  if ( previousRows > 0 && !( p && p->wasCanceled() ) )
+  {
+    writeBlock( outputRasterBand, mNumOutputRows - previousRows, previousRows, resultBlocks[( block + 1 ) % 2] );
   }
 
   if ( p )
@@ -220,13 +274,18 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   }
 
   //close datasets and release memory
-  delete calcNode;
-  QMap< QString, QgsRasterMatrix* >::iterator bufferIt = inputScanLineData.begin();
-  for ( ; bufferIt != inputScanLineData.end(); ++bufferIt )
+  for ( int i = 0; i < 2; ++i )
   {
-    delete bufferIt.value();
+    foreach( float* buffer, inputBlocks[i] )
+    {
+      CPLFree( buffer );
+    }
+    CPLFree( resultBlocks[i] );
+  }
+  foreach( float* buffer, scratchBuffers )
+  {
+    CPLFree( buffer );
   }
-  inputScanLineData.clear();
 
   QVector< GDALDatasetH >::iterator datasetIt = mInputDatasets.begin();
   for ( ; datasetIt != mInputDatasets.end(); ++ datasetIt )
@@ -241,10 +300,30 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     return 3;
   }
   GDALClose( outputDataset );
-  CPLFree( resultScanLine );
   return 0;
 }
 
+void QgsRasterCalculator::readBlock( const QStringList& rasterRefs, const QMap<QString, GDALRasterBandH>& rasterBands, double* targetGeoTransform,
+                                     int firstRow, int nRows, QVector<float*>& buffers )
+{
+  for ( int i = 0; i < rasterRefs.size(); ++i )
+  {
+    double sourceTransformation[6];
+    GDALRasterBandH sourceRasterBand = rasterBands.value( rasterRefs.at( i ) );
+    GDALGetGeoTransform( GDALGetBandDataset( sourceRasterBand ), sourceTransformation );
+    //the function readRasterPart calls GDALRasterIO (and ev. does some conversion if raster transformations are not the same)
+    readRasterPart( targetGeoTransform, 0, firstRow, mNumOutputColumns, nRows, sourceTransformation, sourceRasterBand, buffers[i] );
+  }
+}
+
+void QgsRasterCalculator::writeBlock( GDALRasterBandH outputRasterBand, int firstRow, int nRows, float* data )
+{
+  if ( GDALRasterIO( outputRasterBand, GF_Write, 0, firstRow, mNumOutputColumns, nRows, data, mNumOutputColumns, nRows, GDT_Float32, 0, 0 ) != CE_None )
+  {
+    qWarning( "RasterIO error!" );
+  }
+}
+
 QgsRasterCalculator::QgsRasterCalculator()
 {
 }
@@ -348,11 +427,11 @@ void QgsRasterCalculator::readRasterPart( double* targetGeotransform, int xOffse
       if ( sourceIndexX >= 0 && sourceIndexX < nSourcePixelsX
            && sourceIndexY >= 0 && sourceIndexY < nSourcePixelsY )
       {
-        rasterBuffer[j + i*nRows] = sourceRaster[ sourceIndexX  + nSourcePixelsX * sourceIndexY ];
+        rasterBuffer[j + i*nCols] = sourceRaster[ sourceIndexX  + nSourcePixelsX * sourceIndexY ];
       }
       else
       {
-        rasterBuffer[j + i*j] = nodataValue;
+        rasterBuffer[j + i*nCols] = nodataValue;
       }
       targetPixelX += targetGeotransform[1];
     }
@@ -20,7 +20,9 @@
 
 #include "qgsfield.h"
 #include "qgsrectangle.h"
+#include <QMap>
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include "gdal.h"
 
@@ -45,7 +47,9 @@ class ANALYSIS_EXPORT QgsRasterCalculator
 
     /**Starts the calculation and writes new raster
       @param p progress bar (or 0 if called from non-gui code)
-      @return 0 in case of success*/
+      @return 0 in case of success, 1 if the output driver is not available, 2 if an input raster cannot be read,
+      3 if the calculation was canceled, 4 if the formula cannot be parsed and 5 (added in 1.9) if the output
+      raster has no columns or rows*/
     int processCalculation( QProgressDialog* p = 0 );
 
   private:
@@ -78,6 +82,13 @@ class ANALYSIS_EXPORT QgsRasterCalculator
                          GDALRasterBandH sourceBand,
                          float* rasterBuffer );
 
+    /**Reads nRows rows starting at firstRow of every raster reference into buffers (in the order of rasterRefs)*/
+    void readBlock( const QStringList& rasterRefs, const QMap<QString, GDALRasterBandH>& rasterBands, double* targetGeoTransform,
+                    int firstRow, int nRows, QVector<float*>& buffers );
+
+    /**Writes nRows rows starting at firstRow to the output band*/
+    void writeBlock( GDALRasterBandH outputRasterBand, int firstRow, int nRows, float* data );
+
     /**Compares two geotransformations (six parameter double arrays*/
     bool transformationsEqual( double* t1, double* t2 ) const;
 
@@ -98,6 +109,9 @@ class ANALYSIS_EXPORT QgsRasterCalculator
 
     /***/
     QVector<QgsRasterCalculatorEntry> mRasterEntries;
+
+    /**Approximate number of cells of a block of rows calculated in parallel*/
+    static const int BlockSize = 1024 * 1024;
 };
 
 #endif // QGSRASTERCALCULATOR_H
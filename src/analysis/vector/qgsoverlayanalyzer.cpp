@@ -51,11 +51,11 @@ bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* l
 
   QgsVectorFileWriter vWriter( shapefileName, dpA->encoding(), fieldsA, outputType, &crs );
   QgsFeature currentFeature;
-  QgsSpatialIndex index;
 
   //take only selection
   if ( onlySelectedFeatures )
   {
+    QgsSpatialIndex index;
     const QgsFeatureIds selectionB = layerB->selectedFeaturesIds();
     QgsFeatureIds::const_iterator it = selectionB.constBegin();
     for ( ; it != selectionB.constEnd(); ++it )
@@ -102,11 +102,8 @@ bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* l
   //take all features
   else
   {
-    layerB->select( layerB->pendingAllAttributesList(), QgsRectangle(), true, false );
-    while ( layerB->nextFeature( currentFeature ) )
-    {
-      index.insertFeature( currentFeature );
-    }
+    // pack the index from all features at once
+    QgsSpatialIndex index( layerB );
     QgsFeature currentFeature;
     layerA->select( layerA->pendingAllAttributesList(), QgsRectangle(), true, false );
 
@@ -196,8 +196,6 @@ QgsOptions::QgsOptions( QWidget *parent, Qt::WFlags fl ) :
   cmbPromptRasterSublayers->addItem( tr( "Load all" ) );
   cmbPromptRasterSublayers->setCurrentIndex( settings.value( "/qgis/promptForRasterSublayers", 0 ).toInt() );
 
-  // set the display update threshold
-  spinBoxUpdateThreshold->setValue( settings.value( "/Map/updateThreshold" ).toInt() );
   //set the default projection behaviour radio buttongs
   if ( settings.value( "/Projections/defaultBehaviour", "prompt" ).toString() == "prompt" )
   {
@@ -299,6 +297,7 @@ QgsOptions::QgsOptions( QWidget *parent, Qt::WFlags fl ) :
   //Changed to default to true as of QGIS 1.7
   chkAntiAliasing->setChecked( settings.value( "/qgis/enable_anti_aliasing", true ).toBool() );
   chkUseRenderCaching->setChecked( settings.value( "/qgis/enable_render_caching", false ).toBool() );
+  chkParallelRendering->setChecked( settings.value( "/qgis/parallel_rendering", false ).toBool() );
 
   //Changed to default to true as of QGIS 1.7
   chkUseSymbologyNG->setChecked( settings.value( "/qgis/use_symbology_ng", true ).toBool() );
@@ -629,6 +628,7 @@ void QgsOptions::saveOptions()
   settings.setValue( "/qgis/new_layers_visible", chkAddedVisibility->isChecked() );
   settings.setValue( "/qgis/enable_anti_aliasing", chkAntiAliasing->isChecked() );
   settings.setValue( "/qgis/enable_render_caching", chkUseRenderCaching->isChecked() );
+  settings.setValue( "/qgis/parallel_rendering", chkParallelRendering->isChecked() );
   settings.setValue( "/qgis/use_qimage_to_render", !( chkUseQPixmap->isChecked() ) );
   settings.setValue( "/qgis/use_symbology_ng", chkUseSymbologyNG->isChecked() );
   settings.setValue( "/qgis/legendDoubleClickAction", cmbLegendDoubleClickAction->currentIndex() );
@@ -673,7 +673,6 @@ void QgsOptions::saveOptions()
   settings.setValue( "/IconSize", cmbIconSize->currentText() );
   settings.setValue( "/fontPointSize", spinFontSize->value() );
 
-  settings.setValue( "/Map/updateThreshold", spinBoxUpdateThreshold->value() );
   //check behaviour so default projection when new layer is added with no
   //projection defined...
   if ( radPromptForProjection->isChecked() )
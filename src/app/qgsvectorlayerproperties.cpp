@@ -525,6 +525,9 @@ void QgsVectorLayerProperties::reset( void )
   leMaximumScale->setText( QString::number( layer->maximumScale(), 'f' ) );
   leMaximumScale->setValidator( new QDoubleValidator( 0, std::numeric_limits<float>::max(), 1000, this ) );
 
+  chkSimplifyDrawing->setChecked( layer->simplifyDrawing() );
+  mSimplifyDrawingToleranceSpinBox->setValue( layer->simplifyDrawingTolerance() );
+
   // symbology initialization
   if ( legendtypecombobox->count() == 0 )
   {
@@ -617,6 +620,9 @@ void QgsVectorLayerProperties::apply()
   layer->setMinimumScale( leMinimumScale->text().toFloat() );
   layer->setMaximumScale( leMaximumScale->text().toFloat() );
 
+  layer->setSimplifyDrawing( chkSimplifyDrawing->isChecked() );
+  layer->setSimplifyDrawingTolerance( mSimplifyDrawingToleranceSpinBox->value() );
+
   // provider-specific options
   if ( layer->dataProvider() )
   {
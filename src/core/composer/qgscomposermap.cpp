@@ -20,6 +20,7 @@
 #include "qgscoordinatetransform.h"
 #include "qgslogger.h"
 #include "qgsmaprenderer.h"
+#include "qgsmaprendererjob.h"
 #include "qgsmaplayer.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmaptopixel.h"
@@ -33,17 +34,23 @@
 #include "qgslabelattributes.h"
 #include "qgssymbollayerv2utils.h" //for pointOnLineWithDistance
 
+#include <QCoreApplication>
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QPainter>
 #include <QSettings>
+#include <QTimer>
 #include <cmath>
 
+QHash<QString, QgsComposerMap::SharedRenderJob> QgsComposerMap::sRenderJobs;
+QCache<QString, QImage> QgsComposerMap::sRenderedImages( 16 * 1024 * 1024 );
+int QgsComposerMap::sRenderGeneration = 0;
+
 QgsComposerMap::QgsComposerMap( QgsComposition *composition, int x, int y, int width, int height )
     : QgsComposerItem( x, y, width, height, composition ), mKeepLayerSet( false ), mGridEnabled( false ), mGridStyle( Solid ),
     mGridIntervalX( 0.0 ), mGridIntervalY( 0.0 ), mGridOffsetX( 0.0 ), mGridOffsetY( 0.0 ), mGridAnnotationPrecision( 3 ), mShowGridAnnotation( false ),
     mGridAnnotationPosition( OutsideMapFrame ), mAnnotationFrameDistance( 1.0 ), mGridAnnotationDirection( Horizontal ),
-    mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true )
+    mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true ), mRenderJob( 0 ), mRenderingPreview( false ), mRenderWidthScale( 0 )
 {
   mComposition = composition;
 
@@ -88,7 +95,7 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
     : QgsComposerItem( 0, 0, 10, 10, composition ), mKeepLayerSet( false ), mGridEnabled( false ), mGridStyle( Solid ),
     mGridIntervalX( 0.0 ), mGridIntervalY( 0.0 ), mGridOffsetX( 0.0 ), mGridOffsetY( 0.0 ), mGridAnnotationPrecision( 3 ), mShowGridAnnotation( false ),
     mGridAnnotationPosition( OutsideMapFrame ), mAnnotationFrameDistance( 1.0 ), mGridAnnotationDirection( Horizontal ), mCrossLength( 3 ),
-    mMapCanvas( 0 ), mDrawCanvasItems( true )
+    mMapCanvas( 0 ), mDrawCanvasItems( true ), mRenderJob( 0 ), mRenderingPreview( false ), mRenderWidthScale( 0 )
 {
   //Offset
   mXOffset = 0.0;
@@ -108,6 +115,7 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
 
 QgsComposerMap::~QgsComposerMap()
 {
+  releaseRenderJob();
 }
 
 void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const QSize& size, int dpi )
@@ -130,22 +138,7 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
   }
 
   QgsMapRenderer theMapRenderer;
-  theMapRenderer.setExtent( extent );
-  theMapRenderer.setOutputSize( size, dpi );
-  if ( mMapRenderer->labelingEngine() )
-    theMapRenderer.setLabelingEngine( mMapRenderer->labelingEngine()->clone() );
-
-  //use stored layer set or read current set from main canvas
-  if ( mKeepLayerSet )
-  {
-    theMapRenderer.setLayerSet( mLayerSet );
-  }
-  else
-  {
-    theMapRenderer.setLayerSet( mMapRenderer->layerSet() );
-  }
-  theMapRenderer.setDestinationCrs( mMapRenderer->destinationCrs() );
-  theMapRenderer.setProjectionsEnabled( mMapRenderer->hasCrsTransformEnabled() );
+  initRenderer( theMapRenderer, extent, size, dpi );
 
   //set antialiasing if enabled in options
   QSettings settings;
@@ -155,25 +148,6 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
     painter->setRenderHint( QPainter::Antialiasing );
   }
 
-  QgsRenderContext* theRendererContext = theMapRenderer.rendererContext();
-  if ( theRendererContext )
-  {
-    theRendererContext->setDrawEditingInformation( false );
-    theRendererContext->setRenderingStopped( false );
-  }
-
-  // force vector output (no caching of marker images etc.)
-  theRendererContext->setForceVectorOutput( true );
-
-  //force composer map scale for scale dependent visibility
-  double bk_scale = theMapRenderer.scale();
-  theMapRenderer.setScale( scale() );
-
-  //layer caching (as QImages) cannot be done for composer prints
-  QSettings s;
-  bool bkLayerCaching = s.value( "/qgis/enable_render_caching", false ).toBool();
-  s.setValue( "/qgis/enable_render_caching", false );
-
   if ( forceWidthScale ) //force wysiwyg line widths / marker sizes
   {
     theMapRenderer.render( painter, forceWidthScale );
@@ -182,9 +156,40 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
   {
     theMapRenderer.render( painter );
   }
-  s.setValue( "/qgis/enable_render_caching", bkLayerCaching );
+}
+
+QStringList QgsComposerMap::layersToRender() const
+{
+  //use stored layer set or read current set from main canvas
+  return mKeepLayerSet ? mLayerSet : mMapRenderer->layerSet();
+}
+
+void QgsComposerMap::initRenderer( QgsMapRenderer& renderer, const QgsRectangle& extent, const QSizeF& size, double dpi ) const
+{
+  renderer.setExtent( extent );
+  renderer.setOutputSize( size, dpi );
+  if ( mMapRenderer->labelingEngine() )
+    renderer.setLabelingEngine( mMapRenderer->labelingEngine()->clone() );
+
+  renderer.setLayerSet( layersToRender() );
+  renderer.setDestinationCrs( mMapRenderer->destinationCrs() );
+  renderer.setProjectionsEnabled( mMapRenderer->hasCrsTransformEnabled() );
+
+  QgsRenderContext* theRendererContext = renderer.rendererContext();
+  if ( theRendererContext )
+  {
+    theRendererContext->setDrawEditingInformation( false );
+    theRendererContext->setRenderingStopped( false );
+
+    // force vector output (no caching of marker images etc.)
+    theRendererContext->setForceVectorOutput( true );
+  }
+
+  //layer caching (as QImages) cannot be done for composer prints
+  renderer.setLayerCachingEnabled( false );
 
-  theMapRenderer.setScale( bk_scale );
+  //force composer map scale for scale dependent visibility
+  renderer.setScale( scale() );
 }
 
 void QgsComposerMap::cache( void )
@@ -199,8 +204,6 @@ void QgsComposerMap::cache( void )
     return;
   }
 
-  mDrawing = true;
-
   //in case of rotation, we need to request a larger rectangle and create a larger cache image
   QgsRectangle requestExtent;
   requestedExtent( requestExtent );
@@ -226,12 +229,71 @@ void QgsComposerMap::cache( void )
 
   double forcedWidthScaleFactor = w / requestExtent.width() / mapUnitsToMM();
 
+  bool background = true;
+  foreach( QString layerId, layersToRender() )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( layer && !QgsMapRendererJob::canRenderInBackground( layer ) )
+    {
+      background = false;
+    }
+  }
+
+  if ( background )
+  {
+    // an update of the image was requested, images rendered before are outdated.
+    // All maps updated at once, e.g. after a change of the layers, render with the same generation.
+    if ( !mCacheUpdated )
+    {
+      static QTimer* generationTimer = 0;
+      if ( !generationTimer )
+      {
+        generationTimer = new QTimer( QCoreApplication::instance() );
+        generationTimer->setSingleShot( true );
+      }
+      if ( !generationTimer->isActive() )
+      {
+        ++sRenderGeneration;
+        sRenderedImages.clear();
+        generationTimer->start( 0 );
+      }
+    }
+
+    QString key = renderKey( requestExtent, QSize( w, h ) );
+    if ( key == mRenderKey )
+    {
+      mCacheUpdated = true;
+      return; // the image is shown or being rendered
+    }
+
+    releaseRenderJob();
+    mRenderKey = key;
+    mRenderExtent = requestExtent;
+    mRenderSize = QSize( w, h );
+    mRenderWidthScale = forcedWidthScaleFactor;
+    mCacheUpdated = true;
+
+    // large images are shown at a quarter of the resolution first
+    mRenderingPreview = w * h > 250000 && !sRenderedImages.contains( key );
+    if ( mRenderingPreview )
+    {
+      startRenderJob( QSize( qMax( w / 4, 1 ), qMax( h / 4, 1 ) ), forcedWidthScaleFactor / 4 );
+    }
+    else
+    {
+      startRenderJob( mRenderSize, forcedWidthScaleFactor );
+    }
+    return;
+  }
+
+  // layers that cannot be rendered in background are drawn in the main thread
+  releaseRenderJob();
+  mRenderKey.clear();
+  mDrawing = true;
+
   mCacheImage = QImage( w, h,  QImage::Format_ARGB32 );
   mCacheImage.fill( brush().color().rgb() ); //consider the item background brush
-  double mapUnitsPerPixel = mExtent.width() / w;
-
-  // WARNING: ymax in QgsMapToPixel is device height!!!
-  QgsMapToPixel transform( mapUnitsPerPixel, h, requestExtent.yMinimum(), requestExtent.xMinimum() );
+  mCacheExtent = requestExtent;
 
   QPainter p( &mCacheImage );
 
@@ -242,6 +304,154 @@ void QgsComposerMap::cache( void )
   mDrawing = false;
 }
 
+QString QgsComposerMap::renderKey( const QgsRectangle& extent, const QSize& size ) const
+{
+  QStringList key;
+  key << QString::number( sRenderGeneration )
+  << QString::number( extent.xMinimum(), 'g', 17 ) << QString::number( extent.yMinimum(), 'g', 17 )
+  << QString::number( extent.xMaximum(), 'g', 17 ) << QString::number( extent.yMaximum(), 'g', 17 )
+  << QString::number( size.width() ) << QString::number( size.height() )
+  << QString::number( scale(), 'g', 17 ) << QString::number( mapUnitsToMM(), 'g', 17 )
+  << QString::number( brush().color().rgba() )
+  << QString::number( mMapRenderer->destinationCrs().srsid() )
+  << QString::number( mMapRenderer->hasCrsTransformEnabled() )
+  << layersToRender().join( "," );
+  return key.join( "|" );
+}
+
+void QgsComposerMap::startRenderJob( const QSize& size, double widthScale )
+{
+  QString key = renderKey( mRenderExtent, size );
+
+  QImage* rendered = sRenderedImages.object( key );
+  if ( rendered )
+  {
+    mCacheImage = *rendered;
+    mCacheExtent = mRenderExtent;
+    if ( mRenderingPreview )
+    {
+      mRenderingPreview = false;
+      startRenderJob( mRenderSize, mRenderWidthScale );
+    }
+    QGraphicsRectItem::update();
+    return;
+  }
+
+  QHash<QString, SharedRenderJob>::iterator it = sRenderJobs.find( key );
+  if ( it == sRenderJobs.end() )
+  {
+    QImage image( size, QImage::Format_ARGB32 );
+    image.fill( brush().color().rgb() ); //consider the item background brush
+
+    QgsMapRenderer* renderer = new QgsMapRenderer();
+    initRenderer( *renderer, mRenderExtent, QSizeF( size.width(), size.height() ), image.logicalDpiX() );
+    // before the job exists, prefetching cancels the jobs
+    QgsMapRendererJob::prefetchLayers( renderer );
+
+    QSettings settings;
+    QgsMapRendererJob* job = new QgsMapRendererJob( renderer, image, settings.value( "/qgis/enable_anti_aliasing", true ).toBool() ? QPainter::Antialiasing : QPainter::RenderHints( 0 ) );
+    job->setAutoDeleteRenderer( true );
+    job->setForceWidthScale( widthScale );
+
+    SharedRenderJob shared;
+    shared.job = job;
+    shared.users = 0;
+    it = sRenderJobs.insert( key, shared );
+  }
+
+  it->users++;
+  mRenderJob = it->job;
+  connect( mRenderJob, SIGNAL( finished() ), this, SLOT( renderJobFinished() ) );
+  if ( !mRenderJob->isRunning() && !mRenderJob->isFinished() )
+  {
+    mRenderJob->start( QThread::LowPriority );
+  }
+  else if ( mRenderJob->isRendered() )
+  {
+    // rendered before we were connected
+    takeRenderedImage();
+  }
+  else if ( !mRenderJob->isRunning() )
+  {
+    // cancelled before we were connected
+    mRenderJob->restart( QThread::LowPriority );
+  }
+}
+
+void QgsComposerMap::releaseRenderJob()
+{
+  if ( !mRenderJob )
+  {
+    return;
+  }
+
+  QgsMapRendererJob* job = mRenderJob;
+  mRenderJob = 0;
+  disconnect( job, 0, this, 0 );
+
+  QHash<QString, SharedRenderJob>::iterator it = sRenderJobs.begin();
+  for ( ; it != sRenderJobs.end(); ++it )
+  {
+    if ( it->job == job )
+    {
+      break;
+    }
+  }
+  if ( it == sRenderJobs.end() || --it->users > 0 )
+  {
+    return;
+  }
+
+  if ( job->isRendered() )
+  {
+    const QImage& image = job->renderedImage();
+    sRenderedImages.insert( it.key(), new QImage( image ), image.width() * image.height() );
+  }
+  sRenderJobs.erase( it );
+
+  // the job waits for its thread to stop when it is deleted
+  job->cancel();
+  job->deleteLater();
+}
+
+void QgsComposerMap::renderJobFinished()
+{
+  if ( mRenderJob && sender() == mRenderJob )
+  {
+    if ( !mRenderJob->isRendered() )
+    {
+      // cancelled because a layer changed, see QgsMapRendererJob::cancelRunningJobs()
+      if ( !QgsMapRendererJob::canRenderInBackground( mRenderJob->renderer() ) )
+      {
+        // e.g. a join was added, the layers are drawn in the main thread
+        releaseRenderJob();
+        mRenderKey.clear();
+        cache();
+        QGraphicsRectItem::update();
+        return;
+      }
+      mRenderJob->restart( QThread::LowPriority );
+      return;
+    }
+    takeRenderedImage();
+  }
+}
+
+void QgsComposerMap::takeRenderedImage()
+{
+  mCacheImage = mRenderJob->renderedImage();
+  mCacheExtent = mRenderExtent;
+  releaseRenderJob();
+
+  if ( mRenderingPreview )
+  {
+    mRenderingPreview = false;
+    startRenderJob( mRenderSize, mRenderWidthScale );
+  }
+
+  QGraphicsRectItem::update();
+}
+
 void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget )
 {
   Q_UNUSED( pWidget );
@@ -271,12 +481,12 @@ void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* i
     //QgsComposerMap::cache() and QgsComposerMap::update() need to be called by
     //client functions
 
-    QgsRectangle requestRectangle;
-    requestedExtent( requestRectangle );
-    double horizontalVScaleFactor = horizontalViewScaleFactor();
-    if ( horizontalVScaleFactor < 0 )
+    //the image may still be the one of a previous extent or a lower resolution while
+    //the new one is rendered in background, it is drawn where its extent is
+    QgsRectangle requestRectangle = mCacheExtent;
+    if ( requestRectangle.isEmpty() )
     {
-      horizontalVScaleFactor = mLastValidViewScaleFactor;
+      requestedExtent( requestRectangle );
     }
 
     double imagePixelWidth = mExtent.width() / requestRectangle.width() * mCacheImage.width() ; //how many pixels of the image are for the map extent?
@@ -291,17 +501,20 @@ void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* i
     double xTopLeftShift = ( rotationPoint.x() - mExtent.xMinimum() ) * mapUnitsToMM();
     double yTopLeftShift = ( mExtent.yMaximum() - rotationPoint.y() ) * mapUnitsToMM();
 
-    painter->save();
+    if ( !mCacheImage.isNull() ) //null until the first rendering finished
+    {
+      painter->save();
 
-    painter->translate( mXOffset, mYOffset );
-    painter->translate( xTopLeftShift, yTopLeftShift );
-    painter->rotate( mRotation );
-    painter->translate( xShiftMM, -yShiftMM );
-    painter->scale( scale, scale );
-    painter->drawImage( 0, 0, mCacheImage );
+      painter->translate( mXOffset, mYOffset );
+      painter->translate( xTopLeftShift, yTopLeftShift );
+      painter->rotate( mRotation );
+      painter->translate( xShiftMM, -yShiftMM );
+      painter->scale( scale, scale );
+      painter->drawImage( 0, 0, mCacheImage );
 
-    //restore rotation
-    painter->restore();
+      //restore rotation
+      painter->restore();
+    }
 
     //draw canvas items
     drawCanvasItems( painter, itemStyle );
@@ -20,10 +20,14 @@
 //#include "ui_qgscomposermapbase.h"
 #include "qgscomposeritem.h"
 #include "qgsrectangle.h"
+#include <QCache>
 #include <QGraphicsRectItem>
+#include <QHash>
+#include <QImage>
 
 class QgsComposition;
 class QgsMapRenderer;
+class QgsMapRendererJob;
 class QgsMapToPixel;
 class QDomNode;
 class QDomDocument;
@@ -92,7 +96,10 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /** \brief Reimplementation of QCanvasItem::paint - draw on canvas */
     void paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget );
 
-    /** \brief Create cache image */
+    /** \brief Create cache image. If all layers can be rendered in background, the image
+        is rendered in a background thread, first at a lower resolution for larger images.
+        The previous image is shown until the new one is ready. Maps with the same extent,
+        size and layers share the rendering. */
     void cache( void );
 
     /** \brief Get identification number*/
@@ -277,6 +284,10 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /**Call updateCachedImage if item is in render mode*/
     void renderModeUpdateCachedImage();
 
+  private slots:
+    /**Takes the image of the background rendering that finished*/
+    void renderJobFinished();
+
   private:
 
     /**Enum for different frame borders*/
@@ -303,6 +314,34 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     // Cache used in composer preview
     QImage mCacheImage;
 
+    /**Requested extent the cache image was rendered for*/
+    QgsRectangle mCacheExtent;
+
+    /**Background rendering of the cache image, shared with other maps rendering the same image*/
+    struct SharedRenderJob
+    {
+      QgsMapRendererJob* job;
+      int users;
+    };
+
+    /**Rendering the cache image is waiting for, 0 if there is none*/
+    QgsMapRendererJob* mRenderJob;
+    /**Key of the image being rendered or of the cache image*/
+    QString mRenderKey;
+    /**True if a lower resolution image is rendered before the full one*/
+    bool mRenderingPreview;
+    /**Request extent, full image size and width scale of the cache image being rendered*/
+    QgsRectangle mRenderExtent;
+    QSize mRenderSize;
+    double mRenderWidthScale;
+
+    /**Background renderings by image key*/
+    static QHash<QString, SharedRenderJob> sRenderJobs;
+    /**Recently rendered cache images by image key, the cost is the number of pixels*/
+    static QCache<QString, QImage> sRenderedImages;
+    /**Incremented when cache images need to be rendered again, part of the image keys*/
+    static int sRenderGeneration;
+
     // Is cache up to date
     bool mCacheUpdated;
 
@@ -332,6 +371,19 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /**Removes layer ids from mLayerSet that are no longer present in the qgis main map*/
     void syncLayerSet();
 
+    /**Layers drawn by the map: the stored layer set or the layers of the main map*/
+    QStringList layersToRender() const;
+    /**Sets up a renderer like the main map renderer to draw the map*/
+    void initRenderer( QgsMapRenderer& renderer, const QgsRectangle& extent, const QSizeF& size, double dpi ) const;
+    /**Identifies the cache image of an extent, image size and the current map settings*/
+    QString renderKey( const QgsRectangle& extent, const QSize& size ) const;
+    /**Shows a rendered image or waits for the rendering of it in background*/
+    void startRenderJob( const QSize& size, double widthScale );
+    /**Stops waiting for the background rendering. It is cancelled if no other map needs it*/
+    void releaseRenderJob();
+    /**Takes the image of the finished background rendering and continues with the full resolution*/
+    void takeRenderedImage();
+
     /**True if coordinate grid has to be displayed*/
     bool mGridEnabled;
     /**Solid or crosses*/
@@ -75,12 +75,12 @@ namespace pal
 
   ////////////
 
-  FeaturePart::FeaturePart( Feature *feat, const GEOSGeometry* geom )
+  FeaturePart::FeaturePart( Feature *feat, const GEOSGeometry* geom, bool ownGeom )
       : f( feat ), nbHoles( 0 ), holes( NULL )
   {
     // we'll remove const, but we won't modify that geometry
     the_geom = const_cast<GEOSGeometry*>( geom );
-    ownsGeom = false; // geometry is owned by Feature class
+    ownsGeom = ownGeom; // geometry is usually owned by Feature class
 
     extractCoords( geom );
 
@@ -1228,7 +1228,7 @@ namespace pal
 
   int FeaturePart::setPosition( double scale, LabelPosition ***lPos,
                                 double bbox_min[2], double bbox_max[2],
-                                PointSet *mapShape, RTree<LabelPosition*, double, 2, double> *candidates
+                                PointSet *mapShape
 #ifdef _EXPORT_MAP_
                                 , std::ofstream &svgmap
 #endif
@@ -1309,10 +1309,6 @@ namespace pal
         rnbp--;
         ( *lPos )[i]->setCost( DBL_MAX ); // infinite cost => do not use
       }
-      else   // this one is OK
-      {
-        ( *lPos )[i]->insertIntoIndex( candidates );
-      }
     }
 
     sort(( void** )( *lPos ), nbp, LabelPosition::costGrow );
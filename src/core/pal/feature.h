@@ -143,8 +143,9 @@ namespace pal
         * \brief create a new generic feature
         *
         * \param feat a pointer for a Feat which contains the spatial entites
+        * \param ownGeom whether the part deletes geom (otherwise it is owned by the feature)
         */
-      FeaturePart( Feature *feat, const GEOSGeometry* geom );
+      FeaturePart( Feature *feat, const GEOSGeometry* geom, bool ownGeom = false );
 
       /**
        * \brief Delete the feature
@@ -234,11 +235,13 @@ namespace pal
        * \param bbox_min min values of the map extent
        * \param bbox_max max values of the map extent
        * \param mapShape generate candidates for this spatial entites
-       * \param candidates index for candidates
        * \param svgmap svg map file
        * \return the number of candidates in *lPos
+       *
+       * Only reads the feature, so that candidates of several features
+       * can be generated at the same time. The caller indexes them.
        */
-      int setPosition( double scale, LabelPosition ***lPos, double bbox_min[2], double bbox_max[2], PointSet *mapShape, RTree<LabelPosition*, double, 2, double>*candidates
+      int setPosition( double scale, LabelPosition ***lPos, double bbox_min[2], double bbox_max[2], PointSet *mapShape
 #ifdef _EXPORT_MAP_
                        , std::ofstream &svgmap
 #endif
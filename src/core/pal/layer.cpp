@@ -226,6 +226,42 @@ namespace pal
 
 
 
+  /*
+   * \brief repair an invalid polygon (e.g. with touching rings after clipping) by a zero buffer
+   * \return the biggest polygon of the repaired geometry (to be deleted by the caller) or NULL
+   */
+  static GEOSGeometry* repairPolygon( const GEOSGeometry* geom )
+  {
+    GEOSGeometry* buffered = GEOSBuffer( geom, 0, 1 );
+    if ( !buffered )
+      return NULL;
+
+    const GEOSGeometry* biggest = NULL;
+    if ( GEOSGeomTypeId( buffered ) == GEOS_POLYGON )
+    {
+      biggest = buffered;
+    }
+    else if ( GEOSGeomTypeId( buffered ) == GEOS_MULTIPOLYGON )
+    {
+      double area, biggestArea = 0;
+      for ( int i = 0; i < GEOSGetNumGeometries( buffered ); i++ )
+      {
+        const GEOSGeometry* part = GEOSGetGeometryN( buffered, i );
+        if ( GEOSArea( part, &area ) == 1 && area > biggestArea )
+        {
+          biggestArea = area;
+          biggest = part;
+        }
+      }
+    }
+
+    GEOSGeometry* repaired = NULL;
+    if ( biggest && GEOSisValid( biggest ) == 1 )
+      repaired = GEOSGeom_clone( biggest );
+    GEOSGeom_destroy( buffered );
+    return repaired;
+  }
+
   bool Layer::registerFeature( const char *geom_id, PalGeometry *userGeom, double label_x, double label_y, const char* labelText,
                                double labelPosX, double labelPosY, bool fixedPos, double angle, bool fixedAngle )
   {
@@ -273,10 +309,18 @@ namespace pal
       const GEOSGeometry* geom = simpleGeometries->pop_front();
 
       // ignore invalid geometries (e.g. polygons with self-intersecting rings)
+      // unless they are polygons that can be repaired
+      GEOSGeometry* repairedGeom = NULL;
       if ( GEOSisValid( geom ) != 1 ) // 0=invalid, 1=valid, 2=exception
       {
-        std::cerr << "ignoring invalid feature " << geom_id << std::endl;
-        continue;
+        if ( GEOSGeomTypeId( geom ) == GEOS_POLYGON )
+          repairedGeom = repairPolygon( geom );
+        if ( !repairedGeom )
+        {
+          std::cerr << "ignoring invalid feature " << geom_id << std::endl;
+          continue;
+        }
+        geom = repairedGeom;
       }
 
       int type = GEOSGeomTypeId( geom );
@@ -287,7 +331,7 @@ namespace pal
         throw InternalException::UnknownGeometry();
       }
 
-      FeaturePart* fpart = new FeaturePart( f, geom );
+      FeaturePart* fpart = new FeaturePart( f, geom, repairedGeom != NULL );
 
       // ignore invalid geometries
       if (( type == GEOS_LINESTRING && fpart->nbPoints < 2 ) ||
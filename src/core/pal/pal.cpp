@@ -34,6 +34,8 @@
 //#define _VERBOSE_
 //#define _EXPORT_MAP_
 #include <QTime>
+#include <QVector>
+#include <QtConcurrentMap>
 
 #define _CRT_SECURE_NO_DEPRECATE
 
@@ -93,6 +95,8 @@ namespace pal
     tenure = 10;
     candListSize = 0.2;
 
+    threadCount = 1;
+
     tabuMinIt = 3;
     tabuMaxIt = 4;
     searchMethod = POPMUSIC_CHAIN;
@@ -196,10 +200,21 @@ namespace pal
   }
 
 
+  /*
+   * Feature part to label and its candidates
+   */
+  typedef struct _featCandidates
+  {
+    FeaturePart *feature;
+    LabelPosition **lPos;
+    int nblp;
+  } FeatCandidates;
+
   typedef struct _featCbackCtx
   {
     Layer *layer;
     double scale;
+    QVector<FeatCandidates> *feats;
     LinkedList<Feats*> *fFeats;
     RTree<PointSet*, double, 2, double> *obstacles;
     RTree<LabelPosition*, double, 2, double> *candidates;
@@ -269,35 +284,109 @@ namespace pal
       }
     }
 
-    // generate candidates for the feature part
-    LabelPosition** lPos = NULL;
-    int nblp = ft_ptr->setPosition( context->scale, &lPos, context->bbox_min, context->bbox_max, ft_ptr, context->candidates
+    // candidates are generated once all the parts of the layer are known
+    FeatCandidates fc;
+    fc.feature = ft_ptr;
+    fc.lPos = NULL;
+    fc.nblp = 0;
+    context->feats->append( fc );
+
+    return true;
+  }
+
+
+
+
+  typedef struct _candidatesJob
+  {
+    FeatCandidates *feats;
+    int nbFeats;
+    // the job handles the parts first, first + step, first + 2 * step...
+    int first;
+    int step;
+    FeatCallBackCtx *context;
+  } CandidatesJob;
+
+  void generateCandidatesJob( CandidatesJob &job )
+  {
+    FeatCallBackCtx *context = job.context;
+
+    for ( int i = job.first; i < job.nbFeats; i += job.step )
+    {
+      FeatCandidates &fc = job.feats[i];
+      fc.nblp = fc.feature->setPosition( context->scale, &fc.lPos, context->bbox_min, context->bbox_max, fc.feature
 #ifdef _EXPORT_MAP_
-                                    , *context->svgmap
+                                         , *context->svgmap
 #endif
-                                  );
+                                       );
+    }
+  }
 
-    if ( nblp > 0 )
+  /*
+   * Generate the candidates of the feature parts collected by extractFeatCallback
+   * with nbThreads threads, then add the parts with candidates to fFeats and
+   * their candidates to the index in the order of the parts. The candidates of a part
+   * do not depend on the other parts, so the result is the same for any number of threads.
+   */
+  void extractCandidates( FeatCallBackCtx *context, int nbThreads )
+  {
+    QVector<FeatCandidates> &feats = *context->feats;
+
+#ifdef _EXPORT_MAP_
+    nbThreads = 1;
+#endif
+    if ( nbThreads > feats.size() )
+      nbThreads = feats.size();
+
+    QVector<CandidatesJob> jobs;
+    for ( int i = 0; i < nbThreads; i++ )
     {
-      // valid features are added to fFeats
-      Feats *ft = new Feats();
-      ft->feature = ft_ptr;
-      ft->shape = NULL;
-      ft->nblp = nblp;
-      ft->lPos = lPos;
-      ft->priority = context->priority;
-      context->fFeats->push_back( ft );
+      CandidatesJob job;
+      job.feats = feats.data();
+      job.nbFeats = feats.size();
+      job.first = i;
+      job.step = nbThreads;
+      job.context = context;
+      jobs.append( job );
     }
-    else
+
+    if ( jobs.size() == 1 )
+    {
+      generateCandidatesJob( jobs[0] );
+    }
+    else if ( jobs.size() > 1 )
     {
-      // Others are deleted
-      delete[] lPos;
+      QFuture<void> future = QtConcurrent::map( jobs, generateCandidatesJob );
+      future.waitForFinished();
     }
 
-    return true;
-  }
+    for ( int i = 0; i < feats.size(); i++ )
+    {
+      FeatCandidates &fc = feats[i];
 
+      if ( fc.nblp > 0 )
+      {
+        for ( int j = 0; j < fc.nblp; j++ )
+          fc.lPos[j]->insertIntoIndex( context->candidates );
+
+        // valid features are added to fFeats
+        Feats *ft = new Feats();
+        ft->feature = fc.feature;
+        ft->shape = NULL;
+        ft->nblp = fc.nblp;
+        ft->lPos = fc.lPos;
+        ft->priority = context->priority;
+        context->fFeats->push_back( ft );
+      }
+      else
+      {
+        // Others are deleted
+        delete[] fc.lPos;
+      }
+    }
 
+    feats.clear();
+  }
 
 
   typedef struct _filterContext
@@ -371,8 +460,10 @@ namespace pal
     prob->pal = this;
 
     LinkedList<Feats*> *fFeats = new LinkedList<Feats*> ( ptrFeatsCompare );
+    QVector<FeatCandidates> feats;
 
     FeatCallBackCtx *context = new FeatCallBackCtx();
+    context->feats = &feats;
     context->fFeats = fFeats;
     context->scale = scale;
     context->obstacles = obstacles;
@@ -433,6 +524,7 @@ namespace pal
 
             context->layer->modMutex->lock();
             context->layer->rtree->Search( amin, amax, extractFeatCallback, ( void* ) context );
+            extractCandidates( context, threadCount );
             context->layer->modMutex->unlock();
 
 #ifdef _EXPORT_MAP_
@@ -935,6 +1027,17 @@ namespace pal
     return searchMethod;
   }
 
+  void Pal::setThreadCount( int count )
+  {
+    if ( count > 0 )
+      threadCount = count;
+  }
+
+  int Pal::getThreadCount()
+  {
+    return threadCount;
+  }
+
   void Pal::setSearch( SearchMethod method )
   {
     switch ( method )
@@ -167,6 +167,8 @@ namespace pal
       int tenure;
       double candListSize;
 
+      int threadCount;
+
       /**
        * \brief Problem factory
        * Extract features to label and generates candidates for them,
@@ -419,6 +421,20 @@ namespace pal
        * @return the search method
        */
       SearchMethod getSearch();
+
+      /**
+       * \brief Set the number of threads generating candidates and
+       * optimizing POPMUSIC sub parts
+       *
+       * The labeling does not depend on the number of threads.
+       * @param count number of threads, 1 to label in the calling thread only
+       */
+      void setThreadCount( int count );
+
+      /**
+       * \brief get the number of labeling threads
+       */
+      int getThreadCount();
   };
 } // end namespace pal
 #endif
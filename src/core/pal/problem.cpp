@@ -58,8 +58,15 @@
 #include "util.h"
 #include "priorityqueue.h"
 
+#include <QVector>
+#include <QtConcurrentMap>
+
 #define UNUSED(x) (void)x;
 
+// sub parts optimized in each round of POPMUSIC, whatever the number of threads,
+// so that the labeling is the same on every machine
+#define POPMUSIC_PARTS_PER_ROUND 8
+
 namespace pal
 {
 
@@ -79,10 +86,8 @@ namespace pal
     bbox[1] = 0;
     bbox[2] = 0;
     bbox[3] = 0;
-    featWrap = NULL;
     candidates = new RTree<LabelPosition*, double, 2, double>();
     candidates_sol = new RTree<LabelPosition*, double, 2, double>();
-    candidates_subsol = NULL;
   }
 
   Problem::~Problem()
@@ -97,8 +102,6 @@ namespace pal
     }
 
 
-    if ( featWrap )
-      delete[] featWrap;
     if ( featStartId )
       delete[] featStartId;
     if ( featNbLp )
@@ -120,11 +123,6 @@ namespace pal
 
     delete candidates;
     delete candidates_sol;
-
-    if ( candidates_subsol )
-    {
-      delete candidates_subsol;
-    }
   }
 
   typedef struct
@@ -425,6 +423,51 @@ namespace pal
     delete list;
   }
 
+  typedef struct _subPartJob
+  {
+    Problem *problem;
+    SubPart *part;
+    int pos; // position of the part in the parts list
+    double delta;
+  } SubPartJob;
+
+  void optimizeSubPartJob( SubPartJob &job )
+  {
+    job.delta = job.problem->optimizeSubPart( job.part );
+  }
+
+  double Problem::optimizeSubPart( SubPart *part )
+  {
+    part->candidates_subsol->RemoveAll();
+
+    for ( int i = 0; i < part->subSize; i++ )
+    {
+      if ( part->sol[i] != -1 )
+      {
+        labelpositions[part->sol[i]]->insertIntoIndex( part->candidates_subsol );
+      }
+    }
+
+    switch ( pal->searchMethod )
+    {
+        //case branch_and_bound :
+        //delta = current->branch_and_bound_search();
+        //   break;
+
+      case POPMUSIC_TABU :
+        return popmusic_tabu( part );
+      case POPMUSIC_TABU_CHAIN :
+        return popmusic_tabu_chain( part );
+      case POPMUSIC_CHAIN :
+        return popmusic_chain( part );
+      default:
+#ifdef _VERBOSE_
+        std::cerr << "Unknown search method..." << std::endl;
+#endif
+        return 0.0;
+    }
+  }
+
 //#define _DEBUG_
   void Problem::popmusic()
   {
@@ -433,17 +476,12 @@ namespace pal
       return;
 
     int i;
+    int j;
     int seed;
     bool *ok = new bool[nbft];
 
     int r = pal->popmusic_r;
 
-    SearchMethod searchMethod = pal->searchMethod;
-
-    candidates_subsol = new RTree<LabelPosition*, double, 2, double>();
-
-    double delta = 0.0;
-
     int it = 0;
 
 #ifdef _VERBOSE_
@@ -457,12 +495,6 @@ namespace pal
 
     int subPartTotalSize = 0;
 
-    labelPositionCost = new double[all_nblp];
-    nbOlap = new int[all_nblp];
-
-    featWrap = new int[nbft];
-    memset( featWrap, -1, sizeof( int ) *nbft );
-
     SubPart ** parts = new SubPart*[nbft];
     int *isIn = new int[nbft];
 
@@ -479,6 +511,30 @@ namespace pal
     sort(( void** ) parts, nbft, borderSizeInc );
     //sort ((void**)parts, nbft, borderSizeDec);
 
+    // working data of the sub parts optimized in the same round
+    int nbParallel = POPMUSIC_PARTS_PER_ROUND;
+#ifdef _EXPORT_MAP_
+    nbParallel = 1;
+#endif
+    if ( nbParallel > nbft )
+      nbParallel = nbft;
+
+    SubPart *workspaces = new SubPart[nbParallel];
+    for ( i = 0; i < nbParallel; i++ )
+    {
+      workspaces[i].featWrap = new int[nbft];
+      memset( workspaces[i].featWrap, -1, sizeof( int ) *nbft );
+      workspaces[i].labelPositionCost = new double[all_nblp];
+      workspaces[i].nbOlap = new int[all_nblp];
+      workspaces[i].candidates_subsol = new RTree<LabelPosition*, double, 2, double>();
+    }
+
+    // features of the sub parts selected for the current round
+    bool *busy = new bool[nbft];
+    memset( busy, 0, sizeof( bool ) *nbft );
+
+    QVector<SubPartJob> jobs;
+
 #ifdef _VERBOSE_
     create_part_time = clock();
     std::cout << "   SubPart (averagesize: " << subPartTotalSize / nbft <<  ") creation: " << ( double )( create_part_time - start_time ) / ( double ) CLOCKS_PER_SEC << std::endl;
@@ -505,98 +561,121 @@ namespace pal
     while ( true )
     {
       it++;
-      /* find the next seed not ok */
-      for ( i = ( seed + 1 ) % nbft; ok[i] && i != seed; i = ( i + 1 ) % nbft )
-        ;
 
-      if ( i == seed && ok[seed] )
+      /* find the next seeds not ok, following the previous one, whose sub parts
+       * have no feature in common: the border of a sub part contains every feature
+       * in conflict with the features it optimizes, so such sub parts cannot
+       * interfere and their improvements simply add up. The number of sub parts
+       * does not depend on the number of threads and the result never depends
+       * on the scheduling */
+      jobs.clear();
+      for ( j = 1; j <= nbft && jobs.size() < nbParallel; j++ )
       {
-        current = NULL; // everything is OK :-)
-        break;
+        i = ( seed + j ) % nbft;
+        if ( ok[i] )
+          continue;
+
+        current = parts[i];
+
+        int k;
+        for ( k = 0; k < current->subSize && !busy[current->sub[k]]; k++ )
+          ;
+        if ( k < current->subSize )
+          continue;
+
+        for ( k = 0; k < current->subSize; k++ )
+          busy[current->sub[k]] = true;
+
+        SubPartJob job;
+        job.problem = this;
+        job.part = current;
+        job.pos = i;
+        job.delta = 0.0;
+        jobs.append( job );
       }
-      else
+
+      if ( jobs.isEmpty() )
       {
-        seed = i;
-        current = parts[seed];
+        current = NULL; // everything is OK :-)
+        break;
       }
 
-      // update sub part solution
-      candidates_subsol->RemoveAll();
+      seed = jobs.last().pos;
 
-      for ( i = 0; i < current->subSize; i++ )
+      // update sub parts solution
+      for ( j = 0; j < jobs.size(); j++ )
       {
-        current->sol[i] = sol->s[current->sub[i]];
-        if ( current->sol[i] != -1 )
+        current = jobs[j].part;
+        current->featWrap = workspaces[j].featWrap;
+        current->labelPositionCost = workspaces[j].labelPositionCost;
+        current->nbOlap = workspaces[j].nbOlap;
+        current->candidates_subsol = workspaces[j].candidates_subsol;
+
+        for ( i = 0; i < current->subSize; i++ )
         {
-          labelpositions[current->sol[i]]->insertIntoIndex( candidates_subsol );
+          current->sol[i] = sol->s[current->sub[i]];
+          busy[current->sub[i]] = false;
         }
       }
 
-
-
-      switch ( searchMethod )
+      if ( jobs.size() == 1 || pal->threadCount < 2 )
       {
-          //case branch_and_bound :
-          //delta = current->branch_and_bound_search();
-          //   break;
-
-        case POPMUSIC_TABU :
-          delta = popmusic_tabu( current );
-          break;
-        case POPMUSIC_TABU_CHAIN :
-          delta = popmusic_tabu_chain( current );
-          break;
-        case POPMUSIC_CHAIN :
-          delta = popmusic_chain( current );
-          break;
-        default:
-#ifdef _VERBOSE_
-          std::cerr << "Unknown search method..." << std::endl;
-#endif
-          return;
+        for ( j = 0; j < jobs.size(); j++ )
+          optimizeSubPartJob( jobs[j] );
+      }
+      else
+      {
+        QFuture<void> future = QtConcurrent::map( jobs, optimizeSubPartJob );
+        future.waitForFinished();
       }
 
-      popit++;
+      popit += jobs.size();
 
-      if ( delta > EPSILON )
+      // merge in the order of selection
+      for ( j = 0; j < jobs.size(); j++ )
       {
-        /* Update solution */
-#ifdef _DEBUG_FULL_
-        std::cout << "Update solution from subpart, current cost:" << std::endl;
-        solution_cost();
-        std::cout << "Delta > EPSILON: update solution" << std::endl;
-        std::cout << "after modif cost:" << std::endl;
-        solution_cost();
-#endif
-        for ( i = 0; i < current->borderSize; i++ )
-        {
-          ok[current->sub[i]] = false;
-        }
+        current = jobs[j].part;
 
-        for ( i = current->borderSize; i < current->subSize; i++ )
+        if ( jobs[j].delta > EPSILON )
         {
-
-          if ( sol->s[current->sub[i]] != -1 )
+          /* Update solution */
+#ifdef _DEBUG_FULL_
+          std::cout << "Update solution from subpart, current cost:" << std::endl;
+          solution_cost();
+          std::cout << "Delta > EPSILON: update solution" << std::endl;
+          std::cout << "after modif cost:" << std::endl;
+          solution_cost();
+#endif
+          for ( i = 0; i < current->borderSize; i++ )
           {
-            labelpositions[sol->s[current->sub[i]]]->removeFromIndex( candidates_sol );
+            ok[current->sub[i]] = false;
           }
 
-          sol->s[current->sub[i]] = current->sol[i];
-
-          if ( current->sol[i] != -1 )
+          for ( i = current->borderSize; i < current->subSize; i++ )
           {
-            labelpositions[current->sol[i]]->insertIntoIndex( candidates_sol );
-          }
 
-          ok[current->sub[i]] = false;
+            if ( sol->s[current->sub[i]] != -1 )
+            {
+              labelpositions[sol->s[current->sub[i]]]->removeFromIndex( candidates_sol );
+            }
+
+            sol->s[current->sub[i]] = current->sol[i];
+
+            if ( current->sol[i] != -1 )
+            {
+              labelpositions[current->sol[i]]->insertIntoIndex( candidates_sol );
+            }
+
+            ok[current->sub[i]] = false;
+          }
         }
-      }
-      else  // not improved
-      {
+        else  // not improved
+        {
 #ifdef _DEBUG_FULL_
-        std::cout << "subpart not improved" << std::endl;
+          std::cout << "subpart not improved" << std::endl;
 #endif
-        ok[seed] = true;
+          ok[jobs[j].pos] = true;
+        }
       }
     }
 
@@ -606,19 +685,26 @@ namespace pal
     std::cout << "   Improved solution: " << ( double )( search_time - start_time ) / ( double ) CLOCKS_PER_SEC << " (solution cost: " << sol->cost << ", nbDisplayed: " << nbActive << " (" << ( double ) nbActive / ( double ) nbft << ")" << std::endl;
 
     std::cerr << "\t" << subPartTotalSize;
-    if ( searchMethod == POPMUSIC_TABU )
+    if ( pal->searchMethod == POPMUSIC_TABU )
       std::cerr << "\tpop_tabu\t";
-    else if ( searchMethod == POPMUSIC_TABU_CHAIN )
+    else if ( pal->searchMethod == POPMUSIC_TABU_CHAIN )
       std::cerr << "\tpop_tabu_chain\t";
-    else if ( searchMethod == POPMUSIC_CHAIN )
+    else if ( pal->searchMethod == POPMUSIC_CHAIN )
       std::cerr << "\tpop_chain\t";
 
     std::cerr << r << "\t" << popit << "\t" << ( create_part_time - start_time ) / ( double ) CLOCKS_PER_SEC <<   "\t" << ( init_sol_time - create_part_time ) / ( double ) CLOCKS_PER_SEC << "\t" << ( search_time - init_sol_time ) / ( double ) CLOCKS_PER_SEC << "\t" << ( search_time - start_time ) / ( double ) CLOCKS_PER_SEC <<   "\t" << sol->cost << "\t" << nbActive << "\t" << ( double ) nbActive / ( double ) nbft;
 
 #endif
 
-    delete[] labelPositionCost;
-    delete[] nbOlap;
+    for ( i = 0; i < nbParallel; i++ )
+    {
+      delete[] workspaces[i].featWrap;
+      delete[] workspaces[i].labelPositionCost;
+      delete[] workspaces[i].nbOlap;
+      delete workspaces[i].candidates_subsol;
+    }
+    delete[] workspaces;
+    delete[] busy;
 
     for ( i = 0; i < nbft; i++ )
     {
@@ -765,7 +851,7 @@ namespace pal
       lp->getBoundingBox( amin, amax );
 
       context.lp = lp;
-      candidates_subsol->Search( amin, amax, LabelPosition::countFullOverlapCallback, ( void* ) &context );
+      part->candidates_subsol->Search( amin, amax, LabelPosition::countFullOverlapCallback, ( void* ) &context );
 
       cost += lp->getCost();
     }
@@ -978,7 +1064,7 @@ namespace pal
 
     int lp;
     for ( i = 0; i < subSize; i++ )
-      featWrap[sub[i]] = i;
+      part->featWrap[sub[i]] = i;
 
     for ( i = 0; i < subSize; i++ )
     {
@@ -988,8 +1074,8 @@ namespace pal
         it = j + lp;
         //std::cerr << "it = " << j << " + " << lp << std::endl;
         // std::cerr << "it/nblp:" << it << "/" << all_nblp << std::endl;
-        labelPositionCost[it] = compute_feature_cost( part, i, it, & ( nbOlap[it] ) );
-        //std::cerr << "nbOlap[" << it << "] : " << nbOlap[it] << std::endl;
+        part->labelPositionCost[it] = compute_feature_cost( part, i, it, & ( part->nbOlap[it] ) );
+        //std::cerr << "nbOlap[" << it << "] : " << part->nbOlap[it] << std::endl;
       }
     }
 
@@ -1008,8 +1094,8 @@ namespace pal
       if ( sol[i+borderSize] >= 0 )
       {
         j = sol[i+borderSize];
-        candidateList[i]->cost = labelPositionCost[j];
-        candidateList[i]->nbOverlap = nbOlap[j];
+        candidateList[i]->cost = part->labelPositionCost[j];
+        candidateList[i]->nbOverlap = part->nbOlap[j];
       }
       else
       {
@@ -1028,8 +1114,8 @@ namespace pal
       }
       else
       {
-        nbOverlap += nbOlap[sol[i]];
-        cur_cost += labelPositionCost[sol[i]];
+        nbOverlap += part->nbOlap[sol[i]];
+        cur_cost += part->labelPositionCost[sol[i]];
       }
     }
 
@@ -1078,14 +1164,14 @@ namespace pal
             }
             else
             {
-              delta = -labelPositionCost[sol[feat_id]];
-              delta -= nbOlap[sol[feat_id]] * ( inactiveCost[feat_sub_id] + labelpositions[label_id]->getCost() );
+              delta = -part->labelPositionCost[sol[feat_id]];
+              delta -= part->nbOlap[sol[feat_id]] * ( inactiveCost[feat_sub_id] + labelpositions[label_id]->getCost() );
             }
 
             if ( j >= 0 )
             {
-              delta += labelPositionCost[featStartId[feat_sub_id] + j];
-              delta += nbOlap[featStartId[feat_sub_id] + j] * ( inactiveCost[feat_sub_id] + labelpositions[featStartId[feat_sub_id] + j]->getCost() );
+              delta += part->labelPositionCost[featStartId[feat_sub_id] + j];
+              delta += part->nbOlap[featStartId[feat_sub_id] + j] * ( inactiveCost[feat_sub_id] + labelpositions[featStartId[feat_sub_id] + j]->getCost() );
             }
             else
             {
@@ -1094,7 +1180,7 @@ namespace pal
 
 #ifdef _DEBUG_FULL_
             std::cout <<  "      test moving " << oldPos << " to " << featStartId[feat_sub_id] + j << std::endl;
-            std::cout << "       new pos makes " << nbOlap[featStartId[feat_sub_id] + j] << " overlaps" << std::endl;
+            std::cout << "       new pos makes " << part->nbOlap[featStartId[feat_sub_id] + j] << " overlaps" << std::endl;
             std::cout << "       delta is : " << delta << std::endl;
 #endif
             // move is authorized wether the feat isn't taboo or whether the move give a new best solution
@@ -1164,15 +1250,15 @@ namespace pal
         candidateList[candidateId]->label_id = choosed_label;
 
         if ( old_label != -1 )
-          labelpositions[old_label]->removeFromIndex( candidates_subsol );
+          labelpositions[old_label]->removeFromIndex( part->candidates_subsol );
 
         /* re-compute all labelpositioncost that overlap with old an new label */
         double local_inactive = inactiveCost[sub[choosed_feat]];
 
         if ( choosed_label != -1 )
         {
-          candidateList[candidateId]->cost = labelPositionCost[choosed_label];
-          candidateList[candidateId]->nbOverlap = nbOlap[choosed_label];
+          candidateList[candidateId]->cost = part->labelPositionCost[choosed_label];
+          candidateList[candidateId]->nbOverlap = part->nbOlap[choosed_label];
         }
         else
         {
@@ -1189,9 +1275,9 @@ namespace pal
         UpdateContext context;
 
         context.candidates = candidateListUnsorted;
-        context.labelPositionCost = labelPositionCost;
-        context.nbOlap = nbOlap;
-        context.featWrap = featWrap;
+        context.labelPositionCost = part->labelPositionCost;
+        context.nbOlap = part->nbOlap;
+        context.featWrap = part->featWrap;
         context.sol = sol;
         context.borderSize = borderSize;
 
@@ -1219,7 +1305,7 @@ namespace pal
 
           candidates->Search( amin, amax, updateCandidatesCost, &context );
 
-          lp->insertIntoIndex( candidates_subsol );
+          lp->insertIntoIndex( part->candidates_subsol );
         }
 
         sort(( void** ) candidateList, probSize, decreaseCost );
@@ -1251,7 +1337,7 @@ namespace pal
     memcpy( sol, best_sol, sizeof( int ) *( subSize ) );
 
     for ( i = 0; i < subSize; i++ )
-      featWrap[sub[i]] = -1;
+      part->featWrap[sub[i]] = -1;
 
     for ( i = 0; i < probSize; i++ )
       delete candidateList[i];
@@ -1402,7 +1488,7 @@ namespace pal
     double amax[2];
 
     ChainContext context;
-    context.featWrap = featWrap;
+    context.featWrap = part->featWrap;
     context.borderSize = borderSize;
     context.tmpsol = tmpsol;
     context.inactiveCost = inactiveCost;
@@ -1453,7 +1539,7 @@ namespace pal
                 std::cerr << "Conflicts not empty !!" << std::endl;
 
               // search ative conflicts and count them
-              candidates_subsol->Search( amin, amax, chainCallback, ( void* ) &context );
+              part->candidates_subsol->Search( amin, amax, chainCallback, ( void* ) &context );
 
 #ifdef _DEBUG_FULL_
               std::cout << "Conflicts:" <<  conflicts->size() << std::endl;
@@ -1627,12 +1713,12 @@ namespace pal
 
         if ( et->old_label != -1 )
         {
-          labelpositions[et->old_label]->removeFromIndex( candidates_subsol );
+          labelpositions[et->old_label]->removeFromIndex( part->candidates_subsol );
         }
 
         if ( et->new_label != -1 )
         {
-          labelpositions[et->new_label]->insertIntoIndex( candidates_subsol );
+          labelpositions[et->new_label]->insertIntoIndex( part->candidates_subsol );
         }
 
         tmpsol[seed] = retainedLabel;
@@ -1647,12 +1733,12 @@ namespace pal
 
       if ( et->new_label != -1 )
       {
-        labelpositions[et->new_label]->removeFromIndex( candidates_subsol );
+        labelpositions[et->new_label]->removeFromIndex( part->candidates_subsol );
       }
 
       if ( et->old_label != -1 )
       {
-        labelpositions[et->old_label]->insertIntoIndex( candidates_subsol );
+        labelpositions[et->old_label]->insertIntoIndex( part->candidates_subsol );
       }
 
       delete et;
@@ -1975,7 +2061,7 @@ namespace pal
 
     for ( i = 0; i < subSize; i++ )
     {
-      featWrap[sub[i]] = i;
+      part->featWrap[sub[i]] = i;
       best_sol[i] = sol[i];
     }
 
@@ -2049,13 +2135,13 @@ namespace pal
 
             if ( sol[fid] >= 0 )
             {
-              labelpositions[sol[fid]]->removeFromIndex( candidates_subsol );
+              labelpositions[sol[fid]]->removeFromIndex( part->candidates_subsol );
             }
             sol[fid] = lid;
 
             if ( sol[fid] >= 0 )
             {
-              labelpositions[lid]->insertIntoIndex( candidates_subsol );
+              labelpositions[lid]->insertIntoIndex( part->candidates_subsol );
             }
 
             tabu_list[fid] = it + tenure;
@@ -2102,7 +2188,7 @@ namespace pal
     */
 
     for ( i = 0; i < subSize; i++ )
-      featWrap[sub[i]] = -1;
+      part->featWrap[sub[i]] = -1;
 
     delete[] best_sol;
     delete[] tabu_list;
@@ -2133,7 +2219,7 @@ namespace pal
 
     for ( i = 0; i < subSize; i++ )
     {
-      featWrap[sub[i]] = i;
+      part->featWrap[sub[i]] = i;
     }
 
     double initial_cost;
@@ -2299,12 +2385,12 @@ namespace pal
 #endif
 
           if ( sol[fid] >= 0 )
-            labelpositions[sol[fid]]->removeFromIndex( candidates_subsol );
+            labelpositions[sol[fid]]->removeFromIndex( part->candidates_subsol );
 
           sol[fid] = lid;
 
           if ( lid >= 0 )
-            labelpositions[lid]->insertIntoIndex( candidates_subsol );
+            labelpositions[lid]->insertIntoIndex( part->candidates_subsol );
 
           tabu_list[fid] = it + tenure;
 #ifdef _DEBUG_FULL_
@@ -2372,7 +2458,7 @@ namespace pal
     delete[] candidatesUnsorted;
 
     for ( i = 0; i < subSize; i++ )
-      featWrap[sub[i]] = -1;
+      part->featWrap[sub[i]] = -1;
 
     delete[] best_sol;
     delete[] tmpsol;
@@ -2662,8 +2748,6 @@ namespace pal
 
     Chain *retainedChain;
 
-    featWrap = NULL;
-
     for ( i = 0; i < nbft; i++ )
     {
       ok[i] = false;
@@ -2803,7 +2887,7 @@ namespace pal
 
     for ( i = 0; i < subSize; i++ )
     {
-      featWrap[sub[i]] = i;
+      part->featWrap[sub[i]] = i;
       best_sol[i] = sol[i];
     }
 
@@ -2830,7 +2914,7 @@ namespace pal
     NokContext context;
     context.ok = ok;
     context.feat = NULL;
-    context.wrap = featWrap;
+    context.wrap = part->featWrap;
 
     //int itC;
 
@@ -2894,7 +2978,7 @@ namespace pal
           if ( sol[fid] >= 0 )
           {
             LabelPosition *old = labelpositions[sol[fid]];
-            old->removeFromIndex( candidates_subsol );
+            old->removeFromIndex( part->candidates_subsol );
 
             old->getBoundingBox( amin, amax );
 
@@ -2905,7 +2989,7 @@ namespace pal
           sol[fid] = lid;
 
           if ( sol[fid] >= 0 )
-            labelpositions[lid]->insertIntoIndex( candidates_subsol );
+            labelpositions[lid]->insertIntoIndex( part->candidates_subsol );
 
           ok[fid] = false;
         }
@@ -2926,7 +3010,7 @@ namespace pal
     }
 
     for ( i = 0; i < subSize; i++ )
-      featWrap[sub[i]] = -1;
+      part->featWrap[sub[i]] = -1;
 
     delete[] ok;
 
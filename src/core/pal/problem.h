@@ -80,6 +80,15 @@ namespace pal
      * first feat in sub part
      */
     int seed;
+
+    /**
+     * working data of the optimization, never shared with a sub part
+     * optimized at the same time
+     */
+    int *featWrap;                 // [nbft]
+    double *labelPositionCost;     // [all_nblp]
+    int *nbOlap;                   // [all_nblp]
+    RTree<LabelPosition*, double, 2, double> *candidates_subsol; // index sub part's active candidates
   } SubPart;
 
   typedef struct _chain
@@ -140,14 +149,10 @@ namespace pal
        */
       double scale;
 
-      double *labelPositionCost;
-      int *nbOlap;
-
       LabelPosition **labelpositions;
 
       RTree<LabelPosition*, double, 2, double> *candidates;  // index all candidates
       RTree<LabelPosition*, double, 2, double> *candidates_sol; // index active candidates
-      RTree<LabelPosition*, double, 2, double> *candidates_subsol; // idem for subparts
 
       //int *feat;        // [nblp]
       int *featStartId; // [nbft]
@@ -159,8 +164,6 @@ namespace pal
 
       double nbOverlap;
 
-      int *featWrap;
-
       Chain *chain( SubPart *part, int seed );
 
       Chain *chain( int seed );
@@ -195,6 +198,9 @@ namespace pal
 
       /**
        * \brief popmusic framework
+       *
+       * Sub parts which do not share any feature are optimized
+       * concurrently by up to Pal::getThreadCount() threads.
        */
       void popmusic();
 
@@ -222,6 +228,14 @@ namespace pal
       double popmusic_tabu( SubPart *part );
       double popmusic_tabu_chain( SubPart *part );
 
+      /**
+       * \brief optimize a sub part with the search method of pal
+       * Only uses the sub part's working data, so that sub parts without
+       * common features can be optimized at the same time.
+       * @return the improvement of the sub solution's cost
+       */
+      double optimizeSubPart( SubPart *part );
+
       void init_sol_empty();
       void init_sol_falp();
 
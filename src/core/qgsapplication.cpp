@@ -15,6 +15,7 @@
 
 #include "qgsapplication.h"
 #include "qgslogger.h"
+#include "qgsmaplayer.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsproviderregistry.h"
 #include "qgsexception.h"
@@ -78,6 +79,7 @@ void QgsApplication::init( QString customConfigPath )
     customConfigPath = QDir::homePath() + QString( "/.qgis/" );
   }
   qRegisterMetaType<QgsGeometry::Error>( "QgsGeometry::Error" );
+  qRegisterMetaType<QgsMapLayer*>( "QgsMapLayer*" ); // QgsMapRenderer::drawError() of background jobs
 
   // check if QGIS is run from build directory (not the install directory)
   QDir appDir( applicationDirPath() );
@@ -35,12 +35,12 @@ const double QgsClipper::MIN_Y = -16000;
 
 const double QgsClipper::SMALL_NUM = 1e-12;
 
-unsigned char* QgsClipper::clippedLineWKB( unsigned char* wkb, const QgsRectangle& clipExtent, QPolygonF& line )
+const unsigned char* QgsClipper::clippedLineWKB( const unsigned char* wkb, const QgsRectangle& clipExtent, QPolygonF& line )
 {
   wkb++; // jump over endian info
-  unsigned int wkbType = *(( int* ) wkb );
+  unsigned int wkbType = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
-  unsigned int nPoints = *(( int* ) wkb );
+  unsigned int nPoints = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
 
   bool hasZValue = ( wkbType == QGis::WKBLineString25D );
@@ -105,6 +105,72 @@ unsigned char* QgsClipper::clippedLineWKB( unsigned char* wkb, const QgsRectangl
   return wkb;
 }
 
+void QgsClipper::clippedLineParts( const QPolygonF& line, const QgsRectangle& clipExtent, QList<QPolygonF>& parts )
+{
+  QPolygonF part;
+  double p0x, p0y, p1x, p1y; //clipped segment coordinates
+
+  for ( int i = 1; i < line.size(); ++i )
+  {
+    p0x = line[i - 1].x(); p0y = line[i - 1].y();
+    p1x = line[i].x(); p1y = line[i].y();
+
+    if ( !clipLineSegment( clipExtent.xMinimum(), clipExtent.xMaximum(), clipExtent.yMinimum(), clipExtent.yMaximum(),
+                           p0x, p0y, p1x, p1y ) )
+    {
+      continue;
+    }
+
+    //start a new part if the segment does not continue the last one
+    if ( part.size() > 0 && ( p0x != part.last().x() || p0y != part.last().y() ) )
+    {
+      parts << part;
+      part.clear();
+    }
+    if ( part.size() < 1 )
+    {
+      part << QPointF( p0x, p0y );
+    }
+    part << QPointF( p1x, p1y );
+  }
+
+  if ( part.size() > 0 )
+  {
+    parts << part;
+  }
+}
+
+void QgsClipper::simplifyPolyline( QPolygonF& pts, double tolerance, bool ring )
+{
+  int n = pts.size();
+  if ( tolerance <= 0 || n < ( ring ? 5 : 3 ) )
+    return;
+
+  double tolerance2 = tolerance * tolerance;
+  QPointF* data = pts.data();
+  // only the first vertices are overwritten if a ring collapses
+  QPointF second = data[1];
+  QPointF third = data[2];
+
+  int kept = 1;
+  for ( int i = 1; i < n - 1; ++i )
+  {
+    double dx = data[i].x() - data[kept - 1].x();
+    double dy = data[i].y() - data[kept - 1].y();
+    if ( dx * dx + dy * dy >= tolerance2 )
+      data[kept++] = data[i];
+  }
+  data[kept++] = data[n - 1];
+
+  if ( ring && kept < 4 )
+  {
+    data[1] = second;
+    data[2] = third;
+    return;
+  }
+  pts.resize( kept );
+}
+
 void QgsClipper::connectSeparatedLines( double x0, double y0, double x1, double y1,
                                         const QgsRectangle& clipRect, QPolygonF& pts )
 {
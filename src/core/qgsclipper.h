@@ -26,6 +26,7 @@
 #include <vector>
 #include <utility>
 
+#include <QList>
 #include <QPolygonF>
 
 /** \ingroup core
@@ -84,7 +85,21 @@ class CORE_EXPORT QgsClipper
       @param wkb pointer to the start of the line wkb
       @param clipExtent clipping bounds
       @param line out: clipped line coordinates*/
-    static unsigned char* clippedLineWKB( unsigned char* wkb, const QgsRectangle& clipExtent, QPolygonF& line );
+    static const unsigned char* clippedLineWKB( const unsigned char* wkb, const QgsRectangle& clipExtent, QPolygonF& line );
+
+    /**Clips a polyline to clipExtent. Unlike clippedLineWKB() the line is split where it leaves
+      the extent instead of being connected along the extent border
+      @param line line to clip
+      @param clipExtent clipping bounds
+      @param parts out: the parts of the line inside clipExtent
+      @note added in 1.9*/
+    static void clippedLineParts( const QPolygonF& line, const QgsRectangle& clipExtent, QList<QPolygonF>& parts );
+
+    /**Removes the vertices of a polyline or ring that are closer than tolerance to the previous
+      vertex kept. The first and the last vertex are always kept. Rings that would collapse to
+      less than four vertices are left unchanged
+      @note added in 1.9*/
+    static void simplifyPolyline( QPolygonF& pts, double tolerance, bool ring );
 
   private:
 
@@ -23,6 +23,8 @@
 #include <QDomElement>
 #include <QApplication>
 
+#include <cmath>
+
 extern "C"
 {
 #include <proj_api.h>
@@ -505,6 +507,60 @@ QgsRectangle QgsCoordinateTransform::transformBoundingBox( const QgsRectangle re
 }
 
 void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, double *y, double *z, TransformDirection direction ) const
+{
+  transformCoords( numPoints, 1, x, y, z, direction );
+}
+
+void QgsCoordinateTransform::transformPolygon( QPolygonF& poly, TransformDirection direction ) const
+{
+  if ( mShortCircuit || !mInitialisedFlag || poly.isEmpty() )
+    return;
+
+  int nPoints = poly.size();
+  if ( sizeof( qreal ) == sizeof( double ) )
+  {
+    // QPointF holds its x and y as two adjacent doubles: let proj work directly on the point array
+    double *data = reinterpret_cast<double *>( poly.data() );
+    transformCoords( nPoints, 2, data, data + 1, 0, direction );
+  }
+  else
+  {
+    std::vector<double> x( nPoints ), y( nPoints );
+    for ( int i = 0; i < nPoints; ++i )
+    {
+      x[i] = poly[i].x();
+      y[i] = poly[i].y();
+    }
+    transformCoords( nPoints, 1, &x[0], &y[0], 0, direction );
+    for ( int i = 0; i < nPoints; ++i )
+    {
+      poly[i] = QPointF( x[i], y[i] );
+    }
+  }
+
+  // proj reports failures of single points of a multi point call only by setting them to HUGE_VAL
+  for ( int i = 0; i < nPoints; ++i )
+  {
+    if ( poly[i].x() == HUGE_VAL || poly[i].y() == HUGE_VAL )
+    {
+      QString msg = tr( "%1 of %2 points\n"
+                        "PROJ.4: %3 +to %4\n"
+                        "Error: point %5 could not be transformed" )
+                    .arg( direction == ForwardTransform ? tr( "forward transform" ) : tr( "inverse transform" ) )
+                    .arg( nPoints )
+                    .arg( mSourceCRS.toProj4() ).arg( mDestCRS.toProj4() )
+                    .arg( i );
+
+      QgsDebugMsg( "Projection failed emitting invalid transform signal: " + msg );
+
+      emit invalidTransformInput();
+
+      throw QgsCsException( msg );
+    }
+  }
+}
+
+void QgsCoordinateTransform::transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const
 {
   // Refuse to transform the points if the srs's are invalid
   if ( !mSourceCRS.isValid() )
@@ -534,25 +590,26 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
   if (( pj_is_latlong( mDestinationProjection ) && ( direction == ReverseTransform ) )
       || ( pj_is_latlong( mSourceProjection ) && ( direction == ForwardTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= DEG_TO_RAD;
       y[i] *= DEG_TO_RAD;
-      z[i] *= DEG_TO_RAD;
+      if ( z )
+        z[i] *= DEG_TO_RAD;
     }
 
   }
   int projResult;
   if ( direction == ReverseTransform )
   {
-    projResult = pj_transform( mDestinationProjection, mSourceProjection, numPoints, 0, x, y, z );
+    projResult = pj_transform( mDestinationProjection, mSourceProjection, numPoints, pointOffset, x, y, z );
     dir = tr( "inverse transform" );
   }
   else
   {
     Q_ASSERT( mSourceProjection != 0 );
     Q_ASSERT( mDestinationProjection != 0 );
-    projResult = pj_transform( mSourceProjection, mDestinationProjection, numPoints, 0, x, y, z );
+    projResult = pj_transform( mSourceProjection, mDestinationProjection, numPoints, pointOffset, x, y, z );
     dir = tr( "forward transform" );
   }
 
@@ -561,7 +618,7 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
     //something bad happened....
     QString points;
 
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       if ( direction == ForwardTransform )
       {
@@ -596,11 +653,12 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
   if (( pj_is_latlong( mDestinationProjection ) && ( direction == ForwardTransform ) )
       || ( pj_is_latlong( mSourceProjection ) && ( direction == ReverseTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= RAD_TO_DEG;
       y[i] *= RAD_TO_DEG;
-      z[i] *= RAD_TO_DEG;
+      if ( z )
+        z[i] *= RAD_TO_DEG;
     }
   }
 #ifdef COORDINATE_TRANSFORM_VERBOSE
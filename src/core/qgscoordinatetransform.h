@@ -19,6 +19,7 @@
 
 //qt includes
 #include <QObject>
+#include <QPolygonF>
 
 //qgis includes
 #include "qgspoint.h"
@@ -185,6 +186,16 @@ class CORE_EXPORT QgsCoordinateTransform: public QObject
      */
     void transformCoords( const int &numPoint, double *x, double *y, double *z, TransformDirection direction = ForwardTransform ) const;
 
+    /*! Transform all points of a polygon or polyline in place with a single call to proj.
+    * The coordinates are transformed directly in the point array of the polygon, so no
+    * temporary coordinate arrays are needed. Throws QgsCsException if any point cannot
+    * be transformed.
+    * @param poly points to transform
+    * @param direction TransformDirection (defaults to ForwardTransform)
+    * @note added in 1.9
+     */
+    void transformPolygon( QPolygonF& poly, TransformDirection direction = ForwardTransform ) const;
+
     /*!
      * Flag to indicate whether the coordinate systems have been initialised
      * @return true if initialised, otherwise false
@@ -265,6 +276,12 @@ class CORE_EXPORT QgsCoordinateTransform: public QObject
      * Finder for PROJ grid files.
      */
     void setFinder();
+
+    /*!
+     * Transforms numPoints points whose coordinates are pointOffset doubles apart.
+     * z may be 0 if the points have no z coordinate.
+     */
+    void transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const;
 };
 
 //! Output stream operator
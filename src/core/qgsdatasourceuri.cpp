@@ -27,6 +27,7 @@ QgsDataSourceURI::QgsDataSourceURI()
     , mKeyColumn( "" )
     , mUseEstimatedMetadata( false )
     , mSelectAtIdDisabled( false )
+    , mUseBinaryFetch( false )
     , mGeometryType( QGis::UnknownGeometry )
 {
   // do nothing
@@ -37,6 +38,7 @@ QgsDataSourceURI::QgsDataSourceURI( QString uri )
     , mKeyColumn( "" )
     , mUseEstimatedMetadata( false )
     , mSelectAtIdDisabled( false )
+    , mUseBinaryFetch( false )
     , mGeometryType( QGis::UnknownGeometry )
 {
   int i = 0;
@@ -153,6 +155,10 @@ QgsDataSourceURI::QgsDataSourceURI( QString uri )
       {
         mSelectAtIdDisabled = pval == "false";
       }
+      else if ( pname == "binaryfetch" )
+      {
+        mUseBinaryFetch = pval == "true";
+      }
       else if ( pname == "service" )
       {
         mService = pval;
@@ -357,6 +363,16 @@ bool QgsDataSourceURI::selectAtIdDisabled() const
   return mSelectAtIdDisabled;
 }
 
+void QgsDataSourceURI::setUseBinaryFetch( bool theFlag )
+{
+  mUseBinaryFetch = theFlag;
+}
+
+bool QgsDataSourceURI::useBinaryFetch() const
+{
+  return mUseBinaryFetch;
+}
+
 void QgsDataSourceURI::setSql( QString sql )
 {
   mSql = sql;
@@ -524,6 +540,11 @@ QString QgsDataSourceURI::uri() const
     theUri += QString( " selectatid=false" );
   }
 
+  if ( mUseBinaryFetch )
+  {
+    theUri += QString( " binaryfetch=true" );
+  }
+
   theUri += QString( " table=%1%2 sql=%3" )
             .arg( quotedTablename() )
             .arg( mGeometryColumn.isNull() ? QString() : QString( " (%1)" ).arg( mGeometryColumn ) )
@@ -100,6 +100,11 @@ class CORE_EXPORT QgsDataSourceURI
     void disableSelectAtId( bool theFlag );
     bool selectAtIdDisabled() const;
 
+    //! set fetching of numeric attributes in binary form
+    // added in 1.9
+    void setUseBinaryFetch( bool theFlag );
+    bool useBinaryFetch() const;
+
     void clearSchema();
     void setSql( QString sql );
 
@@ -159,6 +164,8 @@ class CORE_EXPORT QgsDataSourceURI
     bool mUseEstimatedMetadata;
     //! Disable SelectAtId capability (eg. to trigger the attribute table memory model for expensive views)
     bool mSelectAtIdDisabled;
+    //! Fetch numeric attributes in binary form instead of parsing their text representation
+    bool mUseBinaryFetch;
     //! geometry type (or QGis::WKBUnknown if not specified)
     QGis::GeometryType mGeometryType;
     //! SRID or a null string if not specified
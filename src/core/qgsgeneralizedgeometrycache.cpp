@@ -0,0 +1,209 @@
+/***************************************************************************
+  qgsgeneralizedgeometrycache.cpp - generalized geometries of a vector layer
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgeneralizedgeometrycache.h"
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+#include "qgsrectangle.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QtAlgorithms>
+
+// "QGGC"
+static const quint32 CacheFileMagic = 0x51474743;
+static const quint32 CacheFileVersion = 2;
+
+// size and modification time of file data sources, -1 and 0 for other ones.
+// OGR data sources may be followed by the layer, e.g. "file.gml|layerid=1"
+static void sourceFileInfo( const QString &source, qint64 &size, quint32 &modified )
+{
+  QFileInfo info( source.section( '|', 0, 0 ) );
+  size = info.isFile() ? info.size() : -1;
+  modified = info.isFile() ? info.lastModified().toTime_t() : 0;
+}
+
+QgsGeneralizedGeometryCache::QgsGeneralizedGeometryCache( QList<double> tolerances )
+{
+  qSort( tolerances );
+  foreach( double tolerance, tolerances )
+  {
+    Level level;
+    level.tolerance = tolerance;
+    mLevels.append( level );
+  }
+}
+
+void QgsGeneralizedGeometryCache::addGeometry( QgsFeatureId fid, QgsGeometry *geometry )
+{
+  if ( !geometry )
+    return;
+
+  for ( int i = 0; i < mLevels.size(); ++i )
+  {
+    Level &level = mLevels[i];
+
+    // simplification may collapse small polygons, keep the original geometry then
+    QgsGeometry *simplified = geometry->simplify( level.tolerance );
+    QgsGeometry *source = ( simplified && !simplified->isGeosEmpty() ) ? simplified : geometry;
+
+    int length = source->wkbSize();
+    level.index.insert( fid, qMakePair( level.wkb.size(), length ) );
+    level.wkb.append( reinterpret_cast<const char *>( source->asWkb() ), length );
+
+    delete simplified;
+  }
+}
+
+int QgsGeneralizedGeometryCache::featureCount() const
+{
+  return mLevels.isEmpty() ? 0 : mLevels[0].index.size();
+}
+
+int QgsGeneralizedGeometryCache::levelForTolerance( double maxTolerance ) const
+{
+  int result = -1;
+  for ( int i = 0; i < mLevels.size() && mLevels[i].tolerance <= maxTolerance; ++i )
+  {
+    result = i;
+  }
+  return result;
+}
+
+bool QgsGeneralizedGeometryCache::setGeometry( int level, QgsFeature &feature ) const
+{
+  const Level &l = mLevels[level];
+  QHash<QgsFeatureId, QPair<int, int> >::const_iterator it = l.index.constFind( feature.id() );
+  if ( it == l.index.constEnd() )
+    return false;
+
+  QgsGeometry *geometry = new QgsGeometry();
+  geometry->fromWkb( l.wkb, it->first, it->second );
+  feature.setGeometry( geometry );
+  return true;
+}
+
+bool QgsGeneralizedGeometryCache::writeFile( const QString &fileName, const QString &source, long featureCount, const QgsRectangle &extent ) const
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    QgsDebugMsg( "cannot open " + fileName );
+    return false;
+  }
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_5 );
+
+  qint64 size;
+  quint32 modified;
+  sourceFileInfo( source, size, modified );
+
+  out << CacheFileMagic << CacheFileVersion << source << ( qint64 ) featureCount
+  << extent.xMinimum() << extent.yMinimum() << extent.xMaximum() << extent.yMaximum()
+  << size << modified << ( qint32 ) mLevels.size();
+
+  foreach( const Level &level, mLevels )
+  {
+    out << level.tolerance << level.wkb << ( qint32 ) level.index.size();
+    QHash<QgsFeatureId, QPair<int, int> >::const_iterator it = level.index.constBegin();
+    for ( ; it != level.index.constEnd(); ++it )
+    {
+      out << ( qint64 ) it.key() << ( qint32 ) it->first << ( qint32 ) it->second;
+    }
+  }
+
+  return out.status() == QDataStream::Ok;
+}
+
+bool QgsGeneralizedGeometryCache::readFile( const QString &fileName, const QString &source, long featureCount, const QgsRectangle &extent )
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    QgsDebugMsg( "cannot open " + fileName );
+    return false;
+  }
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_5 );
+
+  quint32 magic, version;
+  QString fileSource;
+  qint64 fileFeatureCount, fileSize;
+  double xmin, ymin, xmax, ymax;
+  quint32 fileModified;
+  qint32 levelCount;
+  in >> magic >> version;
+  if ( in.status() != QDataStream::Ok || magic != CacheFileMagic || version != CacheFileVersion )
+  {
+    QgsDebugMsg( fileName + " is not a generalized geometry cache" );
+    return false;
+  }
+  in >> fileSource >> fileFeatureCount >> xmin >> ymin >> xmax >> ymax >> fileSize >> fileModified >> levelCount;
+  if ( in.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( fileName + " is truncated" );
+    return false;
+  }
+  if ( fileSource != source )
+  {
+    QgsDebugMsg( fileName + " was written for " + fileSource );
+    return false;
+  }
+
+  // the cache of a changed data source would draw the old geometries
+  qint64 size;
+  quint32 modified;
+  sourceFileInfo( source, size, modified );
+  if ( fileFeatureCount != featureCount || fileSize != size || fileModified != modified ||
+       xmin != extent.xMinimum() || ymin != extent.yMinimum() || xmax != extent.xMaximum() || ymax != extent.yMaximum() )
+  {
+    QgsDebugMsg( fileName + " was written before the data source changed" );
+    return false;
+  }
+
+  QList<Level> levels;
+  for ( int i = 0; i < levelCount && in.status() == QDataStream::Ok; ++i )
+  {
+    Level level;
+    qint32 count;
+    in >> level.tolerance >> level.wkb >> count;
+    for ( int j = 0; j < count && in.status() == QDataStream::Ok; ++j )
+    {
+      qint64 fid;
+      qint32 offset, length;
+      in >> fid >> offset >> length;
+      if ( offset < 0 || length < 0 || offset + length > level.wkb.size() )
+      {
+        QgsDebugMsg( fileName + " is corrupt" );
+        return false;
+      }
+      level.index.insert( fid, qMakePair( offset, length ) );
+    }
+    levels.append( level );
+  }
+
+  if ( in.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( fileName + " is truncated" );
+    return false;
+  }
+
+  mLevels = levels;
+  return true;
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+  qgsgeneralizedgeometrycache.h - generalized geometries of a vector layer
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGENERALIZEDGEOMETRYCACHE_H
+#define QGSGENERALIZEDGEOMETRYCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include "qgsfeature.h"
+
+class QgsGeometry;
+class QgsRectangle;
+
+/** \ingroup core
+ * Generalized copies of the geometries of a vector layer for drawing at small scales.
+ * Each level holds the geometries simplified with one tolerance in layer units.
+ * All WKB of a level is kept in a single buffer which the geometries handed
+ * out by setGeometry() reference without copying it.
+ * @note added in 1.9
+ */
+class CORE_EXPORT QgsGeneralizedGeometryCache
+{
+  public:
+    //! Creates an empty cache with one level per tolerance (in layer units)
+    QgsGeneralizedGeometryCache( QList<double> tolerances = QList<double>() );
+
+    //! Adds the geometry of a feature to all levels
+    void addGeometry( QgsFeatureId fid, QgsGeometry *geometry );
+
+    //! Number of levels, ordered from the finest to the coarsest
+    int levelCount() const { return mLevels.size(); }
+
+    //! Simplification tolerance of a level in layer units
+    double tolerance( int level ) const { return mLevels[level].tolerance; }
+
+    //! Number of features in the cache
+    int featureCount() const;
+
+    //! Returns the coarsest level with a tolerance not above maxTolerance or -1 if there is none
+    int levelForTolerance( double maxTolerance ) const;
+
+    /** Replaces the geometry of the feature with its generalized geometry of a level
+     * @return false if the feature is not in the cache
+     */
+    bool setGeometry( int level, QgsFeature &feature ) const;
+
+    /** Writes the cache to a file
+     * @param fileName file to write
+     * @param source data source of the layer, checked when reading the file
+     * @param featureCount number of features of the data source, checked when reading the file
+     * @param extent extent of the data source, checked when reading the file
+     * The size and modification time of file data sources are checked as well.
+     */
+    bool writeFile( const QString &fileName, const QString &source, long featureCount, const QgsRectangle &extent ) const;
+
+    /** Reads a cache written with writeFile()
+     * @return false if the file can't be read or was written for another source
+     * or for the source before it changed
+     */
+    bool readFile( const QString &fileName, const QString &source, long featureCount, const QgsRectangle &extent );
+
+  private:
+    struct Level
+    {
+      double tolerance;
+      QByteArray wkb;
+      //! offset and length in wkb of each feature geometry
+      QHash<QgsFeatureId, QPair<int, int> > index;
+    };
+
+    QList<Level> mLevels;
+};
+
+#endif // QGSGENERALIZEDGEOMETRYCACHE_H
@@ -217,10 +217,7 @@ QgsGeometry::QgsGeometry( QgsGeometry const & rhs )
 //! Destructor
 QgsGeometry::~QgsGeometry()
 {
-  if ( mGeometry )
-  {
-    delete [] mGeometry;
-  }
+  releaseWkb();
 
   if ( mGeos )
   {
@@ -532,11 +529,7 @@ QgsGeometry & QgsGeometry::operator=( QgsGeometry const & rhs )
   }
 
   // remove old geometry if it exists
-  if ( mGeometry )
-  {
-    delete [] mGeometry;
-    mGeometry = 0;
-  }
+  releaseWkb();
 
   mGeometrySize    = rhs.mGeometrySize;
 
@@ -560,24 +553,63 @@ QgsGeometry & QgsGeometry::operator=( QgsGeometry const & rhs )
 void QgsGeometry::fromWkb( unsigned char * wkb, size_t length )
 {
   // delete any existing WKB geometry before assigning new one
-  if ( mGeometry )
+  releaseWkb();
+  if ( mGeos )
   {
-    delete [] mGeometry;
-    mGeometry = 0;
+    GEOSGeom_destroy( mGeos );
+    mGeos = 0;
   }
+
+  mGeometry = wkb;
+  mGeometrySize = length;
+
+  mDirtyWkb   = false;
+  mDirtyGeos  = true;
+}
+
+void QgsGeometry::fromWkb( const QByteArray &buffer, int offset, size_t length )
+{
+  releaseWkb();
   if ( mGeos )
   {
     GEOSGeom_destroy( mGeos );
     mGeos = 0;
   }
 
-  mGeometry = wkb;
+  // constData() doesn't detach the buffer from the other geometries sharing it
+  mWkbBuffer = buffer;
+  mGeometry = ( unsigned char * ) mWkbBuffer.constData() + offset;
   mGeometrySize = length;
 
   mDirtyWkb   = false;
   mDirtyGeos  = true;
 }
 
+void QgsGeometry::releaseWkb()
+{
+  if ( mWkbBuffer.isNull() )
+  {
+    delete [] mGeometry;
+  }
+  else
+  {
+    mWkbBuffer = QByteArray();
+  }
+
+  mGeometry = 0;
+}
+
+void QgsGeometry::detachWkb()
+{
+  if ( mWkbBuffer.isNull() || !mGeometry )
+    return;
+
+  unsigned char *wkb = new unsigned char[mGeometrySize];
+  memcpy( wkb, mGeometry, mGeometrySize );
+  mWkbBuffer = QByteArray();
+  mGeometry = wkb;
+}
+
 unsigned char * QgsGeometry::asWkb()
 {
   if ( mDirtyWkb )
@@ -586,6 +618,19 @@ unsigned char * QgsGeometry::asWkb()
     exportGeosToWkb();
   }
 
+  // the caller may write through the pointer
+  detachWkb();
+  return mGeometry;
+}
+
+const unsigned char * QgsGeometry::constWkb()
+{
+  if ( mDirtyWkb )
+  {
+    // convert from GEOS
+    exportGeosToWkb();
+  }
+
   return mGeometry;
 }
 
@@ -680,11 +725,7 @@ void QgsGeometry::fromGeos( GEOSGeometry* geos )
     GEOSGeom_destroy( mGeos );
     mGeos = 0;
   }
-  if ( mGeometry )
-  {
-    delete [] mGeometry;
-    mGeometry = 0;
-  }
+  releaseWkb();
 
   mGeos = geos;
 
@@ -1261,6 +1302,8 @@ bool QgsGeometry::moveVertex( double x, double y, int atVertex )
     exportGeosToWkb();
   }
 
+  detachWkb();
+
   if ( !mGeometry )
   {
     QgsDebugMsg( "WKB geometry not available!" );
@@ -1812,7 +1855,7 @@ bool QgsGeometry::deleteVertex( int atVertex )
   }
   if ( success )
   {
-    delete [] mGeometry;
+    releaseWkb();
     mGeometry = newbuffer;
     mGeometrySize -= ( 2 * sizeof( double ) );
     if ( hasZValue )
@@ -2117,7 +2160,7 @@ bool QgsGeometry::insertVertex( double x, double y, int beforeVertex )
 
   if ( success )
   {
-    delete [] mGeometry;
+    releaseWkb();
     mGeometry = newbuffer;
     mGeometrySize += 2 * sizeof( double );
     if ( hasZValue )
@@ -3001,6 +3044,8 @@ int QgsGeometry::translate( double dx, double dy )
     exportGeosToWkb();
   }
 
+  detachWkb();
+
   if ( !mGeometry )
   {
     QgsDebugMsg( "WKB geometry not available!" );
@@ -3127,6 +3172,8 @@ int QgsGeometry::transform( const QgsCoordinateTransform& ct )
     exportGeosToWkb();
   }
 
+  detachWkb();
+
   if ( !mGeometry )
   {
     QgsDebugMsg( "WKB geometry not available!" );
@@ -4445,11 +4492,7 @@ bool QgsGeometry::exportGeosToWkb()
   }
 
   // clear the WKB, ready to replace with the new one
-  if ( mGeometry )
-  {
-    delete [] mGeometry;
-    mGeometry = 0;
-  }
+  releaseWkb();
 
   if ( !mGeos )
   {
@@ -4893,7 +4936,7 @@ bool QgsGeometry::convertToMultiType()
   //copy the existing single geometry
   memcpy( &newGeometry[currentWkbPosition], mGeometry, mGeometrySize );
 
-  delete [] mGeometry;
+  releaseWkb();
   mGeometry = newGeometry;
   mGeometrySize = newGeomSize;
   mDirtyGeos = true;
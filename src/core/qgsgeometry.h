@@ -16,6 +16,7 @@ email                : morb at ozemail dot com dot au
 #ifndef QGSGEOMETRY_H
 #define QGSGEOMETRY_H
 
+#include <QByteArray>
 #include <QString>
 #include <QVector>
 
@@ -106,12 +107,29 @@ class CORE_EXPORT QgsGeometry
      */
     void fromWkb( unsigned char * wkb, size_t length );
 
+    /**
+      Set the geometry from WKB inside a shared buffer without copying it.
+      The geometry keeps a reference to the buffer, so that a provider can
+      back a whole block of features with a single allocation. The WKB is
+      only copied before the geometry is modified.
+      @note added in 1.9
+     */
+    void fromWkb( const QByteArray &buffer, int offset, size_t length );
+
     /**
        Returns the buffer containing this geometry in WKB format.
        You may wish to use in conjunction with wkbSize().
+       WKB referenced in a shared buffer is copied first, as the caller may modify it.
     */
     unsigned char * asWkb();
 
+    /**
+       Returns the WKB of this geometry for reading, without copying WKB
+       referenced in a shared buffer, see fromWkb().
+       @note added in 1.9
+    */
+    const unsigned char * constWkb();
+
     /**
        Returns the size of the WKB in asWkb().
     */
@@ -452,6 +470,9 @@ class CORE_EXPORT QgsGeometry
     /** size of geometry */
     size_t mGeometrySize;
 
+    /** shared buffer mGeometry points into, null if mGeometry is owned */
+    QByteArray mWkbBuffer;
+
     /** cached GEOS version of this geometry */
     GEOSGeometry* mGeos;
 
@@ -464,6 +485,12 @@ class CORE_EXPORT QgsGeometry
 
     // Private functions
 
+    /** Frees or releases the WKB buffer */
+    void releaseWkb();
+
+    /** Makes sure the WKB buffer is owned before it's modified in place */
+    void detachWkb();
+
     /** Converts from the WKB geometry to the GEOS geometry.
         @return   true in case of success and false else
      */
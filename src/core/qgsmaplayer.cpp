@@ -22,6 +22,7 @@
 #include <QSettings> // TODO: get rid of it [MD]
 #include <QDir>
 #include <QFile>
+#include <QMutexLocker>
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomImplementation>
@@ -74,6 +75,9 @@ QgsMapLayer::QgsMapLayer( QgsMapLayer::LayerType type,
   mMaxScale = 100000000;
   mScaleBasedVisibility = false;
   mpCacheImage = 0;
+
+  // a layer asking to be repainted has changed, unlike the other layers of the map
+  connect( this, SIGNAL( repaintRequested() ), this, SLOT( clearCacheImage() ) );
 }
 
 
@@ -1092,8 +1096,19 @@ void QgsMapLayer::writeCustomProperties( QDomNode & layerNode, QDomDocument & do
 }
 
 void QgsMapLayer::setCacheImage( QImage * thepImage )
+{
+  setCacheImage( thepImage, QgsRectangle(), QString() );
+}
+
+void QgsMapLayer::setCacheImage( QImage * thepImage, const QgsRectangle& extent, const QString& key )
 {
   QgsDebugMsg( "cache Image set!" );
+  // background renderings copy the image, see cachedImage()
+  QMutexLocker locker( &mCacheImageMutex );
+
+  mCacheImageExtent = extent;
+  mCacheImageKey = key;
+
   if ( mpCacheImage == thepImage )
     return;
 
@@ -1119,6 +1134,19 @@ void QgsMapLayer::clearCacheImage()
   setCacheImage( 0 );
 }
 
+bool QgsMapLayer::cachedImage( QImage& image, QgsRectangle& extent, QString& key ) const
+{
+  QMutexLocker locker( &mCacheImageMutex );
+  if ( !mpCacheImage )
+    return false;
+
+  // implicitly shared, the copy stays valid when the layer deletes its image
+  image = *mpCacheImage;
+  extent = mCacheImageExtent;
+  key = mCacheImageKey;
+  return true;
+}
+
 QString QgsMapLayer::metadata()
 {
   return QString();
@@ -23,6 +23,7 @@
 #include <QUndoStack>
 #include <QVariant>
 #include <QImage>
+#include <QMutex>
 #include <QDomNode>
 
 #include "qgis.h"
@@ -321,6 +322,26 @@ class CORE_EXPORT QgsMapLayer : public QObject
      * @note This method was added in QGIS 1.4 **/
     void setCacheImage( QImage * thepImage );
 
+    /** Set the QImage used for caching render operations together with the map extent
+     * and the renderer settings (see QgsMapRenderer) it was rendered with. The image
+     * is reused for the same extent and shown scaled as preview for other extents.
+     * @note added in 1.9 */
+    void setCacheImage( QImage * thepImage, const QgsRectangle& extent, const QString& key );
+
+    /** Map extent of the cache image, empty if unknown
+     * @note added in 1.9 */
+    const QgsRectangle& cacheImageExtent() const { return mCacheImageExtent; }
+
+    /** Renderer settings the cache image was rendered with, empty if unknown
+     * @note added in 1.9 */
+    const QString& cacheImageKey() const { return mCacheImageKey; }
+
+    /** Copies the cache image with its extent and key. Unlike cacheImage(), it may be
+     * called while the image is replaced in another thread, e.g. by a background rendering.
+     * @return false if there is no cache image
+     * @note added in 1.9 */
+    bool cachedImage( QImage& image, QgsRectangle& extent, QString& key ) const;
+
   public slots:
 
     /** Event handler for when a coordinate transform fails due to bad vertex error */
@@ -464,6 +485,12 @@ class CORE_EXPORT QgsMapLayer : public QObject
      * @note This property was added in QGIS 1.4 **/
     QImage * mpCacheImage;
 
+    /**Map extent and renderer settings of mpCacheImage*/
+    QgsRectangle mCacheImageExtent;
+    QString mCacheImageKey;
+    /**Guards the cache image, it is read by background renderings*/
+    mutable QMutex mCacheImageMutex;
+
 };
 
 #endif
@@ -17,6 +17,7 @@
 
 #include "qgsmaplayerregistry.h"
 #include "qgsmaplayer.h"
+#include "qgsmaprendererjob.h"
 #include "qgslogger.h"
 
 //
@@ -92,6 +93,7 @@ void QgsMapLayerRegistry::removeMapLayer( QString theLayerId, bool theEmitSignal
 {
   if ( theEmitSignal )
     emit layerWillBeRemoved( theLayerId );
+  QgsMapRendererJob::cancelRunningJobs();
   delete mMapLayers[theLayerId];
   mMapLayers.remove( theLayerId );
 }
@@ -107,6 +109,7 @@ void QgsMapLayerRegistry::removeAllMapLayers()
   {
     QString id = mMapLayers.begin().key();
     emit layerWillBeRemoved( id );
+    QgsMapRendererJob::cancelRunningJobs();
     delete mMapLayers[ id ]; // delete the map layer
     mMapLayers.remove( id );
   }
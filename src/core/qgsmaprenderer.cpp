@@ -20,26 +20,193 @@
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsmaprenderer.h"
+#include "qgsmaprendererjob.h"
 #include "qgsscalecalculator.h"
 #include "qgsmaptopixel.h"
 #include "qgsmaplayer.h"
 #include "qgsmaplayerregistry.h"
+#include "qgsdatasourceuri.h"
 #include "qgsdistancearea.h"
 #include "qgscentralpointpositionmanager.h"
 #include "qgsoverlayobjectpositionmanager.h"
 #include "qgspalobjectpositionmanager.h"
+#include "qgsrasterlayer.h"
 #include "qgsvectorlayer.h"
 #include "qgsvectoroverlay.h"
 
 
 #include <QDomDocument>
 #include <QDomNode>
+#include <QAtomicInt>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
 #include <QMutexLocker>
 #include <QPainter>
 #include <QListIterator>
 #include <QSettings>
 #include <QTime>
+#include <QTimer>
 #include <QCoreApplication>
+#include <QtConcurrentMap>
+
+/** Labeling engine used while layers are rendered in worker threads.
+ * Serializes the calls that collect layers and features so that the
+ * wrapped engine can place the labels afterwards as usual.
+ */
+class QgsThreadSafeLabelingEngine : public QgsLabelingEngineInterface
+{
+  public:
+    QgsThreadSafeLabelingEngine( QgsLabelingEngineInterface* engine ): mEngine( engine ) {}
+
+    void init( QgsMapRenderer* mp ) { mEngine->init( mp ); }
+    bool willUseLayer( QgsVectorLayer* layer )
+    {
+      QMutexLocker locker( &mMutex );
+      return mEngine->willUseLayer( layer );
+    }
+    int prepareLayer( QgsVectorLayer* layer, QSet<int>& attrIndices, QgsRenderContext& ctx )
+    {
+      QMutexLocker locker( &mMutex );
+      return mEngine->prepareLayer( layer, attrIndices, ctx );
+    }
+    int addDiagramLayer( QgsVectorLayer* layer, QgsDiagramLayerSettings* s )
+    {
+      QMutexLocker locker( &mMutex );
+      return mEngine->addDiagramLayer( layer, s );
+    }
+    void registerFeature( QgsVectorLayer* layer, QgsFeature& feat, const QgsRenderContext& context = QgsRenderContext() )
+    {
+      QMutexLocker locker( &mMutex );
+      mEngine->registerFeature( layer, feat, context );
+    }
+    void registerDiagramFeature( QgsVectorLayer* layer, QgsFeature& feat, const QgsRenderContext& context = QgsRenderContext() )
+    {
+      QMutexLocker locker( &mMutex );
+      mEngine->registerDiagramFeature( layer, feat, context );
+    }
+    void drawLabeling( QgsRenderContext& context ) { mEngine->drawLabeling( context ); }
+    void exit() { mEngine->exit(); }
+    QList<QgsLabelPosition> labelsAtPosition( const QgsPoint& p ) { return mEngine->labelsAtPosition( p ); }
+    QgsLabelingEngineInterface* clone() { return mEngine->clone(); }
+
+  private:
+    QgsLabelingEngineInterface* mEngine;
+    QMutex mMutex;
+};
+
+/** One layer of the layer set rendered into its own image */
+struct QgsMapRendererLayerJob
+{
+  QgsMapLayer* layer;
+  QImage* image;
+  //! copy of the layer's cache image drawn instead of rendering the layer
+  QImage cacheImage;
+  QPainter* painter;
+  QgsRenderContext* context;
+  //! second extent if the layer extent is split at the 180 degree line
+  bool split;
+  QgsRectangle extent2;
+  //! the layer is not rendered, its cache image is drawn if there is one
+  bool cached;
+  //! layer is not safe to be rendered outside of the main thread
+  bool mainThread;
+  bool ok;
+  //! set to 1 once the layer image is complete
+  QAtomicInt done;
+};
+
+static void renderLayerJob( QgsMapRendererLayerJob& job )
+{
+  QMutex* layerMutex = 0;
+  if ( !job.cached && ( layerMutex = lockLayerRendering( job.layer, *job.context ) ) )
+  {
+    job.ok = job.layer->draw( *job.context );
+    if ( job.split )
+    {
+      job.context->setExtent( job.extent2 );
+      job.ok = job.layer->draw( *job.context ) && job.ok;
+    }
+    layerMutex->unlock();
+  }
+  if ( job.painter )
+    job.painter->end();
+  job.done.fetchAndStoreRelease( 1 );
+}
+
+/** Layers rendered one after another by the same worker thread */
+struct QgsMapRendererWorkItem
+{
+  QList<QgsMapRendererLayerJob*> jobs;
+};
+
+static void renderWorkerThreadJob( QgsMapRendererWorkItem& item )
+{
+  foreach( QgsMapRendererLayerJob* job, item.jobs )
+  {
+    renderLayerJob( *job );
+  }
+}
+
+/** Returns a key shared by the layers whose providers use the same database
+ * connection, or an empty string if the layer has a connection of its own.
+ * PostgreSQL layers with the same connection info share one PGconn, which
+ * must not be used from two threads at once. SpatiaLite layers of the same
+ * database file share one sqlite3 handle and its statement cache.
+ */
+static QString sharedConnectionKey( QgsMapLayer* ml )
+{
+  QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+  if ( vl && vl->providerType() == "postgres" )
+  {
+    return "postgres:" + QgsDataSourceURI( vl->source() ).connectionInfo();
+  }
+  if ( vl && vl->providerType() == "spatialite" )
+  {
+    return "spatialite:" + QgsDataSourceURI( vl->source() ).database();
+  }
+  return QString();
+}
+
+//! guards sLayerRenderMutexes
+static QMutex sLayerRenderMutexesMutex;
+//! locks held while layers are drawn, by shared connection or layer id
+static QHash<QString, QMutex*> sLayerRenderMutexes;
+
+/** Waits until no other renderer draws the layer or a layer sharing its connection
+ * and locks them. Returns the locked mutex, or 0 without lock if the rendering is
+ * stopped meanwhile. In the main thread, the background jobs are cancelled instead
+ * of waited for, they are rendered again later.
+ */
+static QMutex* lockLayerRendering( QgsMapLayer* ml, const QgsRenderContext& context )
+{
+  QString key = sharedConnectionKey( ml );
+  if ( key.isEmpty() )
+    key = "layer:" + ml->id();
+
+  QMutex* mutex;
+  {
+    QMutexLocker locker( &sLayerRenderMutexesMutex );
+    mutex = sLayerRenderMutexes.value( key );
+    if ( !mutex )
+    {
+      // recursive: the event loop may run while the layer is drawn.
+      // Kept until the application exits, a layer id is not reused
+      mutex = new QMutex( QMutex::Recursive );
+      sLayerRenderMutexes.insert( key, mutex );
+    }
+  }
+
+  while ( !mutex->tryLock( 50 ) )
+  {
+    if ( context.renderingStopped() )
+      return 0;
+    QgsMapRendererJob::cancelRunningJobs();
+  }
+  return mutex;
+}
+
 
 QgsMapRenderer::QgsMapRenderer()
 {
@@ -62,6 +229,10 @@ QgsMapRenderer::QgsMapRenderer()
   mOutputUnits = QgsMapRenderer::Millimeters;
 
   mLabelingEngine = NULL;
+
+  mParallelRendering = false;
+  mLayerCaching = true;
+  mResetRenderingStopped = true;
 }
 
 QgsMapRenderer::~QgsMapRenderer()
@@ -222,11 +393,6 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   //Lock render method for concurrent threads (e.g. from globe)
   QMutexLocker renderLock( &mRenderMutex );
 
-  //flag to see if the render context has changed
-  //since the last time we rendered. If it hasnt changed we can
-  //take some shortcuts with rendering
-  bool mySameAsLastFlag = true;
-
   QgsDebugMsg( "========== Rendering ==========" );
 
   if ( mExtent.isEmpty() )
@@ -247,6 +413,11 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
     return;
   }
 
+  //this flag is only for stopping during the current rendering progress,
+  //so must be false at every new render operation
+  if ( mResetRenderingStopped )
+    mRenderContext.setRenderingStopped( false );
+
   // wait
   if ( mDrawing )
   {
@@ -275,9 +446,6 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
 
   mRenderContext.setPainter( painter );
   mRenderContext.setCoordinateTransform( 0 );
-  //this flag is only for stopping during the current rendering progress,
-  //so must be false at every new render operation
-  mRenderContext.setRenderingStopped( false );
 
   //calculate scale factor
   //use the specified dpi and not those from the paint device
@@ -296,260 +464,270 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
     }
   }
   double rasterScaleFactor = ( thePaintDevice->logicalDpiX() + thePaintDevice->logicalDpiY() ) / 2.0 / sceneDpi;
-  if ( mRenderContext.rasterScaleFactor() != rasterScaleFactor )
-  {
-    mRenderContext.setRasterScaleFactor( rasterScaleFactor );
-    mySameAsLastFlag = false;
-  }
-  if ( mRenderContext.scaleFactor() != scaleFactor )
-  {
-    mRenderContext.setScaleFactor( scaleFactor );
-    mySameAsLastFlag = false;
-  }
-  if ( mRenderContext.rendererScale() != mScale )
-  {
-    //add map scale to render context
-    mRenderContext.setRendererScale( mScale );
-    mySameAsLastFlag = false;
-  }
-  if ( mLastExtent != mExtent )
-  {
-    mLastExtent = mExtent;
-    mySameAsLastFlag = false;
-  }
+  mRenderContext.setRasterScaleFactor( rasterScaleFactor );
+  mRenderContext.setScaleFactor( scaleFactor );
+  //add map scale to render context
+  mRenderContext.setRendererScale( mScale );
+  mLastExtent = mExtent;
 
   mRenderContext.setLabelingEngine( mLabelingEngine );
   if ( mLabelingEngine )
     mLabelingEngine->init( this );
 
-  // know we know if this render is just a repeat of the last time, we
-  // can clear caches if it has changed
-  if ( !mySameAsLastFlag )
-  {
-    //clear the cache pixmap if we changed resolution / extent
-    QSettings mySettings;
-    if ( mySettings.value( "/qgis/enable_render_caching", false ).toBool() )
-    {
-      QgsMapLayerRegistry::instance()->clearAllLayerCaches();
-    }
-  }
+  // the cache images of the layers are kept with the extent and the settings they were
+  // rendered with: they are reused for this extent and otherwise only shown as previews
+  QString cacheKey = layerCacheKey( painter->device() );
 
   QgsOverlayObjectPositionManager* overlayManager = overlayManagerFromSettings();
   QList<QgsVectorOverlay*> allOverlayList; //list of all overlays, used to draw them after layers have been rendered
 
+  //layers can only be rendered into separate images and composited afterwards
+  //if the output is a raster image without world transformation
+  bool parallel = mParallelRendering && !mRenderContext.forceVectorOutput() &&
+                  painter->transform().isIdentity() &&
+                  ( thePaintDevice->devType() == QInternal::Image || thePaintDevice->devType() == QInternal::Pixmap );
+
   // render all layers in the stack, starting at the base
   QListIterator<QString> li( mLayerSet );
   li.toBack();
 
   QgsRectangle r1, r2;
 
-  while ( li.hasPrevious() )
+  if ( parallel )
   {
-    if ( mRenderContext.renderingStopped() )
+    renderLayersParallel( rasterScaleFactor, cacheKey, overlayManager, allOverlayList );
+  }
+  else
+  {
+    while ( li.hasPrevious() )
     {
-      break;
-    }
+      if ( mRenderContext.renderingStopped() )
+      {
+        break;
+      }
 
-    // Store the painter in case we need to swap it out for the
-    // cache painter
-    QPainter * mypContextPainter = mRenderContext.painter();
+      // Store the painter in case we need to swap it out for the
+      // cache painter
+      QPainter * mypContextPainter = mRenderContext.painter();
 
-    QString layerId = li.previous();
+      QString layerId = li.previous();
 
-    QgsDebugMsg( "Rendering at layer item " + layerId );
+      QgsDebugMsg( "Rendering at layer item " + layerId );
 
-    // This call is supposed to cause the progress bar to
-    // advance. However, it seems that updating the progress bar is
-    // incompatible with having a QPainter active (the one that is
-    // passed into this function), as Qt produces a number of errors
-    // when try to do so. I'm (Gavin) not sure how to fix this, but
-    // added these comments and debug statement to help others...
-    QgsDebugMsg( "If there is a QPaintEngine error here, it is caused by an emit call" );
+      // This call is supposed to cause the progress bar to
+      // advance. However, it seems that updating the progress bar is
+      // incompatible with having a QPainter active (the one that is
+      // passed into this function), as Qt produces a number of errors
+      // when try to do so. I'm (Gavin) not sure how to fix this, but
+      // added these comments and debug statement to help others...
+      QgsDebugMsg( "If there is a QPaintEngine error here, it is caused by an emit call" );
 
-    //emit drawingProgress(myRenderCounter++, mLayerSet.size());
-    QgsMapLayer *ml = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+      //emit drawingProgress(myRenderCounter++, mLayerSet.size());
+      QgsMapLayer *ml = QgsMapLayerRegistry::instance()->mapLayer( layerId );
 
-    if ( !ml )
-    {
-      QgsDebugMsg( "Layer not found in registry!" );
-      continue;
-    }
+      if ( !ml )
+      {
+        QgsDebugMsg( "Layer not found in registry!" );
+        continue;
+      }
 
-    QgsDebugMsg( QString( "layer %1:  minscale:%2  maxscale:%3  scaledepvis:%4  extent:%5" )
-                 .arg( ml->name() )
-                 .arg( ml->minimumScale() )
-                 .arg( ml->maximumScale() )
-                 .arg( ml->hasScaleBasedVisibility() )
-                 .arg( ml->extent().toString() )
-               );
+      QgsDebugMsg( QString( "layer %1:  minscale:%2  maxscale:%3  scaledepvis:%4  extent:%5" )
+                   .arg( ml->name() )
+                   .arg( ml->minimumScale() )
+                   .arg( ml->maximumScale() )
+                   .arg( ml->hasScaleBasedVisibility() )
+                   .arg( ml->extent().toString() )
+                 );
 
-    if ( !ml->hasScaleBasedVisibility() || ( ml->minimumScale() < mScale && mScale < ml->maximumScale() ) || mOverview )
-    {
-      connect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+      if ( !ml->hasScaleBasedVisibility() || ( ml->minimumScale() < mScale && mScale < ml->maximumScale() ) || mOverview )
+      {
+        connect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
 
-      //
-      // Now do the call to the layer that actually does
-      // the rendering work!
-      //
+        //
+        // Now do the call to the layer that actually does
+        // the rendering work!
+        //
 
-      bool split = false;
+        bool split = false;
 
-      if ( hasCrsTransformEnabled() )
-      {
-        r1 = mExtent;
-        split = splitLayersExtent( ml, r1, r2 );
-        ct = new QgsCoordinateTransform( ml->crs(), *mDestCRS );
-        mRenderContext.setExtent( r1 );
-        QgsDebugMsg( "  extent 1: " + r1.toString() );
-        QgsDebugMsg( "  extent 2: " + r2.toString() );
-        if ( !r1.isFinite() || !r2.isFinite() ) //there was a problem transforming the extent. Skip the layer
+        if ( hasCrsTransformEnabled() )
+        {
+          r1 = mExtent;
+          split = splitLayersExtent( ml, r1, r2 );
+          ct = new QgsCoordinateTransform( ml->crs(), *mDestCRS );
+          mRenderContext.setExtent( r1 );
+          QgsDebugMsg( "  extent 1: " + r1.toString() );
+          QgsDebugMsg( "  extent 2: " + r2.toString() );
+          if ( !r1.isFinite() || !r2.isFinite() ) //there was a problem transforming the extent. Skip the layer
+          {
+            disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+            emit layerComposited();
+            continue;
+          }
+        }
+        else
         {
-          continue;
+          ct = NULL;
         }
-      }
-      else
-      {
-        ct = NULL;
-      }
 
-      mRenderContext.setCoordinateTransform( ct );
+        mRenderContext.setCoordinateTransform( ct );
 
-      //decide if we have to scale the raster
-      //this is necessary in case QGraphicsScene is used
-      bool scaleRaster = false;
-      QgsMapToPixel rasterMapToPixel;
-      QgsMapToPixel bk_mapToPixel;
+        //decide if we have to scale the raster
+        //this is necessary in case QGraphicsScene is used
+        bool scaleRaster = false;
+        QgsMapToPixel rasterMapToPixel;
+        QgsMapToPixel bk_mapToPixel;
 
-      if ( ml->type() == QgsMapLayer::RasterLayer && qAbs( rasterScaleFactor - 1.0 ) > 0.000001 )
-      {
-        scaleRaster = true;
-      }
+        if ( ml->type() == QgsMapLayer::RasterLayer && qAbs( rasterScaleFactor - 1.0 ) > 0.000001 )
+        {
+          scaleRaster = true;
+        }
 
 
-      //create overlay objects for features within the view extent
-      if ( ml->type() == QgsMapLayer::VectorLayer && overlayManager )
-      {
-        QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
-        if ( vl )
+        //create overlay objects for features within the view extent
+        if ( ml->type() == QgsMapLayer::VectorLayer && overlayManager )
         {
-          QList<QgsVectorOverlay*> thisLayerOverlayList;
-          vl->vectorOverlays( thisLayerOverlayList );
-
-          QList<QgsVectorOverlay*>::iterator overlayIt = thisLayerOverlayList.begin();
-          for ( ; overlayIt != thisLayerOverlayList.end(); ++overlayIt )
+          QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+          QMutex* layerMutex = vl ? lockLayerRendering( vl, mRenderContext ) : 0;
+          if ( layerMutex )
           {
-            if (( *overlayIt )->displayFlag() )
+            QList<QgsVectorOverlay*> thisLayerOverlayList;
+            vl->vectorOverlays( thisLayerOverlayList );
+
+            QList<QgsVectorOverlay*>::iterator overlayIt = thisLayerOverlayList.begin();
+            for ( ; overlayIt != thisLayerOverlayList.end(); ++overlayIt )
             {
-              ( *overlayIt )->createOverlayObjects( mRenderContext );
-              allOverlayList.push_back( *overlayIt );
+              if (( *overlayIt )->displayFlag() )
+              {
+                ( *overlayIt )->createOverlayObjects( mRenderContext );
+                allOverlayList.push_back( *overlayIt );
+              }
             }
-          }
 
-          overlayManager->addLayer( vl, thisLayerOverlayList );
+            overlayManager->addLayer( vl, thisLayerOverlayList );
+            layerMutex->unlock();
+          }
         }
-      }
 
-      // Force render of layers that are being edited
-      // or if there's a labeling engine that needs the layer to register features
-      if ( ml->type() == QgsMapLayer::VectorLayer )
-      {
-        QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
-        if ( vl->isEditable() ||
-             ( mRenderContext.labelingEngine() && mRenderContext.labelingEngine()->willUseLayer( vl ) ) )
+        // Force render of layers that are being edited
+        // or if there's a labeling engine that needs the layer to register features.
+        // Their cache image is still replaced, so that it can be shown as preview
+        bool forceRender = false;
+        if ( ml->type() == QgsMapLayer::VectorLayer )
         {
-          ml->setCacheImage( 0 );
+          QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+          forceRender = vl->isEditable() ||
+                        ( mRenderContext.labelingEngine() && mRenderContext.labelingEngine()->willUseLayer( vl ) );
         }
-      }
 
-      QSettings mySettings;
-      if ( ! split )//render caching does not yet cater for split extents
-      {
-        if ( mySettings.value( "/qgis/enable_render_caching", false ).toBool() )
+        QSettings mySettings;
+        QImage * mypCacheImage = 0;
+        QImage cachedImage;
+        if ( ! split )//render caching does not yet cater for split extents
         {
-          if ( !mySameAsLastFlag || ml->cacheImage() == 0 )
+          if ( mLayerCaching && mySettings.value( "/qgis/enable_render_caching", false ).toBool() )
           {
-            QgsDebugMsg( "Caching enabled but layer redraw forced by extent change or empty cache" );
-            QImage * mypImage = new QImage( mRenderContext.painter()->device()->width(),
-                                            mRenderContext.painter()->device()->height(), QImage::Format_ARGB32 );
-            mypImage->fill( 0 );
-            ml->setCacheImage( mypImage ); //no need to delete the old one, maplayer does it for you
-            QPainter * mypPainter = new QPainter( ml->cacheImage() );
-            // Changed to enable anti aliasing by default in QGIS 1.7
-            if ( mySettings.value( "/qgis/enable_anti_aliasing", true ).toBool() )
+            if ( forceRender || !isLayerCacheValid( ml, cacheKey, mRenderContext.painter()->device(), cachedImage ) )
             {
-              mypPainter->setRenderHint( QPainter::Antialiasing );
+              QgsDebugMsg( "Caching enabled but layer redraw forced by extent change or empty cache" );
+              // the old image stays the preview until the new one is complete
+              mypCacheImage = new QImage( mRenderContext.painter()->device()->width(),
+                                          mRenderContext.painter()->device()->height(), QImage::Format_ARGB32 );
+              mypCacheImage->fill( 0 );
+              QPainter * mypPainter = new QPainter( mypCacheImage );
+              // Changed to enable anti aliasing by default in QGIS 1.7
+              if ( mySettings.value( "/qgis/enable_anti_aliasing", true ).toBool() )
+              {
+                mypPainter->setRenderHint( QPainter::Antialiasing );
+              }
+              mRenderContext.setPainter( mypPainter );
+            }
+            else
+            {
+              //draw from cached image
+              QgsDebugMsg( "Caching enabled --- drawing layer from cached image" );
+              mypContextPainter->drawImage( 0, 0, cachedImage );
+              disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+              emit layerComposited();
+              //short circuit as there is nothing else to do...
+              continue;
             }
-            mRenderContext.setPainter( mypPainter );
-          }
-          else if ( mySameAsLastFlag )
-          {
-            //draw from cached image
-            QgsDebugMsg( "Caching enabled --- drawing layer from cached image" );
-            mypContextPainter->drawImage( 0, 0, *( ml->cacheImage() ) );
-            disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
-            //short circuit as there is nothing else to do...
-            continue;
           }
         }
-      }
 
-      if ( scaleRaster )
-      {
-        bk_mapToPixel = mRenderContext.mapToPixel();
-        rasterMapToPixel = mRenderContext.mapToPixel();
-        rasterMapToPixel.setMapUnitsPerPixel( mRenderContext.mapToPixel().mapUnitsPerPixel() / rasterScaleFactor );
-        rasterMapToPixel.setYMaximum( mSize.height() * rasterScaleFactor );
-        mRenderContext.setMapToPixel( rasterMapToPixel );
-        mRenderContext.painter()->save();
-        mRenderContext.painter()->scale( 1.0 / rasterScaleFactor, 1.0 / rasterScaleFactor );
-      }
+        // stopped while another renderer draws the layer: an unfinished cache image is dropped below
+        QMutex* layerMutex = lockLayerRendering( ml, mRenderContext );
 
+        if ( layerMutex && scaleRaster )
+        {
+          bk_mapToPixel = mRenderContext.mapToPixel();
+          rasterMapToPixel = mRenderContext.mapToPixel();
+          rasterMapToPixel.setMapUnitsPerPixel( mRenderContext.mapToPixel().mapUnitsPerPixel() / rasterScaleFactor );
+          rasterMapToPixel.setYMaximum( mSize.height() * rasterScaleFactor );
+          mRenderContext.setMapToPixel( rasterMapToPixel );
+          mRenderContext.painter()->save();
+          mRenderContext.painter()->scale( 1.0 / rasterScaleFactor, 1.0 / rasterScaleFactor );
+        }
 
-      if ( !ml->draw( mRenderContext ) )
-      {
-        emit drawError( ml );
-      }
-      else
-      {
-        QgsDebugMsg( "Layer rendered without issues" );
-      }
 
-      if ( split )
-      {
-        mRenderContext.setExtent( r2 );
-        if ( !ml->draw( mRenderContext ) )
+        if ( layerMutex )
         {
-          emit drawError( ml );
-        }
-      }
+          if ( !ml->draw( mRenderContext ) )
+          {
+            emit drawError( ml );
+          }
+          else
+          {
+            QgsDebugMsg( "Layer rendered without issues" );
+          }
 
-      if ( scaleRaster )
-      {
-        mRenderContext.setMapToPixel( bk_mapToPixel );
-        mRenderContext.painter()->restore();
-      }
+          if ( split )
+          {
+            mRenderContext.setExtent( r2 );
+            if ( !ml->draw( mRenderContext ) )
+            {
+              emit drawError( ml );
+            }
+          }
 
-      if ( mySettings.value( "/qgis/enable_render_caching", false ).toBool() )
-      {
-        if ( !split )
+          if ( scaleRaster )
+          {
+            mRenderContext.setMapToPixel( bk_mapToPixel );
+            mRenderContext.painter()->restore();
+          }
+
+          layerMutex->unlock();
+        }
+
+        if ( mypCacheImage )
         {
           // composite the cached image into our view and then clean up from caching
           // by reinstating the painter as it was swapped out for caching renders
           delete mRenderContext.painter();
           mRenderContext.setPainter( mypContextPainter );
           //draw from cached image that we created further up
-          mypContextPainter->drawImage( 0, 0, *( ml->cacheImage() ) );
+          mypContextPainter->drawImage( 0, 0, *mypCacheImage );
+          //an interrupted rendering must not be reused
+          if ( mRenderContext.renderingStopped() )
+          {
+            delete mypCacheImage;
+          }
+          else
+          {
+            ml->setCacheImage( mypCacheImage, mExtent, cacheKey ); //no need to delete the old one, maplayer does it for you
+          }
         }
+        disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+        emit layerComposited();
+      }
+      else // layer not visible due to scale
+      {
+        QgsDebugMsg( "Layer not rendered because it is not within the defined "
+                     "visibility scale range" );
       }
-      disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
-    }
-    else // layer not visible due to scale
-    {
-      QgsDebugMsg( "Layer not rendered because it is not within the defined "
-                   "visibility scale range" );
-    }
 
-  } // while (li.hasPrevious())
+    } // while (li.hasPrevious())
+  }
 
   QgsDebugMsg( "Done rendering map layers" );
 
@@ -591,12 +769,17 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
 
           mRenderContext.setCoordinateTransform( ct );
 
+          QMutex* layerMutex = lockLayerRendering( ml, mRenderContext );
+          if ( !layerMutex )
+            break;
+
           ml->drawLabels( mRenderContext );
           if ( split )
           {
             mRenderContext.setExtent( r2 );
             ml->drawLabels( mRenderContext );
           }
+          layerMutex->unlock();
         }
       }
     }
@@ -634,6 +817,323 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   mDrawing = false;
 }
 
+void QgsMapRenderer::renderLayersParallel( double rasterScaleFactor, const QString& cacheKey,
+    QgsOverlayObjectPositionManager* overlayManager, QList<QgsVectorOverlay*>& overlayList )
+{
+  QPainter* painter = mRenderContext.painter();
+  QSettings mySettings;
+  bool renderCaching = mLayerCaching && mySettings.value( "/qgis/enable_render_caching", false ).toBool();
+
+  QgsThreadSafeLabelingEngine* labelingEngine = 0;
+  if ( mLabelingEngine )
+  {
+    labelingEngine = new QgsThreadSafeLabelingEngine( mLabelingEngine );
+  }
+
+  // prepare one job per visible layer, starting at the base
+  QList<QgsMapRendererLayerJob> jobs;
+  QListIterator<QString> li( mLayerSet );
+  li.toBack();
+  while ( li.hasPrevious() )
+  {
+    QString layerId = li.previous();
+    QgsMapLayer *ml = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( !ml )
+    {
+      QgsDebugMsg( "Layer not found in registry!" );
+      continue;
+    }
+
+    if ( ml->hasScaleBasedVisibility() && ( ml->minimumScale() >= mScale || mScale >= ml->maximumScale() ) && !mOverview )
+    {
+      QgsDebugMsg( "Layer not rendered because it is not within the defined visibility scale range" );
+      continue;
+    }
+
+    QgsMapRendererLayerJob job;
+    job.layer = ml;
+    job.cached = false;
+    job.mainThread = !QgsMapRendererJob::canRenderInBackground( ml );
+    job.ok = true;
+    job.done = 0;
+    job.image = 0;
+    job.painter = 0;
+    job.context = 0;
+
+    QgsRectangle r1 = mExtent, r2;
+    bool split = false;
+    if ( hasCrsTransformEnabled() )
+    {
+      split = splitLayersExtent( ml, r1, r2 );
+      if ( !r1.isFinite() || !r2.isFinite() ) //there was a problem transforming the extent. Skip the layer
+      {
+        // kept as a job without image, so that it is counted when the layers are composited
+        job.cached = true;
+        job.mainThread = false;
+        job.done = 1;
+        jobs.append( job );
+        continue;
+      }
+    }
+    job.split = split;
+    job.extent2 = r2;
+
+    //create overlay objects for features within the view extent
+    if ( ml->type() == QgsMapLayer::VectorLayer && overlayManager )
+    {
+      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+      QMutex* layerMutex = vl ? lockLayerRendering( vl, mRenderContext ) : 0;
+      if ( layerMutex )
+      {
+        mRenderContext.setExtent( r1 );
+        mRenderContext.setCoordinateTransform( hasCrsTransformEnabled() ? new QgsCoordinateTransform( ml->crs(), *mDestCRS ) : 0 );
+
+        QList<QgsVectorOverlay*> thisLayerOverlayList;
+        vl->vectorOverlays( thisLayerOverlayList );
+
+        QList<QgsVectorOverlay*>::iterator overlayIt = thisLayerOverlayList.begin();
+        for ( ; overlayIt != thisLayerOverlayList.end(); ++overlayIt )
+        {
+          if (( *overlayIt )->displayFlag() )
+          {
+            ( *overlayIt )->createOverlayObjects( mRenderContext );
+            overlayList.push_back( *overlayIt );
+          }
+        }
+
+        overlayManager->addLayer( vl, thisLayerOverlayList );
+        layerMutex->unlock();
+      }
+    }
+
+    // Force render of layers that are being edited
+    // or if there's a labeling engine that needs the layer to register features.
+    // Their cache image is still replaced, so that it can be shown as preview
+    bool forceRender = false;
+    if ( ml->type() == QgsMapLayer::VectorLayer )
+    {
+      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+      forceRender = vl->isEditable() || ( mLabelingEngine && mLabelingEngine->willUseLayer( vl ) );
+    }
+
+    // a copy, the event loop may replace the layer's image before it is composited
+    if ( renderCaching && !split && !forceRender && isLayerCacheValid( ml, cacheKey, painter->device(), job.cacheImage ) )
+    {
+      QgsDebugMsg( "Caching enabled --- drawing layer from cached image" );
+      job.cached = true;
+      job.mainThread = false;
+      jobs.append( job );
+      continue;
+    }
+
+    job.image = new QImage( painter->device()->width(), painter->device()->height(), QImage::Format_ARGB32_Premultiplied );
+    job.image->fill( 0 );
+    job.painter = new QPainter( job.image );
+    job.painter->setRenderHints( painter->renderHints() );
+
+    job.context = new QgsRenderContext();
+    job.context->setPainter( job.painter );
+    job.context->setExtent( r1 );
+    job.context->setMapToPixel( mRenderContext.mapToPixel() );
+    job.context->setCoordinateTransform( hasCrsTransformEnabled() ? new QgsCoordinateTransform( ml->crs(), *mDestCRS ) : 0 );
+    job.context->setDrawEditingInformation( mRenderContext.drawEditingInformation() );
+    job.context->setForceVectorOutput( mRenderContext.forceVectorOutput() );
+    job.context->setScaleFactor( mRenderContext.scaleFactor() );
+    job.context->setRasterScaleFactor( rasterScaleFactor );
+    job.context->setRendererScale( mRenderContext.rendererScale() );
+    job.context->setLabelingEngine( labelingEngine );
+    job.context->setRenderingStopped( false );
+
+    //decide if we have to scale the raster
+    if ( ml->type() == QgsMapLayer::RasterLayer && qAbs( rasterScaleFactor - 1.0 ) > 0.000001 )
+    {
+      QgsMapToPixel rasterMapToPixel = mRenderContext.mapToPixel();
+      rasterMapToPixel.setMapUnitsPerPixel( mRenderContext.mapToPixel().mapUnitsPerPixel() / rasterScaleFactor );
+      rasterMapToPixel.setYMaximum( mSize.height() * rasterScaleFactor );
+      job.context->setMapToPixel( rasterMapToPixel );
+      job.painter->scale( 1.0 / rasterScaleFactor, 1.0 / rasterScaleFactor );
+    }
+
+    jobs.append( job );
+  }
+
+  QgsDebugMsg( QString( "Rendering %1 layers in parallel" ).arg( jobs.size() ) );
+
+  // layers sharing a connection are rendered by the same work item, in z-order
+  QList<QgsMapRendererWorkItem> workItems;
+  QMap<QString, int> connectionItems;
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    if ( jobs[i].mainThread || !jobs[i].image )
+      continue;
+
+    QString key = sharedConnectionKey( jobs[i].layer );
+    if ( !key.isEmpty() && connectionItems.contains( key ) )
+    {
+      workItems[ connectionItems[ key ] ].jobs << &jobs[i];
+      continue;
+    }
+
+    if ( !key.isEmpty() )
+      connectionItems.insert( key, workItems.size() );
+    workItems << QgsMapRendererWorkItem();
+    workItems.last().jobs << &jobs[i];
+  }
+
+  QFuture<void> future = QtConcurrent::map( workItems, renderWorkerThreadJob );
+
+  // layers that must stay in the main thread are rendered while the workers are busy
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    if ( jobs[i].mainThread && !jobs[i].cached )
+    {
+      jobs[i].context->setRenderingStopped( mRenderContext.renderingStopped() );
+      renderLayerJob( jobs[i] );
+    }
+  }
+
+  // keep the event loop running so that the rendering can be stopped
+  // and composite the finished layers in z-order as soon as there is no gap
+  QEventLoop loop;
+  QTimer timer;
+  QFutureWatcher<void> watcher;
+  connect( &watcher, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+  connect( &timer, SIGNAL( timeout() ), &loop, SLOT( quit() ) );
+  watcher.setFuture( future );
+  timer.start( 100 );
+
+  int composited = 0;
+  while ( composited < jobs.size() )
+  {
+    if ( !future.isFinished() )
+    {
+      loop.exec();
+      if ( mRenderContext.renderingStopped() )
+      {
+        for ( int i = 0; i < jobs.size(); ++i )
+        {
+          if ( jobs[i].context )
+            jobs[i].context->setRenderingStopped( true );
+        }
+      }
+    }
+
+    for ( ; composited < jobs.size() && jobs[composited].done.testAndSetAcquire( 1, 1 ); ++composited )
+    {
+      QgsMapRendererLayerJob& job = jobs[composited];
+
+      if ( !job.ok )
+      {
+        emit drawError( job.layer );
+      }
+
+      if ( !mRenderContext.renderingStopped() )
+      {
+        if ( job.image )
+          painter->drawImage( 0, 0, *job.image );
+        else if ( !job.cacheImage.isNull() )
+          painter->drawImage( 0, 0, job.cacheImage );
+        emit layerComposited();
+      }
+
+      if ( job.cached )
+        continue;
+
+      delete job.context;
+      delete job.painter;
+
+      if ( renderCaching && !job.split && !mRenderContext.renderingStopped() )
+      {
+        job.layer->setCacheImage( job.image, mExtent, cacheKey ); //maplayer takes ownership
+      }
+      else
+      {
+        delete job.image;
+      }
+    }
+  }
+  timer.stop();
+  future.waitForFinished();
+
+  delete labelingEngine;
+
+  mRenderContext.setCoordinateTransform( 0 );
+  mRenderContext.setExtent( mExtent );
+}
+
+QString QgsMapRenderer::layerCacheKey( QPaintDevice* device ) const
+{
+  return QString( "%1|%2|%3|%4|%5|%6|%7|%8" )
+         .arg( mDestCRS->srsid() )
+         .arg( mScaleCalculator->mapUnits() )
+         .arg( mProjectionsEnabled )
+         .arg( mOverview )
+         .arg( mOutputUnits )
+         .arg( mScaleCalculator->dpi(), 0, 'g', 17 )
+         .arg( device->logicalDpiX() )
+         .arg( device->logicalDpiY() );
+}
+
+bool QgsMapRenderer::isLayerCacheValid( QgsMapLayer* layer, const QString& cacheKey, QPaintDevice* device, QImage& image ) const
+{
+  QgsRectangle extent;
+  QString key;
+  if ( !layer->cachedImage( image, extent, key ) )
+    return false;
+
+  if ( image.width() == device->width() && image.height() == device->height() && key == cacheKey && extent == mExtent )
+    return true;
+
+  image = QImage();
+  return false;
+}
+
+int QgsMapRenderer::drawLayerCachePreviews( QPainter* painter, int first )
+{
+  QSettings mySettings;
+  if ( !mLayerCaching || !mySettings.value( "/qgis/enable_render_caching", false ).toBool() )
+  {
+    return 0;
+  }
+
+  QString cacheKey = layerCacheKey( painter->device() );
+  const QgsMapToPixel& mapToPixel = mRenderContext.mapToPixel();
+
+  int position = 0;
+  int drawn = 0;
+  QListIterator<QString> li( mLayerSet );
+  li.toBack();
+  while ( li.hasPrevious() )
+  {
+    QgsMapLayer *ml = QgsMapLayerRegistry::instance()->mapLayer( li.previous() );
+    if ( !ml || ( ml->hasScaleBasedVisibility() && ( ml->minimumScale() >= mScale || mScale >= ml->maximumScale() ) && !mOverview ) )
+    {
+      continue;
+    }
+
+    if ( position++ < first )
+    {
+      continue;
+    }
+
+    // the image may be replaced meanwhile by the main thread
+    QImage image;
+    QgsRectangle extent;
+    QString key;
+    if ( !ml->cachedImage( image, extent, key ) || extent.isEmpty() || key != cacheKey )
+    {
+      continue;
+    }
+
+    QgsPoint topLeft = mapToPixel.transform( extent.xMinimum(), extent.yMaximum() );
+    QgsPoint bottomRight = mapToPixel.transform( extent.xMaximum(), extent.yMinimum() );
+    painter->drawImage( QRectF( topLeft.x(), topLeft.y(), bottomRight.x() - topLeft.x(), bottomRight.y() - topLeft.y() ), image );
+    ++drawn;
+  }
+
+  return drawn;
+}
+
 void QgsMapRenderer::setMapUnits( QGis::UnitType u )
 {
   mScaleCalculator->setMapUnits( u );
@@ -1116,6 +1616,14 @@ void QgsMapRenderer::setLabelingEngine( QgsLabelingEngineInterface* iface )
   mLabelingEngine = iface;
 }
 
+QgsLabelingEngineInterface* QgsMapRenderer::takeLabelingEngine()
+{
+  QgsLabelingEngineInterface* iface = mLabelingEngine;
+  mLabelingEngine = 0;
+  mRenderContext.setLabelingEngine( 0 );
+  return iface;
+}
+
 QgsCoordinateTransform *QgsMapRenderer::tr( QgsMapLayer *layer )
 {
   if ( mCachedTrForLayer != layer )
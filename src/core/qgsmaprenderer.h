@@ -28,6 +28,7 @@
 
 class QDomDocument;
 class QDomNode;
+class QPaintDevice;
 class QPainter;
 
 class QgsMapToPixel;
@@ -38,6 +39,7 @@ class QgsCoordinateReferenceSystem;
 class QgsDistanceArea;
 class QgsOverlayObjectPositionManager;
 class QgsVectorLayer;
+class QgsVectorOverlay;
 
 struct QgsDiagramLayerSettings;
 
@@ -231,6 +233,50 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! Added in QGIS v1.4
     void setLabelingEngine( QgsLabelingEngineInterface* iface );
 
+    //! Removes the labeling engine from the renderer without deleting it.
+    //! The caller takes ownership of the engine
+    //! @note added in 1.9
+    QgsLabelingEngineInterface* takeLabelingEngine();
+
+    /** Enables rendering of the layer set in worker threads. Each layer is rendered
+     * into its own image and the images are composited in layer order afterwards.
+     * Sequential rendering is used if the painter is not suitable (e.g. vector output
+     * or a painter with world transformation). Layers sharing a database connection
+     * (PostgreSQL layers with the same connection info, SpatiaLite layers of the
+     * same file) are rendered one after another by the same worker.
+     * @note added in 1.9 */
+    void setParallelRenderingEnabled( bool enabled ) { mParallelRendering = enabled; }
+
+    //! returns true if the layers are rendered in parallel threads
+    //! @note added in 1.9
+    bool isParallelRenderingEnabled() const { return mParallelRendering; }
+
+    /** Allows the layers to be drawn into and from their cache images if render caching
+     * is enabled in the settings. Renderers of other outputs than the map canvas disable it
+     * so they do not replace the images of the canvas.
+     * @note added in 1.9 */
+    void setLayerCachingEnabled( bool enabled ) { mLayerCaching = enabled; }
+
+    //! returns true if the layers may use their cache images
+    //! @note added in 1.9
+    bool isLayerCachingEnabled() const { return mLayerCaching; }
+
+    /** Draws the cache images of the layers, scaled from the extent they were rendered for
+     * to the current extent, as preview of the rendering. Only images rendered with the same
+     * CRS and output settings are drawn. Layers are counted from the bottom of the layer set
+     * without the layers outside their scale range.
+     * @param painter painter of an image of the output size
+     * @param first position of the first layer to draw, layers below are not drawn
+     * @return number of layers drawn
+     * @note added in 1.9 */
+    int drawLayerCachePreviews( QPainter* painter, int first = 0 );
+
+    /** Sets whether render() clears the stop flag of the render context when it starts (the default).
+     * Background jobs clear it before they start instead, so that a cancel arriving before
+     * the rendering begins is not lost.
+     * @note added in 1.9 */
+    void setResetRenderingStopped( bool reset ) { mResetRenderingStopped = reset; }
+
   signals:
 
     void drawingProgress( int current, int total );
@@ -246,6 +292,11 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! emitted when layer's draw() returned false
     void drawError( QgsMapLayer* );
 
+    //! emitted from the rendering thread after a layer has been drawn onto the output painter,
+    //! or skipped, once for each layer counted by drawLayerCachePreviews()
+    //! @note added in 1.9
+    void layerComposited();
+
   public slots:
 
     //! called by signal from layer current being drawn
@@ -274,6 +325,21 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     @note this method was added in version 1.1*/
     QgsOverlayObjectPositionManager* overlayManagerFromSettings();
 
+    /**Identifies the settings the cache images of the layers are rendered with, except the extent
+      @note this method was added in version 1.9*/
+    QString layerCacheKey( QPaintDevice* device ) const;
+
+    /**Returns true if the cache image of a layer was rendered for the current extent, output size and settings
+      @param image receives a copy of the cache image if it is valid
+      @note this method was added in version 1.9*/
+    bool isLayerCacheValid( QgsMapLayer* layer, const QString& cacheKey, QPaintDevice* device, QImage& image ) const;
+
+    /**Renders each visible layer into its own image using the global thread pool
+      and composites the images in layer order onto the painter of the render context
+      @note this method was added in version 1.9*/
+    void renderLayersParallel( double rasterScaleFactor, const QString& cacheKey,
+                               QgsOverlayObjectPositionManager* overlayManager, QList<QgsVectorOverlay*>& overlayList );
+
     //! indicates drawing in progress
     static bool mDrawing;
 
@@ -328,6 +394,15 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! Locks rendering loop for concurrent draws
     QMutex mRenderMutex;
 
+    //! Render layers in worker threads
+    bool mParallelRendering;
+
+    //! Layers may use their cache images
+    bool mLayerCaching;
+
+    //! render() clears the stop flag of the render context
+    bool mResetRenderingStopped;
+
   private:
     QgsCoordinateTransform *tr( QgsMapLayer *layer );
     QgsCoordinateTransform *mCachedTr;
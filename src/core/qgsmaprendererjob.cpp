@@ -0,0 +1,268 @@
+/***************************************************************************
+  qgsmaprendererjob.cpp - background rendering of a map layer set
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsmaprendererjob.h"
+
+#include "qgscsexception.h"
+#include "qgslogger.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmaprenderer.h"
+#include "qgsrasterlayer.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+#include <QCoreApplication>
+#include <QMutexLocker>
+
+QList<QgsMapRendererJob*> QgsMapRendererJob::sJobs;
+QMutex QgsMapRendererJob::sJobsMutex;
+
+QgsMapRendererJob::QgsMapRendererJob( QgsMapRenderer* renderer, const QImage& image, QPainter::RenderHints hints )
+    : QThread()
+    , mRenderer( renderer )
+    , mImage( image )
+    , mBackground( image )
+    , mRenderHints( hints )
+    , mPreviewImage( image )
+    , mCancelled( false )
+    , mRendered( false )
+    , mAutoDeleteRenderer( false )
+    , mForceWidthScale( 0 )
+    , mComposited( 0 )
+{
+  connect( mRenderer, SIGNAL( layerComposited() ), this, SLOT( storePreview() ), Qt::DirectConnection );
+
+  // cancel() may be called before the thread has started rendering
+  mRenderer->setResetRenderingStopped( false );
+  mRenderer->rendererContext()->setRenderingStopped( false );
+
+  QMutexLocker locker( &sJobsMutex );
+  sJobs << this;
+}
+
+QgsMapRendererJob::~QgsMapRendererJob()
+{
+  {
+    QMutexLocker locker( &sJobsMutex );
+    sJobs.removeAll( this );
+  }
+
+  cancel();
+  wait();
+
+  if ( mAutoDeleteRenderer )
+    delete mRenderer;
+}
+
+//! InheritPriority stands for the priority of the main thread, which starts the jobs
+static int effectivePriority( QThread::Priority priority )
+{
+  return priority == QThread::InheritPriority ? QThread::NormalPriority : priority;
+}
+
+void QgsMapRendererJob::run()
+{
+  if ( mCancelled )
+  {
+    QgsDebugMsg( "background rendering cancelled before it started" );
+    return;
+  }
+
+  // a layer may have lost its second provider since the job was created, e.g. after a join was added
+  if ( !canRenderInBackground( mRenderer ) )
+  {
+    QgsDebugMsg( "background rendering not possible anymore" );
+    return;
+  }
+
+  // jobs of lower priority (composer maps) do not keep this one waiting,
+  // their owners render them again when they have finished without an image
+  {
+    QMutexLocker locker( &sJobsMutex );
+    foreach( QgsMapRendererJob* job, sJobs )
+    {
+      if ( job != this && job->isRunning() && effectivePriority( job->priority() ) < effectivePriority( priority() ) )
+        job->cancel();
+    }
+  }
+
+  // layers rendered before for another extent are shown until they are rendered again
+  mComposited = 0;
+  QImage preview = mImage.copy();
+  QPainter previewPainter( &preview );
+  if ( mRenderer->drawLayerCachePreviews( &previewPainter ) > 0 )
+  {
+    previewPainter.end();
+    {
+      QMutexLocker locker( &mPreviewMutex );
+      mPreviewImage = preview;
+    }
+    emit previewAvailable();
+  }
+  else
+  {
+    previewPainter.end();
+  }
+
+  QPainter painter;
+  painter.begin( &mImage );
+  painter.setClipRect( mImage.rect() );
+  painter.setRenderHints( mRenderHints );
+
+  if ( mForceWidthScale > 0 )
+    mRenderer->render( &painter, &mForceWidthScale );
+  else
+    mRenderer->render( &painter );
+
+  painter.end();
+
+  mRendered = !mCancelled && !mRenderer->rendererContext()->renderingStopped();
+
+  QgsDebugMsg( "background rendering finished" );
+}
+
+void QgsMapRendererJob::cancel()
+{
+  mCancelled = true;
+  mRenderer->rendererContext()->setRenderingStopped( true );
+}
+
+void QgsMapRendererJob::restart( Priority priority )
+{
+  if ( isRunning() || mRendered )
+    return;
+
+  // creates the second providers deleted meanwhile, the owner renders in the main thread otherwise
+  if ( !canRenderInBackground( mRenderer ) )
+    return;
+
+  mCancelled = false;
+  mRenderer->rendererContext()->setRenderingStopped( false );
+  mImage = mBackground;
+  {
+    QMutexLocker locker( &mPreviewMutex );
+    mPreviewImage = mBackground;
+  }
+  start( priority );
+}
+
+void QgsMapRendererJob::cancelRunningJobs()
+{
+  QCoreApplication* app = QCoreApplication::instance();
+  if ( !app || QThread::currentThread() != app->thread() )
+    return;
+
+  // jobs take sJobsMutex when they start, so it is not held while waiting for them.
+  // Jobs are only created, started and deleted in the main thread
+  QList<QgsMapRendererJob*> jobs;
+  {
+    QMutexLocker locker( &sJobsMutex );
+    jobs = sJobs;
+  }
+
+  // jobs that have not started yet finish without rendering, see run()
+  foreach( QgsMapRendererJob* job, jobs )
+  {
+    if ( !job->isFinished() )
+      job->cancel();
+  }
+  foreach( QgsMapRendererJob* job, jobs )
+  {
+    job->wait();
+  }
+}
+
+QImage QgsMapRendererJob::previewImage()
+{
+  QMutexLocker locker( &mPreviewMutex );
+  return mPreviewImage;
+}
+
+void QgsMapRendererJob::storePreview()
+{
+  if ( QThread::currentThread() != this )
+    return;
+
+  // deep copy - the painter keeps writing into mImage.
+  // The layers above are shown from their cache images.
+  QImage preview = mImage.copy();
+  QPainter previewPainter( &preview );
+  mRenderer->drawLayerCachePreviews( &previewPainter, ++mComposited );
+  previewPainter.end();
+  {
+    QMutexLocker locker( &mPreviewMutex );
+    mPreviewImage = preview;
+  }
+  emit previewAvailable();
+}
+
+bool QgsMapRendererJob::canRenderInBackground( QgsMapLayer* layer )
+{
+  if ( layer->type() == QgsMapLayer::VectorLayer )
+  {
+    // the job reads from a second provider, the main thread keeps reading the layer meanwhile
+    QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( layer );
+    return vl && vl->prepareBackgroundRendering();
+  }
+  else if ( layer->type() == QgsMapLayer::RasterLayer )
+  {
+    QgsRasterLayer* rl = qobject_cast<QgsRasterLayer *>( layer );
+    return rl && rl->providerType() == "gdal";
+  }
+  return false;
+}
+
+bool QgsMapRendererJob::canRenderInBackground( QgsMapRenderer* renderer )
+{
+  foreach( QString layerId, renderer->layerSet() )
+  {
+    QgsMapLayer* ml = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( ml && !canRenderInBackground( ml ) )
+      return false;
+  }
+  return true;
+}
+
+bool QgsMapRendererJob::prefetchLayers( QgsMapRenderer* renderer )
+{
+  foreach( QString layerId, renderer->layerSet() )
+  {
+    QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( QgsMapLayerRegistry::instance()->mapLayer( layerId ) );
+    if ( !vl || !vl->dataProvider() || vl->providerType() != "WFS" )
+      continue;
+
+    double scale = renderer->scale();
+    if ( vl->hasScaleBasedVisibility() && ( vl->minimumScale() >= scale || scale >= vl->maximumScale() ) )
+      continue;
+
+    // the provider replaces the features other jobs may be drawing
+    cancelRunningJobs();
+
+    try
+    {
+      // network requests of the provider keep the event loop running
+      vl->dataProvider()->select( QgsAttributeList(), renderer->mapToLayerCoordinates( vl, renderer->extent() ), false );
+    }
+    catch ( QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+      QgsDebugMsg( QString( "Transform error caught: %1" ).arg( cse.what() ) );
+    }
+
+    if ( renderer->rendererContext()->renderingStopped() )
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,149 @@
+/***************************************************************************
+  qgsmaprendererjob.h - background rendering of a map layer set
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSMAPRENDERERJOB_H
+#define QGSMAPRENDERERJOB_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QPainter>
+#include <QThread>
+
+class QgsMapLayer;
+class QgsMapRenderer;
+
+/** \ingroup core
+ * Renders the layer set of a map renderer into an image in a background thread.
+ *
+ * The stop flag of the renderer's render context is used as cancellation token:
+ * cancel() sets it and the layers stop drawing at the next feature. Whenever a
+ * layer has been composited into the image, a copy of the partial result is
+ * stored and previewAvailable() is emitted, so the caller can show progress
+ * without the render loop having to process events. Layers not rendered yet
+ * are shown in the previews from their cache images, see
+ * QgsMapRenderer::drawLayerCachePreviews().
+ *
+ * A layer, and the layers sharing its database connection, are not drawn from two
+ * threads at once: renderers wait for each other per layer, other layers are drawn
+ * concurrently. A job cancelled while waiting for a layer stops rendering. Renderings
+ * in the main thread cancel the jobs they would wait for and a job cancels the running
+ * jobs of lower priority, the owners of the jobs render them again, see restart(). Jobs read
+ * vector layers from a second provider, so the main thread keeps reading the layers meanwhile.
+ * It does not change the layers while a job reads them: it cancels the running jobs first,
+ * see cancelRunningJobs().
+ * \note added in 1.9
+ */
+class CORE_EXPORT QgsMapRendererJob : public QThread
+{
+    Q_OBJECT
+
+  public:
+    //! Constructor. The image is used as background and must have the output size of the renderer
+    QgsMapRendererJob( QgsMapRenderer* renderer, const QImage& image, QPainter::RenderHints hints = 0 );
+    ~QgsMapRendererJob();
+
+    void run();
+
+    //! Request the rendering to stop. Returns immediately
+    void cancel();
+
+    //! Returns true if cancel() was called
+    //! @note added in 1.9
+    bool isCancelled() const { return mCancelled; }
+
+    //! Returns true once the image is complete, before finished() is emitted.
+    //! Cancelled renderings are never complete
+    //! @note added in 1.9
+    bool isRendered() const { return mRendered; }
+
+    //! Returns the renderer of the job
+    //! @note added in 1.9
+    QgsMapRenderer* renderer() const { return mRenderer; }
+
+    //! Deletes the renderer together with the job
+    //! @note added in 1.9
+    void setAutoDeleteRenderer( bool autoDelete ) { mAutoDeleteRenderer = autoDelete; }
+
+    /** Forces the scale factor of line widths and marker sizes, see QgsMapRenderer::render()
+     * @note added in 1.9 */
+    void setForceWidthScale( double scale ) { mForceWidthScale = scale; }
+
+    //! Returns a copy of the image with the layers rendered so far
+    QImage previewImage();
+
+    //! Returns the rendered image. Only valid once the thread has finished
+    const QImage& renderedImage() const { return mImage; }
+
+    /** Returns true if the layer does not depend on objects living in the
+     * main thread (network access, plugins) and may be rendered in a worker thread.
+     * Vector layers need a second provider, see QgsVectorLayer::prepareBackgroundRendering()
+     */
+    static bool canRenderInBackground( QgsMapLayer* layer );
+
+    //! Returns true if all layers of the renderer's layer set can be rendered in background
+    static bool canRenderInBackground( QgsMapRenderer* renderer );
+
+    /** Loads the features of the renderer's extent for layers whose providers fetch them
+     * over the network (WFS), so that the job draws them from memory. To be called in the
+     * main thread before the job is started. Returns false if the rendering was stopped
+     * meanwhile with the render context of the renderer.
+     * @note added in 1.9 */
+    static bool prefetchLayers( QgsMapRenderer* renderer );
+
+    /** Cancels the jobs that have not finished, including jobs not started yet, and waits
+     * until they stopped drawing. Called in the main thread before layers or data read by
+     * the jobs are changed, does nothing in other threads. The cancelled jobs finish without
+     * a rendered image, see restart().
+     * @note added in 1.9 */
+    static void cancelRunningJobs();
+
+    //! Renders the image again if the job has finished without it, e.g. after it was cancelled.
+    //! Does nothing if a layer cannot be rendered in background anymore, see canRenderInBackground()
+    //! @note added in 1.9
+    void restart( Priority priority = InheritPriority );
+
+  signals:
+    //! emitted from the rendering thread when a new preview image is available
+    void previewAvailable();
+
+  private slots:
+    //! called directly from the rendering thread when a layer has been composited
+    void storePreview();
+
+  private:
+    QgsMapRenderer* mRenderer;
+    QImage mImage;
+    //! the image the job was created with, rendered on again by restart()
+    QImage mBackground;
+    QPainter::RenderHints mRenderHints;
+
+    QImage mPreviewImage;
+    QMutex mPreviewMutex;
+
+    volatile bool mCancelled;
+    volatile bool mRendered;
+    bool mAutoDeleteRenderer;
+    //! 0 if the scale factor is calculated from the output dpi
+    double mForceWidthScale;
+    //! number of layers composited so far
+    int mComposited;
+
+    //! all existing jobs, guarded by sJobsMutex
+    static QList<QgsMapRendererJob*> sJobs;
+    static QMutex sJobsMutex;
+};
+
+#endif
@@ -144,6 +144,17 @@ void QgsMapToPixel::transformInPlace( std::vector<double>& x,
     transformInPlace( x[i], y[i] );
 }
 
+void QgsMapToPixel::transformInPlace( QPolygonF& poly ) const
+{
+  QPointF* p = poly.data();
+  QPointF* end = p + poly.size();
+  for ( ; p != end; ++p )
+  {
+    p->rx() = ( p->x() - xMin ) / mMapUnitsPerPixel;
+    p->ry() = yMax - ( p->y() - yMin ) / mMapUnitsPerPixel;
+  }
+}
+
 #ifdef ANDROID
 void QgsMapToPixel::transformInPlace( float& x, float& y ) const
 {
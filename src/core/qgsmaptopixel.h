@@ -18,6 +18,7 @@
 #define QGSMAPTOPIXEL
 
 #include "qgspoint.h"
+#include <QPolygonF>
 #include <vector>
 
 #include <cassert>
@@ -73,6 +74,11 @@ class CORE_EXPORT QgsMapToPixel
     void transformInPlace( std::vector<double>& x,
                            std::vector<double>& y ) const;
 
+    /* Transform all points of a polygon from map coordinates to device
+       coordinates in place.
+       @note added in 1.9 */
+    void transformInPlace( QPolygonF& poly ) const;
+
 #ifdef ANDROID
     void transformInPlace( float& x, float& y ) const;
     void transformInPlace( std::vector<float>& x,
@@ -33,8 +33,13 @@
 
 #include <QByteArray>
 #include <QString>
+#include <QStringList>
 #include <QFontMetrics>
+#include <QThread>
 #include <QTime>
+#if QT_VERSION >= 0x040800
+#include <QElapsedTimer>
+#endif
 #include <QPainter>
 
 #include "qgsdiagram.h"
@@ -47,6 +52,7 @@
 #include <qgsmaplayerregistry.h>
 #include <qgsvectordataprovider.h>
 #include <qgsgeometry.h>
+#include <qgsclipper.h>
 #include <qgsmaprenderer.h>
 #include <QMessageBox>
 
@@ -56,20 +62,20 @@ using namespace pal;
 class QgsPalGeometry : public PalGeometry
 {
   public:
-    QgsPalGeometry( QgsFeatureId id, QString text, GEOSGeometry* g )
+    QgsPalGeometry( QgsFeatureId id, QString text, QgsGeometry* g )
         : mG( g )
         , mText( text )
         , mId( id )
         , mInfo( NULL )
         , mIsDiagram( false )
+        , mObstacleOnly( false )
     {
       mStrId = FID_TO_STRING( id ).toAscii();
     }
 
     ~QgsPalGeometry()
     {
-      if ( mG )
-        GEOSGeom_destroy( mG );
+      delete mG;
       delete mInfo;
     }
 
@@ -77,7 +83,7 @@ class QgsPalGeometry : public PalGeometry
 
     GEOSGeometry* getGeosGeometry()
     {
-      return mG;
+      return mG->asGeos();
     }
     void releaseGeosGeometry( GEOSGeometry* /*geom*/ )
     {
@@ -86,6 +92,7 @@ class QgsPalGeometry : public PalGeometry
 
     const char* strId() { return mStrId.data(); }
     QString text() { return mText; }
+    QgsFeatureId featureId() const { return mId; }
 
     pal::LabelInfo* info( QFontMetricsF* fm, const QgsMapToPixel* xform, double fontScale )
     {
@@ -112,16 +119,21 @@ class QgsPalGeometry : public PalGeometry
     void setIsDiagram( bool d ) { mIsDiagram = d; }
     bool isDiagram() const { return mIsDiagram; }
 
+    //! the feature is registered without label, only as obstacle for the other labels
+    void setObstacleOnly( bool o ) { mObstacleOnly = o; }
+    bool isObstacleOnly() const { return mObstacleOnly; }
+
     void addDiagramAttribute( int index, QVariant value ) { mDiagramAttributes.insert( index, value ); }
     const QgsAttributeMap& diagramAttributes() { return mDiagramAttributes; }
 
   protected:
-    GEOSGeometry* mG;
+    QgsGeometry* mG;
     QString mText;
     QByteArray mStrId;
     QgsFeatureId mId;
     LabelInfo* mInfo;
     bool mIsDiagram;
+    bool mObstacleOnly;
     /**Stores attribute values for data defined properties*/
     QMap< QgsPalLayerSettings::DataDefinedProperties, QVariant > mDataDefinedValues;
 
@@ -132,7 +144,7 @@ class QgsPalGeometry : public PalGeometry
 // -------------
 
 QgsPalLayerSettings::QgsPalLayerSettings()
-    : palLayer( NULL ), fontMetrics( NULL ), ct( NULL ), extentGeom( NULL ), expression( NULL )
+    : palLayer( NULL ), fontMetrics( NULL ), ct( NULL ), extentGeom( NULL ), previousPlacements( NULL ), expression( NULL )
 {
   placement = AroundPoint;
   placementFlags = 0;
@@ -152,6 +164,7 @@ QgsPalLayerSettings::QgsPalLayerSettings()
   labelPerPart = false;
   mergeLines = false;
   minFeatureSize = 0.0;
+  validateClippedPolygons = true;
   vectorScaleFactor = 1.0;
   rasterCompressFactor = 1.0;
   addDirectionSymbol = false;
@@ -183,6 +196,7 @@ QgsPalLayerSettings::QgsPalLayerSettings( const QgsPalLayerSettings& s )
   labelPerPart = s.labelPerPart;
   mergeLines = s.mergeLines;
   minFeatureSize = s.minFeatureSize;
+  validateClippedPolygons = s.validateClippedPolygons;
   vectorScaleFactor = s.vectorScaleFactor;
   rasterCompressFactor = s.rasterCompressFactor;
   addDirectionSymbol = s.addDirectionSymbol;
@@ -194,6 +208,7 @@ QgsPalLayerSettings::QgsPalLayerSettings( const QgsPalLayerSettings& s )
   fontMetrics = NULL;
   ct = NULL;
   extentGeom = NULL;
+  previousPlacements = NULL;
   expression = NULL;
 }
 
@@ -329,6 +344,7 @@ void QgsPalLayerSettings::readFromLayer( QgsVectorLayer* layer )
   mergeLines = layer->customProperty( "labeling/mergeLines" ).toBool();
   addDirectionSymbol = layer->customProperty( "labeling/addDirectionSymbol" ).toBool();
   minFeatureSize = layer->customProperty( "labeling/minFeatureSize" ).toDouble();
+  validateClippedPolygons = layer->customProperty( "labeling/validateClippedPolygons", true ).toBool();
   fontSizeInMapUnits = layer->customProperty( "labeling/fontSizeInMapUnits" ).toBool();
   distInMapUnits = layer->customProperty( "labeling/distInMapUnits" ).toBool();
   wrapChar = layer->customProperty( "labeling/wrapChar" ).toString();
@@ -368,6 +384,7 @@ void QgsPalLayerSettings::writeToLayer( QgsVectorLayer* layer )
   layer->setCustomProperty( "labeling/mergeLines", mergeLines );
   layer->setCustomProperty( "labeling/addDirectionSymbol", addDirectionSymbol );
   layer->setCustomProperty( "labeling/minFeatureSize", minFeatureSize );
+  layer->setCustomProperty( "labeling/validateClippedPolygons", validateClippedPolygons );
   layer->setCustomProperty( "labeling/fontSizeInMapUnits", fontSizeInMapUnits );
   layer->setCustomProperty( "labeling/distInMapUnits", distInMapUnits );
   layer->setCustomProperty( "labeling/wrapChar", wrapChar );
@@ -459,6 +476,135 @@ void QgsPalLayerSettings::calculateLabelSize( const QFontMetricsF* fm, QString t
   labelY = qAbs( ptSize.y() - ptZero.y() );
 }
 
+static QPolygonF polylineToPolygonF( const QgsPolyline& line )
+{
+  QPolygonF pts( line.size() );
+  for ( int i = 0; i < line.size(); ++i )
+  {
+    pts[i] = QPointF( line[i].x(), line[i].y() );
+  }
+  return pts;
+}
+
+static QgsPolyline polygonFToPolyline( const QPolygonF& pts )
+{
+  QgsPolyline line( pts.size() );
+  for ( int i = 0; i < pts.size(); ++i )
+  {
+    line[i] = QgsPoint( pts[i].x(), pts[i].y() );
+  }
+  return line;
+}
+
+/**Returns the part of geom inside extent without the vertices that are closer than tolerance
+  to the previous vertex, or 0 if nothing of geom is inside extent
+  @param modified out: true if vertices were clipped or removed*/
+static QgsGeometry* labelGeometry( QgsGeometry* geom, const QgsRectangle& extent, double tolerance, bool& modified )
+{
+  bool clip = !extent.contains( geom->boundingBox() );
+  bool multi = geom->isMultipart();
+  modified = clip;
+
+  switch ( geom->type() )
+  {
+    case QGis::Point:
+    {
+      QgsMultiPoint points;
+      if ( multi )
+        points = geom->asMultiPoint();
+      else
+        points << geom->asPoint();
+
+      QgsMultiPoint visible;
+      foreach( const QgsPoint& point, points )
+      {
+        if ( !clip || extent.contains( point ) )
+          visible << point;
+      }
+
+      if ( visible.isEmpty() )
+        return 0;
+      return multi ? QgsGeometry::fromMultiPoint( visible ) : QgsGeometry::fromPoint( visible[0] );
+    }
+
+    case QGis::Line:
+    {
+      QgsMultiPolyline lines;
+      if ( multi )
+        lines = geom->asMultiPolyline();
+      else
+        lines << geom->asPolyline();
+
+      QgsMultiPolyline visible;
+      foreach( const QgsPolyline& line, lines )
+      {
+        QList<QPolygonF> parts;
+        if ( clip )
+          QgsClipper::clippedLineParts( polylineToPolygonF( line ), extent, parts );
+        else
+          parts << polylineToPolygonF( line );
+
+        for ( int i = 0; i < parts.size(); ++i )
+        {
+          int n = parts[i].size();
+          QgsClipper::simplifyPolyline( parts[i], tolerance, false );
+          modified = modified || parts[i].size() != n;
+          if ( parts[i].size() >= 2 )
+            visible << polygonFToPolyline( parts[i] );
+        }
+      }
+
+      if ( visible.isEmpty() )
+        return 0;
+      return multi || visible.size() > 1 ? QgsGeometry::fromMultiPolyline( visible ) : QgsGeometry::fromPolyline( visible[0] );
+    }
+
+    case QGis::Polygon:
+    {
+      QgsMultiPolygon polygons;
+      if ( multi )
+        polygons = geom->asMultiPolygon();
+      else
+        polygons << geom->asPolygon();
+
+      QgsMultiPolygon visible;
+      foreach( const QgsPolygon& polygon, polygons )
+      {
+        QgsPolygon rings;
+        for ( int i = 0; i < polygon.size(); ++i )
+        {
+          QPolygonF ring = polylineToPolygonF( polygon[i] );
+          int n = ring.size();
+          if ( clip )
+            QgsClipper::trimPolygon( ring, extent );
+          if ( ring.size() > 0 && ring.first() != ring.last() )
+            ring << ring.first();
+          QgsClipper::simplifyPolyline( ring, tolerance, true );
+          modified = modified || ring.size() != n;
+
+          if ( ring.size() < 4 )
+          {
+            if ( i == 0 )
+              break; // nothing left of the exterior ring
+            continue;
+          }
+          rings << polygonFToPolyline( ring );
+        }
+
+        if ( !rings.isEmpty() )
+          visible << rings;
+      }
+
+      if ( visible.isEmpty() )
+        return 0;
+      return multi || visible.size() > 1 ? QgsGeometry::fromMultiPolygon( visible ) : QgsGeometry::fromPolygon( visible[0] );
+    }
+
+    default:
+      return 0;
+  }
+}
+
 void QgsPalLayerSettings::registerFeature( QgsVectorLayer* layer,  QgsFeature& f, const QgsRenderContext& context )
 {
   QString labelText;
@@ -536,29 +682,32 @@ void QgsPalLayerSettings::registerFeature( QgsVectorLayer* layer,  QgsFeature& f
     return;
   }
 
-  // CLIP the geometry if it is bigger than the extent
-  QgsGeometry* geomClipped = NULL;
-  GEOSGeometry* geos_geom;
-  bool do_clip = !extentGeom->contains( geom );
-  if ( do_clip )
+  // pal only needs the visible part of the feature at the output resolution,
+  // so its GEOS geometry is built from that instead of the whole feature
+  bool modified;
+  QgsGeometry* labelGeom = labelGeometry( geom, extentGeom->boundingBox(), xform->mapUnitsPerPixel(), modified );
+  if ( !labelGeom )
   {
-    geomClipped = geom->intersection( extentGeom ); // creates new geometry
-    if ( !geomClipped )
+    return;
+  }
+  if ( validateClippedPolygons && modified && labelGeom->type() == QGis::Polygon && !labelGeom->isGeosValid() )
+  {
+    // clipping and simplifying may make rings touch, let GEOS clip such polygons
+    // (without the check pal repairs them). The GEOS geometry built for the check
+    // is kept by labelGeom and handed to pal.
+    delete labelGeom;
+    labelGeom = geom->intersection( extentGeom ); // creates new geometry
+    if ( !labelGeom )
     {
       return;
     }
-    geos_geom = geomClipped->asGeos();
-  }
-  else
-  {
-    geos_geom = geom->asGeos();
   }
 
-  if ( geos_geom == NULL )
+  if ( labelGeom->asGeos() == NULL )
+  {
+    delete labelGeom;
     return; // invalid geometry
-  GEOSGeometry* geos_geom_clone = GEOSGeom_clone( geos_geom );
-  if ( do_clip )
-    delete geomClipped;
+  }
 
   //data defined position / alignment / rotation?
   bool dataDefinedPosition = false;
@@ -654,7 +803,63 @@ void QgsPalLayerSettings::registerFeature( QgsVectorLayer* layer,  QgsFeature& f
     }
   }
 
-  QgsPalGeometry* lbl = new QgsPalGeometry( f.id(), labelText, geos_geom_clone );
+  bool obstacleOnly = false;
+  if ( !placements.key.isEmpty() )
+  {
+    QgsLabelPlacementCache::Label& cached = placements.labels[ f.id()];
+    cached.text = labelText;
+    cached.width = labelX;
+    cached.height = labelY;
+    cached.geometryHash = qHash( QByteArray::fromRawData(( const char* ) geom->asWkb(), geom->wkbSize() ) );
+    cached.placed = false;
+
+    // the feature and its label did not change since the last rendering at this scale
+    QHash<QgsFeatureId, QgsLabelPlacementCache::Label>::const_iterator prevIt;
+    if ( previousPlacements && !dataDefinedPosition
+         && ( prevIt = previousPlacements->labels.constFind( f.id() ) ) != previousPlacements->labels.constEnd()
+         && prevIt->text == cached.text && prevIt->width == labelX && prevIt->height == labelY
+         && prevIt->geometryHash == cached.geometryHash )
+    {
+      if ( prevIt->placed )
+      {
+        // keep a label that is still entirely visible where it was. It still takes part
+        // in the conflict resolution with its position as only candidate.
+        if ( extentGeom->boundingBox().contains( prevIt->rect ) )
+        {
+          dataDefinedPosition = true;
+          dataDefinedRotation = true;
+          xPos = prevIt->x;
+          yPos = prevIt->y;
+          angle = prevIt->angle;
+        }
+      }
+      else
+      {
+        // a label that was hidden by its neighbours stays hidden unless it is near
+        // the newly exposed area, the feature is then only an obstacle
+        QgsRectangle unchanged = extentGeom->boundingBox().intersect( &previousPlacements->extent );
+        double margin = previousPlacements->margin;
+        if ( !unchanged.isEmpty() && unchanged.width() > 2 * margin && unchanged.height() > 2 * margin )
+        {
+          unchanged.set( unchanged.xMinimum() + margin, unchanged.yMinimum() + margin,
+                         unchanged.xMaximum() - margin, unchanged.yMaximum() - margin );
+          if ( unchanged.contains( geom->boundingBox() ) )
+          {
+            obstacleOnly = true;
+          }
+        }
+      }
+    }
+  }
+
+  QgsPalGeometry* lbl = new QgsPalGeometry( f.id(), labelText, labelGeom );
+  if ( obstacleOnly )
+  {
+    // pal generates no candidates for an empty label, the feature stays an obstacle
+    lbl->setObstacleOnly( true );
+    labelX = 0;
+    labelY = 0;
+  }
 
   // record the created geometry - it will be deleted at the end.
   geometries.append( lbl );
@@ -726,8 +931,26 @@ int QgsPalLayerSettings::sizeToPixel( double size, const QgsRenderContext& c ) c
 
 // -------------
 
+/**Adds the time until it is destroyed to a counter in ms. Registering a single feature
+  mostly takes less than a millisecond, so a finer clock than QTime is used if available*/
+class QgsPalLabelingTimer
+{
+  public:
+    QgsPalLabelingTimer( double& total ) : mTotal( total ) { mTimer.start(); }
+#if QT_VERSION >= 0x040800
+    ~QgsPalLabelingTimer() { mTotal += mTimer.nsecsElapsed() / 1000000.0; }
+  private:
+    QElapsedTimer mTimer;
+#else
+    ~QgsPalLabelingTimer() { mTotal += mTimer.elapsed(); }
+  private:
+    QTime mTimer;
+#endif
+    double& mTotal;
+};
+
 QgsPalLabeling::QgsPalLabeling()
-    : mMapRenderer( NULL ), mPal( NULL )
+    : mMapRenderer( NULL ), mPal( NULL ), mPreparationTime( 0 ), mPlacementTime( 0 ), mDrawingTime( 0 )
 {
 
   // find out engine defaults
@@ -747,6 +970,8 @@ QgsPalLabeling::QgsPalLabeling()
 
   mShowingCandidates = false;
   mShowingAllLabels = false;
+  mThreadCount = qMax( QThread::idealThreadCount(), 1 );
+  mCachingPlacements = true;
 
   mLabelSearchTree = new QgsLabelSearchTree();
 }
@@ -873,6 +1098,20 @@ int QgsPalLabeling::prepareLayer( QgsVectorLayer* layer, QSet<int>& attrIndices,
   // rect for clipping
   lyr.extentGeom = QgsGeometry::fromRect( mMapRenderer->extent() );
 
+  // curved labels, labels per part or of merged lines and direction symbols
+  // depend on more than the feature and its fixed position
+  if ( mCachingPlacements && !layer->isEditable()
+       && lyr.placement != QgsPalLayerSettings::Curved && !lyr.labelPerPart
+       && !lyr.mergeLines && !lyr.addDirectionSymbol )
+  {
+    lyr.placements.key = placementKey( lyr, ctx );
+    lyr.placements.extent = mMapRenderer->extent();
+
+    QHash<QString, QgsLabelPlacementCache>::const_iterator cacheIt = mPlacementCache.constFind( layer->id() );
+    if ( cacheIt != mPlacementCache.constEnd() && cacheIt->key == lyr.placements.key )
+      lyr.previousPlacements = &cacheIt.value();
+  }
+
   return 1; // init successful
 }
 
@@ -893,12 +1132,15 @@ int QgsPalLabeling::addDiagramLayer( QgsVectorLayer* layer, QgsDiagramLayerSetti
 
 void QgsPalLabeling::registerFeature( QgsVectorLayer* layer, QgsFeature& f, const QgsRenderContext& context )
 {
+  QgsPalLabelingTimer timer( mPreparationTime );
   QgsPalLayerSettings& lyr = mActiveLayers[layer];
   lyr.registerFeature( layer, f, context );
 }
 
 void QgsPalLabeling::registerDiagramFeature( QgsVectorLayer* layer, QgsFeature& feat, const QgsRenderContext& context )
 {
+  QgsPalLabelingTimer timer( mPreparationTime );
+
   //get diagram layer settings, diagram renderer
   QHash<QgsVectorLayer*, QgsDiagramLayerSettings>::iterator layerIt = mActiveDiagramLayers.find( layer );
   if ( layerIt == mActiveDiagramLayers.constEnd() )
@@ -921,7 +1163,9 @@ void QgsPalLabeling::registerDiagramFeature( QgsVectorLayer* layer, QgsFeature&
   }
 
   //create PALGeometry with diagram = true
-  QgsPalGeometry* lbl = new QgsPalGeometry( feat.id(), "", GEOSGeom_clone( geos_geom ) );
+  QgsGeometry* diagramGeom = new QgsGeometry();
+  diagramGeom->fromGeos( GEOSGeom_clone( geos_geom ) );
+  QgsPalGeometry* lbl = new QgsPalGeometry( feat.id(), "", diagramGeom );
   lbl->setIsDiagram( true );
 
   // record the created geometry - it will be deleted at the end.
@@ -1023,8 +1267,14 @@ void QgsPalLabeling::init( QgsMapRenderer* mr )
   mPal->setLineP( mCandLine );
   mPal->setPolyP( mCandPolygon );
 
+  mPal->setThreadCount( mThreadCount );
+
   mActiveLayers.clear();
   mActiveDiagramLayers.clear();
+
+  mPreparationTime = 0;
+  mPlacementTime = 0;
+  mDrawingTime = 0;
 }
 
 void QgsPalLabeling::exit()
@@ -1105,7 +1355,9 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
   // find the solution
   labels = mPal->solveProblem( problem, mShowingAllLabels );
 
-  QgsDebugMsg( QString( "LABELING work:  %1 ms ... labels# %2" ).arg( t.elapsed() ).arg( labels->size() ) );
+  mPlacementTime = t.elapsed();
+  QgsDebugMsg( QString( "LABELING prepare:  %1 ms" ).arg( mPreparationTime ) );
+  QgsDebugMsg( QString( "LABELING work:  %1 ms ... labels# %2" ).arg( mPlacementTime ).arg( labels->size() ) );
   t.restart();
 
   painter->setRenderHint( QPainter::Antialiasing );
@@ -1115,7 +1367,7 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
   for ( ; it != labels->end(); ++it )
   {
     QgsPalGeometry* palGeometry = dynamic_cast< QgsPalGeometry* >(( *it )->getFeaturePart()->getUserGeometry() );
-    if ( !palGeometry )
+    if ( !palGeometry || palGeometry->isObstacleOnly() )
     {
       continue;
     }
@@ -1146,7 +1398,19 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
       continue;
     }
 
-    const QgsPalLayerSettings& lyr = layer( layerNameUtf8 );
+    QgsPalLayerSettings& lyr = layer( layerNameUtf8 );
+    if ( !lyr.placements.key.isEmpty() )
+    {
+      QgsLabelPlacementCache::Label& cached = lyr.placements.labels[ palGeometry->featureId()];
+      cached.placed = true;
+      cached.x = ( *it )->getX();
+      cached.y = ( *it )->getY();
+      cached.angle = ( *it )->getAlpha();
+      double amin[2], amax[2];
+      ( *it )->getBoundingBox( amin, amax );
+      cached.rect = QgsRectangle( amin[0], amin[1], amax[0], amax[1] );
+    }
+
     QFont fontForLabel = lyr.textFont;
     QColor fontColor = lyr.textColor;
     double bufferSize = lyr.bufferSize;
@@ -1228,16 +1492,52 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
     }
   }
 
-  QgsDebugMsg( QString( "LABELING draw:  %1 ms" ).arg( t.elapsed() ) );
+  mDrawingTime = t.elapsed();
+  QgsDebugMsg( QString( "LABELING draw:  %1 ms" ).arg( mDrawingTime ) );
 
   delete problem;
   delete labels;
 
-  // delete all allocated geometries for features
+  // keep the placements for the next rendering. A layer being edited may hide or
+  // uncover the labels of other layers, so nothing is kept while editing.
+  mPlacementCache.clear();
+  bool caching = mCachingPlacements && !context.renderingStopped();
   QHash<QgsVectorLayer*, QgsPalLayerSettings>::iterator lit;
+  for ( lit = mActiveLayers.begin(); caching && lit != mActiveLayers.end(); ++lit )
+  {
+    if ( lit.key()->isEditable() )
+      caching = false;
+  }
+
+  if ( caching )
+  {
+    // hidden labels are placed again when they are as close to the newly exposed area
+    // as two labels can be for their candidates to overlap
+    double margin = 0;
+    for ( lit = mActiveLayers.begin(); lit != mActiveLayers.end(); ++lit )
+    {
+      const QgsPalLayerSettings& lyr = lit.value();
+      if ( lyr.placements.key.isEmpty() )
+        continue;
+
+      QHash<QgsFeatureId, QgsLabelPlacementCache::Label>::const_iterator labelIt = lyr.placements.labels.constBegin();
+      for ( ; labelIt != lyr.placements.labels.constEnd(); ++labelIt )
+        margin = qMax( margin, 2 * qMax( labelIt->width, labelIt->height ) );
+
+      mPlacementCache.insert( lit.key()->id(), lyr.placements );
+    }
+
+    QHash<QString, QgsLabelPlacementCache>::iterator cacheIt = mPlacementCache.begin();
+    for ( ; cacheIt != mPlacementCache.end(); ++cacheIt )
+      cacheIt->margin = margin;
+  }
+
+  // delete all allocated geometries for features
   for ( lit = mActiveLayers.begin(); lit != mActiveLayers.end(); ++lit )
   {
     QgsPalLayerSettings& lyr = lit.value();
+    lyr.previousPlacements = NULL;
+    lyr.placements = QgsLabelPlacementCache();
     for ( QList<QgsPalGeometry*>::iterator git = lyr.geometries.begin(); git != lyr.geometries.end(); ++git )
       delete *git;
     lyr.geometries.clear();
@@ -1402,5 +1702,43 @@ QgsLabelingEngineInterface* QgsPalLabeling::clone()
   QgsPalLabeling* lbl = new QgsPalLabeling();
   lbl->mShowingAllLabels = mShowingAllLabels;
   lbl->mShowingCandidates = mShowingCandidates;
+  lbl->mThreadCount = mThreadCount;
+  lbl->mCachingPlacements = mCachingPlacements;
   return lbl;
 }
+
+void QgsPalLabeling::setCachingPlacements( bool caching )
+{
+  mCachingPlacements = caching;
+  if ( !caching )
+    mPlacementCache.clear();
+}
+
+QString QgsPalLabeling::placementKey( const QgsPalLayerSettings& lyr, const QgsRenderContext& ctx ) const
+{
+  QStringList key;
+  key << lyr.fieldName << QString::number( lyr.isExpression )
+  << QString::number( lyr.placement ) << QString::number( lyr.placementFlags )
+  << lyr.textFont.toString() << QString::number( lyr.textFont.pixelSize() )
+  << QString::number( lyr.priority ) << QString::number( lyr.obstacle )
+  << QString::number( lyr.dist, 'g', 12 ) << QString::number( lyr.distInMapUnits )
+  << QString::number( lyr.scaleMin ) << QString::number( lyr.scaleMax )
+  << QString::number( lyr.minFeatureSize, 'g', 12 ) << QString::number( lyr.validateClippedPolygons )
+  << QString::number( lyr.fontSizeInMapUnits )
+  << QString::number( lyr.formatNumbers ) << QString::number( lyr.decimals ) << QString::number( lyr.plusSign )
+  << lyr.wrapChar;
+
+  QMap< QgsPalLayerSettings::DataDefinedProperties, int >::const_iterator dIt = lyr.dataDefinedProperties.constBegin();
+  for ( ; dIt != lyr.dataDefinedProperties.constEnd(); ++dIt )
+    key << QString( "%1:%2" ).arg( dIt.key() ).arg( dIt.value() );
+
+  // engine settings, output scale and map
+  key << QString::number( mCandPoint ) << QString::number( mCandLine ) << QString::number( mCandPolygon )
+  << QString::number( mSearch ) << QString::number( mShowingAllLabels )
+  << QString::number( ctx.scaleFactor(), 'g', 12 ) << QString::number( ctx.rasterScaleFactor(), 'g', 12 )
+  << QString::number( mMapRenderer->mapUnitsPerPixel(), 'g', 12 )
+  << QString::number( mMapRenderer->hasCrsTransformEnabled() )
+  << QString::number( mMapRenderer->destinationCrs().srsid() );
+
+  return key.join( "|" );
+}
@@ -47,13 +47,50 @@ namespace pal
 class QgsMapToPixel;
 class QgsFeature;
 
+#include "qgsfeature.h"
 #include "qgspoint.h"
+#include "qgsrectangle.h"
 #include "qgsmaprenderer.h" // definition of QgsLabelingEngineInterface
 #include "qgsexpression.h"
 
 class QgsPalGeometry;
 class QgsVectorLayer;
 
+/** \ingroup core
+  * Labels of the features of a layer placed in a rendering. The labeling engine
+  * keeps them to place the labels of the next rendering at the same scale
+  * without solving all label conflicts again.
+  * @note added in 1.9
+  */
+class CORE_EXPORT QgsLabelPlacementCache
+{
+  public:
+    QgsLabelPlacementCache(): margin( 0 ) {}
+
+    struct Label
+    {
+      QString text;
+      //! label size in map units
+      double width, height;
+      //! hash of the feature geometry in map coordinates
+      uint geometryHash;
+      //! whether the label was drawn
+      bool placed;
+      //! lower left corner and rotation of a placed label
+      double x, y, angle;
+      //! bounding box of a placed label
+      QgsRectangle rect;
+    };
+
+    //! settings and scale the labels were placed with
+    QString key;
+    //! map extent of the rendering
+    QgsRectangle extent;
+    //! distance from the extent border within which hidden labels are placed again
+    double margin;
+    QHash<QgsFeatureId, Label> labels;
+};
+
 class CORE_EXPORT QgsPalLayerSettings
 {
   public:
@@ -127,6 +164,12 @@ class CORE_EXPORT QgsPalLayerSettings
     bool labelPerPart; // whether to label every feature's part or only the biggest one
     bool mergeLines;
     double minFeatureSize; // minimum feature size to be labelled (in mm)
+    /**Whether polygons that were clipped to the map extent or simplified are checked with GEOS
+      and clipped by GEOS instead if they became invalid. Without the check pal repairs such
+      polygons with a zero buffer and labels their biggest part, which saves a validity test
+      per modified polygon.
+      @note added in 1.9 */
+    bool validateClippedPolygons;
     // Adds '<' or '>' to the label string pointing to the direction of the line / polygon ring
     // Works only if Placement == Line
     bool addDirectionSymbol;
@@ -156,6 +199,10 @@ class CORE_EXPORT QgsPalLayerSettings
     QgsPoint ptZero, ptOne;
     QList<QgsPalGeometry*> geometries;
     QgsGeometry* extentGeom;
+    //! placements of the previous rendering to reuse, NULL if there are none
+    const QgsLabelPlacementCache* previousPlacements;
+    //! placements of this rendering, not recorded if the key is empty
+    QgsLabelPlacementCache placements;
 
     /**Stores field indices for data defined layer properties*/
     QMap< DataDefinedProperties, int > dataDefinedProperties;
@@ -205,6 +252,32 @@ class CORE_EXPORT QgsPalLabeling : public QgsLabelingEngineInterface
     bool isShowingAllLabels() const { return mShowingAllLabels; }
     void setShowingAllLabels( bool showing ) { mShowingAllLabels = showing; }
 
+    //! number of threads generating label candidates and optimizing the placement
+    //! @note added in 1.9
+    int threadCount() const { return mThreadCount; }
+    //! set the number of labeling threads, 1 labels in the rendering thread only.
+    //! The label placement is the same for any number of threads
+    //! @note added in 1.9
+    void setThreadCount( int count ) { mThreadCount = qMax( count, 1 ); }
+
+    //! whether labels placed in the last rendering are reused when the map is
+    //! panned at the same scale
+    //! @note added in 1.9
+    bool isCachingPlacements() const { return mCachingPlacements; }
+    //! enable or disable reusing the label placements of the last rendering
+    //! @note added in 1.9
+    void setCachingPlacements( bool caching );
+
+    //! time in ms spent registering the features of the current or last rendering
+    //! @note added in 1.9
+    double preparationTime() const { return mPreparationTime; }
+    //! time in ms spent placing the labels of the last rendering
+    //! @note added in 1.9
+    double placementTime() const { return mPlacementTime; }
+    //! time in ms spent drawing the labels of the last rendering
+    //! @note added in 1.9
+    double drawingTime() const { return mDrawingTime; }
+
     // implemented methods from labeling engine interface
 
     //! called when we're going to start with rendering
@@ -238,6 +311,9 @@ class CORE_EXPORT QgsPalLabeling : public QgsLabelingEngineInterface
 
     void initPal();
 
+    //! identifies the settings and scale the labels of a layer are placed with
+    QString placementKey( const QgsPalLayerSettings& lyr, const QgsRenderContext& ctx ) const;
+
   protected:
     // hashtable of layer settings, being filled during labeling
     QHash<QgsVectorLayer*, QgsPalLayerSettings> mActiveLayers;
@@ -257,7 +333,18 @@ class CORE_EXPORT QgsPalLabeling : public QgsLabelingEngineInterface
 
     bool mShowingAllLabels; // whether to avoid collisions or not
 
+    int mThreadCount;
+
+    bool mCachingPlacements;
+    // label placements of the last rendering by layer id
+    QHash<QString, QgsLabelPlacementCache> mPlacementCache;
+
     QgsLabelSearchTree* mLabelSearchTree;
+
+    // labeling stats of the current / last rendering
+    double mPreparationTime;
+    double mPlacementTime;
+    double mDrawingTime;
 };
 
 #endif // QGSPALLABELING_H
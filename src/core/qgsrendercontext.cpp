@@ -26,7 +26,8 @@ QgsRenderContext::QgsRenderContext()
     mRenderingStopped( false ),
     mScaleFactor( 1.0 ),
     mRasterScaleFactor( 1.0 ),
-    mLabelingEngine( NULL )
+    mLabelingEngine( NULL ),
+    mSimplifyTolerance( 0.0 )
 {
 
 }
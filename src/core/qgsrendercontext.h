@@ -64,6 +64,9 @@ class CORE_EXPORT QgsRenderContext
     //! Added in QGIS v1.4
     QgsLabelingEngineInterface* labelingEngine() const { return mLabelingEngine; }
 
+    //! Distance in device pixels below which vertices are merged when drawing, 0 if disabled. Added in QGIS v1.9
+    double simplifyTolerance() const { return mSimplifyTolerance; }
+
     //setters
 
     /**Sets coordinate transformation. QgsRenderContext takes ownership and deletes if necessary*/
@@ -80,6 +83,8 @@ class CORE_EXPORT QgsRenderContext
     void setForceVectorOutput( bool force ) {mForceVectorOutput = force;}
     //! Added in QGIS v1.4
     void setLabelingEngine( QgsLabelingEngineInterface* iface ) { mLabelingEngine = iface; }
+    //! Added in QGIS v1.9
+    void setSimplifyTolerance( double tolerance ) { mSimplifyTolerance = tolerance; }
 
   private:
 
@@ -113,6 +118,9 @@ class CORE_EXPORT QgsRenderContext
 
     /**Labeling engine (can be NULL)*/
     QgsLabelingEngineInterface* mLabelingEngine;
+
+    /**Vertices closer than this number of device pixels are merged when drawing, 0 to draw all vertices*/
+    double mSimplifyTolerance;
 };
 
 #endif
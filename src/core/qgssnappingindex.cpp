@@ -0,0 +1,324 @@
+/***************************************************************************
+  qgssnappingindex.cpp - vertex and segment index for snapping
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgssnappingindex.h"
+#include "qgsrectangle.h"
+#include "qgsspatialindex.h"
+
+#include <QMap>
+
+#include <cmath>
+#include <limits>
+
+// closest vertex and segment of a geometry found by a snapping query
+struct Closest
+{
+  double sqrVertexDist;
+  int vertex;
+  double sqrSegmentDist;
+  int segmentTo;
+  QgsPoint segmentPoint;
+};
+
+// feeds all segments to the bulk loader
+class QgsSnappingIndex::SegmentSource : public QgsSpatialIndex::EntrySource
+{
+  public:
+    SegmentSource( const QgsSnappingIndex& index )
+        : mIndex( index ), mIt( index.mSegments.constBegin() ) {}
+
+    bool nextEntry( QgsFeatureId& id, QgsRectangle& rect )
+    {
+      if ( mIt == mIndex.mSegments.constEnd() )
+        return false;
+
+      id = mIt.key();
+      rect = segmentRect( mIndex.mGeometries[ mIt->fid ], *mIt );
+      ++mIt;
+      return true;
+    }
+
+  private:
+    const QgsSnappingIndex& mIndex;
+    QHash<qint64, Segment>::const_iterator mIt;
+};
+
+QgsSnappingIndex::QgsSnappingIndex()
+    : mNextEntry( 0 )
+{
+  mIndex = new QgsSpatialIndex();
+}
+
+QgsSnappingIndex::QgsSnappingIndex( QgsGeometryMap& geometries )
+    : mIndex( 0 )
+    , mNextEntry( 0 )
+{
+  QgsGeometryMap::iterator it = geometries.begin();
+  for ( ; it != geometries.end(); ++it )
+  {
+    Vertices vertices;
+    addVertices( it.key(), &it.value(), vertices );
+    if ( !vertices.entries.isEmpty() )
+      mGeometries.insert( it.key(), vertices );
+  }
+
+  SegmentSource source( *this );
+  mIndex = new QgsSpatialIndex( source );
+}
+
+QgsSnappingIndex::~QgsSnappingIndex()
+{
+  delete mIndex;
+}
+
+void QgsSnappingIndex::addGeometry( QgsFeatureId fid, QgsGeometry* geometry )
+{
+  removeGeometry( fid );
+
+  if ( !geometry )
+    return;
+
+  Vertices vertices;
+  addVertices( fid, geometry, vertices );
+  if ( !vertices.entries.isEmpty() )
+    mGeometries.insert( fid, vertices );
+}
+
+void QgsSnappingIndex::removeGeometry( QgsFeatureId fid )
+{
+  QHash<QgsFeatureId, Vertices>::iterator it = mGeometries.find( fid );
+  if ( it == mGeometries.end() )
+    return;
+
+  foreach( qint64 entry, it->entries )
+  {
+    mIndex->deleteEntry( entry, segmentRect( *it, mSegments[ entry ] ) );
+    mSegments.remove( entry );
+  }
+  mGeometries.erase( it );
+}
+
+void QgsSnappingIndex::addVertices( QgsFeatureId fid, QgsGeometry* geometry, Vertices& vertices )
+{
+  switch ( geometry->type() )
+  {
+    case QGis::Point:
+    {
+      QgsMultiPoint points;
+      if ( geometry->isMultipart() )
+        points = geometry->asMultiPoint();
+      else
+        points << geometry->asPoint();
+
+      foreach( const QgsPoint& point, points )
+      {
+        vertices.points << point;
+        vertices.before << -1;
+        vertices.after << -1;
+        int vertex = vertices.points.size() - 1;
+        addSegment( fid, vertex, vertex, vertices );
+      }
+      break;
+    }
+
+    case QGis::Line:
+    {
+      QgsMultiPolyline lines;
+      if ( geometry->isMultipart() )
+        lines = geometry->asMultiPolyline();
+      else
+        lines << geometry->asPolyline();
+
+      foreach( const QgsPolyline& line, lines )
+        addPart( fid, line, false, vertices );
+      break;
+    }
+
+    case QGis::Polygon:
+    {
+      QgsMultiPolygon polygons;
+      if ( geometry->isMultipart() )
+        polygons = geometry->asMultiPolygon();
+      else
+        polygons << geometry->asPolygon();
+
+      foreach( const QgsPolygon& polygon, polygons )
+      {
+        foreach( const QgsPolyline& ring, polygon )
+          addPart( fid, ring, true, vertices );
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+void QgsSnappingIndex::addPart( QgsFeatureId fid, const QgsPolyline& part, bool ring, Vertices& vertices )
+{
+  int first = vertices.points.size();
+  int n = part.size();
+
+  for ( int i = 0; i < n; ++i )
+  {
+    int vertex = first + i;
+    vertices.points << part[i];
+
+    // same neighbours as QgsGeometry::adjacentVertices(), rings wrap around their closing vertex
+    if ( ring && n > 2 && i == 0 )
+    {
+      vertices.before << first + n - 2;
+      vertices.after << vertex + 1;
+    }
+    else if ( ring && n > 2 && i == n - 1 )
+    {
+      vertices.before << vertex - 1;
+      vertices.after << first + 1;
+    }
+    else
+    {
+      vertices.before << ( i == 0 ? -1 : vertex - 1 );
+      vertices.after << ( i == n - 1 ? -1 : vertex + 1 );
+    }
+
+    if ( i > 0 )
+      addSegment( fid, vertex - 1, vertex, vertices );
+  }
+
+  // degenerate parts can still be snapped to as vertices
+  if ( n == 1 )
+    addSegment( fid, first, first, vertices );
+}
+
+void QgsSnappingIndex::addSegment( QgsFeatureId fid, int from, int to, Vertices& vertices )
+{
+  Segment segment;
+  segment.fid = fid;
+  segment.from = from;
+  segment.to = to;
+
+  qint64 entry = mNextEntry++;
+  mSegments.insert( entry, segment );
+  vertices.entries << entry;
+
+  // while bulk loading the index is created from mSegments afterwards
+  if ( mIndex )
+    mIndex->insertEntry( entry, segmentRect( vertices, segment ) );
+}
+
+QgsRectangle QgsSnappingIndex::segmentRect( const Vertices& vertices, const Segment& segment )
+{
+  const QgsPoint& p1 = vertices.points[ segment.from ];
+  const QgsPoint& p2 = vertices.points[ segment.to ];
+  return QgsRectangle( p1.x(), p1.y(), p2.x(), p2.y() );
+}
+
+int QgsSnappingIndex::snap( const QgsPoint& startPoint, double snappingTolerance,
+                            QMultiMap<double, QgsSnappingResult>& snappingResults,
+                            QgsSnapper::SnappingType snap_to, const QgsVectorLayer* layer )
+{
+  QgsRectangle searchRect( startPoint.x() - snappingTolerance, startPoint.y() - snappingTolerance,
+                           startPoint.x() + snappingTolerance, startPoint.y() + snappingTolerance );
+  double sqrSnappingTolerance = snappingTolerance * snappingTolerance;
+
+  bool toVertex = snap_to == QgsSnapper::SnapToVertex || snap_to == QgsSnapper::SnapToVertexAndSegment;
+  bool toSegment = snap_to == QgsSnapper::SnapToSegment || snap_to == QgsSnapper::SnapToVertexAndSegment;
+
+  // closest vertex and segment of each geometry among the segments in the search rectangle.
+  // Ties go to the lower vertex number like in QgsGeometry.
+  QMap<QgsFeatureId, Closest> closest;
+
+  foreach( QgsFeatureId entry, mIndex->intersects( searchRect ) )
+  {
+    const Segment& segment = mSegments[ entry ];
+    const Vertices& vertices = mGeometries[ segment.fid ];
+
+    QMap<QgsFeatureId, Closest>::iterator it = closest.find( segment.fid );
+    if ( it == closest.end() )
+    {
+      Closest c;
+      c.sqrVertexDist = std::numeric_limits<double>::max();
+      c.vertex = -1;
+      c.sqrSegmentDist = std::numeric_limits<double>::max();
+      c.segmentTo = -1;
+      it = closest.insert( segment.fid, c );
+    }
+
+    if ( toVertex )
+    {
+      int ends[2] = { segment.from, segment.to };
+      for ( int i = 0; i < 2; ++i )
+      {
+        double d = startPoint.sqrDist( vertices.points[ ends[i] ] );
+        if ( d < it->sqrVertexDist || ( d == it->sqrVertexDist && ends[i] < it->vertex ) )
+        {
+          it->sqrVertexDist = d;
+          it->vertex = ends[i];
+        }
+      }
+    }
+
+    if ( toSegment && segment.from != segment.to )
+    {
+      const QgsPoint& p1 = vertices.points[ segment.from ];
+      const QgsPoint& p2 = vertices.points[ segment.to ];
+      QgsPoint distPoint;
+      double d = startPoint.sqrDistToSegment( p1.x(), p1.y(), p2.x(), p2.y(), distPoint );
+      if ( d < it->sqrSegmentDist || ( d == it->sqrSegmentDist && segment.to < it->segmentTo ) )
+      {
+        it->sqrSegmentDist = d;
+        it->segmentTo = segment.to;
+        it->segmentPoint = distPoint;
+      }
+    }
+  }
+
+  QMap<QgsFeatureId, Closest>::const_iterator it = closest.constBegin();
+  for ( ; it != closest.constEnd(); ++it )
+  {
+    const Vertices& vertices = mGeometries[ it.key()];
+
+    QgsSnappingResult result;
+    result.snappedAtGeometry = it.key();
+    result.layer = layer;
+
+    // a vertex within the tolerance wins over the segments, as in QgsVectorLayer::snapToGeometry()
+    if ( toVertex && it->vertex >= 0 && it->sqrVertexDist < sqrSnappingTolerance )
+    {
+      result.snappedVertex = vertices.points[ it->vertex ];
+      result.snappedVertexNr = it->vertex;
+      result.beforeVertexNr = vertices.before[ it->vertex ];
+      if ( result.beforeVertexNr != -1 )
+        result.beforeVertex = vertices.points[ result.beforeVertexNr ];
+      result.afterVertexNr = vertices.after[ it->vertex ];
+      if ( result.afterVertexNr != -1 )
+        result.afterVertex = vertices.points[ result.afterVertexNr ];
+      snappingResults.insert( sqrt( it->sqrVertexDist ), result );
+    }
+    else if ( toSegment && it->segmentTo >= 0 && it->sqrSegmentDist < sqrSnappingTolerance )
+    {
+      result.snappedVertex = it->segmentPoint;
+      result.snappedVertexNr = -1;
+      result.beforeVertexNr = it->segmentTo - 1;
+      result.beforeVertex = vertices.points[ it->segmentTo - 1 ];
+      result.afterVertexNr = it->segmentTo;
+      result.afterVertex = vertices.points[ it->segmentTo ];
+      snappingResults.insert( sqrt( it->sqrSegmentDist ), result );
+    }
+  }
+
+  return closest.size();
+}
@@ -0,0 +1,114 @@
+/***************************************************************************
+  qgssnappingindex.h - vertex and segment index for snapping
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSNAPPINGINDEX_H
+#define QGSSNAPPINGINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QMultiMap>
+#include <QVector>
+
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgspoint.h"
+#include "qgssnapper.h"
+
+class QgsSpatialIndex;
+class QgsVectorLayer;
+
+/** \ingroup core
+ * Spatial index of the segments of a set of geometries that answers the
+ * snapping queries of QgsVectorLayer::snapWithContext() without looking at
+ * geometries far from the snapping point. Points are indexed as segments of
+ * length zero. The vertices of every geometry are kept with the vertex numbers
+ * and neighbours QgsGeometry uses, so the results are the same as those of
+ * QgsGeometry::closestVertex() and QgsGeometry::closestSegmentWithContext().
+ * @note added in 1.9
+ */
+class CORE_EXPORT QgsSnappingIndex
+{
+  public:
+    //! Creates an empty index
+    QgsSnappingIndex();
+
+    //! Creates an index of the geometries, bulk loaded with the STR algorithm
+    QgsSnappingIndex( QgsGeometryMap& geometries );
+
+    ~QgsSnappingIndex();
+
+    //! Adds the geometry of a feature, replacing the geometry it had in the index
+    void addGeometry( QgsFeatureId fid, QgsGeometry* geometry );
+
+    //! Removes the geometry of a feature
+    void removeGeometry( QgsFeatureId fid );
+
+    //! Number of geometries in the index
+    int geometryCount() const { return mGeometries.size(); }
+
+    /** Snaps to the closest vertex or segment of every geometry near a point
+     * @param startPoint point to snap
+     * @param snappingTolerance distance tolerance for snapping
+     * @param snappingResults receives one result per geometry within the tolerance,
+     * keyed by the distance to startPoint
+     * @param snap_to to segment / to vertex
+     * @param layer layer set in the results
+     * @return number of geometries with segments near startPoint
+     */
+    int snap( const QgsPoint& startPoint, double snappingTolerance,
+              QMultiMap<double, QgsSnappingResult>& snappingResults,
+              QgsSnapper::SnappingType snap_to, const QgsVectorLayer* layer );
+
+  private:
+    //! Vertices of a geometry numbered as in QgsGeometry
+    struct Vertices
+    {
+      QVector<QgsPoint> points;
+      //! number of the vertex before / after each vertex or -1
+      QVector<int> before;
+      QVector<int> after;
+      //! index entries of the segments
+      QList<qint64> entries;
+    };
+
+    //! Segment from vertex from to vertex to of a geometry
+    struct Segment
+    {
+      QgsFeatureId fid;
+      int from;
+      int to;
+    };
+
+    class SegmentSource;
+    friend class SegmentSource;
+
+    QgsSnappingIndex( const QgsSnappingIndex& );
+    QgsSnappingIndex& operator=( const QgsSnappingIndex& );
+
+    //! Extracts the vertices of a geometry and adds its segments to mSegments
+    void addVertices( QgsFeatureId fid, QgsGeometry* geometry, Vertices& vertices );
+    //! Appends a line or ring starting with vertex number vertices.points.size()
+    void addPart( QgsFeatureId fid, const QgsPolyline& part, bool ring, Vertices& vertices );
+    void addSegment( QgsFeatureId fid, int from, int to, Vertices& vertices );
+
+    static QgsRectangle segmentRect( const Vertices& vertices, const Segment& segment );
+
+    QgsSpatialIndex* mIndex;
+    QHash<QgsFeatureId, Vertices> mGeometries;
+    QHash<qint64, Segment> mSegments;
+    qint64 mNextEntry;
+};
+
+#endif // QGSSNAPPINGINDEX_H
@@ -19,11 +19,32 @@
 #include "qgsfeature.h"
 #include "qgsrectangle.h"
 #include "qgslogger.h"
+#include "qgsvectorlayer.h"
 
 #include "SpatialIndex.h"
 
+#include <QDataStream>
+#include <QFile>
+#include <QVector>
+
+#include <limits>
+
 using namespace SpatialIndex;
 
+// "QGSI"
+static const quint32 IndexFileMagic = 0x51475349;
+static const quint32 IndexFileVersion = 1;
+
+static Region rectangleToRegion( const QgsRectangle& rect )
+{
+  double pt1[2], pt2[2];
+  pt1[0] = rect.xMinimum();
+  pt1[1] = rect.yMinimum();
+  pt2[0] = rect.xMaximum();
+  pt2[1] = rect.yMaximum();
+  return Region( pt1, pt2, 2 );
+}
+
 
 // custom visitor that adds found features to list
 class QgisVisitor : public SpatialIndex::IVisitor
@@ -47,9 +68,284 @@ class QgisVisitor : public SpatialIndex::IVisitor
     QList<QgsFeatureId>& mList;
 };
 
+// custom visitor that collects the ids and bounding boxes of found entries
+class QgisEntryVisitor : public SpatialIndex::IVisitor
+{
+  public:
+    QgisEntryVisitor( QList<id_type>& ids, QList<QgsRectangle>& rects )
+        : mIds( ids ), mRects( rects ) {}
+
+    void visitNode( const INode& n )
+    { Q_UNUSED( n ); }
+
+    void visitData( const IData& d )
+    {
+      IShape* shape;
+      d.getShape( &shape );
+      Region r;
+      shape->getMBR( r );
+      delete shape;
+
+      mIds.append( d.getIdentifier() );
+      mRects.append( QgsRectangle( r.getLow( 0 ), r.getLow( 1 ), r.getHigh( 0 ), r.getHigh( 1 ) ) );
+    }
+
+    void visitData( std::vector<const IData*>& v )
+    { Q_UNUSED( v ); }
+
+  private:
+    QList<id_type>& mIds;
+    QList<QgsRectangle>& mRects;
+};
 
-QgsSpatialIndex::QgsSpatialIndex()
+// feeds the bulk loader with index entries, always reading one entry ahead.
+// The entries read are kept until the bulk load succeeded, see nextEntry()
+class QgisDataStream : public SpatialIndex::IDataStream
 {
+  public:
+    QgisDataStream() : mNext( 0 ), mReplayed( 0 ) {}
+    ~QgisDataStream() { delete mNext; }
+
+    IData* getNext()
+    {
+      RTree::Data* d = mNext;
+      mNext = 0;
+      try
+      {
+        readNext();
+      }
+      catch ( ... )
+      {
+        delete d;
+        throw;
+      }
+      return d;
+    }
+
+    bool hasNext() { return mNext != 0; }
+
+    uint32_t size() { throw Tools::NotSupportedException( "Operation not supported." ); }
+
+    void rewind() { throw Tools::NotSupportedException( "Operation not supported." ); }
+
+    // returns the entries read by the bulk loader again, then the remaining ones
+    bool nextEntry( id_type& id, QgsRectangle& rect )
+    {
+      if ( mReplayed < mReadIds.size() )
+      {
+        id = mReadIds[mReplayed];
+        rect = mReadRects[mReplayed];
+        ++mReplayed;
+        return true;
+      }
+      return readEntry( id, rect );
+    }
+
+    // frees the entries kept for nextEntry()
+    void clearReadEntries()
+    {
+      mReadIds.clear();
+      mReadRects.clear();
+    }
+
+  protected:
+    // reads the next entry, returns false at the end
+    virtual bool readEntry( id_type& id, QgsRectangle& rect ) = 0;
+
+    // fetches the first entry, to be called by the constructor of subclasses
+    void readNext()
+    {
+      id_type id;
+      QgsRectangle rect;
+      if ( readEntry( id, rect ) )
+      {
+        mReadIds.append( id );
+        mReadRects.append( rect );
+        Region r = rectangleToRegion( rect );
+        mNext = new RTree::Data( 0, 0, r, id );
+      }
+    }
+
+  private:
+    RTree::Data* mNext;
+    QVector<id_type> mReadIds;
+    QVector<QgsRectangle> mReadRects;
+    int mReplayed;
+};
+
+// entries from the bounding boxes of features
+class QgisFeatureDataStream : public QgisDataStream
+{
+  public:
+    QgisFeatureDataStream( QgsSpatialIndex::FeatureSource& source )
+        : mSource( source ) { readNext(); }
+
+  protected:
+    bool readEntry( id_type& id, QgsRectangle& rect )
+    {
+      QgsFeature f;
+      while ( mSource.nextFeature( f ) )
+      {
+        QgsGeometry* g = f.geometry();
+        if ( !g )
+          continue;
+
+        id = FID_TO_NUMBER( f.id() );
+        rect = g->boundingBox();
+        return true;
+      }
+      return false;
+    }
+
+  private:
+    QgsSpatialIndex::FeatureSource& mSource;
+};
+
+// entries supplied directly
+class QgisEntryDataStream : public QgisDataStream
+{
+  public:
+    QgisEntryDataStream( QgsSpatialIndex::EntrySource& source )
+        : mSource( source ) { readNext(); }
+
+  protected:
+    bool readEntry( id_type& id, QgsRectangle& rect )
+    {
+      QgsFeatureId fid;
+      if ( !mSource.nextEntry( fid, rect ) )
+        return false;
+
+      id = FID_TO_NUMBER( fid );
+      return true;
+    }
+
+  private:
+    QgsSpatialIndex::EntrySource& mSource;
+};
+
+// entries from a file written by QgsSpatialIndex::save()
+class QgisFileDataStream : public QgisDataStream
+{
+  public:
+    QgisFileDataStream( QDataStream& in, qint64 count )
+        : mIn( in ), mRemaining( count ) { readNext(); }
+
+  protected:
+    bool readEntry( id_type& id, QgsRectangle& rect )
+    {
+      if ( mRemaining <= 0 )
+        return false;
+      --mRemaining;
+
+      qint64 fid;
+      double xmin, ymin, xmax, ymax;
+      mIn >> fid >> xmin >> ymin >> xmax >> ymax;
+      if ( mIn.status() != QDataStream::Ok )
+        return false;
+
+      id = fid;
+      rect = QgsRectangle( xmin, ymin, xmax, ymax );
+      return true;
+    }
+
+  private:
+    QDataStream& mIn;
+    qint64 mRemaining;
+};
+
+// features of a vector layer
+class QgisLayerFeatureSource : public QgsSpatialIndex::FeatureSource
+{
+  public:
+    QgisLayerFeatureSource( QgsVectorLayer* layer ) : mLayer( layer )
+    {
+      mLayer->select( QgsAttributeList(), QgsRectangle(), true, false );
+    }
+
+    bool nextFeature( QgsFeature& f ) { return mLayer->nextFeature( f ); }
+
+  private:
+    QgsVectorLayer* mLayer;
+};
+
+
+QgsSpatialIndex::QgsSpatialIndex( int indexCapacity, int leafCapacity )
+{
+  createRTree( 0, indexCapacity, leafCapacity );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( FeatureSource& source, int indexCapacity, int leafCapacity )
+{
+  QgisFeatureDataStream stream( source );
+  createRTree( &stream, indexCapacity, leafCapacity );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( QgsVectorLayer* layer, int indexCapacity, int leafCapacity )
+{
+  QgisLayerFeatureSource source( layer );
+  QgisFeatureDataStream stream( source );
+  createRTree( &stream, indexCapacity, leafCapacity );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( EntrySource& source, int indexCapacity, int leafCapacity )
+{
+  QgisEntryDataStream stream( source );
+  createRTree( &stream, indexCapacity, leafCapacity );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( QgisDataStream& stream, int indexCapacity, int leafCapacity )
+{
+  createRTree( &stream, indexCapacity, leafCapacity );
+}
+
+QgsSpatialIndex* QgsSpatialIndex::load( const QString& fileName )
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    QgsDebugMsg( "cannot open " + fileName );
+    return 0;
+  }
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_5 );
+
+  quint32 magic, version;
+  qint32 indexCapacity, leafCapacity;
+  qint64 count;
+  in >> magic >> version >> indexCapacity >> leafCapacity >> count;
+  if ( in.status() != QDataStream::Ok || magic != IndexFileMagic || version != IndexFileVersion
+       || indexCapacity < 4 || leafCapacity < 4 || count < 0 )
+  {
+    QgsDebugMsg( fileName + " is not a spatial index" );
+    return 0;
+  }
+
+  QgisFileDataStream stream( in, count );
+  QgsSpatialIndex* index = new QgsSpatialIndex( stream, indexCapacity, leafCapacity );
+
+  if ( in.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( fileName + " is truncated" );
+    delete index;
+    return 0;
+  }
+  return index;
+}
+
+void QgsSpatialIndex::createRTree( QgisDataStream* stream, int indexCapacity, int leafCapacity )
+{
+  // the R-tree refuses nodes of less than 4 entries
+  if ( indexCapacity < 4 || leafCapacity < 4 )
+  {
+    QgsDebugMsg( QString( "node capacities %1 / %2 raised to 4" ).arg( indexCapacity ).arg( leafCapacity ) );
+    indexCapacity = qMax( indexCapacity, 4 );
+    leafCapacity = qMax( leafCapacity, 4 );
+  }
+
+  mIndexCapacity = indexCapacity;
+  mLeafCapacity = leafCapacity;
+
   // for now only memory manager
   mStorageManager = StorageManager::createNewMemoryStorageManager();
 
@@ -61,15 +357,60 @@ QgsSpatialIndex::QgsSpatialIndex()
 
   // R-Tree parameters
   double fillFactor = 0.7;
-  unsigned long indexCapacity = 10;
-  unsigned long leafCapacity = 10;
   unsigned long dimension = 2;
   RTree::RTreeVariant variant = RTree::RV_RSTAR;
 
-  // create R-tree
+  // create R-tree, the bulk loader refuses empty streams
   SpatialIndex::id_type indexId;
-  mRTree = RTree::createNewRTree( *mStorage, fillFactor, indexCapacity,
-                                  leafCapacity, dimension, variant, indexId );
+  mRTree = 0;
+  bool bulkLoad = stream && stream->hasNext();
+  if ( bulkLoad )
+  {
+    try
+    {
+      mRTree = RTree::createAndBulkLoadNewRTree( RTree::BLM_STR, *stream, *mStorage, fillFactor, indexCapacity,
+               leafCapacity, dimension, variant, indexId );
+      stream->clearReadEntries();
+    }
+    catch ( Tools::Exception &e )
+    {
+      Q_UNUSED( e );
+      QgsDebugMsg( QString( "Tools::Exception caught: %1" ).arg( e.what().c_str() ) );
+    }
+    catch ( const std::exception &e )
+    {
+      Q_UNUSED( e );
+      QgsDebugMsg( QString( "std::exception caught: %1" ).arg( e.what() ) );
+    }
+  }
+
+  if ( !mRTree )
+  {
+    if ( bulkLoad )
+    {
+      // the failed bulk load has freed its tree, but its nodes are still stored
+      delete mStorage;
+      delete mStorageManager;
+      mStorageManager = StorageManager::createNewMemoryStorageManager();
+      mStorage = StorageManager::createNewRandomEvictionsBuffer( *mStorageManager, capacity, writeThrough );
+    }
+
+    mRTree = RTree::createNewRTree( *mStorage, fillFactor, indexCapacity,
+                                    leafCapacity, dimension, variant, indexId );
+
+    if ( bulkLoad )
+    {
+      // the source cannot be read again, the entries the bulk loader has read were kept
+      QgsDebugMsg( "bulk load failed, inserting the entries one by one" );
+      SpatialIndex::id_type id;
+      QgsRectangle rect;
+      while ( stream->nextEntry( id, rect ) )
+      {
+        insertEntry( id, rect );
+      }
+      stream->clearReadEntries();
+    }
+  }
 }
 
 QgsSpatialIndex:: ~QgsSpatialIndex()
@@ -81,12 +422,7 @@ QgsSpatialIndex:: ~QgsSpatialIndex()
 
 Region QgsSpatialIndex::rectToRegion( QgsRectangle rect )
 {
-  double pt1[2], pt2[2];
-  pt1[0] = rect.xMinimum();
-  pt1[1] = rect.yMinimum();
-  pt2[0] = rect.xMaximum();
-  pt2[1] = rect.yMaximum();
-  return Region( pt1, pt2, 2 );
+  return rectangleToRegion( rect );
 }
 
 bool QgsSpatialIndex::featureInfo( QgsFeature& f, Region& r, QgsFeatureId &id )
@@ -101,12 +437,29 @@ bool QgsSpatialIndex::featureInfo( QgsFeature& f, Region& r, QgsFeatureId &id )
 }
 
 bool QgsSpatialIndex::insertFeature( QgsFeature& f )
+{
+  QgsGeometry *g = f.geometry();
+  if ( !g )
+    return false;
+
+  return insertEntry( f.id(), g->boundingBox() );
+}
+
+bool QgsSpatialIndex::deleteFeature( QgsFeature& f )
 {
   Region r;
   QgsFeatureId id;
   if ( !featureInfo( f, r, id ) )
     return false;
 
+  // TODO: handle exceptions
+  return mRTree->deleteData( r, FID_TO_NUMBER( id ) );
+}
+
+bool QgsSpatialIndex::insertEntry( QgsFeatureId id, const QgsRectangle& rect )
+{
+  Region r = rectangleToRegion( rect );
+
   // TODO: handle possible exceptions correctly
   try
   {
@@ -130,15 +483,39 @@ bool QgsSpatialIndex::insertFeature( QgsFeature& f )
   return true;
 }
 
-bool QgsSpatialIndex::deleteFeature( QgsFeature& f )
+bool QgsSpatialIndex::deleteEntry( QgsFeatureId id, const QgsRectangle& rect )
 {
-  Region r;
-  QgsFeatureId id;
-  if ( !featureInfo( f, r, id ) )
+  // TODO: handle exceptions
+  return mRTree->deleteData( rectangleToRegion( rect ), FID_TO_NUMBER( id ) );
+}
+
+bool QgsSpatialIndex::save( const QString& fileName )
+{
+  // fetch all entries, in the order of the leaves
+  QList<id_type> ids;
+  QList<QgsRectangle> rects;
+  QgisEntryVisitor visitor( ids, rects );
+
+  double max = std::numeric_limits<double>::max();
+  mRTree->intersectsWithQuery( rectangleToRegion( QgsRectangle( -max, -max, max, max ) ), visitor );
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    QgsDebugMsg( "cannot open " + fileName );
     return false;
+  }
 
-  // TODO: handle exceptions
-  return mRTree->deleteData( r, FID_TO_NUMBER( id ) );
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_5 );
+  out << IndexFileMagic << IndexFileVersion << ( qint32 ) mIndexCapacity << ( qint32 ) mLeafCapacity << ( qint64 ) ids.size();
+  for ( int i = 0; i < ids.size(); ++i )
+  {
+    const QgsRectangle& r = rects[i];
+    out << ( qint64 ) ids[i] << r.xMinimum() << r.yMinimum() << r.xMaximum() << r.yMaximum();
+  }
+
+  return out.status() == QDataStream::Ok;
 }
 
 QList<QgsFeatureId> QgsSpatialIndex::intersects( QgsRectangle rect )
@@ -167,3 +544,36 @@ QList<QgsFeatureId> QgsSpatialIndex::nearestNeighbor( QgsPoint point, int neighb
 
   return list;
 }
+
+QList< QList<QgsFeatureId> > QgsSpatialIndex::intersects( const QList<QgsRectangle>& rects )
+{
+  QList< QList<QgsFeatureId> > result;
+
+  foreach( const QgsRectangle& rect, rects )
+  {
+    result.append( QList<QgsFeatureId>() );
+    QgisVisitor visitor( result.last() );
+    mRTree->intersectsWithQuery( rectangleToRegion( rect ), visitor );
+  }
+
+  return result;
+}
+
+QList< QList<QgsFeatureId> > QgsSpatialIndex::nearestNeighbor( const QList<QgsPoint>& points, int neighbors )
+{
+  QList< QList<QgsFeatureId> > result;
+
+  double pt[2];
+  foreach( const QgsPoint& point, points )
+  {
+    result.append( QList<QgsFeatureId>() );
+    QgisVisitor visitor( result.last() );
+
+    pt[0] = point.x();
+    pt[1] = point.y();
+    Point p( pt, 2 );
+    mRTree->nearestNeighborQuery( neighbors, p, visitor );
+  }
+
+  return result;
+}
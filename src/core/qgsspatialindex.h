@@ -32,9 +32,12 @@ namespace SpatialIndex
 
 class QgsFeature;
 class QgsRectangle;
+class QgisDataStream;
 class QgsPoint;
+class QgsVectorLayer;
 
 #include <QList>
+#include <QString>
 
 #include "qgsfeature.h"
 
@@ -43,6 +46,34 @@ class CORE_EXPORT QgsSpatialIndex
 
   public:
 
+    /** Supplies the features an index is bulk loaded from
+     * @note added in 1.9
+     */
+    class CORE_EXPORT FeatureSource
+    {
+      public:
+        virtual ~FeatureSource() {}
+
+        /** fetch the next feature including its geometry, return false after the last one */
+        virtual bool nextFeature( QgsFeature& f ) = 0;
+    };
+
+    /** Supplies index entries with their own bounding rectangles, for indexes
+     * of things other than whole features
+     * @note added in 1.9
+     */
+    class CORE_EXPORT EntrySource
+    {
+      public:
+        virtual ~EntrySource() {}
+
+        /** fetch the next entry, return false after the last one */
+        virtual bool nextEntry( QgsFeatureId& id, QgsRectangle& rect ) = 0;
+    };
+
+    /** default number of entries in index and leaf nodes */
+    static const int DefaultCapacity = 10;
+
     /* creation of spatial index */
 
     /** create new spatial index that will be stored in memory */
@@ -51,8 +82,34 @@ class CORE_EXPORT QgsSpatialIndex
     /** create new spatial index that stores its data on disk */
     //static QgsSpatialIndex* createDiskIndex(QString fileName);
 
-    /** constructor - creates R-tree */
-    QgsSpatialIndex();
+    /** constructor - creates R-tree
+     * @param indexCapacity maximal number of entries of index nodes, smaller values than 4 are raised to 4 (added in 1.9)
+     * @param leafCapacity maximal number of entries of leaf nodes, smaller values than 4 are raised to 4 (added in 1.9)
+     */
+    QgsSpatialIndex( int indexCapacity = DefaultCapacity, int leafCapacity = DefaultCapacity );
+
+    /** creates R-tree packed with the STR algorithm from all features of source.
+     * This is much faster than inserting the features one by one and gives a tree
+     * with fuller nodes, which is also faster to query.
+     * @note added in 1.9
+     */
+    QgsSpatialIndex( FeatureSource& source, int indexCapacity = DefaultCapacity, int leafCapacity = DefaultCapacity );
+
+    /** creates R-tree packed with the STR algorithm from all features of a layer.
+     * The features are fetched with QgsVectorLayer::select() and nextFeature().
+     * @note added in 1.9
+     */
+    QgsSpatialIndex( QgsVectorLayer* layer, int indexCapacity = DefaultCapacity, int leafCapacity = DefaultCapacity );
+
+    /** creates R-tree packed with the STR algorithm from all entries of source
+     * @note added in 1.9
+     */
+    QgsSpatialIndex( EntrySource& source, int indexCapacity = DefaultCapacity, int leafCapacity = DefaultCapacity );
+
+    /** create spatial index from a file written by save(), returns 0 if the file cannot be read
+     * @note added in 1.9
+     */
+    static QgsSpatialIndex* load( const QString& fileName );
 
     /** destructor finalizes work with spatial index */
     ~QgsSpatialIndex();
@@ -66,6 +123,21 @@ class CORE_EXPORT QgsSpatialIndex
     /** remove feature from index */
     bool deleteFeature( QgsFeature& f );
 
+    /** add entry with given bounding rectangle to index
+     * @note added in 1.9
+     */
+    bool insertEntry( QgsFeatureId id, const QgsRectangle& rect );
+
+    /** remove entry from index, rect has to be the rectangle it was inserted with
+     * @note added in 1.9
+     */
+    bool deleteEntry( QgsFeatureId id, const QgsRectangle& rect );
+
+    /** write the index entries to a file so that the index can be restored with load()
+     * @note added in 1.9
+     */
+    bool save( const QString& fileName );
+
 
     /* queries */
 
@@ -75,6 +147,16 @@ class CORE_EXPORT QgsSpatialIndex
     /** returns nearest neighbors (their count is specified by second parameter) */
     QList<QgsFeatureId> nearestNeighbor( QgsPoint point, int neighbors );
 
+    /** returns for each rectangle the features that intersect it
+     * @note added in 1.9
+     */
+    QList< QList<QgsFeatureId> > intersects( const QList<QgsRectangle>& rects );
+
+    /** returns for each point its nearest neighbors
+     * @note added in 1.9
+     */
+    QList< QList<QgsFeatureId> > nearestNeighbor( const QList<QgsPoint>& points, int neighbors );
+
 
   protected:
 
@@ -85,6 +167,19 @@ class CORE_EXPORT QgsSpatialIndex
 
   private:
 
+    /** creates R-tree bulk loaded from stream */
+    QgsSpatialIndex( QgisDataStream& stream, int indexCapacity, int leafCapacity );
+
+    /** creates storage and R-tree, bulk loaded from stream if it is not 0.
+     * If the bulk load fails, the entries of the stream are inserted one by one */
+    void createRTree( QgisDataStream* stream, int indexCapacity, int leafCapacity );
+
+    /** maximal number of entries of index nodes */
+    int mIndexCapacity;
+
+    /** maximal number of entries of leaf nodes */
+    int mLeafCapacity;
+
     /** storage manager */
     SpatialIndex::IStorageManager* mStorageManager;
 
@@ -65,6 +65,23 @@ bool QgsVectorDataProvider::featureAtId( QgsFeatureId featureId,
   return false;
 }
 
+int QgsVectorDataProvider::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  int count = 0;
+  while ( count < maxCount )
+  {
+    // fill the feature in place to avoid copying the geometry
+    features.append( QgsFeature() );
+    if ( !nextFeature( features.last() ) )
+    {
+      features.removeLast();
+      break;
+    }
+    ++count;
+  }
+  return count;
+}
+
 QString QgsVectorDataProvider::dataComment() const
 {
   return QString();
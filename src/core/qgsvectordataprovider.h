@@ -143,6 +143,18 @@ class CORE_EXPORT QgsVectorDataProvider : public QgsDataProvider
      */
     virtual bool nextFeature( QgsFeature& feature ) = 0;
 
+    /**
+     * Get a batch of features resulting from a select operation.
+     * @param features list the features are appended to
+     * @param maxCount maximal number of features to fetch
+     * @return number of features appended, 0 when end was hit
+     *
+     * Default implementation calls nextFeature() repeatedly. Providers that
+     * fetch features in blocks should override it to hand out a whole block at once.
+     * @note added in 1.9
+     */
+    virtual int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /**
      * Get feature type.
      * @return int representing the feature type
@@ -359,6 +371,13 @@ class CORE_EXPORT QgsVectorDataProvider : public QgsDataProvider
           @note: added in version 1.4*/
     virtual bool doesStrictFeatureTypeCheck() const { return true;}
 
+    /** Returns a new provider for the same data source, with the same subset string.
+     * It does not share a connection or cursor with this provider, so that the two may
+     * be used from different threads at the same time, e.g. to render the layer in
+     * background. The caller takes ownership. Returns 0 if not supported (the default).
+     * @note added in 1.9 */
+    virtual QgsVectorDataProvider* createConcurrentProvider() { return 0; }
+
 
     static const QStringList &availableEncodings();
 
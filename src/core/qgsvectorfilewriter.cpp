@@ -625,7 +625,6 @@ QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
   }
 
   QgsAttributeList allAttr = skipAttributeCreation ? QgsAttributeList() : layer->pendingAllAttributesList();
-  QgsFeature fet;
 
   layer->select( allAttr, QgsRectangle(), layer->wkbType() != QGis::WKBNoGeometry );
 
@@ -646,63 +645,71 @@ QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
   int n = 0, errors = 0;
 
   // write all features
-  while ( layer->nextFeature( fet ) )
+  QgsFeatureList batch;
+  bool stop = false;
+  while ( !stop && layer->nextFeatures( batch, 1000 ) )
   {
-    if ( onlySelected && !ids.contains( fet.id() ) )
-      continue;
-
-    if ( shallTransform )
+    for ( QgsFeatureList::iterator fit = batch.begin(); fit != batch.end(); ++fit )
     {
-      try
+      QgsFeature &fet = *fit;
+      if ( onlySelected && !ids.contains( fet.id() ) )
+        continue;
+
+      if ( shallTransform )
       {
-        if ( fet.geometry() )
+        try
         {
-          fet.geometry()->transform( *ct );
+          if ( fet.geometry() )
+          {
+            fet.geometry()->transform( *ct );
+          }
         }
-      }
-      catch ( QgsCsException &e )
-      {
-        delete ct;
-        delete writer;
+        catch ( QgsCsException &e )
+        {
+          delete ct;
+          delete writer;
 
-        QString msg = QObject::tr( "Failed to transform a point while drawing a feature of type '%1'. Writing stopped. (Exception: %2)" )
-                      .arg( fet.typeName() ).arg( e.what() );
-        QgsLogger::warning( msg );
-        if ( errorMessage )
-          *errorMessage = msg;
+          QString msg = QObject::tr( "Failed to transform a point while drawing a feature of type '%1'. Writing stopped. (Exception: %2)" )
+                        .arg( fet.typeName() ).arg( e.what() );
+          QgsLogger::warning( msg );
+          if ( errorMessage )
+            *errorMessage = msg;
 
-        return ErrProjection;
+          return ErrProjection;
+        }
       }
-    }
-    if ( skipAttributeCreation )
-    {
-      fet.clearAttributeMap();
-    }
-    if ( !writer->addFeature( fet ) )
-    {
-      WriterError err = writer->hasError();
-      if ( err != NoError && errorMessage )
+      if ( skipAttributeCreation )
       {
-        if ( errorMessage->isEmpty() )
-        {
-          *errorMessage = QObject::tr( "Feature write errors:" );
-        }
-        *errorMessage += "\n" + writer->errorMessage();
+        fet.clearAttributeMap();
       }
-      errors++;
-
-      if ( errors > 1000 )
+      if ( !writer->addFeature( fet ) )
       {
-        if ( errorMessage )
+        WriterError err = writer->hasError();
+        if ( err != NoError && errorMessage )
         {
-          *errorMessage += QObject::tr( "Stopping after %1 errors" ).arg( errors );
+          if ( errorMessage->isEmpty() )
+          {
+            *errorMessage = QObject::tr( "Feature write errors:" );
+          }
+          *errorMessage += "\n" + writer->errorMessage();
         }
+        errors++;
 
-        n = -1;
-        break;
+        if ( errors > 1000 )
+        {
+          if ( errorMessage )
+          {
+            *errorMessage += QObject::tr( "Stopping after %1 errors" ).arg( errors );
+          }
+
+          n = -1;
+          stop = true;
+          break;
+        }
       }
+      n++;
     }
-    n++;
+    batch.clear();
   }
 
   delete writer;
@@ -29,6 +29,7 @@
 #include <QPolygonF>
 #include <QSettings>
 #include <QString>
+#include <QThread>
 #include <QDomNode>
 
 #include "qgsvectorlayer.h"
@@ -38,6 +39,7 @@
 #include "qgsgraduatedsymbolrenderer.h"
 #include "qgsrenderer.h"
 #include "qgssinglesymbolrenderer.h"
+#include "qgssnappingindex.h"
 #include "qgsuniquevaluerenderer.h"
 
 #include "qgsattributeaction.h"
@@ -47,11 +49,13 @@
 #include "qgscoordinatetransform.h"
 #include "qgsfeature.h"
 #include "qgsfield.h"
+#include "qgsgeneralizedgeometrycache.h"
 #include "qgsgeometry.h"
 #include "qgslabel.h"
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsmaptopixel.h"
+#include "qgsmaprendererjob.h"
 #include "qgspoint.h"
 #include "qgsproviderregistry.h"
 #include "qgsrectangle.h"
@@ -86,27 +90,42 @@ QgsVectorLayer::QgsVectorLayer( QString vectorLayerPath,
                                 QString providerKey,
                                 bool loadDefaultStyleFlag )
     : QgsMapLayer( VectorLayer, baseName, vectorLayerPath )
-    , mUpdateThreshold( 0 )     // XXX better default value?
     , mDataProvider( NULL )
     , mProviderKey( providerKey )
     , mEditable( false )
     , mReadOnly( false )
     , mModified( false )
+    , mCachedGeometriesRevision( 0 )
     , mMaxUpdatedIndex( -1 )
     , mActiveCommand( NULL )
     , mRenderer( 0 )
     , mRendererV2( NULL )
     , mUsingRendererV2( false )
+    , mSimplifyDrawing( false )
+    , mSimplifyDrawingTolerance( 1.0 )
+    , mGeneralizedCache( 0 )
+    , mGeneralizedCacheLevel( -1 )
+    , mSnappingIndex( 0 )
     , mLabel( 0 )
     , mLabelOn( false )
     , mVertexMarkerOnlyForSelection( false )
-    , mFetching( false )
+    , mRenderProvider( 0 )
     , mJoinBuffer( 0 )
     , mDiagramRenderer( 0 )
     , mDiagramLayerSettings( 0 )
 {
   mActions = new QgsAttributeAction( this );
 
+  // generalized geometries are only valid for unchanged features
+  connect( this, SIGNAL( featureAdded( QgsFeatureId ) ), this, SLOT( clearGeneralizedCache() ) );
+  connect( this, SIGNAL( featureDeleted( QgsFeatureId ) ), this, SLOT( clearGeneralizedCache() ) );
+  connect( this, SIGNAL( geometryChanged( QgsFeatureId, QgsGeometry & ) ), this, SLOT( clearGeneralizedCache() ) );
+
+  // the snapping index follows the edits instead of being rebuilt on every change
+  connect( this, SIGNAL( featureAdded( QgsFeatureId ) ), this, SLOT( snappingIndexFeatureAdded( QgsFeatureId ) ) );
+  connect( this, SIGNAL( featureDeleted( QgsFeatureId ) ), this, SLOT( snappingIndexFeatureDeleted( QgsFeatureId ) ) );
+  connect( this, SIGNAL( geometryChanged( QgsFeatureId, QgsGeometry & ) ), this, SLOT( snappingIndexGeometryChanged( QgsFeatureId, QgsGeometry & ) ) );
+
   // if we're given a provider type, try to create and bind one to this layer
   if ( ! mProviderKey.isEmpty() )
   {
@@ -118,6 +137,9 @@ QgsVectorLayer::QgsVectorLayer( QString vectorLayerPath,
     setCoordinateSystem();
 
     QSettings settings;
+    mSimplifyDrawing = settings.value( "/qgis/simplifyDrawing", false ).toBool();
+    mSimplifyDrawingTolerance = settings.value( "/qgis/simplifyDrawingTol", 1.0 ).toDouble();
+
     //Changed to default to true as of QGIS 1.7
     if ( settings.value( "/qgis/use_symbology_ng", true ).toBool() && hasGeometryType() )
     {
@@ -152,15 +174,6 @@ QgsVectorLayer::QgsVectorLayer( QString vectorLayerPath,
 
     connect( QgsMapLayerRegistry::instance(), SIGNAL( layerWillBeRemoved( QString ) ), this, SLOT( checkJoinLayerRemove( QString ) ) );
     updateFieldMap();
-
-    // Get the update threshold from user settings. We
-    // do this only on construction to avoid the penality of
-    // fetching this each time the layer is drawn. If the user
-    // changes the threshold from the preferences dialog, it will
-    // have no effect on existing layers
-    // TODO: load this setting somewhere else [MD]
-    //QSettings settings;
-    //mUpdateThreshold = settings.readNumEntry("Map/updateThreshold", 1000);
   }
 } // QgsVectorLayer ctor
 
@@ -175,10 +188,12 @@ QgsVectorLayer::~QgsVectorLayer()
   mValid = false;
 
   delete mRenderer;
+  delete mRenderProvider;
   delete mDataProvider;
   delete mJoinBuffer;
   delete mLabel;
   delete mDiagramLayerSettings;
+  delete mGeneralizedCache;
 
   // Destroy any cached geometries and clear the references to them
   deleteCachedGeometries();
@@ -712,75 +727,64 @@ void QgsVectorLayer::drawRendererV2( QgsRenderContext& rendererContext, bool lab
 
   mRendererV2->startRender( rendererContext, this );
 
-#ifndef Q_WS_MAC
-  int featureCount = 0;
-#endif //Q_WS_MAC
-
-  QgsFeature fet;
-  while ( nextFeature( fet ) )
+  // progress and screen updates are done by QgsMapRendererJob,
+  // keep this loop free of event processing
+  QgsFeatureList batch;
+  while ( !rendererContext.renderingStopped() && nextFeatures( batch, RenderBatchSize ) )
   {
-    try
+    for ( QgsFeatureList::iterator fit = batch.begin(); fit != batch.end(); ++fit )
     {
       if ( rendererContext.renderingStopped() )
       {
         break;
       }
-
-#ifndef Q_WS_MAC //MH: disable this on Mac for now to avoid problems with resizing
-      if ( mUpdateThreshold > 0 && 0 == featureCount % mUpdateThreshold )
-      {
-        emit screenUpdateRequested();
-        // emit drawingProgress( featureCount, totalFeatures );
-        qApp->processEvents();
-      }
-      else if ( featureCount % 1000 == 0 )
+      if ( mGeneralizedCacheLevel >= 0 && !mGeneralizedCache->setGeometry( mGeneralizedCacheLevel, *fit ) )
       {
-        // emit drawingProgress( featureCount, totalFeatures );
-        qApp->processEvents();
+        continue;
       }
-#endif //Q_WS_MAC
+      drawFeatureV2( *fit, rendererContext, labeling, vertexMarkerOnlyForSelection );
+    }
+    batch.clear();
+  }
 
-      bool sel = mSelectedFeatureIds.contains( fet.id() );
-      bool drawMarker = ( mEditable && ( !vertexMarkerOnlyForSelection || sel ) );
+  stopRendererV2( rendererContext, NULL );
+}
+
+void QgsVectorLayer::drawFeatureV2( QgsFeature& fet, QgsRenderContext& rendererContext, bool labeling, bool vertexMarkerOnlyForSelection )
+{
+  try
+  {
+    bool sel = mSelectedFeatureIds.contains( fet.id() );
+    bool drawMarker = ( mEditable && ( !vertexMarkerOnlyForSelection || sel ) );
+
+    // render feature
+    bool rendered = mRendererV2->renderFeature( fet, rendererContext, -1, sel, drawMarker );
 
-      // render feature
-      bool rendered = mRendererV2->renderFeature( fet, rendererContext, -1, sel, drawMarker );
+    if ( mEditable )
+    {
+      // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
+      cacheGeometry( fet );
+    }
 
-      if ( mEditable )
+    // labeling - register feature
+    if ( rendered && rendererContext.labelingEngine() )
+    {
+      if ( labeling )
       {
-        // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
-        mCachedGeometries[fet.id()] = *fet.geometry();
+        rendererContext.labelingEngine()->registerFeature( this, fet, rendererContext );
       }
-
-      // labeling - register feature
-      if ( rendered && rendererContext.labelingEngine() )
+      if ( mDiagramRenderer )
       {
-        if ( labeling )
-        {
-          rendererContext.labelingEngine()->registerFeature( this, fet, rendererContext );
-        }
-        if ( mDiagramRenderer )
-        {
-          rendererContext.labelingEngine()->registerDiagramFeature( this, fet, rendererContext );
-        }
+        rendererContext.labelingEngine()->registerDiagramFeature( this, fet, rendererContext );
       }
     }
-    catch ( const QgsCsException &cse )
-    {
-      Q_UNUSED( cse );
-      QgsDebugMsg( QString( "Failed to transform a point while drawing a feature of type '%1'. Ignoring this feature. %2" )
-                   .arg( fet.typeName() ).arg( cse.what() ) );
-    }
-#ifndef Q_WS_MAC
-    ++featureCount;
-#endif //Q_WS_MAC
   }
-
-  stopRendererV2( rendererContext, NULL );
-
-#ifndef Q_WS_MAC
-  QgsDebugMsg( QString( "Total features processed %1" ).arg( featureCount ) );
-#endif
+  catch ( const QgsCsException &cse )
+  {
+    Q_UNUSED( cse );
+    QgsDebugMsg( QString( "Failed to transform a point while drawing a feature of type '%1'. Ignoring this feature. %2" )
+                 .arg( fet.typeName() ).arg( cse.what() ) );
+  }
 }
 
 void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bool labeling )
@@ -807,9 +811,6 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
 
   // 1. fetch features
   QgsFeature fet;
-#ifndef Q_WS_MAC
-  int featureCount = 0;
-#endif //Q_WS_MAC
   while ( nextFeature( fet ) )
   {
     if ( rendererContext.renderingStopped() )
@@ -817,12 +818,10 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
       stopRendererV2( rendererContext, selRenderer );
       return;
     }
-#ifndef Q_WS_MAC
-    if ( featureCount % 1000 == 0 )
+    if ( mGeneralizedCacheLevel >= 0 && !mGeneralizedCache->setGeometry( mGeneralizedCacheLevel, fet ) )
     {
-      qApp->processEvents();
+      continue;
     }
-#endif //Q_WS_MAC
     QgsSymbolV2* sym = mRendererV2->symbolForFeature( fet );
     if ( !sym )
     {
@@ -838,7 +837,7 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
     if ( mEditable )
     {
       // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
-      mCachedGeometries[fet.id()] = *fet.geometry();
+      cacheGeometry( fet );
     }
 
     if ( sym && rendererContext.labelingEngine() )
@@ -852,10 +851,6 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
         rendererContext.labelingEngine()->registerDiagramFeature( this, fet, rendererContext );
       }
     }
-
-#ifndef Q_WS_MAC
-    ++featureCount;
-#endif //Q_WS_MAC
   }
 
   // find out the order
@@ -891,9 +886,6 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
       int layer = item.layer();
       QList<QgsFeature>& lst = features[item.symbol()];
       QList<QgsFeature>::iterator fit;
-#ifndef Q_WS_MAC
-      featureCount = 0;
-#endif //Q_WS_MAC
       for ( fit = lst.begin(); fit != lst.end(); ++fit )
       {
         if ( rendererContext.renderingStopped() )
@@ -901,12 +893,6 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
           stopRendererV2( rendererContext, selRenderer );
           return;
         }
-#ifndef Q_WS_MAC
-        if ( featureCount % 1000 == 0 )
-        {
-          qApp->processEvents();
-        }
-#endif //Q_WS_MAC
         bool sel = mSelectedFeatureIds.contains( fit->id() );
         // maybe vertex markers should be drawn only during the last pass...
         bool drawMarker = ( mEditable && ( !vertexMarkerOnlyForSelection || sel ) );
@@ -921,9 +907,6 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
           QgsDebugMsg( QString( "Failed to transform a point while drawing a feature of type '%1'. Ignoring this feature. %2" )
                        .arg( fet.typeName() ).arg( cse.what() ) );
         }
-#ifndef Q_WS_MAC
-        ++featureCount;
-#endif //Q_WS_MAC
       }
     }
   }
@@ -933,10 +916,91 @@ void QgsVectorLayer::drawRendererV2Levels( QgsRenderContext& rendererContext, bo
 
 void QgsVectorLayer::reload()
 {
+  deleteRenderProvider();
   if ( mDataProvider )
   {
     mDataProvider->reloadData();
   }
+  clearGeneralizedCache();
+}
+
+bool QgsVectorLayer::buildGeneralizedCache( const QList<double>& tolerances )
+{
+  clearGeneralizedCache();
+
+  if ( !hasGeometryType() || geometryType() == QGis::Point || tolerances.isEmpty() )
+    return false;
+
+  QgsGeneralizedGeometryCache *cache = new QgsGeneralizedGeometryCache( tolerances );
+
+  select( QgsAttributeList(), QgsRectangle(), true );
+  QgsFeature fet;
+  while ( nextFeature( fet ) )
+  {
+    cache->addGeometry( fet.id(), fet.geometry() );
+  }
+
+  mGeneralizedCache = cache;
+  return true;
+}
+
+bool QgsVectorLayer::saveGeneralizedCache( const QString& fileName ) const
+{
+  return mGeneralizedCache && mDataProvider &&
+         mGeneralizedCache->writeFile( fileName, mDataSource, mDataProvider->featureCount(), mDataProvider->extent() );
+}
+
+bool QgsVectorLayer::loadGeneralizedCache( const QString& fileName )
+{
+  clearGeneralizedCache();
+
+  if ( !mDataProvider )
+    return false;
+
+  QgsGeneralizedGeometryCache *cache = new QgsGeneralizedGeometryCache();
+  if ( !cache->readFile( fileName, mDataSource, mDataProvider->featureCount(), mDataProvider->extent() ) )
+  {
+    delete cache;
+    return false;
+  }
+
+  mGeneralizedCache = cache;
+  return true;
+}
+
+void QgsVectorLayer::clearGeneralizedCache()
+{
+  QgsMapRendererJob::cancelRunningJobs();
+
+  delete mGeneralizedCache;
+  mGeneralizedCache = 0;
+}
+
+int QgsVectorLayer::generalizedCacheLevel( const QgsRenderContext& rendererContext ) const
+{
+  if ( !mGeneralizedCache || mEditable )
+    return -1;
+
+  // size of a pixel in layer units, the context extent is in layer coordinates
+  double pixelSize = rendererContext.mapToPixel().mapUnitsPerPixel();
+  const QgsCoordinateTransform *ct = rendererContext.coordinateTransform();
+  if ( ct )
+  {
+    try
+    {
+      QgsRectangle mapExtent = ct->transformBoundingBox( rendererContext.extent() );
+      if ( mapExtent.width() <= 0 )
+        return -1;
+      pixelSize *= rendererContext.extent().width() / mapExtent.width();
+    }
+    catch ( QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+      return -1;
+    }
+  }
+
+  return mGeneralizedCache->levelForTolerance( pixelSize );
 }
 
 bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
@@ -944,9 +1008,7 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
   if ( !hasGeometryType() )
     return true;
 
-  //set update threshold before each draw to make sure the current setting is picked up
   QSettings settings;
-  mUpdateThreshold = settings.value( "Map/updateThreshold", 0 ).toInt();
 
   if ( mUsingRendererV2 )
   {
@@ -959,7 +1021,6 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
     {
       // Destroy all cached geometries and clear the references to them
       deleteCachedGeometries();
-      mCachedGeometriesRect = rendererContext.extent();
 
       // set editing vertex markers style
       mRendererV2->setVertexMarkerAppearance( currentVertexMarkerType(), currentVertexMarkerSize() );
@@ -977,7 +1038,12 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
     //register label and diagram layer to the labeling engine
     prepareLabelingAndDiagrams( rendererContext, attributes, labeling );
 
-    select( attributes, rendererContext.extent() );
+    // generalized geometries replace the provider geometries, so these need not be fetched
+    mGeneralizedCacheLevel = generalizedCacheLevel( rendererContext );
+    select( attributes, rendererContext.extent(), mGeneralizedCacheLevel < 0 );
+
+    // all vertices are needed for the vertex markers while editing
+    rendererContext.setSimplifyTolerance( mSimplifyDrawing && !mEditable ? mSimplifyDrawingTolerance : 0 );
 
     if (( mRendererV2->capabilities() & QgsFeatureRendererV2::SymbolLevels )
         && mRendererV2->usingSymbolLevels() )
@@ -985,6 +1051,13 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
     else
       drawRendererV2( rendererContext, labeling );
 
+    rendererContext.setSimplifyTolerance( 0 );
+    mGeneralizedCacheLevel = -1;
+
+    // snapping only relies on the cached geometries if all features of the extent were drawn
+    if ( mEditable && !rendererContext.renderingStopped() )
+      setCachedGeometriesRect( rendererContext.extent() );
+
     return true;
   }
 
@@ -1011,7 +1084,6 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
     {
       // Destroy all cached geometries and clear the references to them
       deleteCachedGeometries();
-      mCachedGeometriesRect = rendererContext.extent();
       vertexMarker = currentVertexMarkerType();
       vertexMarkerSize = currentVertexMarkerSize();
       mVertexMarkerOnlyForSelection = settings.value( "/qgis/digitizing/marker_only_for_selected", false ).toBool();
@@ -1037,22 +1109,6 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
           break;
         }
 
-#ifndef Q_WS_MAC //MH: disable this on Mac for now to avoid problems with resizing
-        if ( mUpdateThreshold > 0 && 0 == featureCount % mUpdateThreshold )
-        {
-          emit screenUpdateRequested();
-          // emit drawingProgress( featureCount, totalFeatures );
-          qApp->processEvents();
-        }
-        else if ( featureCount % 1000 == 0 )
-        {
-          // emit drawingProgress( featureCount, totalFeatures );
-          qApp->processEvents();
-        }
-// #else
-//         Q_UNUSED( totalFeatures );
-#endif //Q_WS_MAC
-
         // check if feature is selected
         // only show selections of the current layer
         // TODO: create a mechanism to let layer know whether it's current layer or not [MD]
@@ -1064,7 +1120,7 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
         if ( mEditable )
         {
           // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
-          mCachedGeometries[fet.id()] = *fet.geometry();
+          cacheGeometry( fet );
 
           if ( !mVertexMarkerOnlyForSelection || sel )
           {
@@ -1121,6 +1177,9 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
   if ( mEditable )
   {
     QgsDebugMsg( QString( "Cached %1 geometries." ).arg( mCachedGeometries.count() ) );
+
+    if ( mRenderer && !rendererContext.renderingStopped() )
+      setCachedGeometriesRect( rendererContext.extent() );
   }
 
   return true; // Assume success always
@@ -1128,9 +1187,56 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
 
 void QgsVectorLayer::deleteCachedGeometries()
 {
+  QMutexLocker locker( &mCachedGeometriesMutex );
+
   // Destroy any cached geometries
   mCachedGeometries.clear();
   mCachedGeometriesRect = QgsRectangle();
+
+  delete mSnappingIndex;
+  mSnappingIndex = 0;
+}
+
+void QgsVectorLayer::setCachedGeometriesRect( const QgsRectangle& rect )
+{
+  QMutexLocker locker( &mCachedGeometriesMutex );
+
+  mCachedGeometriesRect = rect;
+  ++mCachedGeometriesRevision;
+}
+
+void QgsVectorLayer::cacheGeometry( QgsFeature& fet )
+{
+  QMutexLocker locker( &mCachedGeometriesMutex );
+
+  QgsGeometry& geom = mCachedGeometries[fet.id()];
+  geom = *fet.geometry();
+
+  // keep an index built while the layer is drawn complete
+  if ( mSnappingIndex )
+    mSnappingIndex->addGeometry( fet.id(), &geom );
+}
+
+void QgsVectorLayer::snappingIndexGeometryChanged( QgsFeatureId fid, QgsGeometry &geom )
+{
+  if ( mSnappingIndex )
+    mSnappingIndex->addGeometry( fid, &geom );
+}
+
+void QgsVectorLayer::snappingIndexFeatureAdded( QgsFeatureId fid )
+{
+  if ( !mSnappingIndex )
+    return;
+
+  QgsGeometryMap::iterator it = mCachedGeometries.find( fid );
+  if ( it != mCachedGeometries.end() )
+    mSnappingIndex->addGeometry( fid, &it.value() );
+}
+
+void QgsVectorLayer::snappingIndexFeatureDeleted( QgsFeatureId fid )
+{
+  if ( mSnappingIndex )
+    mSnappingIndex->removeGeometry( fid );
 }
 
 void QgsVectorLayer::drawVertexMarker( double x, double y, QPainter& p, QgsVectorLayer::VertexMarkerType type, int m )
@@ -1151,6 +1257,8 @@ void QgsVectorLayer::drawVertexMarker( double x, double y, QPainter& p, QgsVecto
 
 void QgsVectorLayer::select( QgsFeatureId fid, bool emitSignal )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   mSelectedFeatureIds.insert( fid );
 
   if ( emitSignal )
@@ -1164,6 +1272,8 @@ void QgsVectorLayer::select( QgsFeatureId fid, bool emitSignal )
 
 void QgsVectorLayer::deselect( QgsFeatureId fid, bool emitSignal )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   mSelectedFeatureIds.remove( fid );
 
   if ( emitSignal )
@@ -1177,6 +1287,8 @@ void QgsVectorLayer::deselect( QgsFeatureId fid, bool emitSignal )
 
 void QgsVectorLayer::select( QgsRectangle & rect, bool lock )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   // normalize the rectangle
   rect.normalize();
 
@@ -1202,6 +1314,8 @@ void QgsVectorLayer::select( QgsRectangle & rect, bool lock )
 
 void QgsVectorLayer::invertSelection()
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   // copy the ids of selected features to tmp
   QgsFeatureIds tmp = mSelectedFeatureIds;
 
@@ -1228,6 +1342,8 @@ void QgsVectorLayer::invertSelection()
 
 void QgsVectorLayer::invertSelectionInRectangle( QgsRectangle & rect )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   // normalize the rectangle
   rect.normalize();
 
@@ -1254,6 +1370,8 @@ void QgsVectorLayer::invertSelectionInRectangle( QgsRectangle & rect )
 
 void QgsVectorLayer::removeSelection( bool emitSignal )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( mSelectedFeatureIds.size() == 0 )
     return;
 
@@ -1285,6 +1403,7 @@ const QgsVectorDataProvider* QgsVectorLayer::dataProvider() const
 
 void QgsVectorLayer::setProviderEncoding( const QString& encoding )
 {
+  deleteRenderProvider();
   if ( mDataProvider )
   {
     mDataProvider->setEncoding( encoding );
@@ -1304,6 +1423,8 @@ void QgsVectorLayer::setRenderer( QgsRenderer *r )
 
   if ( r != mRenderer )
   {
+    QgsMapRendererJob::cancelRunningJobs();
+
     if ( r )
       setUsingRendererV2( false );
     delete mRenderer;
@@ -1519,6 +1640,8 @@ QString QgsVectorLayer::subsetString()
 
 bool QgsVectorLayer::setSubsetString( QString subset )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( ! mDataProvider )
   {
     QgsDebugMsg( "invoked with null mDataProvider" );
@@ -1527,6 +1650,9 @@ bool QgsVectorLayer::setSubsetString( QString subset )
 
   bool res = mDataProvider->setSubsetString( subset );
 
+  deleteRenderProvider();
+  clearGeneralizedCache();
+
   // get the updated data source string from the provider
   mDataSource = mDataProvider->dataSourceUri();
   updateExtents();
@@ -1539,7 +1665,9 @@ bool QgsVectorLayer::setSubsetString( QString subset )
 
 void QgsVectorLayer::updateFeatureAttributes( QgsFeature &f, bool all )
 {
-  if ( mDataProvider && ( all || ( mFetchAttributes.size() > 0 && mJoinBuffer->containsFetchJoins() ) ) )
+  const FetchState& fetch = fetchState();
+
+  if ( mDataProvider && ( all || ( fetch.mAttributes.size() > 0 && mJoinBuffer->containsFetchJoins() ) ) )
   {
     int index = 0;
     QgsVectorLayerJoinBuffer::maximumIndex( mDataProvider->fields(), index );
@@ -1566,7 +1694,7 @@ void QgsVectorLayer::updateFeatureAttributes( QgsFeature &f, bool all )
 
   // null/add all attributes that were added, but don't exist in the feature yet
   for ( QgsFieldMap::const_iterator it = mUpdatedFields.begin(); it != mUpdatedFields.end(); it++ )
-    if ( !map.contains( it.key() ) && ( all || mFetchAttributes.contains( it.key() ) ) )
+    if ( !map.contains( it.key() ) && ( all || fetch.mAttributes.contains( it.key() ) ) )
       f.changeAttribute( it.key(), QVariant( QString::null ) );
 }
 
@@ -1644,26 +1772,75 @@ void QgsVectorLayer::updateFeatureGeometry( QgsFeature &f )
 }
 
 
+QgsVectorLayer::FetchState& QgsVectorLayer::fetchState()
+{
+  if ( mRenderProvider && QThread::currentThread() != thread() )
+  {
+    mRenderFetch.mProvider = mRenderProvider;
+    return mRenderFetch;
+  }
+
+  mFetch.mProvider = mDataProvider;
+  return mFetch;
+}
+
+bool QgsVectorLayer::prepareBackgroundRendering()
+{
+  // joins read the joined layers, which are not prepared
+  if ( !mDataProvider || !mJoinBuffer || mJoinBuffer->containsJoins() )
+    return false;
+
+  if ( !mRenderProvider && QThread::currentThread() == thread() )
+  {
+    mRenderProvider = mDataProvider->createConcurrentProvider();
+    if ( mRenderProvider && !mRenderProvider->isValid() )
+    {
+      QgsDebugMsg( "second provider for background rendering not valid" );
+      delete mRenderProvider;
+      mRenderProvider = 0;
+    }
+    if ( mRenderProvider )
+    {
+      mRenderProvider->setEncoding( mDataProvider->encoding() );
+    }
+  }
+
+  return mRenderProvider != 0;
+}
+
+void QgsVectorLayer::deleteRenderProvider()
+{
+  if ( !mRenderProvider )
+    return;
+
+  QgsMapRendererJob::cancelRunningJobs();
+
+  delete mRenderProvider;
+  mRenderProvider = 0;
+  mRenderFetch = FetchState();
+}
+
 void QgsVectorLayer::select( QgsAttributeList attributes, QgsRectangle rect, bool fetchGeometries, bool useIntersect )
 {
   if ( !mDataProvider )
     return;
 
-  mFetching        = true;
-  mFetchRect       = rect;
-  mFetchAttributes = attributes;
-  mFetchGeometry   = fetchGeometries;
-  mFetchConsidered = mDeletedFeatureIds;
+  FetchState& fetch = fetchState();
+  fetch.mFetching   = true;
+  fetch.mRect       = rect;
+  fetch.mAttributes = attributes;
+  fetch.mGeometry   = fetchGeometries;
+  fetch.mConsidered = mDeletedFeatureIds;
   QgsAttributeList targetJoinFieldList;
 
   if ( mEditable )
   {
-    mFetchAddedFeaturesIt = mAddedFeatures.begin();
-    mFetchChangedGeomIt = mChangedGeometries.begin();
+    fetch.mAddedFeaturesIt = mAddedFeatures.begin();
+    fetch.mChangedGeomIt = mChangedGeometries.begin();
   }
 
   //look in the normal features of the provider
-  if ( mFetchAttributes.size() > 0 )
+  if ( fetch.mAttributes.size() > 0 )
   {
     if ( mEditable || mJoinBuffer->containsJoins() )
     {
@@ -1675,70 +1852,71 @@ void QgsVectorLayer::select( QgsAttributeList attributes, QgsRectangle rect, boo
         QgsVectorLayerJoinBuffer::maximumIndex( mDataProvider->fields(), maxProviderIndex );
       }
 
-      mJoinBuffer->select( mFetchAttributes, joinFields, maxProviderIndex );
+      mJoinBuffer->select( fetch.mAttributes, joinFields, maxProviderIndex );
       QgsAttributeList::const_iterator joinFieldIt = joinFields.constBegin();
       for ( ; joinFieldIt != joinFields.constEnd(); ++joinFieldIt )
       {
-        if ( !mFetchAttributes.contains( *joinFieldIt ) )
+        if ( !fetch.mAttributes.contains( *joinFieldIt ) )
         {
-          mFetchAttributes.append( *joinFieldIt );
+          fetch.mAttributes.append( *joinFieldIt );
         }
       }
 
       //detect which fields are from the provider
-      mFetchProvAttributes.clear();
-      for ( QgsAttributeList::iterator it = mFetchAttributes.begin(); it != mFetchAttributes.end(); it++ )
+      fetch.mProvAttributes.clear();
+      for ( QgsAttributeList::iterator it = fetch.mAttributes.begin(); it != fetch.mAttributes.end(); it++ )
       {
         if ( mDataProvider->fields().contains( *it ) )
         {
-          mFetchProvAttributes << *it;
+          fetch.mProvAttributes << *it;
         }
       }
 
-      mDataProvider->select( mFetchProvAttributes, rect, fetchGeometries, useIntersect );
+      fetch.mProvider->select( fetch.mProvAttributes, rect, fetchGeometries, useIntersect );
     }
     else
     {
-      mDataProvider->select( mFetchAttributes, rect, fetchGeometries, useIntersect );
+      fetch.mProvider->select( fetch.mAttributes, rect, fetchGeometries, useIntersect );
     }
   }
   else //we don't need any attributes at all
   {
-    mDataProvider->select( QgsAttributeList(), rect, fetchGeometries, useIntersect );
+    fetch.mProvider->select( QgsAttributeList(), rect, fetchGeometries, useIntersect );
   }
 }
 
 bool QgsVectorLayer::nextFeature( QgsFeature &f )
 {
-  if ( !mFetching )
+  FetchState& fetch = fetchState();
+  if ( !fetch.mFetching )
     return false;
 
   if ( mEditable )
   {
-    if ( !mFetchRect.isEmpty() )
+    if ( !fetch.mRect.isEmpty() )
     {
       // check if changed geometries are in rectangle
-      for ( ; mFetchChangedGeomIt != mChangedGeometries.end(); mFetchChangedGeomIt++ )
+      for ( ; fetch.mChangedGeomIt != mChangedGeometries.end(); fetch.mChangedGeomIt++ )
       {
-        QgsFeatureId fid = mFetchChangedGeomIt.key();
+        QgsFeatureId fid = fetch.mChangedGeomIt.key();
 
-        if ( mFetchConsidered.contains( fid ) )
+        if ( fetch.mConsidered.contains( fid ) )
           // skip deleted features
           continue;
 
-        mFetchConsidered << fid;
+        fetch.mConsidered << fid;
 
-        if ( !mFetchChangedGeomIt->intersects( mFetchRect ) )
+        if ( !fetch.mChangedGeomIt->intersects( fetch.mRect ) )
           // skip changed geometries not in rectangle and don't check again
           continue;
 
         f.setFeatureId( fid );
         f.setValid( true );
 
-        if ( mFetchGeometry )
-          f.setGeometry( mFetchChangedGeomIt.value() );
+        if ( fetch.mGeometry )
+          f.setGeometry( fetch.mChangedGeomIt.value() );
 
-        if ( mFetchAttributes.size() > 0 )
+        if ( fetch.mAttributes.size() > 0 )
         {
           if ( fid < 0 )
           {
@@ -1765,75 +1943,120 @@ bool QgsVectorLayer::nextFeature( QgsFeature &f )
           {
             // retrieve attributes from provider
             QgsFeature tmp;
-            mDataProvider->featureAtId( fid, tmp, false, mFetchProvAttributes );
+            fetch.mProvider->featureAtId( fid, tmp, false, fetch.mProvAttributes );
             updateFeatureAttributes( tmp );
             f.setAttributeMap( tmp.attributeMap() );
           }
         }
 
         // return complete feature
-        mFetchChangedGeomIt++;
+        fetch.mChangedGeomIt++;
         return true;
       }
 
       // no more changed geometries
     }
 
-    for ( ; mFetchAddedFeaturesIt != mAddedFeatures.end(); mFetchAddedFeaturesIt++ )
+    for ( ; fetch.mAddedFeaturesIt != mAddedFeatures.end(); fetch.mAddedFeaturesIt++ )
     {
-      QgsFeatureId fid = mFetchAddedFeaturesIt->id();
+      QgsFeatureId fid = fetch.mAddedFeaturesIt->id();
 
-      if ( mFetchConsidered.contains( fid ) )
+      if ( fetch.mConsidered.contains( fid ) )
         // must have changed geometry outside rectangle
         continue;
 
-      if ( !mFetchRect.isEmpty() &&
-           mFetchAddedFeaturesIt->geometry() &&
-           !mFetchAddedFeaturesIt->geometry()->intersects( mFetchRect ) )
+      if ( !fetch.mRect.isEmpty() &&
+           fetch.mAddedFeaturesIt->geometry() &&
+           !fetch.mAddedFeaturesIt->geometry()->intersects( fetch.mRect ) )
         // skip added features not in rectangle
         continue;
 
       f.setFeatureId( fid );
       f.setValid( true );
 
-      if ( mFetchGeometry )
-        f.setGeometry( *mFetchAddedFeaturesIt->geometry() );
+      if ( fetch.mGeometry )
+        f.setGeometry( *fetch.mAddedFeaturesIt->geometry() );
 
-      if ( mFetchAttributes.size() > 0 )
+      if ( fetch.mAttributes.size() > 0 )
       {
-        f.setAttributeMap( mFetchAddedFeaturesIt->attributeMap() );
+        f.setAttributeMap( fetch.mAddedFeaturesIt->attributeMap() );
         updateFeatureAttributes( f );
       }
 
-      mFetchAddedFeaturesIt++;
+      fetch.mAddedFeaturesIt++;
       return true;
     }
 
     // no more added features
   }
 
-  while ( dataProvider()->nextFeature( f ) )
+  while ( fetch.mProvider->nextFeature( f ) )
   {
-    if ( mFetchConsidered.contains( f.id() ) )
+    if ( fetch.mConsidered.contains( f.id() ) )
     {
       continue;
     }
-    if ( mFetchAttributes.size() > 0 )
+    if ( fetch.mAttributes.size() > 0 )
     {
       updateFeatureAttributes( f ); //check joined attributes / changed attributes
     }
     return true;
   }
 
-  mFetching = false;
+  fetch.mFetching = false;
   return false;
 }
 
+int QgsVectorLayer::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  FetchState& fetch = fetchState();
+  if ( !fetch.mFetching )
+    return 0;
+
+  int count = 0;
+
+  if ( mEditable || !fetch.mConsidered.isEmpty() )
+  {
+    // the edit buffer needs to be merged feature by feature
+    while ( count < maxCount )
+    {
+      features.append( QgsFeature() );
+      if ( !nextFeature( features.last() ) )
+      {
+        features.removeLast();
+        break;
+      }
+      ++count;
+    }
+    return count;
+  }
+
+  count = fetch.mProvider->nextFeatures( features, maxCount );
+  if ( count == 0 )
+  {
+    fetch.mFetching = false;
+    return 0;
+  }
+
+  if ( fetch.mAttributes.size() > 0 )
+  {
+    for ( int i = features.size() - count; i < features.size(); ++i )
+    {
+      updateFeatureAttributes( features[i] ); //check joined attributes / changed attributes
+    }
+  }
+
+  return count;
+}
+
 bool QgsVectorLayer::featureAtId( QgsFeatureId featureId, QgsFeature& f, bool fetchGeometries, bool fetchAttributes )
 {
   if ( !mDataProvider )
     return false;
 
+  // the provider of the calling thread, see fetchState()
+  QgsVectorDataProvider* provider = fetchState().mProvider;
+
   if ( mDeletedFeatureIds.contains( featureId ) )
     return false;
 
@@ -1869,7 +2092,7 @@ bool QgsVectorLayer::featureAtId( QgsFeatureId featureId, QgsFeature& f, bool fe
       {
         // retrieve attributes from provider
         QgsFeature tmp;
-        mDataProvider->featureAtId( featureId, tmp, false, mDataProvider->attributeIndexes() );
+        provider->featureAtId( featureId, tmp, false, mDataProvider->attributeIndexes() );
         f.setAttributeMap( tmp.attributeMap() );
       }
       updateFeatureAttributes( f, true );
@@ -1897,7 +2120,7 @@ bool QgsVectorLayer::featureAtId( QgsFeatureId featureId, QgsFeature& f, bool fe
   // regular features
   if ( fetchAttributes )
   {
-    if ( mDataProvider->featureAtId( featureId, f, fetchGeometries, mDataProvider->attributeIndexes() ) )
+    if ( provider->featureAtId( featureId, f, fetchGeometries, mDataProvider->attributeIndexes() ) )
     {
       updateFeatureAttributes( f, true );
       return true;
@@ -1905,7 +2128,7 @@ bool QgsVectorLayer::featureAtId( QgsFeatureId featureId, QgsFeature& f, bool fe
   }
   else
   {
-    if ( mDataProvider->featureAtId( featureId, f, fetchGeometries, QgsAttributeList() ) )
+    if ( provider->featureAtId( featureId, f, fetchGeometries, QgsAttributeList() ) )
     {
       return true;
     }
@@ -1915,6 +2138,8 @@ bool QgsVectorLayer::featureAtId( QgsFeatureId featureId, QgsFeature& f, bool fe
 
 bool QgsVectorLayer::addFeature( QgsFeature& f, bool alsoUpdateExtent )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   static int addedIdLowWaterMark = -1;
 
   if ( !mDataProvider )
@@ -1997,6 +2222,8 @@ bool QgsVectorLayer::updateFeature( QgsFeature &f )
 
 bool QgsVectorLayer::insertVertex( double x, double y, QgsFeatureId atFeatureId, int beforeVertex )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return false;
 
@@ -2036,6 +2263,8 @@ bool QgsVectorLayer::insertVertex( double x, double y, QgsFeatureId atFeatureId,
 
 bool QgsVectorLayer::moveVertex( double x, double y, QgsFeatureId atFeatureId, int atVertex )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return false;
 
@@ -2076,6 +2305,8 @@ bool QgsVectorLayer::moveVertex( double x, double y, QgsFeatureId atFeatureId, i
 
 bool QgsVectorLayer::deleteVertex( QgsFeatureId atFeatureId, int atVertex )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return false;
 
@@ -2150,6 +2381,8 @@ bool QgsVectorLayer::deleteSelectedFeatures()
 
 int QgsVectorLayer::addRing( const QList<QgsPoint>& ring )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return 5;
 
@@ -2187,6 +2420,8 @@ int QgsVectorLayer::addRing( const QList<QgsPoint>& ring )
 
 int QgsVectorLayer::addPart( const QList<QgsPoint> &points )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return 6;
 
@@ -2264,6 +2499,8 @@ int QgsVectorLayer::addPart( const QList<QgsPoint> &points )
 
 int QgsVectorLayer::translateFeature( QgsFeatureId featureId, double dx, double dy )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return 1;
 
@@ -2322,6 +2559,8 @@ int QgsVectorLayer::translateFeature( QgsFeatureId featureId, double dx, double
 
 int QgsVectorLayer::splitFeatures( const QList<QgsPoint>& splitLine, bool topologicalEditing )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !hasGeometryType() )
     return 4;
 
@@ -2653,6 +2892,8 @@ bool QgsVectorLayer::hasLabelsEnabled( void ) const
 
 bool QgsVectorLayer::startEditing()
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !mDataProvider )
   {
     return false;
@@ -2727,6 +2968,13 @@ bool QgsVectorLayer::readXml( const QDomNode& layer_node )
     return false;
   }
 
+  QDomElement layerElem = layer_node.toElement();
+  if ( layerElem.hasAttribute( "simplifyDrawing" ) )
+  {
+    mSimplifyDrawing = layerElem.attribute( "simplifyDrawing" ).toInt();
+    mSimplifyDrawingTolerance = layerElem.attribute( "simplifyDrawingTol", "1" ).toDouble();
+  }
+
   QDomElement pkeyElem = pkeyNode.toElement();
   if ( !pkeyElem.isNull() )
   {
@@ -2881,6 +3129,9 @@ bool QgsVectorLayer::writeXml( QDomNode & layer_node,
   // set the geometry type
   mapLayerNode.setAttribute( "geometry", QGis::qgisVectorGeometryType[geometryType()] );
 
+  mapLayerNode.setAttribute( "simplifyDrawing", mSimplifyDrawing ? 1 : 0 );
+  mapLayerNode.setAttribute( "simplifyDrawingTol", QString::number( mSimplifyDrawingTolerance ) );
+
   // add provider node
   if ( mDataProvider )
   {
@@ -3443,6 +3694,8 @@ bool QgsVectorLayer::writeSld( QDomNode& node, QDomDocument& doc, QString& error
 
 bool QgsVectorLayer::changeGeometry( QgsFeatureId fid, QgsGeometry* geom )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !mEditable || !mDataProvider || !hasGeometryType() )
   {
     return false;
@@ -3458,6 +3711,8 @@ bool QgsVectorLayer::changeGeometry( QgsFeatureId fid, QgsGeometry* geom )
 
 bool QgsVectorLayer::changeAttributeValue( QgsFeatureId fid, int field, QVariant value, bool emitSignal )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !isEditable() )
     return false;
 
@@ -3472,6 +3727,8 @@ bool QgsVectorLayer::changeAttributeValue( QgsFeatureId fid, int field, QVariant
 
 bool QgsVectorLayer::addAttribute( const QgsField &field )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !isEditable() )
     return false;
 
@@ -3553,6 +3810,8 @@ QString QgsVectorLayer::attributeDisplayName( int attributeIndex ) const
 
 bool QgsVectorLayer::deleteAttribute( int index )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !isEditable() )
     return false;
 
@@ -3581,6 +3840,8 @@ bool QgsVectorLayer::deleteAttribute( int index )
 
 bool QgsVectorLayer::deleteFeature( QgsFeatureId fid )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !isEditable() )
     return false;
 
@@ -3616,6 +3877,11 @@ int QgsVectorLayer::pendingFeatureCount()
 
 bool QgsVectorLayer::commitChanges()
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
+  // the second provider may not see the committed changes
+  deleteRenderProvider();
+
   bool success = true;
 
   //clear the cache image so markers don't appear anymore on next draw
@@ -3950,6 +4216,8 @@ const QStringList &QgsVectorLayer::commitErrors()
 
 bool QgsVectorLayer::rollBack()
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   if ( !isEditable() )
   {
     return false;
@@ -3985,6 +4253,8 @@ bool QgsVectorLayer::rollBack()
 
 void QgsVectorLayer::setSelectedFeatures( const QgsFeatureIds& ids )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   // TODO: check whether features with these ID exist
   mSelectedFeatureIds = ids;
 
@@ -4177,22 +4447,21 @@ int QgsVectorLayer::snapWithContext( const QgsPoint& startPoint, double snapping
   int n = 0;
   QgsFeature f;
 
+  // the geometries are cached by the rendering thread while the layer is drawn
+  QMutexLocker cacheLocker( &mCachedGeometriesMutex );
   if ( mCachedGeometriesRect.contains( searchRect ) )
   {
-    QgsGeometryMap::iterator it = mCachedGeometries.begin();
-    for ( ; it != mCachedGeometries.end() ; ++it )
+    // index the segments of the cached geometries once, then only look at the ones near startPoint
+    if ( !mSnappingIndex )
     {
-      QgsGeometry* g = &( it.value() );
-      if ( g->boundingBox().intersects( searchRect ) )
-      {
-        snapToGeometry( startPoint, it.key(), g, sqrSnappingTolerance, snappingResults, snap_to );
-        ++n;
-      }
+      mSnappingIndex = new QgsSnappingIndex( mCachedGeometries );
     }
+    n = mSnappingIndex->snap( startPoint, snappingTolerance, snappingResults, snap_to, this );
   }
   else
   {
-    // snapping outside cached area
+    // snapping outside cached area, select() stops the rendering
+    cacheLocker.unlock();
 
     select( QgsAttributeList(), searchRect, true, true );
 
@@ -4691,6 +4960,8 @@ void QgsVectorLayer::setRendererV2( QgsFeatureRendererV2 *r )
 
   if ( r != mRendererV2 )
   {
+    QgsMapRendererJob::cancelRunningJobs();
+
     if ( r )
       setUsingRendererV2( true );
     delete mRendererV2;
@@ -4824,6 +5095,8 @@ void QgsVectorLayer::destroyEditCommand()
 
 void QgsVectorLayer::redoEditCommand( QgsUndoCommand* cmd )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   QMap<QgsFeatureId, QgsUndoCommand::GeometryChangeEntry>& geometryChange = cmd->mGeometryChange;
   QgsFeatureIds& deletedFeatureIdChange = cmd->mDeletedFeatureIdChange;
   QgsFeatureList& addedFeatures = cmd->mAddedFeatures;
@@ -4935,6 +5208,8 @@ void QgsVectorLayer::redoEditCommand( QgsUndoCommand* cmd )
 
 void QgsVectorLayer::undoEditCommand( QgsUndoCommand* cmd )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   QMap<QgsFeatureId, QgsUndoCommand::GeometryChangeEntry>& geometryChange = cmd->mGeometryChange;
   QgsFeatureIds& deletedFeatureIdChange = cmd->mDeletedFeatureIdChange;
   QgsFeatureList& addedFeatures = cmd->mAddedFeatures;
@@ -5088,6 +5363,8 @@ int QgsVectorLayer::fieldNameIndex( const QString& fieldName ) const
 
 void QgsVectorLayer::addJoin( QgsVectorJoinInfo joinInfo )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   mJoinBuffer->addJoin( joinInfo );
   updateFieldMap();
 }
@@ -5099,6 +5376,8 @@ void QgsVectorLayer::checkJoinLayerRemove( QString theLayerId )
 
 void QgsVectorLayer::removeJoin( const QString& joinLayerId )
 {
+  QgsMapRendererJob::cancelRunningJobs();
+
   mJoinBuffer->removeJoin( joinLayerId );
   updateFieldMap();
 }
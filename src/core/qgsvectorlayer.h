@@ -21,6 +21,7 @@
 #include <QMap>
 #include <QSet>
 #include <QList>
+#include <QMutex>
 #include <QStringList>
 
 #include "qgis.h"
@@ -48,6 +49,8 @@ class QgsRectangle;
 class QgsVectorLayerJoinBuffer;
 class QgsFeatureRendererV2;
 class QgsDiagramRendererV2;
+class QgsGeneralizedGeometryCache;
+class QgsSnappingIndex;
 struct QgsDiagramLayerSettings;
 
 typedef QList<int> QgsAttributeList;
@@ -244,6 +247,48 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
      */
     void setUsingRendererV2( bool usingRendererV2 );
 
+    /** Return whether vertices closer to each other than the simplify drawing
+     * tolerance are dropped when the layer is drawn with renderer V2.
+     * @note added in 1.9
+     */
+    bool simplifyDrawing() const { return mSimplifyDrawing; }
+    /** Set whether to drop vertices closer to each other than the simplify
+     * drawing tolerance when drawing. Not applied while editing.
+     * @note added in 1.9
+     */
+    void setSimplifyDrawing( bool simplify ) { mSimplifyDrawing = simplify; }
+    /** Return the simplify drawing tolerance in device pixels.
+     * @note added in 1.9
+     */
+    double simplifyDrawingTolerance() const { return mSimplifyDrawingTolerance; }
+    /** Set the simplify drawing tolerance in device pixels.
+     * @note added in 1.9
+     */
+    void setSimplifyDrawingTolerance( double tolerance ) { mSimplifyDrawingTolerance = tolerance; }
+
+    /** Build generalized copies of all geometries, one level per tolerance in layer units.
+     * When drawing with renderer V2 outside of editing, the coarsest level whose tolerance
+     * is below the size of a pixel is drawn instead of the geometries of the provider.
+     * The cache is dropped whenever features are added, deleted or their geometry changes.
+     * @return false for point layers or if there are no tolerances
+     * @note added in 1.9
+     */
+    bool buildGeneralizedCache( const QList<double>& tolerances );
+    /** Return whether generalized geometries have been built or loaded
+     * @note added in 1.9
+     */
+    bool hasGeneralizedCache() const { return mGeneralizedCache; }
+    /** Save the generalized geometries to a file, e.g. next to the data source
+     * @note added in 1.9
+     */
+    bool saveGeneralizedCache( const QString& fileName ) const;
+    /** Load generalized geometries saved for the same data source. Files written before
+     * the feature count, the extent or the size or modification time of a data source
+     * file changed are refused
+     * @note added in 1.9
+     */
+    bool loadGeneralizedCache( const QString& fileName );
+
     /** Draw layer with renderer V2.
      * @note added in 1.4
      */
@@ -343,10 +388,27 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
      */
     bool nextFeature( QgsFeature& feature );
 
+    /**
+     * fetch a batch of features (after select)
+     * @param features list the features are appended to
+     * @param maxCount maximal number of features to fetch
+     * @return number of features appended, 0 if there are no more features
+     * @note added in 1.9
+     */
+    int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /**Gets the feature at the given feature id. Considers the changed, added, deleted and permanent features
      @return true in case of success*/
     bool featureAtId( QgsFeatureId featureId, QgsFeature &f, bool fetchGeometries = true, bool fetchAttributes = true );
 
+    /** Prepares the layer to be drawn in another thread while it is read in its own thread.
+     * The other threads read the features from a second provider for the same data source,
+     * see QgsVectorDataProvider::createConcurrentProvider(). Creates the provider if it is
+     * called in the layer's thread, other threads only get whether it exists.
+     * @return false if the provider does not support it or the layer has joins
+     * @note added in 1.9 */
+    bool prepareBackgroundRendering();
+
     /** Adds a feature
         @param f feature to add
         @param alsoUpdateExtent If True, will also go to the effort of e.g. updating the extents.
@@ -480,6 +542,11 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
                          QMultiMap < double, QgsSnappingResult > &snappingResults,
                          QgsSnapper::SnappingType snap_to );
 
+    /**Returns a counter incremented whenever the geometries cached while editing are
+       complete for a newly drawn extent
+       @note added in 1.9 */
+    int cachedGeometriesRevision() const { return mCachedGeometriesRevision; }
+
     /**Synchronises with changes in the datasource
       @note added in version 1.6*/
     virtual void reload();
@@ -714,6 +781,10 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
       @note added in 1.7 */
     void checkJoinLayerRemove( QString theLayerId );
 
+    /** Drop the generalized geometries
+      @note added in 1.9 */
+    void clearGeneralizedCache();
+
     QString metadata();
 
   signals:
@@ -744,8 +815,40 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     void committedAttributeValuesChanges( const QString& layerId, const QgsChangedAttributesMap& changedAttributesValues );
     void committedGeometriesChanges( const QString& layerId, const QgsGeometryMap& changedGeometries );
 
+  private slots:
+
+    /** Keep mSnappingIndex in sync with the edit buffer */
+    void snappingIndexGeometryChanged( QgsFeatureId fid, QgsGeometry &geom );
+    void snappingIndexFeatureAdded( QgsFeatureId fid );
+    void snappingIndexFeatureDeleted( QgsFeatureId fid );
+
   private:                       // Private methods
 
+    /** State of the features selected with select() and fetched with nextFeature() */
+    struct FetchState
+    {
+      FetchState() : mProvider( 0 ), mFetching( false ), mGeometry( false ) {}
+
+      QgsVectorDataProvider* mProvider;
+      bool mFetching;
+      QgsRectangle mRect;
+      QgsAttributeList mAttributes;
+      QgsAttributeList mProvAttributes;
+      bool mGeometry;
+
+      QSet<QgsFeatureId> mConsidered;
+      QgsGeometryMap::iterator mChangedGeomIt;
+      QgsFeatureList::iterator mAddedFeaturesIt;
+    };
+
+    /** Returns the fetch state of the calling thread. Threads other than the layer's
+        read from the render provider if there is one, see prepareBackgroundRendering() */
+    FetchState& fetchState();
+
+    /** Cancels the background renderings and deletes the render provider,
+        which would not see the changes of the data source */
+    void deleteRenderProvider();
+
     /** vector layers are not copyable */
     QgsVectorLayer( QgsVectorLayer const & rhs );
 
@@ -786,6 +889,15 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     /**Deletes the geometries in mCachedGeometries*/
     void deleteCachedGeometries();
 
+    /**Sets the extent mCachedGeometries are complete for, once the layer has been drawn
+      without being stopped
+      @note added in 1.9 */
+    void setCachedGeometriesRect( const QgsRectangle& rect );
+
+    /**Adds the geometry of a drawn feature to mCachedGeometries and the snapping index
+      @note added in 1.9 */
+    void cacheGeometry( QgsFeature& fet );
+
     /**Snaps to a geometry and adds the result to the multimap if it is within the snapping result
      @param startPoint start point of the snap
      @param featureId id of feature
@@ -842,6 +954,17 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     /** Stop version 2 renderer and selected renderer (if required) */
     void stopRendererV2( QgsRenderContext& rendererContext, QgsSingleSymbolRendererV2* selRenderer );
 
+    /** Render a single feature with renderer V2 and register it for labeling
+     * @note added in 1.9
+     */
+    void drawFeatureV2( QgsFeature& fet, QgsRenderContext& rendererContext, bool labeling, bool vertexMarkerOnlyForSelection );
+
+    /** Number of features fetched from the provider at once while rendering */
+    static const int RenderBatchSize = 1000;
+
+    /** Level of the generalized geometry cache to draw in the given context, -1 to draw the provider geometries */
+    int generalizedCacheLevel( const QgsRenderContext& rendererContext ) const;
+
     /**Updates an index in an attribute map to a new value (usually necessary because of a join operation)*/
     void updateAttributeMapIndex( QgsAttributeMap& map, int oldIndex, int newIndex ) const;
 
@@ -853,11 +976,6 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
 
   private:                       // Private attributes
 
-    /** Update threshold for drawing features as they are read. A value of zero indicates
-     *  that no features will be drawn until all have been read
-     */
-    int mUpdateThreshold;
-
     /** Pointer to data provider derived from the abastract base class QgsDataProvider */
     QgsVectorDataProvider *mDataProvider;
 
@@ -882,9 +1000,16 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     /** cache of the committed geometries retrieved *for the current display* */
     QgsGeometryMap mCachedGeometries;
 
-    /** extent for which there are cached geometries */
+    /** extent for which the cached geometries are complete, empty while the layer is drawn */
     QgsRectangle mCachedGeometriesRect;
 
+    /** incremented when mCachedGeometriesRect is set, see cachedGeometriesRevision() */
+    int mCachedGeometriesRevision;
+
+    /** guards mCachedGeometries, mCachedGeometriesRect, mCachedGeometriesRevision and mSnappingIndex, which are
+        filled by the rendering thread while the layer is drawn in background */
+    QMutex mCachedGeometriesMutex;
+
     /** Set holding the feature IDs that are activated.  Note that if a feature
         subsequently gets deleted (i.e. by its addition to mDeletedFeatureIds),
         it always needs to be removed from mSelectedFeatureIds as well.
@@ -937,6 +1062,21 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     /** whether to use V1 or V2 renderer */
     bool mUsingRendererV2;
 
+    /** whether to drop vertices closer than mSimplifyDrawingTolerance pixels when drawing */
+    bool mSimplifyDrawing;
+
+    /** simplify drawing tolerance in device pixels */
+    double mSimplifyDrawingTolerance;
+
+    /** generalized geometries for small scales, 0 if not built */
+    QgsGeneralizedGeometryCache *mGeneralizedCache;
+
+    /** level of mGeneralizedCache drawn by the current draw() call, -1 if none */
+    int mGeneralizedCacheLevel;
+
+    /** segments of mCachedGeometries for snapping, built on the first snap, 0 if not built */
+    QgsSnappingIndex *mSnappingIndex;
+
     /** Label */
     QgsLabel *mLabel;
 
@@ -967,15 +1107,12 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     //annotation form for this layer
     QString mAnnotationForm;
 
-    bool mFetching;
-    QgsRectangle mFetchRect;
-    QgsAttributeList mFetchAttributes;
-    QgsAttributeList mFetchProvAttributes;
-    bool mFetchGeometry;
+    /** features fetched in the layer's thread */
+    FetchState mFetch;
 
-    QSet<QgsFeatureId> mFetchConsidered;
-    QgsGeometryMap::iterator mFetchChangedGeomIt;
-    QgsFeatureList::iterator mFetchAddedFeaturesIt;
+    /** provider and features fetched by background renderings, see prepareBackgroundRendering() */
+    QgsVectorDataProvider *mRenderProvider;
+    FetchState mRenderFetch;
 
     //stores information about joined layers
     QgsVectorLayerJoinBuffer* mJoinBuffer;
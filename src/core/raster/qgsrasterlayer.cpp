@@ -19,11 +19,13 @@ email                : tim at linfiniti.com
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsmaplayerregistry.h"
+#include "qgsmaprendererjob.h"
 #include "qgsmaptopixel.h"
 #include "qgsproviderregistry.h"
 #include "qgsrasterbandstats.h"
 #include "qgsrasterlayer.h"
 #include "qgsrasterpyramid.h"
+#include "qgsrastertilecache.h"
 #include "qgsrectangle.h"
 #include "qgsrendercontext.h"
 #include "qgscoordinatereferencesystem.h"
@@ -80,6 +82,93 @@ typedef bool isvalidrasterfilename_t( QString const & theFileNameQString, QStrin
 // doubles can take for the current system.  (Yes, 20 was arbitrary.)
 #define TINY_VALUE  std::numeric_limits<double>::epsilon() * 20
 
+// Scan line kernels used by the drawing routines. The data type switch is
+// resolved once per scan line, the loops themselves are free of branches on
+// the data type so that the compiler can vectorize them.
+
+// Convert a scan line of raster values of type T to doubles
+template <class T>
+static void convertScanLine( const void *data, double *values, int count )
+{
+  const T *src = static_cast<const T *>( data );
+  for ( int i = 0; i < count; ++i )
+  {
+    values[i] = static_cast<double>( src[i] );
+  }
+}
+
+// Map a scan line of raster values of integer type T through a table
+// holding a result for every possible value
+template <class T, class V>
+static void lookupTypedScanLine( const void *data, const V *table, int offset, V *dst, int count )
+{
+  const T *src = static_cast<const T *>( data );
+  for ( int i = 0; i < count; ++i )
+  {
+    dst[i] = table[ static_cast<int>( src[i] ) + offset ];
+  }
+}
+
+// Map a scan line through a table built from lookupTableValues(),
+// returns false if the data type has no lookup table
+template <class V>
+static bool lookupScanLine( void *data, int type, const V *table, V *dst, int count )
+{
+  if ( !data )
+    return false;
+
+  switch ( type )
+  {
+    case QgsRasterDataProvider::Byte:
+      lookupTypedScanLine<GByte, V>( data, table, 0, dst, count );
+      return true;
+    case QgsRasterDataProvider::UInt16:
+      lookupTypedScanLine<GUInt16, V>( data, table, 0, dst, count );
+      return true;
+    case QgsRasterDataProvider::Int16:
+      lookupTypedScanLine<GInt16, V>( data, table, 32768, dst, count );
+      return true;
+    default:
+      break;
+  }
+  return false;
+}
+
+// Every possible value of a Byte, UInt16 or Int16 band in ascending order.
+// Empty for wider data types and for views having less pixels than the
+// table, where computing the table would cost more than it saves.
+static QVector<double> lookupTableValues( int type, const QgsRasterViewPort *viewPort )
+{
+  int mySize = 0;
+  double myMinimum = 0.0;
+  switch ( type )
+  {
+    case QgsRasterDataProvider::Byte:
+      mySize = 256;
+      break;
+    case QgsRasterDataProvider::UInt16:
+      mySize = 65536;
+      break;
+    case QgsRasterDataProvider::Int16:
+      mySize = 65536;
+      myMinimum = -32768.0;
+      break;
+    default:
+      break;
+  }
+
+  QVector<double> myValues;
+  if ( mySize == 0 || ( double ) viewPort->drawableAreaXDim * viewPort->drawableAreaYDim < mySize )
+    return myValues;
+
+  myValues.resize( mySize );
+  for ( int i = 0; i < mySize; ++i )
+  {
+    myValues[i] = myMinimum + i;
+  }
+  return myValues;
+}
+
 
 QgsRasterLayer::QgsRasterLayer(
   QString const & path,
@@ -176,6 +265,7 @@ QgsRasterLayer::QgsRasterLayer( int dummy,
 
 QgsRasterLayer::~QgsRasterLayer()
 {
+  QgsRasterTileCache::instance()->removeLayer( id() );
   mValid = false;
   delete mRasterShader;
   delete mDataProvider;
@@ -788,7 +878,17 @@ bool QgsRasterLayer::draw( QgsRenderContext& rendererContext )
 
   mDataProvider->setDpi( rendererContext.rasterScaleFactor() * 25.4 * rendererContext.scaleFactor() );
 
-  draw( theQPainter, myRasterViewPort, &theQgsMapToPixel );
+  if ( !mDrawingTile && canDrawTiled( rendererContext ) )
+  {
+    drawTiled( rendererContext );
+
+    // drawing the tiles replaced the view port, keep the one of the whole view
+    mLastViewPort = *myRasterViewPort;
+  }
+  else
+  {
+    draw( theQPainter, myRasterViewPort, &theQgsMapToPixel );
+  }
 
   delete myRasterViewPort;
   QgsDebugMsg( "exiting." );
@@ -797,6 +897,104 @@ bool QgsRasterLayer::draw( QgsRenderContext& rendererContext )
 
 }
 
+bool QgsRasterLayer::canDrawTiled( QgsRenderContext& rendererContext ) const
+{
+  // local files only, other providers are tiled (WMS) or slow to read in small blocks
+  if ( mProviderKey != "gdal" )
+    return false;
+
+  // tiles are aligned to the map grid, which doesn't work for reprojected layers
+  if ( rendererContext.coordinateTransform() )
+    return false;
+
+  // only cache what ends up as pixels anyway (not printing or exporting)
+  QPainter* painter = rendererContext.painter();
+  if ( !painter || !painter->device() || !painter->transform().isIdentity() )
+    return false;
+
+  int deviceType = painter->device()->devType();
+  if ( deviceType != QInternal::Image && deviceType != QInternal::Pixmap )
+    return false;
+
+  QSettings settings;
+  return settings.value( "/qgis/raster_tile_cache", true ).toBool();
+}
+
+void QgsRasterLayer::drawTiled( QgsRenderContext& rendererContext )
+{
+  const QgsMapToPixel& theQgsMapToPixel = rendererContext.mapToPixel();
+  double myMapUnitsPerPixel = theQgsMapToPixel.mapUnitsPerPixel();
+  double myTileExtentSize = QgsRasterTileCache::TileSize * myMapUnitsPerPixel;
+
+  QgsRectangle myExtent = rendererContext.extent().intersect( &mLayerExtent );
+  if ( myExtent.isEmpty() || myMapUnitsPerPixel <= 0 )
+    return;
+
+  // everything that changes the content of a tile goes into its key.
+  // Tiles drawn with a previous symbology are not used again and drop out of the cache
+  QString myState = QString( "%1|%2|%3|%4" )
+                    .arg( mSymbologyRevision )
+                    .arg( mTransparencyLevel )
+                    .arg( mDataProvider->dataTimestamp().toTime_t() )
+                    .arg( myMapUnitsPerPixel, 0, 'g', 17 );
+
+  int myColumnMin = ( int ) floor( myExtent.xMinimum() / myTileExtentSize );
+  int myColumnMax = ( int ) floor( myExtent.xMaximum() / myTileExtentSize );
+  int myRowMin = ( int ) floor( myExtent.yMinimum() / myTileExtentSize );
+  int myRowMax = ( int ) floor( myExtent.yMaximum() / myTileExtentSize );
+
+  QgsRasterTileCache* myCache = QgsRasterTileCache::instance();
+  QPainter* theQPainter = rendererContext.painter();
+
+  // the top left corner of the first tile is snapped to a device pixel once, the other
+  // tiles are placed whole tiles away from it so that no seams or overlaps appear
+  QgsPoint myGridOrigin = theQgsMapToPixel.transform( myColumnMin * myTileExtentSize, ( myRowMax + 1 ) * myTileExtentSize );
+  QPoint myGridOriginPixel( qRound( myGridOrigin.x() ), qRound( myGridOrigin.y() ) );
+
+  for ( int myRow = myRowMax; myRow >= myRowMin; --myRow )
+  {
+    for ( int myColumn = myColumnMin; myColumn <= myColumnMax; ++myColumn )
+    {
+      if ( rendererContext.renderingStopped() )
+        return;
+
+      QgsRectangle myTileExtent( myColumn * myTileExtentSize, myRow * myTileExtentSize,
+                                 ( myColumn + 1 ) * myTileExtentSize, ( myRow + 1 ) * myTileExtentSize );
+
+      QString myKey = QString( "%1|%2|%3" ).arg( myState ).arg( myColumn ).arg( myRow );
+      QImage myTile = myCache->tile( id(), myKey );
+      if ( myTile.isNull() )
+      {
+        myTile = QImage( QgsRasterTileCache::TileSize, QgsRasterTileCache::TileSize, QImage::Format_ARGB32_Premultiplied );
+        myTile.fill( 0 );
+
+        QPainter myTilePainter( &myTile );
+
+        QgsRenderContext myTileContext;
+        myTileContext.setPainter( &myTilePainter );
+        myTileContext.setExtent( myTileExtent );
+        myTileContext.setMapToPixel( QgsMapToPixel( myMapUnitsPerPixel, QgsRasterTileCache::TileSize,
+                                     myTileExtent.yMinimum(), myTileExtent.xMinimum() ) );
+        myTileContext.setScaleFactor( rendererContext.scaleFactor() );
+        myTileContext.setRasterScaleFactor( rendererContext.rasterScaleFactor() );
+        myTileContext.setRendererScale( rendererContext.rendererScale() );
+
+        mDrawingTile = true;
+        draw( myTileContext );
+        mDrawingTile = false;
+
+        myTilePainter.end();
+
+        myCache->insertTile( id(), myKey, myTile );
+      }
+
+      QPoint myOrigin = myGridOriginPixel + QPoint(( myColumn - myColumnMin ) * QgsRasterTileCache::TileSize,
+                                                   ( myRowMax - myRow ) * QgsRasterTileCache::TileSize );
+      theQPainter->drawImage( myOrigin, myTile );
+    }
+  }
+}
+
 void QgsRasterLayer::draw( QPainter * theQPainter,
                            QgsRasterViewPort * theRasterViewPort,
                            const QgsMapToPixel* theQgsMapToPixel )
@@ -1041,6 +1239,9 @@ bool QgsRasterLayer::identify( const QgsPoint& thePoint, QMap<QString, QString>&
 {
   theResults.clear();
 
+  // the GDAL dataset must not be read while a background job draws it
+  QgsMapRendererJob::cancelRunningJobs();
+
   QgsDebugMsg( "identify provider : " + mProviderKey ) ;
   return ( mDataProvider->identify( thePoint, theResults ) );
 }
@@ -2087,6 +2288,7 @@ void QgsRasterLayer::resetNoDataValue()
 
 void QgsRasterLayer::setBlueBandName( QString const & theBandName )
 {
+  ++mSymbologyRevision;
   mBlueBandName = validateBandName( theBandName );
 }
 
@@ -2125,6 +2327,9 @@ void QgsRasterLayer::init()
   mNoDataValue = -9999.0;
   mValidNoDataValue = false;
 
+  mDrawingTile = false;
+  mSymbologyRevision = 0;
+
   //Initialize the last view port structure, should really be a class
   mLastViewPort.drawableAreaXDim = 0;
   mLastViewPort.drawableAreaYDim = 0;
@@ -2520,6 +2725,7 @@ void QgsRasterLayer::closeDataProvider()
 
 void QgsRasterLayer::setColorShadingAlgorithm( ColorShadingAlgorithm theShadingAlgorithm )
 {
+  ++mSymbologyRevision;
   QgsDebugMsg( "called with [" + QString::number( theShadingAlgorithm ) + "]" );
   if ( mColorShadingAlgorithm != theShadingAlgorithm )
   {
@@ -2571,6 +2777,7 @@ void QgsRasterLayer::setColorShadingAlgorithm( QString theShaderAlgorithm )
 
 void QgsRasterLayer::setContrastEnhancementAlgorithm( QgsContrastEnhancement::ContrastEnhancementAlgorithm theAlgorithm, bool theGenerateLookupTableFlag )
 {
+  ++mSymbologyRevision;
   QList<QgsContrastEnhancement>::iterator myIterator = mContrastEnhancementList.begin();
   while ( myIterator !=  mContrastEnhancementList.end() )
   {
@@ -2612,6 +2819,7 @@ void QgsRasterLayer::setContrastEnhancementAlgorithm( QString theAlgorithm, bool
 
 void QgsRasterLayer::setContrastEnhancementFunction( QgsContrastEnhancementFunction* theFunction )
 {
+  ++mSymbologyRevision;
   if ( theFunction )
   {
     QList<QgsContrastEnhancement>::iterator myIterator = mContrastEnhancementList.begin();
@@ -2630,6 +2838,7 @@ void QgsRasterLayer::setContrastEnhancementFunction( QgsContrastEnhancementFunct
  */
 void QgsRasterLayer::setDrawingStyle( QString const & theDrawingStyleQString )
 {
+  ++mSymbologyRevision;
   QgsDebugMsg( "DrawingStyle = " + theDrawingStyleQString );
   if ( theDrawingStyleQString == "SingleBandGray" )//no need to tr() this its not shown in ui
   {
@@ -2681,11 +2890,13 @@ void QgsRasterLayer::setDrawingStyle( QString const & theDrawingStyleQString )
 
 void QgsRasterLayer::setGrayBandName( QString const & theBandName )
 {
+  ++mSymbologyRevision;
   mGrayBandName = validateBandName( theBandName );
 }
 
 void QgsRasterLayer::setGreenBandName( QString const & theBandName )
 {
+  ++mSymbologyRevision;
   mGreenBandName = validateBandName( theBandName );
 }
 
@@ -2706,6 +2917,9 @@ void QgsRasterLayer::setMaximumValue( unsigned int theBand, double theValue, boo
   QgsDebugMsg( "setMaximumValue theValue = " + QString::number( theValue ) );
   if ( 0 < theBand && theBand <= bandCount() )
   {
+    // the drawing routines set the stretch on every draw, mostly to the same values
+    if ( mContrastEnhancementList[theBand - 1].maximumValue() != theValue )
+      ++mSymbologyRevision;
     mContrastEnhancementList[theBand - 1].setMaximumValue( theValue, theGenerateLookupTableFlag );
   }
 }
@@ -2787,6 +3001,9 @@ void QgsRasterLayer::setMinimumValue( unsigned int theBand, double theValue, boo
   QgsDebugMsg( "setMinimumValue theValue = " + QString::number( theValue ) );
   if ( 0 < theBand && theBand <= bandCount() )
   {
+    // the drawing routines set the stretch on every draw, mostly to the same values
+    if ( mContrastEnhancementList[theBand - 1].minimumValue() != theValue )
+      ++mSymbologyRevision;
     mContrastEnhancementList[theBand - 1].setMinimumValue( theValue, theGenerateLookupTableFlag );
   }
 }
@@ -2804,6 +3021,7 @@ void QgsRasterLayer::setNoDataValue( double theNoDataValue )
 {
   if ( theNoDataValue != mNoDataValue )
   {
+    ++mSymbologyRevision;
     mNoDataValue = theNoDataValue;
     mValidNoDataValue = true;
     //Basically set the raster stats as invalid
@@ -2818,6 +3036,7 @@ void QgsRasterLayer::setNoDataValue( double theNoDataValue )
 
 void QgsRasterLayer::setRasterShaderFunction( QgsRasterShaderFunction* theFunction )
 {
+  ++mSymbologyRevision;
   if ( theFunction )
   {
     mRasterShader->setRasterShaderFunction( theFunction );
@@ -2833,6 +3052,7 @@ void QgsRasterLayer::setRasterShaderFunction( QgsRasterShaderFunction* theFuncti
 
 void QgsRasterLayer::setRedBandName( QString const & theBandName )
 {
+  ++mSymbologyRevision;
   QgsDebugMsg( "setRedBandName :  " + theBandName );
   mRedBandName = validateBandName( theBandName );
 }
@@ -2850,6 +3070,7 @@ void QgsRasterLayer::setSubLayerVisibility( QString name, bool vis )
 
 void QgsRasterLayer::setTransparentBandName( QString const & theBandName )
 {
+  ++mSymbologyRevision;
   mTransparencyBandName = validateBandName( theBandName );
 }
 
@@ -2957,6 +3178,7 @@ void QgsRasterLayer::thumbnailAsImage( QImage * thepImage )
 
 void QgsRasterLayer::triggerRepaint()
 {
+  ++mSymbologyRevision;
   emit repaintRequested();
 }
 
@@ -2986,6 +3208,7 @@ void QgsRasterLayer::onProgress( int theType, double theProgress, QString theMes
  */
 bool QgsRasterLayer::readSymbology( const QDomNode& layer_node, QString& errorMessage )
 {
+  ++mSymbologyRevision;
   Q_UNUSED( errorMessage );
   QDomNode mnl = layer_node.namedItem( "rasterproperties" );
   QDomNode snode = mnl.namedItem( "mDrawingStyle" );
@@ -3770,16 +3993,6 @@ void QgsRasterLayer::drawMultiBandColor( QPainter * theQPainter, QgsRasterViewPo
     setMaximumValue( myBlueBandNo, mDataProvider->maximumValue( myBlueBandNo ) );
   }
 
-  //Read and display pixels
-  double myRedValue = 0.0;
-  double myGreenValue = 0.0;
-  double myBlueValue = 0.0;
-  int myTransparencyValue = 0;
-
-  int myStretchedRedValue   = 0;
-  int myStretchedGreenValue = 0;
-  int myStretchedBlueValue  = 0;
-  int myAlphaValue = 0;
   QgsContrastEnhancement* myRedContrastEnhancement = contrastEnhancement( myRedBandNo );
   QgsContrastEnhancement* myGreenContrastEnhancement = contrastEnhancement( myGreenBandNo );
   QgsContrastEnhancement* myBlueContrastEnhancement = contrastEnhancement( myBlueBandNo );
@@ -3801,79 +4014,83 @@ void QgsRasterLayer::drawMultiBandColor( QPainter * theQPainter, QgsRasterViewPo
     transparencyImageBuffer->reset();
   }
 
+  int myWidth = theRasterViewPort->drawableAreaXDim;
+  QVector<double> myRedValues( myWidth );
+  QVector<double> myGreenValues( myWidth );
+  QVector<double> myBlueValues( myWidth );
+  QVector<double> myTransparencyValues( hasTransparencyBand ? myWidth : 0 );
+  QVector<int> myRedChannel( myWidth );
+  QVector<int> myGreenChannel( myWidth );
+  QVector<int> myBlueChannel( myWidth );
+
+  // Without transparent pixel values the alpha does not depend on the raw
+  // values and the channels of Byte and 16 bit bands can be stretched through tables
+  bool myConstantAlpha = mRasterTransparency.transparentThreeValuePixelList().isEmpty();
+  QVector<int> myRedTable;
+  QVector<int> myGreenTable;
+  QVector<int> myBlueTable;
+  if ( myConstantAlpha )
+  {
+    QVector<double> myTableValues = lookupTableValues( myRedType, theRasterViewPort );
+    myRedTable.resize( myTableValues.size() );
+    colorChannelScanLine( myTableValues.constData(), myRedTable.data(), myTableValues.size(), myRedContrastEnhancement );
+
+    myTableValues = lookupTableValues( myGreenType, theRasterViewPort );
+    myGreenTable.resize( myTableValues.size() );
+    colorChannelScanLine( myTableValues.constData(), myGreenTable.data(), myTableValues.size(), myGreenContrastEnhancement );
+
+    myTableValues = lookupTableValues( myBlueType, theRasterViewPort );
+    myBlueTable.resize( myTableValues.size() );
+    colorChannelScanLine( myTableValues.constData(), myBlueTable.data(), myTableValues.size(), myBlueContrastEnhancement );
+  }
+
   while ( redImageBuffer.nextScanLine( &redImageScanLine, &redRasterScanLine )
           && greenImageBuffer.nextScanLine( &greenImageScanLine, &greenRasterScanLine )
           && blueImageBuffer.nextScanLine( &blueImageScanLine, &blueRasterScanLine )
           && ( !transparencyImageBuffer || transparencyImageBuffer->nextScanLine( &transparencyImageScanLine, &transparencyRasterScanLine ) ) )
   {
-    for ( int i = 0; i < theRasterViewPort->drawableAreaXDim; ++i )
+    if ( myRedTable.isEmpty() || !lookupScanLine( redRasterScanLine, myRedType, myRedTable.constData(), myRedChannel.data(), myWidth ) )
     {
-      if ( transparencyImageBuffer )
-      {
-        myTransparencyValue = readValue( transparencyRasterScanLine, myTransparencyType, i );
-        if ( 0 == myTransparencyValue )
-        {
-          redImageScanLine[ i ] = myDefaultColor;
-          continue;
-        }
-      }
-
-      myRedValue   = readValue( redRasterScanLine, myRedType, i );
-      myGreenValue = readValue( greenRasterScanLine, myGreenType, i );
-      myBlueValue  = readValue( blueRasterScanLine, myBlueType, i );
-
-      if ( mValidNoDataValue &&
-           (
-             ( qAbs( myRedValue - mNoDataValue ) <= TINY_VALUE || myRedValue != myRedValue ) ||
-             ( qAbs( myGreenValue - mNoDataValue ) <= TINY_VALUE || myGreenValue != myGreenValue ) ||
-             ( qAbs( myBlueValue - mNoDataValue ) <= TINY_VALUE || myBlueValue != myBlueValue )
-           )
-         )
-      {
-        redImageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
+      readScanLine( redRasterScanLine, myRedType, myRedValues.data(), myWidth );
+      colorChannelScanLine( myRedValues.constData(), myRedChannel.data(), myWidth, myRedContrastEnhancement );
+    }
+    if ( myGreenTable.isEmpty() || !lookupScanLine( greenRasterScanLine, myGreenType, myGreenTable.constData(), myGreenChannel.data(), myWidth ) )
+    {
+      readScanLine( greenRasterScanLine, myGreenType, myGreenValues.data(), myWidth );
+      colorChannelScanLine( myGreenValues.constData(), myGreenChannel.data(), myWidth, myGreenContrastEnhancement );
+    }
+    if ( myBlueTable.isEmpty() || !lookupScanLine( blueRasterScanLine, myBlueType, myBlueTable.constData(), myBlueChannel.data(), myWidth ) )
+    {
+      readScanLine( blueRasterScanLine, myBlueType, myBlueValues.data(), myWidth );
+      colorChannelScanLine( myBlueValues.constData(), myBlueChannel.data(), myWidth, myBlueContrastEnhancement );
+    }
 
-      if ( QgsContrastEnhancement::NoEnhancement != contrastEnhancementAlgorithm() &&
-           ( !myRedContrastEnhancement->isValueInDisplayableRange( myRedValue ) ||
-             !myGreenContrastEnhancement->isValueInDisplayableRange( myGreenValue ) ||
-             !myBlueContrastEnhancement->isValueInDisplayableRange( myBlueValue ) ) )
+    const int *myRed = myRedChannel.constData();
+    const int *myGreen = myGreenChannel.constData();
+    const int *myBlue = myBlueChannel.constData();
+    for ( int i = 0; i < myWidth; ++i )
+    {
+      if ( myRed[i] < 0 || myGreen[i] < 0 || myBlue[i] < 0 )
       {
         redImageScanLine[ i ] = myDefaultColor;
         continue;
       }
 
-      myAlphaValue = mRasterTransparency.alphaValue( myRedValue, myGreenValue, myBlueValue, mTransparencyLevel );
+      int myAlphaValue = myConstantAlpha ? mTransparencyLevel :
+                         mRasterTransparency.alphaValue( myRedValues[i], myGreenValues[i], myBlueValues[i], mTransparencyLevel );
       if ( 0 == myAlphaValue )
       {
         redImageScanLine[ i ] = myDefaultColor;
         continue;
       }
 
-      if ( QgsContrastEnhancement::NoEnhancement == contrastEnhancementAlgorithm() )
-      {
-        myStretchedRedValue = myRedValue;
-        myStretchedGreenValue = myGreenValue;
-        myStretchedBlueValue = myBlueValue;
-      }
-      else
-      {
-        myStretchedRedValue = myRedContrastEnhancement->enhanceContrast( myRedValue );
-        myStretchedGreenValue = myGreenContrastEnhancement->enhanceContrast( myGreenValue );
-        myStretchedBlueValue = myBlueContrastEnhancement->enhanceContrast( myBlueValue );
-      }
-
-      if ( mInvertColor )
-      {
-        myStretchedRedValue = 255 - myStretchedRedValue;
-        myStretchedGreenValue = 255 - myStretchedGreenValue;
-        myStretchedBlueValue = 255 - myStretchedBlueValue;
-      }
-
-      if ( myTransparencyValue )
-        myAlphaValue *= myTransparencyValue / 255.0;
+      redImageScanLine[ i ] = qRgba( myRed[i], myGreen[i], myBlue[i], myAlphaValue );
+    }
 
-      redImageScanLine[ i ] = qRgba( myStretchedRedValue, myStretchedGreenValue, myStretchedBlueValue, myAlphaValue );
+    if ( transparencyImageBuffer )
+    {
+      readScanLine( transparencyRasterScanLine, myTransparencyType, myTransparencyValues.data(), myWidth );
+      transparencyScanLine( myTransparencyValues.constData(), redImageScanLine, myWidth );
     }
   }
 
@@ -4299,11 +4516,6 @@ void QgsRasterLayer::drawSingleBandGray( QPainter * theQPainter, QgsRasterViewPo
   QRgb* transparencyImageScanLine = 0;
   void* transparencyRasterScanLine = 0;
 
-  QRgb myDefaultColor = qRgba( 255, 255, 255, 0 );
-  double myGrayValue = 0.0;
-  int myGrayVal = 0;
-  int myTransparencyValue = 0;
-  int myAlphaValue = 0;
   QgsContrastEnhancement* myContrastEnhancement = contrastEnhancement( theBandNo );
 
   QgsRasterBandStats myGrayBandStats;
@@ -4324,61 +4536,33 @@ void QgsRasterLayer::drawSingleBandGray( QPainter * theQPainter, QgsRasterViewPo
     setMinimumValue( theBandNo, mDataProvider->minimumValue( theBandNo ) );
   }
 
+  int myWidth = theRasterViewPort->drawableAreaXDim;
+  QVector<double> myValues( myWidth );
+  QVector<double> myTransparencyValues( hasTransparencyBand ? myWidth : 0 );
+
+  // Byte and 16 bit bands are colored through a table holding the color of every possible value
+  QVector<QRgb> myColorTable;
+  QVector<double> myTableValues = lookupTableValues( myDataType, theRasterViewPort );
+  if ( !myTableValues.isEmpty() )
+  {
+    myColorTable.resize( myTableValues.size() );
+    grayScanLine( myTableValues.constData(), myColorTable.data(), myTableValues.size(), myContrastEnhancement );
+  }
+
   QgsDebugMsg( " -> imageBuffer.nextScanLine" );
   while ( imageBuffer.nextScanLine( &imageScanLine, &rasterScanLine )
           && ( !transparencyImageBuffer || transparencyImageBuffer->nextScanLine( &transparencyImageScanLine, &transparencyRasterScanLine ) ) )
   {
-    //QgsDebugMsg( " rendering line");
-    for ( int i = 0; i < theRasterViewPort->drawableAreaXDim; ++i )
+    if ( myColorTable.isEmpty() || !lookupScanLine( rasterScanLine, myDataType, myColorTable.constData(), imageScanLine, myWidth ) )
     {
-      if ( transparencyImageBuffer )
-      {
-        myTransparencyValue = readValue( transparencyRasterScanLine, myTransparencyType, i );
-        if ( 0 == myTransparencyValue )
-        {
-          imageScanLine[ i ] = myDefaultColor;
-          continue;
-        }
-      }
-
-      myGrayValue = readValue( rasterScanLine, myDataType, i );
-      //QgsDebugMsg( QString( "i = %1 myGrayValue = %2 ").arg(i).arg( myGrayValue ) );
-      //if ( myGrayValue != -2147483647 ) {
-      //QgsDebugMsg( "myGrayValue = " + QString::number( myGrayValue ) );
-      //}
-
-      if ( mValidNoDataValue && ( qAbs( myGrayValue - mNoDataValue ) <= TINY_VALUE || myGrayValue != myGrayValue ) )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-      if ( !myContrastEnhancement->isValueInDisplayableRange( myGrayValue ) )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-      myAlphaValue = mRasterTransparency.alphaValue( myGrayValue, mTransparencyLevel );
-      if ( 0 == myAlphaValue )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-
-      myGrayVal = myContrastEnhancement->enhanceContrast( myGrayValue );
-
-      if ( mInvertColor )
-      {
-        myGrayVal = 255 - myGrayVal;
-      }
-
-      if ( myTransparencyValue )
-        myAlphaValue *= myTransparencyValue / 255.0;
+      readScanLine( rasterScanLine, myDataType, myValues.data(), myWidth );
+      grayScanLine( myValues.constData(), imageScanLine, myWidth, myContrastEnhancement );
+    }
 
-      //QgsDebugMsg( QString( "i = %1 myGrayValue = %2 myGrayVal = %3 myAlphaValue = %4").arg(i).arg( myGrayValue ).arg(myGrayVal).arg(myAlphaValue) );
-      imageScanLine[ i ] = qRgba( myGrayVal, myGrayVal, myGrayVal, myAlphaValue );
+    if ( transparencyImageBuffer )
+    {
+      readScanLine( transparencyRasterScanLine, myTransparencyType, myTransparencyValues.data(), myWidth );
+      transparencyScanLine( myTransparencyValues.constData(), imageScanLine, myWidth );
     }
   }
 
@@ -4424,8 +4608,6 @@ void QgsRasterLayer::drawSingleBandPseudoColor( QPainter * theQPainter, QgsRaste
   QRgb* transparencyImageScanLine = 0;
   void* transparencyRasterScanLine = 0;
 
-  QRgb myDefaultColor = qRgba( 255, 255, 255, 0 );
-
   double myMinimumValue = 0.0;
   double myMaximumValue = 0.0;
   //Use standard deviations if set, otherwise, use min max of band
@@ -4443,64 +4625,32 @@ void QgsRasterLayer::drawSingleBandPseudoColor( QPainter * theQPainter, QgsRaste
   mRasterShader->setMinimumValue( myMinimumValue );
   mRasterShader->setMaximumValue( myMaximumValue );
 
-  int myRedValue = 255;
-  int myGreenValue = 255;
-  int myBlueValue = 255;
-  int myTransparencyValue = 0;
+  int myWidth = theRasterViewPort->drawableAreaXDim;
+  QVector<double> myValues( myWidth );
+  QVector<double> myTransparencyValues( hasTransparencyBand ? myWidth : 0 );
 
-  double myPixelValue = 0.0;
-  int myAlphaValue = 0;
+  // shading is expensive, shade every possible value of Byte and 16 bit bands only once
+  QVector<QRgb> myColorTable;
+  QVector<double> myTableValues = lookupTableValues( myDataType, theRasterViewPort );
+  if ( !myTableValues.isEmpty() )
+  {
+    myColorTable.resize( myTableValues.size() );
+    pseudoColorScanLine( myTableValues.constData(), myColorTable.data(), myTableValues.size() );
+  }
 
   while ( imageBuffer.nextScanLine( &imageScanLine, &rasterScanLine )
           && ( !transparencyImageBuffer || transparencyImageBuffer->nextScanLine( &transparencyImageScanLine, &transparencyRasterScanLine ) ) )
   {
-    for ( int i = 0; i < theRasterViewPort->drawableAreaXDim; ++i )
+    if ( myColorTable.isEmpty() || !lookupScanLine( rasterScanLine, myDataType, myColorTable.constData(), imageScanLine, myWidth ) )
     {
-      if ( transparencyImageBuffer )
-      {
-        myTransparencyValue = readValue( transparencyRasterScanLine, myTransparencyType, i );
-        if ( 0 == myTransparencyValue )
-        {
-          imageScanLine[ i ] = myDefaultColor;
-          continue;
-        }
-      }
-
-      myPixelValue = readValue( rasterScanLine, myDataType, i );
-
-      if ( mValidNoDataValue && ( qAbs( myPixelValue - mNoDataValue ) <= TINY_VALUE || myPixelValue != myPixelValue ) )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-      myAlphaValue = mRasterTransparency.alphaValue( myPixelValue, mTransparencyLevel );
-      if ( 0 == myAlphaValue )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-      if ( !mRasterShader->shade( myPixelValue, &myRedValue, &myGreenValue, &myBlueValue ) )
-      {
-        imageScanLine[ i ] = myDefaultColor;
-        continue;
-      }
-
-      if ( myTransparencyValue )
-        myAlphaValue *= myTransparencyValue / 255.0;
+      readScanLine( rasterScanLine, myDataType, myValues.data(), myWidth );
+      pseudoColorScanLine( myValues.constData(), imageScanLine, myWidth );
+    }
 
-      if ( mInvertColor )
-      {
-        //Invert flag, flip blue and red
-        imageScanLine[ i ] = qRgba( myBlueValue, myGreenValue, myRedValue, myAlphaValue );
-      }
-      else
-      {
-        //Normal
-        imageScanLine[ i ] = qRgba( myRedValue, myGreenValue, myBlueValue, myAlphaValue );
-        //QgsDebugMsg ( QString ( "%1 value :  %2 rgba : %3 %4 %5 %6" ).arg (i).arg( myPixelValue ).arg(myRedValue).arg(myGreenValue).arg(myBlueValue).arg(myAlphaValue) );
-      }
+    if ( transparencyImageBuffer )
+    {
+      readScanLine( transparencyRasterScanLine, myTransparencyType, myTransparencyValues.data(), myWidth );
+      transparencyScanLine( myTransparencyValues.constData(), imageScanLine, myWidth );
     }
   }
 
@@ -4637,6 +4787,191 @@ double QgsRasterLayer::readValue( void *data, int type, int index )
   return mValidNoDataValue ? mNoDataValue : 0.0;
 }
 
+/*
+ *  @param values receives count values converted to double
+ */
+void QgsRasterLayer::readScanLine( void *data, int type, double *values, int count )
+{
+  if ( data )
+  {
+    switch ( type )
+    {
+      case QgsRasterDataProvider::Byte:
+        convertScanLine<GByte>( data, values, count );
+        return;
+      case QgsRasterDataProvider::UInt16:
+        convertScanLine<GUInt16>( data, values, count );
+        return;
+      case QgsRasterDataProvider::Int16:
+        convertScanLine<GInt16>( data, values, count );
+        return;
+      case QgsRasterDataProvider::UInt32:
+        convertScanLine<GUInt32>( data, values, count );
+        return;
+      case QgsRasterDataProvider::Int32:
+        convertScanLine<GInt32>( data, values, count );
+        return;
+      case QgsRasterDataProvider::Float32:
+        convertScanLine<float>( data, values, count );
+        return;
+      case QgsRasterDataProvider::Float64:
+        convertScanLine<double>( data, values, count );
+        return;
+      default:
+        QgsMessageLog::logMessage( tr( "GDAL data type %1 is not supported" ).arg( type ), tr( "Raster" ) );
+        break;
+    }
+  }
+
+  double myValue = mValidNoDataValue ? mNoDataValue : 0.0;
+  for ( int i = 0; i < count; ++i )
+  {
+    values[i] = myValue;
+  }
+}
+
+void QgsRasterLayer::grayScanLine( const double *values, QRgb *imageScanLine, int count, QgsContrastEnhancement *theContrastEnhancement )
+{
+  QRgb myDefaultColor = qRgba( 255, 255, 255, 0 );
+
+  for ( int i = 0; i < count; ++i )
+  {
+    double myGrayValue = values[i];
+
+    if ( mValidNoDataValue && ( qAbs( myGrayValue - mNoDataValue ) <= TINY_VALUE || myGrayValue != myGrayValue ) )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    if ( !theContrastEnhancement->isValueInDisplayableRange( myGrayValue ) )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    int myAlphaValue = mRasterTransparency.alphaValue( myGrayValue, mTransparencyLevel );
+    if ( 0 == myAlphaValue )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    int myGrayVal = theContrastEnhancement->enhanceContrast( myGrayValue );
+
+    if ( mInvertColor )
+    {
+      myGrayVal = 255 - myGrayVal;
+    }
+
+    imageScanLine[ i ] = qRgba( myGrayVal, myGrayVal, myGrayVal, myAlphaValue );
+  }
+}
+
+void QgsRasterLayer::pseudoColorScanLine( const double *values, QRgb *imageScanLine, int count )
+{
+  QRgb myDefaultColor = qRgba( 255, 255, 255, 0 );
+  int myRedValue = 255;
+  int myGreenValue = 255;
+  int myBlueValue = 255;
+
+  for ( int i = 0; i < count; ++i )
+  {
+    double myPixelValue = values[i];
+
+    if ( mValidNoDataValue && ( qAbs( myPixelValue - mNoDataValue ) <= TINY_VALUE || myPixelValue != myPixelValue ) )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    int myAlphaValue = mRasterTransparency.alphaValue( myPixelValue, mTransparencyLevel );
+    if ( 0 == myAlphaValue )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    if ( !mRasterShader->shade( myPixelValue, &myRedValue, &myGreenValue, &myBlueValue ) )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    if ( mInvertColor )
+    {
+      //Invert flag, flip blue and red
+      imageScanLine[ i ] = qRgba( myBlueValue, myGreenValue, myRedValue, myAlphaValue );
+    }
+    else
+    {
+      //Normal
+      imageScanLine[ i ] = qRgba( myRedValue, myGreenValue, myBlueValue, myAlphaValue );
+    }
+  }
+}
+
+/*
+ *  @param channel receives the stretched 8 bit channel value, or -1 for pixels not to be drawn
+ */
+void QgsRasterLayer::colorChannelScanLine( const double *values, int *channel, int count, QgsContrastEnhancement *theContrastEnhancement )
+{
+  bool myEnhance = QgsContrastEnhancement::NoEnhancement != contrastEnhancementAlgorithm();
+
+  for ( int i = 0; i < count; ++i )
+  {
+    double myValue = values[i];
+
+    if ( myValue != myValue || ( mValidNoDataValue && qAbs( myValue - mNoDataValue ) <= TINY_VALUE ) )
+    {
+      channel[ i ] = -1;
+      continue;
+    }
+
+    if ( myEnhance && !theContrastEnhancement->isValueInDisplayableRange( myValue ) )
+    {
+      channel[ i ] = -1;
+      continue;
+    }
+
+    int myStretchedValue = myEnhance ? theContrastEnhancement->enhanceContrast( myValue ) : static_cast<int>( myValue );
+
+    if ( mInvertColor )
+    {
+      myStretchedValue = 255 - myStretchedValue;
+    }
+
+    // qRgba() only keeps the lowest byte of each channel as well
+    channel[ i ] = myStretchedValue & 0xff;
+  }
+}
+
+/*
+ *  @param values transparency band values, 0 hides the pixel, 255 keeps its alpha
+ */
+void QgsRasterLayer::transparencyScanLine( const double *values, QRgb *imageScanLine, int count )
+{
+  QRgb myDefaultColor = qRgba( 255, 255, 255, 0 );
+
+  for ( int i = 0; i < count; ++i )
+  {
+    int myTransparencyValue = static_cast<int>( values[i] );
+    if ( 0 == myTransparencyValue )
+    {
+      imageScanLine[ i ] = myDefaultColor;
+      continue;
+    }
+
+    QRgb myColor = imageScanLine[ i ];
+    int myAlphaValue = qAlpha( myColor );
+    if ( 0 == myAlphaValue )
+      continue;
+
+    myAlphaValue *= myTransparencyValue / 255.0;
+    imageScanLine[ i ] = qRgba( qRed( myColor ), qGreen( myColor ), qBlue( myColor ), myAlphaValue );
+  }
+}
+
 bool QgsRasterLayer::update()
 {
   QgsDebugMsg( "entered." );
@@ -371,25 +371,25 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
 
 
     /** \brief Mutator for drawing style */
-    void setDrawingStyle( const DrawingStyle &  theDrawingStyle ) { mDrawingStyle = theDrawingStyle; }
+    void setDrawingStyle( const DrawingStyle &  theDrawingStyle ) { mDrawingStyle = theDrawingStyle; ++mSymbologyRevision; }
 
     /** \brief Mutator for mGrayMinimumMaximumEstimated */
     void setGrayMinimumMaximumEstimated( bool theBool ) { mGrayMinimumMaximumEstimated = theBool; }
 
     /** \brief Mutator to alter the state of the invert histogram flag  */
-    void setInvertHistogram( bool theFlag ) { mInvertColor = theFlag; }
+    void setInvertHistogram( bool theFlag ) { mInvertColor = theFlag; ++mSymbologyRevision; }
 
     /** \brief Mutator for mRGBMinimumMaximumEstimated */
     void setRGBMinimumMaximumEstimated( bool theBool ) { mRGBMinimumMaximumEstimated = theBool; }
 
     /** \brief Mutator to alter the number of standard deviations that should be plotted */
-    void setStandardDeviations( double theStandardDeviations ) { mStandardDeviations = theStandardDeviations; }
+    void setStandardDeviations( double theStandardDeviations ) { mStandardDeviations = theStandardDeviations; ++mSymbologyRevision; }
 
     /** \brief Mutator for mUserDefinedGrayMinimumMaximum */
-    void setUserDefinedGrayMinimumMaximum( bool theBool ) { mUserDefinedGrayMinimumMaximum = theBool; }
+    void setUserDefinedGrayMinimumMaximum( bool theBool ) { mUserDefinedGrayMinimumMaximum = theBool; ++mSymbologyRevision; }
 
     /** \brief Mutator for mUserDefinedRGBMinimumMaximum */
-    void setUserDefinedRGBMinimumMaximum( bool theBool ) { mUserDefinedRGBMinimumMaximum = theBool; }
+    void setUserDefinedRGBMinimumMaximum( bool theBool ) { mUserDefinedRGBMinimumMaximum = theBool; ++mSymbologyRevision; }
 
     /** \brief Accessor to find out how many standard deviations are being plotted */
     double standardDeviations() const { return mStandardDeviations; }
@@ -714,6 +714,12 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
     //
     // Private methods
     //
+    /** \brief Whether the layer can be drawn from cached tiles in the given context */
+    bool canDrawTiled( QgsRenderContext& rendererContext ) const;
+
+    /** \brief Draw the view from tiles of the raster tile cache, rendering missing tiles */
+    void drawTiled( QgsRenderContext& rendererContext );
+
     /** \brief Drawing routine for color type data  */
     void drawSingleBandColorData( QPainter * theQPainter,
                                   QgsRasterViewPort * theRasterViewPort,
@@ -796,6 +802,26 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
     //inline double readValue( void *data, GDALDataType type, int index );
     inline double readValue( void *data, int type, int index );
 
+    /** \brief Convert a scan line created by readData() to doubles
+     *  @note added in 1.9 */
+    void readScanLine( void *data, int type, double *values, int count );
+
+    /** \brief Color a scan line of gray values for drawSingleBandGray()
+     *  @note added in 1.9 */
+    void grayScanLine( const double *values, QRgb *imageScanLine, int count, QgsContrastEnhancement *theContrastEnhancement );
+
+    /** \brief Color a scan line of values for drawSingleBandPseudoColor()
+     *  @note added in 1.9 */
+    void pseudoColorScanLine( const double *values, QRgb *imageScanLine, int count );
+
+    /** \brief Stretch a scan line of one band for drawMultiBandColor()
+     *  @note added in 1.9 */
+    void colorChannelScanLine( const double *values, int *channel, int count, QgsContrastEnhancement *theContrastEnhancement );
+
+    /** \brief Apply a scan line of the transparency band to colored pixels
+     *  @note added in 1.9 */
+    void transparencyScanLine( const double *values, QRgb *imageScanLine, int count );
+
     /** \brief Update the layer if it is outdated */
     bool update();
 
@@ -876,6 +902,12 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
 
     QgsRasterViewPort mLastViewPort;
 
+    /** \brief Flag indicating that a single tile of the tile cache is being drawn */
+    bool mDrawingTile;
+
+    /** \brief Incremented whenever the symbology changes, part of the keys of cached tiles */
+    int mSymbologyRevision;
+
     /**  [ data provider interface ] pointer for loading the provider library */
     //QLibrary* mLib;
 
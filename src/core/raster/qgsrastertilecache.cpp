@@ -0,0 +1,84 @@
+/***************************************************************************
+  qgsrastertilecache.cpp - cache of rendered raster tiles
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrastertilecache.h"
+
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStringList>
+
+QgsRasterTileCache *QgsRasterTileCache::instance()
+{
+  static QgsRasterTileCache sInstance;
+  return &sInstance;
+}
+
+QgsRasterTileCache::QgsRasterTileCache()
+{
+  QSettings settings;
+  mTiles.setMaxCost( settings.value( "/qgis/raster_tile_cache_size", 64 ).toInt() * 1024 );
+}
+
+QImage QgsRasterTileCache::tile( const QString &layerId, const QString &key )
+{
+  QMutexLocker locker( &mMutex );
+
+  QImage *image = mTiles.object( layerId + "|" + key );
+  return image ? *image : QImage();
+}
+
+void QgsRasterTileCache::insertTile( const QString &layerId, const QString &key, const QImage &image )
+{
+  QMutexLocker locker( &mMutex );
+
+  int cost = qMax( 1, image.byteCount() / 1024 );
+  mTiles.insert( layerId + "|" + key, new QImage( image ), cost );
+}
+
+void QgsRasterTileCache::removeLayer( const QString &layerId )
+{
+  QMutexLocker locker( &mMutex );
+
+  QString prefix = layerId + "|";
+  foreach( QString key, mTiles.keys() )
+  {
+    if ( key.startsWith( prefix ) )
+      mTiles.remove( key );
+  }
+}
+
+void QgsRasterTileCache::clear()
+{
+  QMutexLocker locker( &mMutex );
+  mTiles.clear();
+}
+
+int QgsRasterTileCache::tileCount() const
+{
+  QMutexLocker locker( &mMutex );
+  return mTiles.count();
+}
+
+void QgsRasterTileCache::setMaxSize( int kiloBytes )
+{
+  QMutexLocker locker( &mMutex );
+  mTiles.setMaxCost( kiloBytes );
+}
+
+int QgsRasterTileCache::maxSize() const
+{
+  QMutexLocker locker( &mMutex );
+  return mTiles.maxCost();
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+  qgsrastertilecache.h - cache of rendered raster tiles
+  -------------------------------------------------------------------
+Date                 : 18.10.2012
+Copyright            : (C) 2012 by the QGIS project
+email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERTILECACHE_H
+#define QGSRASTERTILECACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+/** \ingroup core
+ * Memory bounded LRU cache of rendered (decoded and colour mapped) raster tiles.
+ * Tiles are keyed on layer, rendering state, resolution and tile position,
+ * so that panning only renders the newly exposed tiles.
+ * The cache is shared by all raster layers and may be used from
+ * several rendering threads.
+ * @note added in 1.9
+ */
+class CORE_EXPORT QgsRasterTileCache
+{
+  public:
+    //! Tile width and height in pixels
+    static const int TileSize = 256;
+
+    static QgsRasterTileCache *instance();
+
+    //! Returns the tile or a null image if it isn't cached
+    QImage tile( const QString &layerId, const QString &key );
+
+    //! Store a tile
+    void insertTile( const QString &layerId, const QString &key, const QImage &image );
+
+    //! Drop all tiles of a layer
+    void removeLayer( const QString &layerId );
+
+    //! Drop all tiles
+    void clear();
+
+    //! Number of cached tiles
+    int tileCount() const;
+
+    //! Set the maximal size of the cache in kB
+    void setMaxSize( int kiloBytes );
+    int maxSize() const;
+
+  private:
+    QgsRasterTileCache();
+
+    mutable QMutex mMutex;
+
+    // key: layer id + tile key, cost: size in kB
+    QCache<QString, QImage> mTiles;
+};
+
+#endif // QGSRASTERTILECACHE_H
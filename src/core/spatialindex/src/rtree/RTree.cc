@@ -197,14 +197,23 @@ SpatialIndex::ISpatialIndex* SpatialIndex::RTree::createAndBulkLoadNewRTree(
 
   SpatialIndex::RTree::BulkLoader bl;
 
-  switch ( m )
+  try
   {
-    case BLM_STR:
-      bl.bulkLoadUsingSTR( static_cast<RTree*>( tree ), stream, bindex, bleaf, 10000, 100 );
-      break;
-    default:
-      throw Tools::IllegalArgumentException( "createAndBulkLoadNewRTree: Unknown bulk load method." );
-      break;
+    switch ( m )
+    {
+      case BLM_STR:
+        bl.bulkLoadUsingSTR( static_cast<RTree*>( tree ), stream, bindex, bleaf, 10000, 100 );
+        break;
+      default:
+        throw Tools::IllegalArgumentException( "createAndBulkLoadNewRTree: Unknown bulk load method." );
+        break;
+    }
+  }
+  catch ( ... )
+  {
+    // the caller never sees the partially loaded tree
+    delete tree;
+    throw;
   }
 
   return tree;
@@ -318,14 +327,23 @@ SpatialIndex::ISpatialIndex* SpatialIndex::RTree::createAndBulkLoadNewRTree(
 
   SpatialIndex::RTree::BulkLoader bl;
 
-  switch ( m )
+  try
   {
-    case BLM_STR:
-      bl.bulkLoadUsingSTR( static_cast<RTree*>( tree ), stream, bindex, bleaf, pageSize, numberOfPages );
-      break;
-    default:
-      throw Tools::IllegalArgumentException( "createAndBulkLoadNewRTree: Unknown bulk load method." );
-      break;
+    switch ( m )
+    {
+      case BLM_STR:
+        bl.bulkLoadUsingSTR( static_cast<RTree*>( tree ), stream, bindex, bleaf, pageSize, numberOfPages );
+        break;
+      default:
+        throw Tools::IllegalArgumentException( "createAndBulkLoadNewRTree: Unknown bulk load method." );
+        break;
+    }
+  }
+  catch ( ... )
+  {
+    // the caller never sees the partially loaded tree
+    delete tree;
+    throw;
   }
 
   return tree;
@@ -86,7 +86,7 @@ bool QgsPointDisplacementRenderer::renderFeature( QgsFeature& feature, QgsRender
     return false;
   }
   QPointF pt;
-  _getPoint( pt, context, geom->asWkb() );
+  _getPoint( pt, context, geom->constWkb() );
 
 
   //get list of labels and symbols
@@ -19,15 +19,14 @@
 #include <QPolygonF>
 
 
-
-unsigned char* QgsFeatureRendererV2::_getPoint( QPointF& pt, QgsRenderContext& context, unsigned char* wkb )
+const unsigned char* QgsFeatureRendererV2::_getPoint( QPointF& pt, QgsRenderContext& context, const unsigned char* wkb )
 {
   wkb++; // jump over endian info
-  unsigned int wkbType = *(( int* ) wkb );
+  unsigned int wkbType = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
 
-  double x = *(( double * ) wkb ); wkb += sizeof( double );
-  double y = *(( double * ) wkb ); wkb += sizeof( double );
+  double x = *(( const double * ) wkb ); wkb += sizeof( double );
+  double y = *(( const double * ) wkb ); wkb += sizeof( double );
 
   if ( wkbType == QGis::WKBPolygon25D )
     wkb += sizeof( double );
@@ -44,21 +43,16 @@ unsigned char* QgsFeatureRendererV2::_getPoint( QPointF& pt, QgsRenderContext& c
   return wkb;
 }
 
-unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRenderContext& context, unsigned char* wkb )
+const unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRenderContext& context, const unsigned char* wkb )
 {
   wkb++; // jump over endian info
-  unsigned int wkbType = *(( int* ) wkb );
+  unsigned int wkbType = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
-  unsigned int nPoints = *(( int* ) wkb );
+  unsigned int nPoints = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
 
   bool hasZValue = ( wkbType == QGis::WKBLineString25D );
   double x, y;
-#ifdef ANDROID
-  qreal z;
-#else
-  double z;
-#endif //ANDROID
   const QgsCoordinateTransform* ct = context.coordinateTransform();
   const QgsMapToPixel& mtp = context.mapToPixel();
 
@@ -76,9 +70,9 @@ unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRenderCo
 
     for ( unsigned int i = 0; i < nPoints; ++i )
     {
-      x = *(( double * ) wkb );
+      x = *(( const double * ) wkb );
       wkb += sizeof( double );
-      y = *(( double * ) wkb );
+      y = *(( const double * ) wkb );
       wkb += sizeof( double );
 
       if ( hasZValue ) // ignore Z value
@@ -89,26 +83,21 @@ unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRenderCo
   }
 
   //transform the QPolygonF to screen coordinates
-  for ( int i = 0; i < pts.size(); ++i )
-  {
-    if ( ct )
-    {
-      z = 0;
-      ct->transformInPlace( pts[i].rx(), pts[i].ry(), z );
-    }
-    mtp.transformInPlace( pts[i].rx(), pts[i].ry() );
-  }
+  if ( ct )
+    ct->transformPolygon( pts );
+  mtp.transformInPlace( pts );
 
+  QgsClipper::simplifyPolyline( pts, context.simplifyTolerance(), false );
 
   return wkb;
 }
 
-unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygonF>& holes, QgsRenderContext& context, unsigned char* wkb )
+const unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygonF>& holes, QgsRenderContext& context, const unsigned char* wkb )
 {
   wkb++; // jump over endian info
-  unsigned int wkbType = *(( int* ) wkb );
+  unsigned int wkbType = *(( const int* ) wkb );
   wkb += sizeof( unsigned int ); // jump over wkb type
-  unsigned int numRings = *(( int* ) wkb );
+  unsigned int numRings = *(( const int* ) wkb );
   wkb += sizeof( unsigned int );
 
   if ( numRings == 0 )  // sanity check for zero rings in polygon
@@ -120,18 +109,13 @@ unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygon
 
   const QgsCoordinateTransform* ct = context.coordinateTransform();
   const QgsMapToPixel& mtp = context.mapToPixel();
-#ifdef ANDROID
-  qreal z = 0; // dummy variable for coordiante transform
-#else
-  double z = 0; // dummy variable for coordiante transform
-#endif
   const QgsRectangle& e = context.extent();
   double cw = e.width() / 10; double ch = e.height() / 10;
   QgsRectangle clipRect( e.xMinimum() - cw, e.yMinimum() - ch, e.xMaximum() + cw, e.yMaximum() + ch );
 
   for ( unsigned int idx = 0; idx < numRings; idx++ )
   {
-    unsigned int nPoints = *(( int* )wkb );
+    unsigned int nPoints = *(( const int* )wkb );
     wkb += sizeof( unsigned int );
 
     QPolygonF poly( nPoints );
@@ -139,8 +123,8 @@ unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygon
     // Extract the points from the WKB and store in a pair of vectors.
     for ( unsigned int jdx = 0; jdx < nPoints; jdx++ )
     {
-      x = *(( double * ) wkb ); wkb += sizeof( double );
-      y = *(( double * ) wkb ); wkb += sizeof( double );
+      x = *(( const double * ) wkb ); wkb += sizeof( double );
+      y = *(( const double * ) wkb ); wkb += sizeof( double );
 
       poly[jdx] = QPointF( x, y );
 
@@ -155,15 +139,11 @@ unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygon
     QgsClipper::trimPolygon( poly, clipRect );
 
     //transform the QPolygonF to screen coordinates
-    for ( int i = 0; i < poly.size(); ++i )
-    {
-      if ( ct )
-      {
-        z = 0;
-        ct->transformInPlace( poly[i].rx(), poly[i].ry(), z );
-      }
-      mtp.transformInPlace( poly[i].rx(), poly[i].ry() );
-    }
+    if ( ct )
+      ct->transformPolygon( poly );
+    mtp.transformInPlace( poly );
+
+    QgsClipper::simplifyPolyline( poly, context.simplifyTolerance(), true );
 
     if ( idx == 0 )
       pts = poly;
@@ -214,7 +194,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         break;
       }
       QPointF pt;
-      _getPoint( pt, context, geom->asWkb() );
+      _getPoint( pt, context, geom->constWkb() );
       (( QgsMarkerSymbolV2* )symbol )->renderPoint( pt, &feature, context, layer, selected );
 
       //if ( drawVertexMarker )
@@ -231,7 +211,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         break;
       }
       QPolygonF pts;
-      _getLineString( pts, context, geom->asWkb() );
+      _getLineString( pts, context, geom->constWkb() );
       (( QgsLineSymbolV2* )symbol )->renderPolyline( pts, &feature, context, layer, selected );
 
       if ( drawVertexMarker )
@@ -249,7 +229,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
       }
       QPolygonF pts;
       QList<QPolygonF> holes;
-      _getPolygon( pts, holes, context, geom->asWkb() );
+      _getPolygon( pts, holes, context, geom->constWkb() );
       (( QgsFillSymbolV2* )symbol )->renderPolygon( pts, ( holes.count() ? &holes : NULL ), &feature, context, layer, selected );
 
       if ( drawVertexMarker )
@@ -266,9 +246,9 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         break;
       }
 
-      unsigned char* wkb = geom->asWkb();
-      unsigned int num = *(( int* )( wkb + 5 ) );
-      unsigned char* ptr = wkb + 9;
+      const unsigned char* wkb = geom->constWkb();
+      unsigned int num = *(( const int* )( wkb + 5 ) );
+      const unsigned char* ptr = wkb + 9;
       QPointF pt;
 
       for ( unsigned int i = 0; i < num; ++i )
@@ -291,9 +271,9 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         break;
       }
 
-      unsigned char* wkb = geom->asWkb();
-      unsigned int num = *(( int* )( wkb + 5 ) );
-      unsigned char* ptr = wkb + 9;
+      const unsigned char* wkb = geom->constWkb();
+      unsigned int num = *(( const int* )( wkb + 5 ) );
+      const unsigned char* ptr = wkb + 9;
       QPolygonF pts;
 
       for ( unsigned int i = 0; i < num; ++i )
@@ -316,9 +296,9 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         break;
       }
 
-      unsigned char* wkb = geom->asWkb();
-      unsigned int num = *(( int* )( wkb + 5 ) );
-      unsigned char* ptr = wkb + 9;
+      const unsigned char* wkb = geom->constWkb();
+      unsigned int num = *(( const int* )( wkb + 5 ) );
+      const unsigned char* ptr = wkb + 9;
       QPolygonF pts;
       QList<QPolygonF> holes;
 
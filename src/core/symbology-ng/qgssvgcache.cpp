@@ -21,6 +21,7 @@
 #include <QDomElement>
 #include <QFile>
 #include <QImage>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QPicture>
 #include <QSvgRenderer>
@@ -98,6 +99,7 @@ QgsSvgCache::~QgsSvgCache()
 const QImage& QgsSvgCache::svgAsImage( const QString& file, int size, const QColor& fill, const QColor& outline, double outlineWidth,
                                        double widthScaleFactor, double rasterScaleFactor )
 {
+  QMutexLocker locker( &mMutex );
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
   //if current entry image is 0: cache image for entry
@@ -114,6 +116,7 @@ const QImage& QgsSvgCache::svgAsImage( const QString& file, int size, const QCol
 const QPicture& QgsSvgCache::svgAsPicture( const QString& file, int size, const QColor& fill, const QColor& outline, double outlineWidth,
     double widthScaleFactor, double rasterScaleFactor )
 {
+  QMutexLocker locker( &mMutex );
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
   //if current entry image is 0: cache image for entry
@@ -21,6 +21,7 @@
 #include <QColor>
 #include <QMap>
 #include <QMultiHash>
+#include <QMutex>
 #include <QString>
 
 class QDomElement;
@@ -108,6 +109,9 @@ class CORE_EXPORT QgsSvgCache
     QgsSvgCacheEntry* mLeastRecentEntry;
     QgsSvgCacheEntry* mMostRecentEntry;
 
+    /**Protects the cache when symbols are rendered from several threads*/
+    QMutex mMutex;
+
     //Maximum cache size
     static const long mMaximumSize = 20000000;
 
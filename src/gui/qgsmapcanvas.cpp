@@ -409,6 +409,23 @@ void QgsMapCanvas::refresh()
   mDrawing = false;
 } // refresh
 
+void QgsMapCanvas::stopRendering()
+{
+  if ( mMapRenderer )
+  {
+    QgsRenderContext* theRenderContext = mMapRenderer->rendererContext();
+    if ( theRenderContext )
+    {
+      theRenderContext->setRenderingStopped( true );
+    }
+  }
+
+  if ( mMap )
+  {
+    mMap->stopRendering();
+  }
+}
+
 void QgsMapCanvas::updateMap()
 {
   if ( mMap )
@@ -989,14 +1006,7 @@ void QgsMapCanvas::paintEvent( QPaintEvent *e )
     if ( mPainting || mDrawing )
     {
       //cancel current render progress
-      if ( mMapRenderer )
-      {
-        QgsRenderContext* theRenderContext = mMapRenderer->rendererContext();
-        if ( theRenderContext )
-        {
-          theRenderContext->setRenderingStopped( true );
-        }
-      }
+      stopRendering();
       return;
     }
 
@@ -1330,12 +1340,16 @@ QGis::UnitType QgsMapCanvas::mapUnits() const
 void QgsMapCanvas::setRenderFlag( bool theFlag )
 {
   mRenderFlag = theFlag;
-  if ( mMapRenderer )
+  if ( !theFlag )
+  {
+    stopRendering();
+  }
+  else if ( mMapRenderer )
   {
     QgsRenderContext* rc = mMapRenderer->rendererContext();
     if ( rc )
     {
-      rc->setRenderingStopped( !theFlag );
+      rc->setRenderingStopped( false );
     }
   }
 
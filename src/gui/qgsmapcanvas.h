@@ -269,6 +269,10 @@ class GUI_EXPORT QgsMapCanvas : public QGraphicsView
     /**Repaints the canvas map*/
     void refresh();
 
+    //! Stops the current rendering of the canvas map. Returns immediately
+    //! @note added in 1.9
+    void stopRendering();
+
     //! Receives signal about selection change, and pass it on with layer info
     void selectionChangedSlot();
 
@@ -17,11 +17,16 @@
 #include "qgsmapcanvas.h"
 #include "qgsmapcanvasmap.h"
 #include "qgsmaprenderer.h"
+#include "qgsmaprendererjob.h"
 
+#include <QEventLoop>
 #include <QPainter>
+#include <QTimer>
 
 QgsMapCanvasMap::QgsMapCanvasMap( QgsMapCanvas* canvas )
     : mCanvas( canvas )
+    , mJob( 0 )
+    , mRenderingStopped( false )
 {
   setZValue( -10 );
   setPos( 0, 0 );
@@ -71,18 +76,59 @@ void QgsMapCanvasMap::render()
     mPixmap = QPixmap( mImage.size() );
     mPixmap.fill( mBgColor.rgb() );
 
-    QPainter paint;
-    paint.begin( &mImage );
-    // Clip drawing to the QImage
-    paint.setClipRect( mImage.rect() );
-
-    // antialiasing
-    if ( mAntiAliasing )
-      paint.setRenderHint( QPainter::Antialiasing );
-
-    mCanvas->mapRenderer()->render( &paint );
-
-    paint.end();
+    QgsMapRenderer* canvasRenderer = mCanvas->mapRenderer();
+    mRenderingStopped = false;
+    canvasRenderer->rendererContext()->setRenderingStopped( false );
+
+    if ( QgsMapRendererJob::canRenderInBackground( canvasRenderer ) )
+    {
+      // render in a background thread and keep the event loop running,
+      // the previews of the layers rendered so far are shown while waiting.
+      // The job renders with a copy of the canvas settings, layer changes cancel it
+      if ( QgsMapRendererJob::prefetchLayers( canvasRenderer ) )
+      {
+        QgsMapRenderer* renderer = rendererSnapshot();
+        QgsMapRendererJob job( renderer, mImage, mAntiAliasing ? QPainter::Antialiasing : QPainter::RenderHints( 0 ) );
+        job.setAutoDeleteRenderer( true );
+        QEventLoop loop;
+        QObject::connect( &job, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+        QObject::connect( &job, SIGNAL( previewAvailable() ), mCanvas, SLOT( updateMap() ) );
+        QObject::connect( renderer, SIGNAL( drawingProgress( int, int ) ), canvasRenderer, SIGNAL( drawingProgress( int, int ) ) );
+        QObject::connect( renderer, SIGNAL( drawError( QgsMapLayer* ) ), canvasRenderer, SIGNAL( drawError( QgsMapLayer* ) ) );
+
+        mJob = &job;
+        job.start();
+        loop.exec();
+        mJob = 0;
+
+        // the labels placed by the job are searched by the map tools
+        if ( !canvasRenderer->labelingEngine() )
+          canvasRenderer->setLabelingEngine( renderer->takeLabelingEngine() );
+
+        mImage = job.renderedImage();
+
+        if ( !job.isRendered() && !mRenderingStopped )
+        {
+          // cancelled because a layer changed: render again once the canvas is done
+          QTimer::singleShot( 0, mCanvas, SLOT( refresh() ) );
+        }
+      }
+    }
+    else
+    {
+      QPainter paint;
+      paint.begin( &mImage );
+      // Clip drawing to the QImage
+      paint.setClipRect( mImage.rect() );
+
+      // antialiasing
+      if ( mAntiAliasing )
+        paint.setRenderHint( QPainter::Antialiasing );
+
+      mCanvas->mapRenderer()->render( &paint );
+
+      paint.end();
+    }
 
     // convert QImage to QPixmap to acheive faster drawing on screen
     mPixmap = QPixmap::fromImage( mImage );
@@ -105,6 +151,39 @@ void QgsMapCanvasMap::render()
   update();
 }
 
+void QgsMapCanvasMap::stopRendering()
+{
+  mRenderingStopped = true;
+  if ( mJob )
+    mJob->cancel();
+}
+
+QgsMapRenderer* QgsMapCanvasMap::rendererSnapshot()
+{
+  QgsMapRenderer* canvasRenderer = mCanvas->mapRenderer();
+  QgsMapRenderer* renderer = new QgsMapRenderer();
+
+  renderer->setMapUnits( canvasRenderer->mapUnits() );
+  renderer->setOutputUnits( canvasRenderer->outputUnits() );
+  renderer->setDestinationCrs( canvasRenderer->destinationCrs() );
+  renderer->setProjectionsEnabled( canvasRenderer->hasCrsTransformEnabled() );
+  renderer->setOutputSize( canvasRenderer->outputSize(), canvasRenderer->outputDpi() );
+  renderer->setExtent( canvasRenderer->extent() );
+  renderer->setLayerSet( canvasRenderer->layerSet() );
+  renderer->setParallelRenderingEnabled( canvasRenderer->isParallelRenderingEnabled() );
+  renderer->setLayerCachingEnabled( canvasRenderer->isLayerCachingEnabled() );
+
+  // the engine is given back when the job has finished
+  renderer->setLabelingEngine( canvasRenderer->takeLabelingEngine() );
+
+  QgsRenderContext* context = renderer->rendererContext();
+  QgsRenderContext* canvasContext = canvasRenderer->rendererContext();
+  context->setDrawEditingInformation( canvasContext->drawEditingInformation() );
+  context->setForceVectorOutput( canvasContext->forceVectorOutput() );
+
+  return renderer;
+}
+
 QPaintDevice& QgsMapCanvasMap::paintDevice()
 {
   return mPixmap;
@@ -114,7 +193,7 @@ void QgsMapCanvasMap::updateContents()
 {
   // make sure we're using current contents
   if ( mUseQImageToRender )
-    mPixmap = QPixmap::fromImage( mImage );
+    mPixmap = QPixmap::fromImage( mJob ? mJob->previewImage() : mImage );
 
   // trigger update of this item
   update();
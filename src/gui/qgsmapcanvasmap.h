@@ -22,6 +22,7 @@
 #include <qgis.h>
 
 class QgsMapRenderer;
+class QgsMapRendererJob;
 class QgsMapCanvas;
 
 /** \ingroup gui
@@ -61,8 +62,15 @@ class GUI_EXPORT QgsMapCanvasMap : public QGraphicsRectItem
     //! Added in version 1.2
     void updateContents();
 
+    //! Stops the rendering started by render()
+    //! @note added in 1.9
+    void stopRendering();
+
   private:
 
+    //! Returns a new renderer with the settings of the canvas renderer for a background job
+    QgsMapRenderer* rendererSnapshot();
+
     //! indicates whether antialiasing will be used for rendering
     bool mAntiAliasing;
 
@@ -78,6 +86,12 @@ class GUI_EXPORT QgsMapCanvasMap : public QGraphicsRectItem
     QColor mBgColor;
 
     QPoint mOffset;
+
+    //! background rendering job while rendering into the QImage
+    QgsMapRendererJob* mJob;
+
+    //! true if stopRendering() was called during render()
+    bool mRenderingStopped;
 };
 
 #endif
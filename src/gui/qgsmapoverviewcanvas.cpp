@@ -75,6 +75,8 @@ QgsMapOverviewCanvas::QgsMapOverviewCanvas( QWidget * parent, QgsMapCanvas* mapC
 
   mMapRenderer = new QgsMapRenderer;
   mMapRenderer->enableOverviewMode();
+  // the layer cache images belong to the main map canvas
+  mMapRenderer->setLayerCachingEnabled( false );
 
   setBackgroundColor( palette().window().color() );
 }
@@ -195,6 +195,11 @@ int main( int argc, char * argv[] )
 
   //creating QgsMapRenderer is expensive (access to srs.db), so we do it here before the fcgi loop
   QgsMapRenderer* theMapRenderer = new QgsMapRenderer();
+  //render the layers of GetMap requests in parallel threads if requested
+  if ( getenv( "QGIS_SERVER_PARALLEL_RENDERING" ) != NULL )
+  {
+    theMapRenderer->setParallelRenderingEnabled( true );
+  }
 
   while ( fcgi_accept() >= 0 )
   {
@@ -18,15 +18,20 @@
 #include "qgsdelimitedtextprovider.h"
 
 #include <QtGlobal>
+#include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QDataStream>
-#include <QTextStream>
 #include <QStringList>
 #include <QMessageBox>
 #include <QSettings>
 #include <QRegExp>
+#include <QTextCodec>
 #include <QUrl>
 
+#include <cstring>
+#include <limits>
+
 #include "qgsapplication.h"
 #include "qgsdataprovider.h"
 #include "qgsfeature.h"
@@ -35,96 +40,251 @@
 #include "qgslogger.h"
 #include "qgsmessageoutput.h"
 #include "qgsrectangle.h"
+#include "qgsspatialindex.h"
 #include "qgis.h"
 
 static const QString TEXT_PROVIDER_KEY = "delimitedtext";
 static const QString TEXT_PROVIDER_DESCRIPTION = "Delimited text data provider";
 
+static const quint32 INDEX_FILE_MAGIC = 0x51445458; // "QDTX"
+static const qint32 INDEX_FILE_VERSION = 2;
+
+// bytes at the start and at the end of the file covered by the checksum in the index file
+static const qint64 INDEX_CHECKSUM_BYTES = 64 * 1024;
 
-QString QgsDelimitedTextProvider::readLine( QTextStream *stream )
+// feeds the row boxes to the bulk loader, skipping rows without geometry
+class QgsDelimitedTextBoxSource : public QgsSpatialIndex::EntrySource
 {
-  QString buffer;
+  public:
+    QgsDelimitedTextBoxSource( const QVector<double>& boxes, int stride )
+        : mBoxes( boxes ), mStride( stride ), mRow( 0 ) {}
+
+    bool nextEntry( QgsFeatureId& id, QgsRectangle& rect )
+    {
+      int rows = mBoxes.size() / mStride;
+      while ( mRow < rows && qIsNaN( mBoxes[ mRow * mStride ] ) )
+        mRow++;
+
+      if ( mRow == rows )
+        return false;
 
-  while ( !stream->atEnd() )
+      const double* box = mBoxes.constData() + mRow * mStride;
+      if ( mStride == 2 )
+        rect.set( box[0], box[1], box[0], box[1] );
+      else
+        rect.set( box[0], box[1], box[2], box[3] );
+      id = ++mRow;
+      return true;
+    }
+
+  private:
+    const QVector<double>& mBoxes;
+    int mStride;
+    int mRow;
+};
+
+
+bool QgsDelimitedTextProvider::nextLine( qint64& offset, QString& line ) const
+{
+  const char* data = mData;
+
+  // skip CR / LF of the previous line and empty lines
+  while ( offset < mDataSize && ( data[offset] == '\r' || data[offset] == '\n' ) )
+    offset++;
+
+  if ( offset >= mDataSize )
+    return false;
+
+  qint64 end = rowEnd( offset );
+  line = mCodec->toUnicode( data + offset, end - offset );
+  offset = end;
+  return true;
+}
+
+qint64 QgsDelimitedTextProvider::rowEnd( qint64 offset ) const
+{
+  const char* data = mData;
+  qint64 end = offset;
+
+  if ( mDelimiterType != "plain" || mDelimiterBytes.isEmpty() )
   {
-    QChar c = stream->read( 1 ).at( 0 );
+    while ( end < mDataSize && data[end] != '\r' && data[end] != '\n' )
+      end++;
+    return end;
+  }
 
-    if ( c == '\r' || c == '\n' )
+  // like in splitLine() a field starting with a double quote ends at the next
+  // delimiter or line end preceded by a double quote, line breaks before are
+  // part of the field
+  const char* delimiter = mDelimiterBytes.constData();
+  int delimiterLength = mDelimiterBytes.size();
+  qint64 quoteStart = -1;
+  qint64 firstBreak = -1;
+  bool fieldStart = true;
+  while ( end < mDataSize )
+  {
+    char c = data[end];
+    if ( fieldStart )
     {
-      if ( buffer.isEmpty() )
+      fieldStart = false;
+      if ( c == '"' )
       {
-        // skip leading CR / LF
+        quoteStart = end++;
         continue;
       }
-
-      break;
     }
 
-    buffer.append( c );
+    bool closed = quoteStart < 0 || data[end - 1] == '"';
+    if ( c == '\r' || c == '\n' )
+    {
+      if ( closed )
+        return end;
+      if ( firstBreak < 0 )
+        firstBreak = end;
+    }
+    else if ( c == delimiter[0] && end + delimiterLength <= mDataSize &&
+              memcmp( data + end, delimiter, delimiterLength ) == 0 )
+    {
+      if ( closed )
+      {
+        quoteStart = -1;
+        firstBreak = -1;
+        fieldStart = true;
+      }
+      end += delimiterLength;
+      continue;
+    }
+    end++;
   }
 
-  return buffer;
+  // a quote that is never closed does not extend the row past its line
+  if ( quoteStart >= 0 && firstBreak >= 0 && data[end - 1] != '"' )
+    return firstBreak;
+
+  return end;
 }
 
-QStringList QgsDelimitedTextProvider::splitLine( QString line )
+void QgsDelimitedTextProvider::splitLine( const QString& line )
 {
   QgsDebugMsgLevel( "Attempting to split the input line: " + line + " using delimiter " + mDelimiter, 3 );
 
-  QStringList parts;
-  if ( mDelimiterType == "regexp" )
-    parts = line.split( mDelimiterRegexp );
-  else
-    parts = line.split( mDelimiter );
+  // resizing keeps the capacity reserved for the fields, so no allocation per line
+  mTokens.resize( 0 );
 
-  QgsDebugMsgLevel( "Split line into " + QString::number( parts.size() ) + " parts", 3 );
-
-  if ( mDelimiterType == "plain" )
+  if ( mDelimiterType == "regexp" )
   {
-    QChar delim;
-    int i = 0, first = parts.size();
-    while ( i < parts.size() )
+    mSplitParts = line.split( mDelimiterRegexp );
+    for ( int i = 0; i < mSplitParts.size(); i++ )
+      mTokens << QStringRef( &mSplitParts[i] );
+  }
+  else if ( mDelimiterType == "plain" )
+  {
+    // fields starting with a quote extend to the next field ending with the same
+    // quote and may contain delimiters, the quotes are removed
+    int delimiterLength = mDelimiter.length();
+    int length = line.length();
+    int pos = 0;
+    for ( ;; )
     {
-      if ( delim == 0 && ( parts[i][0] == '"' || parts[i][0] == '\'' ) )
-      {
-        delim = parts[i][0];
-        first = i;
-        continue;
-      }
+      int end = line.indexOf( mDelimiter, pos );
+      if ( end < 0 )
+        end = length;
 
-      if ( delim != 0 && parts[i][ parts[i].length() - 1 ] == delim )
+      if ( end > pos && ( line[pos] == '"' || line[pos] == '\'' ) )
       {
-        parts[first] = parts[first].mid( 1 );
-        parts[i] = parts[i].left( parts[i].length() - 1 );
-
-        if ( first < i )
+        QChar quote = line[pos];
+        int close = end;
+        while ( line[close - 1] != quote && close < length )
         {
-          QStringList values;
-          while ( first <= i )
-          {
-            values << parts[first];
-            parts.takeAt( first );
-            i--;
-          }
-
-          parts.insert( first, values.join( mDelimiter ) );
+          close = line.indexOf( mDelimiter, close + delimiterLength );
+          if ( close < 0 )
+            close = length;
         }
 
-        first = -1;
-        delim = 0;
+        if ( line[close - 1] == quote )
+        {
+          mTokens << QStringRef( &line, pos + 1, qMax( 0, close - pos - 2 ) );
+          end = close;
+        }
+        else
+        {
+          // no closing quote, keep the field as it is
+          mTokens << QStringRef( &line, pos, end - pos );
+        }
       }
+      else
+      {
+        mTokens << QStringRef( &line, pos, end - pos );
+      }
+
+      if ( end >= length )
+        break;
+      pos = end + delimiterLength;
+    }
+  }
+  else
+  {
+    mSplitParts = line.split( mDelimiter );
+    for ( int i = 0; i < mSplitParts.size(); i++ )
+      mTokens << QStringRef( &mSplitParts[i] );
+  }
 
-      i++;
+  QgsDebugMsgLevel( "Split line into " + QString::number( mTokens.size() ) + " parts", 3 );
 
-      if ( i == parts.size() && first >= 0 )
+  // Ensure that the input has at least the required number of fields (mainly to tolerate
+  // missed blank strings at end of row)
+  while ( mTokens.size() < mFieldCount )
+    mTokens << QStringRef();
+}
+
+QgsGeometry* QgsDelimitedTextProvider::tokenGeometry()
+{
+  if ( mWktFieldIndex >= 0 )
+  {
+    QgsGeometry *geom = 0;
+    try
+    {
+      QString sWkt = mTokens[mWktFieldIndex].toString();
+      // Remove Z and M coordinates if present, as currently fromWkt doesn't
+      // support these.
+      if ( mWktHasZM )
       {
-        i = first + 1;
-        first = -1;
-        delim = 0;
+        sWkt.remove( mWktZMRegexp ).replace( mWktCrdRegexp, "\\1" );
       }
+
+      geom = QgsGeometry::fromWkt( sWkt );
+    }
+    catch ( ... )
+    {
+      geom = 0;
     }
+
+    if ( geom && geom->wkbType() != mWkbType )
+    {
+      delete geom;
+      geom = 0;
+    }
+    return geom;
   }
+  else if ( mXFieldIndex >= 0 && mYFieldIndex >= 0 )
+  {
+    QString sX = mTokens[mXFieldIndex].toString();
+    QString sY = mTokens[mYFieldIndex].toString();
 
-  return parts;
+    if ( !mDecimalPoint.isEmpty() )
+    {
+      sX.replace( mDecimalPoint, "." );
+      sY.replace( mDecimalPoint, "." );
+    }
+
+    bool xOk, yOk;
+    double x = sX.toDouble( &xOk );
+    double y = sY.toDouble( &yOk );
+    if ( xOk && yOk )
+      return QgsGeometry::fromPoint( QgsPoint( x, y ) );
+  }
+
+  return 0;
 }
 
 QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
@@ -139,9 +299,21 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
     , mWktHasZM( false )
     , mWktZMRegexp( "\\s+(?:z|m|zm)(?=\\s*\\()", Qt::CaseInsensitive )
     , mWktCrdRegexp( "(\\-?\\d+(?:\\.\\d*)?\\s+\\-?\\d+(?:\\.\\d*)?)\\s[\\s\\d\\.\\-]+" )
+    , mFile( 0 )
+    , mData( 0 )
+    , mDataSize( 0 )
+    , mMap( 0 )
+    , mFileSize( -1 )
+    , mDataStart( 0 )
+    , mCodec( 0 )
+    , mSpatialIndex( 0 )
+    , mUseIndex( false )
+    , mSelectUsingIndex( false )
+    , mSelectPos( 0 )
+    , mNumberFeatures( 0 )
     , mSkipLines( 0 )
-    , mFirstDataLine( 0 )
     , mShowInvalidLines( false )
+    , mFid( 0 )
     , mCrs()
     , mWkbType( QGis::WKBUnknown )
 {
@@ -170,6 +342,8 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
     mCrs.createFromString( url.queryItemValue( "crs" ) );
   if ( url.hasQueryItem( "decimalPoint" ) )
     mDecimalPoint = url.queryItemValue( "decimalPoint" );
+  if ( url.hasQueryItem( "index" ) )
+    mUseIndex = url.queryItemValue( "index" ) == "yes";
 
   QgsDebugMsg( "Data source uri is " + uri );
   QgsDebugMsg( "Delimited text file is: " + mFileName );
@@ -212,47 +386,150 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
   {
     QgsDebugMsg( "Data source " + dataSourceUri() + " could not be opened" );
     delete mFile;
+    mFile = 0;
     return;
   }
 
   // now we have the file opened and ready for parsing
+  if ( !mapFile() )
+  {
+    QgsDebugMsg( "Data source " + dataSourceUri() + " could not be read" );
+    return;
+  }
+
+  if ( !mUseIndex || !loadIndex() )
+  {
+    scanFile( wktField, xField, yField );
+
+    if ( mUseIndex && mWkbType != QGis::WKBUnknown && mWkbType != QGis::WKBNoGeometry )
+    {
+      saveIndex();
+      buildSpatialIndex();
+    }
+  }
+  mTokens.reserve( mFieldCount );
+  unmapFile();
+
+  QgsDebugMsg( "geometry type is: " + QString::number( mWkbType ) );
+  QgsDebugMsg( "feature count is: " + QString::number( mNumberFeatures ) );
+
+  mValid = mWkbType != QGis::WKBUnknown;
+}
+
+bool QgsDelimitedTextProvider::mapFile()
+{
+  // read or converted contents stay in memory
+  if ( mData )
+    return true;
+
+  // the rows were found in the file as it was scanned, reading a file of another
+  // size would be wrong and reading past the end of a truncated mapping crashes
+  qint64 size = mFile->size();
+  if ( mFileSize >= 0 && size != mFileSize )
+  {
+    QgsDebugMsg( "Data source " + dataSourceUri() + " changed since it was opened" );
+    return false;
+  }
+  mFileSize = size;
+
+  mMap = size > 0 ? mFile->map( 0, size ) : 0;
+  if ( mMap )
+  {
+    mData = reinterpret_cast<const char *>( mMap );
+  }
+  else
+  {
+    // files that cannot be mapped (e.g. on some network file systems) are read into memory
+    if ( size > 0 )
+      QgsDebugMsg( "Data source " + dataSourceUri() + " could not be mapped, reading it" );
+    mFile->seek( 0 );
+    mBuffer = mFile->readAll();
+    if ( mBuffer.size() != size )
+    {
+      mBuffer.clear();
+      return false;
+    }
+    mData = mBuffer.constData();
+  }
+  mDataSize = size;
+  mDataStart = 0;
+  mCodec = QTextCodec::codecForLocale();
 
+  const uchar *bom = reinterpret_cast<const uchar *>( mData );
+  if ( size >= 2 && (( bom[0] == 0xff && bom[1] == 0xfe ) || ( bom[0] == 0xfe && bom[1] == 0xff ) ) )
+  {
+    // UTF-16 is converted to UTF-8 once, so that lines can be found bytewise
+    QByteArray utf8 = QTextCodec::codecForName( "UTF-16" )->toUnicode( mData, size ).toUtf8();
+    if ( mMap )
+      mFile->unmap( mMap );
+    mMap = 0;
+    mBuffer = utf8;
+    mData = mBuffer.constData();
+    mDataSize = mBuffer.size();
+    mCodec = QTextCodec::codecForName( "UTF-8" );
+  }
+  else if ( size >= 3 && bom[0] == 0xef && bom[1] == 0xbb && bom[2] == 0xbf )
+  {
+    mDataStart = 3;
+    mCodec = QTextCodec::codecForName( "UTF-8" );
+  }
+
+  mDelimiterBytes = mCodec->fromUnicode( mDelimiter );
+  return true;
+}
+
+void QgsDelimitedTextProvider::unmapFile()
+{
+  if ( !mMap )
+    return;
+
+  mFile->unmap( mMap );
+  mMap = 0;
+  mData = 0;
+}
+
+void QgsDelimitedTextProvider::scanFile( const QString& wktField, const QString& xField, const QString& yField )
+{
   // set the initial extent
   mExtent = QgsRectangle();
 
   QMap<int, bool> couldBeInt;
   QMap<int, bool> couldBeDouble;
 
-  mStream = new QTextStream( mFile );
   QString line;
+  qint64 offset = mDataStart;
   mNumberFeatures = 0;
   int lineNumber = 0;
   bool hasFields = false;
-  while ( !mStream->atEnd() )
+  while ( true )
   {
-    lineNumber++;
-    line = readLine( mStream ); // line of text excluding '\n', default local 8 bit encoding.
+    qint64 lineStart = offset;
+    if ( !nextLine( offset, line ) )
+      break;
 
-    if ( lineNumber < mSkipLines + 1 )
-      continue;
+    // nextLine() skips empty lines, the row starts at the first character
+    while ( mData[lineStart] == '\r' || mData[lineStart] == '\n' )
+      lineStart++;
 
-    if ( line.isEmpty() )
+    lineNumber++;
+    if ( lineNumber < mSkipLines + 1 )
       continue;
 
     if ( !hasFields )
     {
       // Get the fields from the header row and store them in the
       // fields vector
-      QStringList fieldList = splitLine( line );
+      splitLine( line );
 
-      mFieldCount = fieldList.count();
+      mFieldCount = mTokens.count();
+      mTokens.reserve( mFieldCount );
 
       // We don't know anything about a text based field other
       // than its name. All fields are assumed to be text
       int fieldPos = 0;
       for ( int column = 0; column < mFieldCount; column++ )
       {
-        QString field = fieldList[column];
+        QString field = mTokens[column].toString();
 
         if (( field.left( 1 ) == "'" || field.left( 1 ) == "\"" ) &&
             field.left( 1 ) == field.right( 1 ) )
@@ -303,129 +580,146 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
       QgsDebugMsg( "yfield index: " + QString::number( mYFieldIndex ) );
       QgsDebugMsg( "Field count for the delimited text file is " + QString::number( attributeFields.size() ) );
       hasFields = true;
+      continue;
     }
-    else // hasFields == true - field names already read
-    {
-      if ( mFirstDataLine == 0 )
-        mFirstDataLine = lineNumber;
 
-      // split the line on the delimiter
-      QStringList parts = splitLine( line );
+    // split the line on the delimiter
+    splitLine( line );
 
-      // Ensure that the input has at least the required number of fields (mainly to tolerate
-      // missed blank strings at end of row)
-      while ( parts.size() < mFieldCount )
-        parts.append( QString::null );
+    if ( mWktFieldIndex >= 0 )
+    {
+      // Get the wkt - confirm it is valid, get the type, and
+      // if compatible with the rest of file, add to the extents.
+      // Every row gets a feature id, rows of other types are skipped when reading.
 
-      if ( mWktFieldIndex >= 0 )
+      QString sWkt = mTokens[mWktFieldIndex].toString();
+      QgsGeometry *geom = 0;
+      try
       {
-        // Get the wkt - confirm it is valid, get the type, and
-        // if compatible with the rest of file, add to the extents
-
-        QString sWkt = parts[mWktFieldIndex];
-        QgsGeometry *geom = 0;
-        try
-        {
-          if ( !mWktHasZM && sWkt.indexOf( mWktZMRegexp ) >= 0 )
-            mWktHasZM = true;
-          if ( mWktHasZM )
-          {
-            sWkt.remove( mWktZMRegexp ).replace( mWktCrdRegexp, "\\1" );
-          }
-          geom = QgsGeometry::fromWkt( sWkt );
-        }
-        catch ( ... )
+        if ( !mWktHasZM && sWkt.indexOf( mWktZMRegexp ) >= 0 )
+          mWktHasZM = true;
+        if ( mWktHasZM )
         {
-          mInvalidLines << line;
-          geom = 0;
+          sWkt.remove( mWktZMRegexp ).replace( mWktCrdRegexp, "\\1" );
         }
+        geom = QgsGeometry::fromWkt( sWkt );
+      }
+      catch ( ... )
+      {
+        mInvalidLines << line;
+        geom = 0;
+      }
+
+      mRowOffsets << lineStart;
 
-        if ( geom )
+      bool counted = false;
+      if ( geom )
+      {
+        QGis::WkbType type = geom->wkbType();
+        if ( type != QGis::WKBNoGeometry )
         {
-          QGis::WkbType type = geom->wkbType();
-          if ( type != QGis::WKBNoGeometry )
+          QgsRectangle bbox( geom->boundingBox() );
+          if ( mNumberFeatures == 0 )
+          {
+            mNumberFeatures++;
+            mWkbType = type;
+            mExtent = bbox;
+            counted = true;
+          }
+          else if ( type == mWkbType )
           {
-            if ( mNumberFeatures == 0 )
-            {
-              mNumberFeatures++;
-              mWkbType = type;
-              mExtent = geom->boundingBox();
-            }
-            else if ( type == mWkbType )
-            {
-              mNumberFeatures++;
-              QgsRectangle bbox( geom->boundingBox() );
-              mExtent.combineExtentWith( &bbox );
-            }
+            mNumberFeatures++;
+            mExtent.combineExtentWith( &bbox );
+            counted = true;
           }
-          delete geom;
+
+          // the type is only known at the end, so boxes have four values for now
+          if ( counted && mUseIndex )
+            mBoxes << bbox.xMinimum() << bbox.yMinimum() << bbox.xMaximum() << bbox.yMaximum();
         }
+        delete geom;
       }
-      else if ( mWktFieldIndex == -1 && mXFieldIndex >= 0 && mYFieldIndex >= 0 )
-      {
-        // Get the x and y values, first checking to make sure they
-        // aren't null.
 
-        QString sX = parts[mXFieldIndex];
-        QString sY = parts[mYFieldIndex];
+      if ( !counted && mUseIndex )
+        mBoxes << std::numeric_limits<double>::quiet_NaN() << 0.0 << 0.0 << 0.0;
+    }
+    else if ( mWktFieldIndex == -1 && mXFieldIndex >= 0 && mYFieldIndex >= 0 )
+    {
+      // Get the x and y values, first checking to make sure they
+      // aren't null.
 
+      QString sX = mTokens[mXFieldIndex].toString();
+      QString sY = mTokens[mYFieldIndex].toString();
 
-        if ( !mDecimalPoint.isEmpty() )
-        {
-          sX.replace( mDecimalPoint, "." );
-          sY.replace( mDecimalPoint, "." );
-        }
+      if ( !mDecimalPoint.isEmpty() )
+      {
+        sX.replace( mDecimalPoint, "." );
+        sY.replace( mDecimalPoint, "." );
+      }
 
-        bool xOk = false;
-        bool yOk = false;
-        double x = sX.toDouble( &xOk );
-        double y = sY.toDouble( &yOk );
+      bool xOk = false;
+      bool yOk = false;
+      double x = sX.toDouble( &xOk );
+      double y = sY.toDouble( &yOk );
 
-        if ( xOk && yOk )
+      if ( xOk && yOk )
+      {
+        if ( mNumberFeatures > 0 )
         {
-          if ( mNumberFeatures > 0 )
-          {
-            mExtent.combineExtentWith( x, y );
-          }
-          else
-          {
-            // Extent for the first point is just the first point
-            mExtent.set( x, y, x, y );
-            mWkbType = QGis::WKBPoint;
-          }
-          mNumberFeatures++;
+          mExtent.combineExtentWith( x, y );
         }
         else
         {
-          mInvalidLines << line;
+          // Extent for the first point is just the first point
+          mExtent.set( x, y, x, y );
+          mWkbType = QGis::WKBPoint;
         }
+        mNumberFeatures++;
+        mRowOffsets << lineStart;
+        if ( mUseIndex )
+          mBoxes << x << y;
       }
       else
       {
-        mWkbType = QGis::WKBNoGeometry;
-        mNumberFeatures++;
+        mInvalidLines << line;
       }
+    }
+    else
+    {
+      mWkbType = QGis::WKBNoGeometry;
+      mNumberFeatures++;
+      mRowOffsets << lineStart;
+    }
 
-      for ( int i = 0; i < attributeFields.size(); i++ )
+    for ( int i = 0; i < attributeFields.size(); i++ )
+    {
+      const QStringRef &ref = mTokens[attributeColumns[i]];
+      if ( ref.isEmpty() )
+        continue;
+      // try to convert attribute values to integer and double
+      QString value = ref.toString();
+      if ( couldBeInt[i] )
       {
-        QString &value = parts[attributeColumns[i]];
-        if ( value.isEmpty() )
-          continue;
-        // try to convert attribute values to integer and double
-        if ( couldBeInt[i] )
-        {
-          value.toInt( &couldBeInt[i] );
-        }
-        if ( couldBeDouble[i] )
-        {
-          value.toDouble( &couldBeDouble[i] );
-        }
+        value.toInt( &couldBeInt[i] );
+      }
+      if ( couldBeDouble[i] )
+      {
+        value.toDouble( &couldBeDouble[i] );
       }
     }
   }
 
-  QgsDebugMsg( "geometry type is: " + QString::number( mWkbType ) );
-  QgsDebugMsg( "feature count is: " + QString::number( mNumberFeatures ) );
+  // point rows use two values per box, other geometries four
+  if ( mUseIndex && mWktFieldIndex >= 0 && mWkbType == QGis::WKBPoint )
+  {
+    QVector<double> points( 2 * mRowOffsets.size() );
+    for ( int i = 0; i < mRowOffsets.size(); i++ )
+    {
+      points[2 * i] = mBoxes[4 * i];
+      points[2 * i + 1] = mBoxes[4 * i + 1];
+    }
+    mBoxes = points;
+  }
 
   // now it's time to decide the types for the fields
   for ( QgsFieldMap::iterator it = attributeFields.begin(); it != attributeFields.end(); ++it )
@@ -441,15 +735,17 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
       it->setTypeName( "double" );
     }
   }
-
-  mValid = mWkbType != QGis::WKBUnknown;
 }
 
 QgsDelimitedTextProvider::~QgsDelimitedTextProvider()
 {
-  mFile->close();
+  if ( mFile )
+  {
+    unmapFile();
+    mFile->close();
+  }
   delete mFile;
-  delete mStream;
+  delete mSpatialIndex;
 }
 
 
@@ -459,130 +755,105 @@ QString QgsDelimitedTextProvider::storageType() const
 }
 
 
-bool QgsDelimitedTextProvider::nextFeature( QgsFeature& feature )
+bool QgsDelimitedTextProvider::featureFromRow( QgsFeatureId fid, QgsFeature& feature, bool fetchGeometry,
+    const QgsAttributeList& fetchAttributes, bool checkBounds )
 {
-  // before we do anything else, assume that there's something wrong with
-  // the feature
-  feature.setValid( false );
-  while ( !mStream->atEnd() )
-  {
-    QString line = readLine( mStream ); // Default local 8 bit encoding
-    if ( line.isEmpty() )
-      continue;
+  QString line;
+  qint64 offset = mRowOffsets[fid - 1];
+  if ( !nextLine( offset, line ) )
+    return false;
 
-    // lex the tokens from the current data line
-    QStringList tokens = splitLine( line );
+  // lex the tokens from the data line
+  splitLine( line );
 
-    while ( tokens.size() < mFieldCount )
-      tokens.append( QString::null );
+  QgsGeometry *geom = tokenGeometry();
+  if ( !geom && mWkbType != QGis::WKBNoGeometry )
+    return false;
 
-    QgsGeometry *geom = 0;
+  if ( geom && checkBounds &&
+       !( mWktFieldIndex < 0 ? boundsCheck( geom->asPoint().x(), geom->asPoint().y() ) : boundsCheck( geom ) ) )
+  {
+    delete geom;
+    return false;
+  }
 
-    if ( mWktFieldIndex >= 0 )
-    {
-      try
-      {
-        QString &sWkt = tokens[mWktFieldIndex];
-        // Remove Z and M coordinates if present, as currently fromWkt doesn't
-        // support these.
-        if ( mWktHasZM )
-        {
-          sWkt.remove( mWktZMRegexp ).replace( mWktCrdRegexp, "\\1" );
-        }
+  // At this point the current feature values are valid
 
-        geom = QgsGeometry::fromWkt( sWkt );
-      }
-      catch ( ... )
-      {
-        geom = 0;
-      }
+  feature.setValid( true );
 
-      if ( geom && geom->wkbType() != mWkbType )
-      {
-        delete geom;
-        geom = 0;
-      }
-      mFid++;
-      if ( geom && !boundsCheck( geom ) )
-      {
-        delete geom;
-        geom = 0;
-      }
-    }
-    else if ( mXFieldIndex >= 0 && mYFieldIndex >= 0 )
-    {
-      QString sX = tokens[mXFieldIndex];
-      QString sY = tokens[mYFieldIndex];
+  feature.setFeatureId( fid );
 
-      if ( !mDecimalPoint.isEmpty() )
-      {
-        sX.replace( mDecimalPoint, "." );
-        sY.replace( mDecimalPoint, "." );
-      }
+  if ( geom && fetchGeometry )
+    feature.setGeometry( geom );
+  else
+    delete geom;
 
-      bool xOk, yOk;
-      double x = sX.toDouble( &xOk );
-      double y = sY.toDouble( &yOk );
-      if ( xOk && yOk )
-      {
-        mFid++;
-        if ( boundsCheck( x, y ) )
-        {
-          geom = QgsGeometry::fromPoint( QgsPoint( x, y ) );
-        }
-      }
-    }
+  for ( QgsAttributeList::const_iterator i = fetchAttributes.begin();
+        i != fetchAttributes.end();
+        ++i )
+  {
+    int fieldIdx = *i;
+    if ( fieldIdx < 0 || fieldIdx >= attributeColumns.count() )
+      continue; // ignore non-existant fields
 
-    if ( !geom && mWkbType != QGis::WKBNoGeometry )
+    QString value = mTokens[attributeColumns[fieldIdx]].toString();
+    QVariant val;
+    switch ( attributeFields[fieldIdx].type() )
     {
-      mInvalidLines << line;
-      continue;
+      case QVariant::Int:
+        if ( !value.isEmpty() )
+          val = QVariant( value );
+        else
+          val = QVariant( attributeFields[fieldIdx].type() );
+        break;
+      case QVariant::Double:
+        if ( !value.isEmpty() )
+          val = QVariant( value.toDouble() );
+        else
+          val = QVariant( attributeFields[fieldIdx].type() );
+        break;
+      default:
+        val = QVariant( value );
+        break;
     }
+    feature.addAttribute( fieldIdx, val );
+  }
 
-    // At this point the current feature values are valid
-
-    feature.setValid( true );
+  return true;
+}
 
-    feature.setFeatureId( mFid );
+bool QgsDelimitedTextProvider::nextFeature( QgsFeature& feature )
+{
+  // before we do anything else, assume that there's something wrong with
+  // the feature
+  feature.setValid( false );
 
-    if ( geom )
-      feature.setGeometry( geom );
+  // the file is mapped for each pass over the rows
+  if ( !mValid || !mapFile() )
+    return false;
 
-    for ( QgsAttributeList::const_iterator i = mAttributesToFetch.begin();
-          i != mAttributesToFetch.end();
-          ++i )
+  for ( ;; )
+  {
+    QgsFeatureId fid;
+    if ( mSelectUsingIndex )
     {
-      int fieldIdx = *i;
-      if ( fieldIdx < 0 || fieldIdx >= attributeColumns.count() )
-        continue; // ignore non-existant fields
-
-      QString &value = tokens[attributeColumns[fieldIdx]];
-      QVariant val;
-      switch ( attributeFields[fieldIdx].type() )
-      {
-        case QVariant::Int:
-          if ( !value.isEmpty() )
-            val = QVariant( value );
-          else
-            val = QVariant( attributeFields[fieldIdx].type() );
-          break;
-        case QVariant::Double:
-          if ( !value.isEmpty() )
-            val = QVariant( value.toDouble() );
-          else
-            val = QVariant( attributeFields[fieldIdx].type() );
-          break;
-        default:
-          val = QVariant( value );
-          break;
-      }
-      feature.addAttribute( fieldIdx, val );
+      if ( mSelectPos >= mSelectIds.size() )
+        break;
+      fid = mSelectIds[mSelectPos++];
+    }
+    else
+    {
+      if ( mFid >= mRowOffsets.size() )
+        break;
+      fid = ++mFid;
     }
 
     // We have a good line, so return
-    return true;
+    if ( featureFromRow( fid, feature, true, mAttributesToFetch, true ) )
+      return true;
+  }
 
-  } // !mStream->atEnd()
+  unmapFile();
 
   // End of the file. If there are any lines that couldn't be
   // loaded, display them now.
@@ -611,6 +882,28 @@ bool QgsDelimitedTextProvider::nextFeature( QgsFeature& feature )
 } // nextFeature
 
 
+bool QgsDelimitedTextProvider::featureAtId( QgsFeatureId featureId,
+    QgsFeature& feature,
+    bool fetchGeometry,
+    QgsAttributeList fetchAttributes )
+{
+  feature.setValid( false );
+  if ( featureId < 1 || featureId > mRowOffsets.size() )
+    return false;
+
+  // keep the mapping of a running pass
+  bool mapped = mData != 0;
+  if ( !mapFile() )
+    return false;
+
+  bool found = featureFromRow( featureId, feature, fetchGeometry, fetchAttributes, false );
+
+  if ( !mapped )
+    unmapFile();
+  return found;
+}
+
+
 void QgsDelimitedTextProvider::select( QgsAttributeList fetchAttributes,
                                        QgsRectangle rect,
                                        bool fetchGeometry,
@@ -628,10 +921,219 @@ void QgsDelimitedTextProvider::select( QgsAttributeList fetchAttributes,
   {
     mSelectionRectangle = rect;
   }
+
+  // with a spatial index only the rows in the rectangle are read,
+  // in file order to keep the access to the mapped file sequential
+  mSelectUsingIndex = mSpatialIndex && !rect.isEmpty() && !rect.contains( mExtent );
+  mSelectIds.clear();
+  if ( mSelectUsingIndex )
+  {
+    mSelectIds = mSpatialIndex->intersects( rect );
+    qSort( mSelectIds );
+    QgsDebugMsg( "Features returned by spatial index: " + QString::number( mSelectIds.count() ) );
+  }
+
   rewind();
 }
 
 
+bool QgsDelimitedTextProvider::createSpatialIndex()
+{
+  if ( mSpatialIndex )
+    return true;
+
+  if ( !mValid || mWkbType == QGis::WKBNoGeometry )
+    return false;
+
+  bool mapped = mData != 0;
+  if ( !mapFile() )
+    return false;
+
+  // collect the row boxes with one pass over the rows
+  int stride = boxStride();
+  mBoxes.resize( 0 );
+  mBoxes.reserve( stride * mRowOffsets.size() );
+  for ( int row = 0; row < mRowOffsets.size(); row++ )
+  {
+    QString line;
+    qint64 offset = mRowOffsets[row];
+    nextLine( offset, line );
+    splitLine( line );
+
+    QgsGeometry *geom = tokenGeometry();
+    if ( !geom )
+    {
+      mBoxes << std::numeric_limits<double>::quiet_NaN() << 0.0;
+      if ( stride == 4 )
+        mBoxes << 0.0 << 0.0;
+      continue;
+    }
+
+    QgsRectangle bbox = geom->boundingBox();
+    mBoxes << bbox.xMinimum() << bbox.yMinimum();
+    if ( stride == 4 )
+      mBoxes << bbox.xMaximum() << bbox.yMaximum();
+    delete geom;
+  }
+
+  mUseIndex = true;
+  saveIndex();
+  buildSpatialIndex();
+
+  if ( !mapped )
+    unmapFile();
+  return true;
+}
+
+void QgsDelimitedTextProvider::buildSpatialIndex()
+{
+  QgsDelimitedTextBoxSource source( mBoxes, boxStride() );
+  mSpatialIndex = new QgsSpatialIndex( source );
+  mBoxes = QVector<double>();
+}
+
+QString QgsDelimitedTextProvider::indexFileName() const
+{
+  return mFileName + ".dtx";
+}
+
+bool QgsDelimitedTextProvider::loadIndex()
+{
+  QFile file( indexFileName() );
+  if ( !file.open( QIODevice::ReadOnly ) )
+    return false;
+
+  QFileInfo info( mFileName );
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_4 );
+
+  quint32 magic;
+  qint32 version;
+  QString uri;
+  qint64 size;
+  uint modified;
+  in >> magic >> version;
+  if ( magic != INDEX_FILE_MAGIC || version != INDEX_FILE_VERSION )
+    return false;
+
+  // the index is only valid for the same file read with the same settings,
+  // the checksum catches changes within the resolution of the modification time
+  QByteArray checksum;
+  in >> uri >> size >> modified >> checksum;
+  if ( uri != dataSourceUri() || size != info.size() || modified != info.lastModified().toTime_t() ||
+       checksum != dataChecksum() )
+  {
+    QgsDebugMsg( "index file " + indexFileName() + " is out of date" );
+    return false;
+  }
+
+  QByteArray contents;
+  QByteArray contentsChecksum;
+  in >> contents >> contentsChecksum;
+  if ( in.status() != QDataStream::Ok ||
+       contentsChecksum != QCryptographicHash::hash( contents, QCryptographicHash::Md5 ) )
+  {
+    QgsDebugMsg( "index file " + indexFileName() + " is corrupt" );
+    return false;
+  }
+
+  QDataStream data( contents );
+  data.setVersion( QDataStream::Qt_4_4 );
+
+  qint32 fieldCount, xFieldIndex, yFieldIndex, wktFieldIndex, wkbType;
+  qint64 numberFeatures;
+  bool wktHasZM;
+  double xMin, yMin, xMax, yMax;
+  QList<int> columns;
+  QStringList names;
+  QList<int> types;
+  data >> fieldCount >> xFieldIndex >> yFieldIndex >> wktFieldIndex >> wktHasZM >> wkbType >> numberFeatures
+  >> xMin >> yMin >> xMax >> yMax >> columns >> names >> types >> mRowOffsets >> mBoxes;
+
+  if ( data.status() != QDataStream::Ok || columns.size() != names.size() || columns.size() != types.size() ||
+       ( !mRowOffsets.isEmpty() && ( mRowOffsets.first() < mDataStart || mRowOffsets.last() >= mDataSize ) ) )
+  {
+    QgsDebugMsg( "index file " + indexFileName() + " could not be read" );
+    mRowOffsets.clear();
+    mBoxes.clear();
+    return false;
+  }
+
+  mFieldCount = fieldCount;
+  mXFieldIndex = xFieldIndex;
+  mYFieldIndex = yFieldIndex;
+  mWktFieldIndex = wktFieldIndex;
+  mWktHasZM = wktHasZM;
+  mWkbType = ( QGis::WkbType ) wkbType;
+  mNumberFeatures = numberFeatures;
+  mExtent.set( xMin, yMin, xMax, yMax );
+
+  attributeColumns = columns;
+  for ( int i = 0; i < columns.size(); i++ )
+  {
+    QVariant::Type type = ( QVariant::Type ) types[i];
+    QString typeName = type == QVariant::Int ? "integer" : type == QVariant::Double ? "double" : "Text";
+    attributeFields[i] = QgsField( names[i], type, typeName );
+  }
+
+  if ( mWkbType != QGis::WKBUnknown && mWkbType != QGis::WKBNoGeometry )
+    buildSpatialIndex();
+
+  return true;
+}
+
+void QgsDelimitedTextProvider::saveIndex()
+{
+  QFile file( indexFileName() );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    // the directory may not be writable, the index is rebuilt on the next open
+    QgsDebugMsg( "cannot write index file " + indexFileName() );
+    return;
+  }
+
+  QFileInfo info( mFileName );
+
+  QStringList names;
+  QList<int> types;
+  for ( int i = 0; i < attributeColumns.size(); i++ )
+  {
+    names << attributeFields[i].name();
+    types << attributeFields[i].type();
+  }
+
+  // the contents are written with their checksum to detect a damaged index file
+  QByteArray contents;
+  QDataStream data( &contents, QIODevice::WriteOnly );
+  data.setVersion( QDataStream::Qt_4_4 );
+  data << ( qint32 ) mFieldCount << ( qint32 ) mXFieldIndex << ( qint32 ) mYFieldIndex << ( qint32 ) mWktFieldIndex
+  << mWktHasZM << ( qint32 ) mWkbType << ( qint64 ) mNumberFeatures
+  << mExtent.xMinimum() << mExtent.yMinimum() << mExtent.xMaximum() << mExtent.yMaximum()
+  << attributeColumns << names << types << mRowOffsets << mBoxes;
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_4 );
+  out << INDEX_FILE_MAGIC << INDEX_FILE_VERSION
+  << dataSourceUri() << ( qint64 ) info.size() << info.lastModified().toTime_t() << dataChecksum()
+  << contents << QCryptographicHash::hash( contents, QCryptographicHash::Md5 );
+
+  if ( data.status() != QDataStream::Ok || out.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( "cannot write index file " + indexFileName() );
+    file.remove();
+  }
+}
+
+QByteArray QgsDelimitedTextProvider::dataChecksum() const
+{
+  QCryptographicHash hash( QCryptographicHash::Md5 );
+  qint64 head = qMin( mDataSize, INDEX_CHECKSUM_BYTES );
+  hash.addData( mData, ( int ) head );
+  qint64 tail = qMin( mDataSize - head, INDEX_CHECKSUM_BYTES );
+  hash.addData( mData + mDataSize - tail, ( int ) tail );
+  return hash.result();
+}
 
 
 // Return the extent of the layer
@@ -672,13 +1174,14 @@ const QgsFieldMap & QgsDelimitedTextProvider::fields() const
 
 void QgsDelimitedTextProvider::rewind()
 {
-  // Reset feature id to 0
+  // Restart at the first row, or the first row found in the spatial index
   mFid = 0;
-  // Skip to first data record
-  mStream->seek( 0 );
-  int n = mFirstDataLine - 1;
-  while ( n-- > 0 )
-    readLine( mStream );
+  mSelectPos = 0;
+}
+
+QgsVectorDataProvider* QgsDelimitedTextProvider::createConcurrentProvider()
+{
+  return new QgsDelimitedTextProvider( dataSourceUri() );
 }
 
 bool QgsDelimitedTextProvider::isValid()
@@ -712,7 +1215,7 @@ bool QgsDelimitedTextProvider::boundsCheck( QgsGeometry *geom )
 
 int QgsDelimitedTextProvider::capabilities() const
 {
-  return NoCapabilities;
+  return SelectAtId | SelectGeometryAtId | CreateSpatialIndex;
 }
 
 
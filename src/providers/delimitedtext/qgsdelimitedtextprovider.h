@@ -19,12 +19,15 @@
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
 
+#include <QByteArray>
 #include <QStringList>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
+class QgsSpatialIndex;
 class QFile;
-class QTextStream;
+class QTextCodec;
 
 
 /**
@@ -39,6 +42,14 @@ class QTextStream;
 * /full/path/too/delimited.txt?delimiter=<delimiter>
 *
 * Example uri = "/home/foo/delim.txt?delimiter=|"
+*
+* The file is memory mapped while it is read and the byte offset of every row
+* is kept, so features can be read by id without scanning the file. With a
+* plain delimiter, fields in double quotes may contain delimiters and line
+* breaks. With index=yes in the uri the bounding boxes of the rows are packed
+* into a spatial index and the row offsets, boxes and column types are stored
+* in a sidecar file (the file name with .dtx appended) that is reused while the
+* file is unchanged.
 */
 class QgsDelimitedTextProvider : public QgsVectorDataProvider
 {
@@ -74,11 +85,24 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
      * @param feature feature which will receive data from the provider
      * @return true when there was a feature to fetch, false when end was hit
      *
-     * mFile should be open with the file pointer at the record of the next
-     * feature, or EOF.  The feature found on the current line is parsed.
+     * The rows are read in file order, or only those found in the spatial
+     * index when there is one and a selection rectangle was given.
      */
     virtual bool nextFeature( QgsFeature& feature );
 
+    /**
+     * Gets the feature at the given feature ID, reading only its own row.
+     * @param featureId id of the feature to be returned
+     * @param feature which will receive the data
+     * @param fetchGeometry true if the geometry should be fetched
+     * @param fetchAttributes a list containing the indexes of the attribute fields to copy
+     * @return true when the feature was found
+     */
+    virtual bool featureAtId( QgsFeatureId featureId,
+                              QgsFeature& feature,
+                              bool fetchGeometry = true,
+                              QgsAttributeList fetchAttributes = QgsAttributeList() );
+
     /**
      * Get feature type.
      * @return int representing the feature type
@@ -105,6 +129,10 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     /** Restart reading features from previous select operation */
     virtual void rewind();
 
+    /** Returns a provider reading the file through a file handle of its own
+     * @note added in 1.9 */
+    virtual QgsVectorDataProvider* createConcurrentProvider();
+
     /** Returns a bitmask containing the supported capabilities
         Note, some capabilities may change depending on whether
         a spatial filter is active on this provider, so it may
@@ -112,6 +140,12 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
      */
     virtual int capabilities() const;
 
+    /**
+     * Packs the bounding boxes of the rows into a spatial index and
+     * stores it in the sidecar file
+     */
+    virtual bool createSpatialIndex();
+
 
     /* Implementation of functions from QgsDataProvider */
 
@@ -177,6 +211,52 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
 
   private:
 
+    /**
+     * Maps the file, or reads it when it cannot be mapped
+     * @return false if the size of the file changed since it was scanned
+     */
+    bool mapFile();
+
+    //! Releases the mapping of the file between reads
+    void unmapFile();
+
+    //! Scans all rows for their offsets, the extent and the column types
+    void scanFile( const QString& wktField, const QString& xField, const QString& yField );
+
+    /**
+     * Reads the line starting at or after offset, skipping empty lines
+     * @param offset position to read from, moved past the line
+     * @param line receives the line
+     * @return false at the end of the file
+     */
+    bool nextLine( qint64& offset, QString& line ) const;
+
+    //! Returns the end of the row starting at offset, past line breaks in quoted fields
+    qint64 rowEnd( qint64 offset ) const;
+
+    //! Splits line into mTokens, padded to the number of fields
+    void splitLine( const QString& line );
+
+    //! Parses the geometry of the current tokens, returns 0 if there is none
+    QgsGeometry* tokenGeometry();
+
+    //! Reads the row of feature fid
+    bool featureFromRow( QgsFeatureId fid, QgsFeature& feature, bool fetchGeometry,
+                         const QgsAttributeList& fetchAttributes, bool checkBounds );
+
+    //! Bulk loads mSpatialIndex from mBoxes and releases them
+    void buildSpatialIndex();
+
+    //! Number of values per row in mBoxes
+    int boxStride() const { return mWkbType == QGis::WKBPoint ? 2 : 4; }
+
+    QString indexFileName() const;
+    bool loadIndex();
+    void saveIndex();
+
+    //! Checksum of the start and the end of the file to detect changes within the mtime resolution
+    QByteArray dataChecksum() const;
+
     //! Fields
     QList<int> attributeColumns;
     QgsFieldMap attributeFields;
@@ -212,7 +292,38 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     //! Text file
     QFile *mFile;
 
-    QTextStream *mStream;
+    //! Contents of the file, mapped or in mBuffer, 0 while unmapped
+    const char *mData;
+    qint64 mDataSize;
+    //! Mapping of the file, 0 if it is not mapped
+    uchar *mMap;
+    //! Size of the file when it was scanned, -1 before
+    qint64 mFileSize;
+    //! Delimiter encoded like the file
+    QByteArray mDelimiterBytes;
+    //! Offset of the first line, past a byte order mark
+    qint64 mDataStart;
+    QByteArray mBuffer;
+    QTextCodec *mCodec;
+
+    //! Byte offset of the row of each feature, feature id - 1 is the position
+    QVector<qint64> mRowOffsets;
+
+    //! Bounding boxes of the rows while the spatial index is built, NaN for rows without geometry
+    QVector<double> mBoxes;
+
+    //! Spatial index of the rows if index=yes or createSpatialIndex() was called
+    QgsSpatialIndex *mSpatialIndex;
+    bool mUseIndex;
+
+    //! Features of the current select found in the spatial index
+    QList<QgsFeatureId> mSelectIds;
+    bool mSelectUsingIndex;
+    int mSelectPos;
+
+    //! Tokens of the current line, referring into it or into mSplitParts
+    QVector<QStringRef> mTokens;
+    QStringList mSplitParts;
 
     bool mValid;
     bool mUseIntersect;
@@ -221,7 +332,6 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
 
     long mNumberFeatures;
     int mSkipLines;
-    int mFirstDataLine; // Actual first line of data (accounting for blank lines)
     QString mDecimalPoint;
 
     //! Storage for any lines in the file that couldn't be loaded
@@ -229,7 +339,7 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     //! Only want to show the invalid lines once to the user
     bool mShowInvalidLines;
 
-    //! Feature id
+    //! Id of the last feature read by nextFeature
     long mFid;
 
     struct wkbPoint
@@ -245,7 +355,4 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     QgsCoordinateReferenceSystem mCrs;
 
     QGis::WkbType mWkbType;
-
-    QString readLine( QTextStream *stream );
-    QStringList splitLine( QString line );
 };
@@ -15,6 +15,7 @@
 
 #include "qgsmemoryprovider.h"
 
+#include "qgsexpression.h"
 #include "qgsfeature.h"
 #include "qgsfield.h"
 #include "qgsgeometry.h"
@@ -29,9 +30,236 @@
 static const QString TEXT_PROVIDER_KEY = "memory";
 static const QString TEXT_PROVIDER_DESCRIPTION = "Memory provider";
 
+// layers with at least that many features get a spatial index when they are first selected with a rectangle
+static const int SPATIAL_INDEX_MIN_FEATURES = 1000;
+
+// numeric value of an attribute, if QgsExpression compares it as a number
+static bool numericValue( const QVariant& value, double& number )
+{
+  bool ok = false;
+  if ( value.type() == QVariant::Int || value.type() == QVariant::Double )
+  {
+    number = value.toDouble( &ok );
+  }
+  else if ( value.type() == QVariant::String )
+  {
+    number = value.toString().toDouble( &ok );
+  }
+  return ok;
+}
+
+void QgsMemoryProvider::AttributeIndex::insert( QgsFeatureId fid, const QVariant& value )
+{
+  double number;
+  if ( value.isNull() )
+    nulls.insert( fid );
+  else if ( numeric && numericValue( value, number ) )
+    numbers.insert( number, fid );
+  else
+    strings.insert( value.toString(), fid );
+}
+
+void QgsMemoryProvider::AttributeIndex::remove( QgsFeatureId fid, const QVariant& value )
+{
+  double number;
+  if ( value.isNull() )
+    nulls.remove( fid );
+  else if ( numeric && numericValue( value, number ) )
+    numbers.remove( number, fid );
+  else
+    strings.remove( value.toString(), fid );
+}
+
+// Finds the features that may match a subset expression from the attribute indexes.
+// Comparisons of an indexed field with a literal are looked up in the index, AND and OR
+// combine the results. Each visit sets whether the node could be answered and the ids.
+class QgsMemoryProvider::IndexVisitor : public QgsExpression::Visitor
+{
+  public:
+    IndexVisitor( const QgsMemoryProvider& provider )
+        : mProvider( provider ), mIndexed( false ) {}
+
+    bool indexed() const { return mIndexed; }
+    const QSet<QgsFeatureId>& ids() const { return mIds; }
+
+    void visit( QgsExpression::NodeBinaryOperator* n )
+    {
+      QgsExpression::BinaryOperator op = n->op();
+      if ( op == QgsExpression::boAnd || op == QgsExpression::boOr )
+      {
+        n->opLeft()->accept( *this );
+        bool leftIndexed = mIndexed;
+        QSet<QgsFeatureId> leftIds = mIds;
+        n->opRight()->accept( *this );
+
+        if ( op == QgsExpression::boAnd )
+        {
+          // one indexed side is enough, the other one is evaluated for the candidates
+          if ( leftIndexed && mIndexed )
+            mIds.intersect( leftIds );
+          else if ( leftIndexed )
+          {
+            mIds = leftIds;
+            mIndexed = true;
+          }
+        }
+        else
+        {
+          if ( leftIndexed && mIndexed )
+            mIds.unite( leftIds );
+          else
+            notIndexed();
+        }
+        return;
+      }
+
+      // field <op> literal or literal <op> field
+      QgsExpression::NodeColumnRef* column = dynamic_cast<QgsExpression::NodeColumnRef*>( n->opLeft() );
+      QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( n->opRight() );
+      if ( !column || !literal )
+      {
+        column = dynamic_cast<QgsExpression::NodeColumnRef*>( n->opRight() );
+        literal = dynamic_cast<QgsExpression::NodeLiteral*>( n->opLeft() );
+        switch ( op )
+        {
+          case QgsExpression::boLT: op = QgsExpression::boGT; break;
+          case QgsExpression::boGT: op = QgsExpression::boLT; break;
+          case QgsExpression::boLE: op = QgsExpression::boGE; break;
+          case QgsExpression::boGE: op = QgsExpression::boLE; break;
+          default: break;
+        }
+      }
+      if ( !column || !literal )
+      {
+        notIndexed();
+        return;
+      }
+
+      mIds.clear();
+      mIndexed = lookup( column->name(), op, literal->value() );
+    }
+
+    void visit( QgsExpression::NodeInOperator* n )
+    {
+      QgsExpression::NodeColumnRef* column = dynamic_cast<QgsExpression::NodeColumnRef*>( n->node() );
+      if ( !column || n->isNotIn() )
+      {
+        notIndexed();
+        return;
+      }
+
+      mIds.clear();
+      foreach( QgsExpression::Node* item, n->list()->list() )
+      {
+        QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( item );
+        if ( !literal || !lookup( column->name(), QgsExpression::boEQ, literal->value() ) )
+        {
+          notIndexed();
+          return;
+        }
+      }
+      mIndexed = true;
+    }
+
+    void visit( QgsExpression::NodeUnaryOperator* ) { notIndexed(); }
+    void visit( QgsExpression::NodeFunction* ) { notIndexed(); }
+    void visit( QgsExpression::NodeLiteral* ) { notIndexed(); }
+    void visit( QgsExpression::NodeColumnRef* ) { notIndexed(); }
+    void visit( QgsExpression::NodeCondition* ) { notIndexed(); }
+
+  private:
+    void notIndexed()
+    {
+      mIndexed = false;
+      mIds.clear();
+    }
+
+    // adds the features of the index that may satisfy field <op> value to mIds,
+    // returns false if the comparison cannot be looked up
+    bool lookup( const QString& name, QgsExpression::BinaryOperator op, const QVariant& value )
+    {
+      // same field lookup as QgsExpression::NodeColumnRef::prepare()
+      int field = -1;
+      foreach( int i, mProvider.mFields.keys() )
+      {
+        if ( QString::compare( mProvider.mFields[i].name(), name, Qt::CaseInsensitive ) == 0 )
+        {
+          field = i;
+          break;
+        }
+      }
+
+      QMap<int, AttributeIndex>::const_iterator it = mProvider.mAttributeIndexes.find( field );
+      if ( it == mProvider.mAttributeIndexes.constEnd() || value.isNull() )
+        return false;
+
+      double number;
+      bool numericLiteral = numericValue( value, number );
+
+      if ( !it->numeric )
+      {
+        // values of string fields that look like numbers are compared numerically with numeric literals
+        if ( op != QgsExpression::boEQ || numericLiteral )
+          return false;
+
+        foreach( QgsFeatureId fid, it->strings.values( value.toString() ) )
+          mIds.insert( fid );
+        return true;
+      }
+
+      if ( !numericLiteral )
+        return false;
+
+      QMultiMap<double, QgsFeatureId>::const_iterator begin, end;
+      switch ( op )
+      {
+        case QgsExpression::boEQ:
+          begin = it->numbers.lowerBound( number );
+          end = it->numbers.upperBound( number );
+          break;
+        case QgsExpression::boLT:
+          begin = it->numbers.constBegin();
+          end = it->numbers.lowerBound( number );
+          break;
+        case QgsExpression::boLE:
+          begin = it->numbers.constBegin();
+          end = it->numbers.upperBound( number );
+          break;
+        case QgsExpression::boGT:
+          begin = it->numbers.upperBound( number );
+          end = it->numbers.constEnd();
+          break;
+        case QgsExpression::boGE:
+          begin = it->numbers.lowerBound( number );
+          end = it->numbers.constEnd();
+          break;
+        default:
+          return false;
+      }
+
+      for ( ; begin != end; ++begin )
+        mIds.insert( begin.value() );
+
+      // values that are not numbers are compared as strings
+      foreach( QgsFeatureId fid, it->strings.values() )
+        mIds.insert( fid );
+      return true;
+    }
+
+    const QgsMemoryProvider& mProvider;
+    bool mIndexed;
+    QSet<QgsFeatureId> mIds;
+};
+
 QgsMemoryProvider::QgsMemoryProvider( QString uri )
     : QgsVectorDataProvider( uri ),
+    mExtentValid( false ),
+    mSubsetExpression( NULL ),
+    mSubsetFeatureCount( -1 ),
     mSelectRectGeom( NULL ),
+    mSelectSlot( 0 ),
+    mSelectUsingIndex( false ),
+    mSelectUsingSpatialIndex( false ),
     mSpatialIndex( NULL )
 {
   // Initialize the geometry with the uri to support old style uri's
@@ -140,6 +368,7 @@ QgsMemoryProvider::~QgsMemoryProvider()
 {
   delete mSpatialIndex;
   delete mSelectRectGeom;
+  delete mSubsetExpression;
 }
 
 QString QgsMemoryProvider::dataSourceUri() const
@@ -220,79 +449,82 @@ QString QgsMemoryProvider::storageType() const
 bool QgsMemoryProvider::nextFeature( QgsFeature& feature )
 {
   feature.setValid( false );
-  bool hasFeature = false;
 
-  // option 1: using spatial index
-  if ( mSelectUsingSpatialIndex )
-  {
-    while ( mSelectSI_Iterator != mSelectSI_Features.end() )
-    {
-      // do exact check in case we're doing intersection
-      if ( mSelectUseIntersect )
-      {
-        if ( mFeatures[*mSelectSI_Iterator].geometry()->intersects( mSelectRectGeom ) )
-          hasFeature = true;
-      }
-      else
-        hasFeature = true;
+  QgsFeature* f = nextSelectedFeature();
+  if ( !f )
+    return false;
 
-      if ( hasFeature )
-        break;
+  feature = *f;
+  return true;
+}
 
-      mSelectSI_Iterator++;
-    }
+int QgsMemoryProvider::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  int count = 0;
+  QgsFeature* f;
+  for ( ; count < maxCount && ( f = nextSelectedFeature() ); ++count )
+  {
+    features.append( *f );
+  }
+  return count;
+}
 
-    // copy feature
-    if ( hasFeature )
+QgsFeature* QgsMemoryProvider::nextSelectedFeature()
+{
+  // option 1: candidates from an index
+  if ( mSelectUsingIndex )
+  {
+    while ( mSelectCandidateIterator != mSelectCandidates.end() )
     {
-      feature = mFeatures[*mSelectSI_Iterator];
-      mSelectSI_Iterator++;
+      QHash<QgsFeatureId, int>::const_iterator it = mFeatureSlots.find( *mSelectCandidateIterator++ );
+      if ( it == mFeatureSlots.constEnd() )
+        continue; // deleted meanwhile
+
+      QgsFeature& f = mFeatures[ *it ];
+      if ( matchesSelection( f ) )
+        return &f;
     }
-    return hasFeature;
+    return 0;
+  }
+
+  // option 2: all features
+  while ( mSelectSlot < mFeatures.size() )
+  {
+    QgsFeature& f = mFeatures[ mSelectSlot++ ];
+    if ( f.isValid() && matchesSelection( f ) )
+      return &f;
   }
+  return 0;
+}
 
-  // option 2: not using spatial index
-  while ( mSelectIterator != mFeatures.end() )
+bool QgsMemoryProvider::matchesSelection( QgsFeature& feature )
+{
+  if ( !mSelectRect.isEmpty() )
   {
-    if ( mSelectRect.isEmpty() )
+    QgsGeometry* geometry = feature.geometry();
+    if ( !geometry )
+      return false;
+
+    if ( mSelectUseIntersect )
     {
-      // selection rect empty => using all features
-      hasFeature = true;
+      // using exact test when checking for intersection
+      if ( !geometry->intersects( mSelectRectGeom ) )
+        return false;
     }
-    else
+    else if ( !mSelectUsingSpatialIndex )
     {
-      if ( mSelectUseIntersect )
-      {
-        // using exact test when checking for intersection
-        if ( mSelectIterator->geometry()->intersects( mSelectRectGeom ) )
-          hasFeature = true;
-      }
-      else
-      {
-        // check just bounding box against rect when not using intersection
-        if ( mSelectIterator->geometry()->boundingBox().intersects( mSelectRect ) )
-          hasFeature = true;
-      }
+      // check just bounding box against rect when not using intersection
+      if ( !geometry->boundingBox().intersects( mSelectRect ) )
+        return false;
     }
-
-    if ( hasFeature )
-      break;
-
-    mSelectIterator++;
   }
 
-  // copy feature
-  if ( hasFeature )
-  {
-    feature = mSelectIterator.value();
-    mSelectIterator++;
-    feature.setValid( true );
-  }
+  if ( mSubsetExpression && mSubsetExpression->evaluate( &feature ).toInt() == 0 )
+    return false;
 
-  return hasFeature;
+  return true;
 }
 
-
 bool QgsMemoryProvider::featureAtId( QgsFeatureId featureId,
                                      QgsFeature& feature,
                                      bool fetchGeometry,
@@ -301,13 +533,12 @@ bool QgsMemoryProvider::featureAtId( QgsFeatureId featureId,
   Q_UNUSED( fetchGeometry );
   Q_UNUSED( fetchAttributes );
   feature.setValid( false );
-  QgsFeatureMap::iterator it = mFeatures.find( featureId );
+  QHash<QgsFeatureId, int>::const_iterator it = mFeatureSlots.find( featureId );
 
-  if ( it == mFeatures.end() )
+  if ( it == mFeatureSlots.constEnd() )
     return false;
 
-  feature = *it;
-  feature.setValid( true );
+  feature = mFeatures[ *it ];
   return true;
 }
 
@@ -324,18 +555,39 @@ void QgsMemoryProvider::select( QgsAttributeList fetchAttributes,
   mSelectGeometry = fetchGeometry;
   mSelectUseIntersect = useIntersect;
 
-  // if there's spatial index, use it!
-  // (but don't use it when selection rect is not specified)
-  if ( mSpatialIndex && !mSelectRect.isEmpty() )
+  mSelectUsingIndex = false;
+  mSelectUsingSpatialIndex = false;
+  mSelectCandidates.clear();
+
+  // attribute indexes answering the subset
+  if ( mSubsetExpression && !mAttributeIndexes.isEmpty() )
   {
-    mSelectUsingSpatialIndex = true;
-    mSelectSI_Features = mSpatialIndex->intersects( rect );
-    QgsDebugMsg( "Features returned by spatial index: " + QString::number( mSelectSI_Features.count() ) );
+    IndexVisitor visitor( *this );
+    mSubsetExpression->acceptVisitor( visitor );
+    if ( visitor.indexed() )
+    {
+      mSelectUsingIndex = true;
+      mSelectCandidates = visitor.ids().toList();
+      // ids grow with the slots, keep the order of the features
+      qSort( mSelectCandidates );
+      QgsDebugMsg( "Features returned by attribute index: " + QString::number( mSelectCandidates.count() ) );
+    }
   }
-  else
+
+  // if there's spatial index, use it!
+  // (but don't use it when selection rect is not specified)
+  if ( !mSelectUsingIndex && !mSelectRect.isEmpty() )
   {
-    mSelectUsingSpatialIndex = false;
-    mSelectSI_Features.clear();
+    if ( !mSpatialIndex && mFeatureSlots.size() >= SPATIAL_INDEX_MIN_FEATURES )
+      createSpatialIndex();
+
+    if ( mSpatialIndex )
+    {
+      mSelectUsingIndex = true;
+      mSelectUsingSpatialIndex = true;
+      mSelectCandidates = mSpatialIndex->intersects( rect );
+      QgsDebugMsg( "Features returned by spatial index: " + QString::number( mSelectCandidates.count() ) );
+    }
   }
 
   rewind();
@@ -343,10 +595,10 @@ void QgsMemoryProvider::select( QgsAttributeList fetchAttributes,
 
 void QgsMemoryProvider::rewind()
 {
-  if ( mSelectUsingSpatialIndex )
-    mSelectSI_Iterator = mSelectSI_Features.begin();
+  if ( mSelectUsingIndex )
+    mSelectCandidateIterator = mSelectCandidates.begin();
   else
-    mSelectIterator = mFeatures.begin();
+    mSelectSlot = 0;
 }
 
 
@@ -362,7 +614,22 @@ QGis::WkbType QgsMemoryProvider::geometryType() const
 
 long QgsMemoryProvider::featureCount() const
 {
-  return mFeatures.count();
+  if ( !mSubsetExpression )
+    return mFeatureSlots.size();
+
+  if ( mSubsetFeatureCount < 0 )
+  {
+    QgsMemoryProvider* provider = const_cast<QgsMemoryProvider*>( this );
+    long count = 0;
+    for ( int i = 0; i < provider->mFeatures.size(); ++i )
+    {
+      QgsFeature& f = provider->mFeatures[i];
+      if ( f.isValid() && mSubsetExpression->evaluate( &f ).toInt() != 0 )
+        ++count;
+    }
+    provider->mSubsetFeatureCount = count;
+  }
+  return mSubsetFeatureCount;
 }
 
 uint QgsMemoryProvider::fieldCount() const
@@ -393,19 +660,36 @@ bool QgsMemoryProvider::addFeatures( QgsFeatureList & flist )
   // TODO: sanity checks of fields and geometries
   for ( QgsFeatureList::iterator it = flist.begin(); it != flist.end(); ++it )
   {
-    mFeatures[mNextFeatureId] = *it;
-    QgsFeature& newfeat = mFeatures[mNextFeatureId];
+    mFeatures.append( *it );
+    QgsFeature& newfeat = mFeatures.last();
     newfeat.setFeatureId( mNextFeatureId );
+    newfeat.setValid( true );
     it->setFeatureId( mNextFeatureId );
+    mFeatureSlots.insert( mNextFeatureId, mFeatures.size() - 1 );
 
     // update spatial index
     if ( mSpatialIndex )
       mSpatialIndex->insertFeature( newfeat );
 
+    // update attribute indexes
+    for ( QMap<int, AttributeIndex>::iterator iit = mAttributeIndexes.begin(); iit != mAttributeIndexes.end(); ++iit )
+      iit->insert( mNextFeatureId, newfeat.attributeMap().value( iit.key() ) );
+
+    // extend the extent instead of recalculating it from all features
+    if ( newfeat.geometry() )
+    {
+      if ( !mExtentValid )
+        mExtent = newfeat.geometry()->boundingBox();
+      else
+        mExtent.unionRect( newfeat.geometry()->boundingBox() );
+      mExtentValid = true;
+    }
+
     mNextFeatureId++;
   }
 
-  updateExtent();
+  mSubsetFeatureCount = -1;
+  clearMinMaxCache();
 
   return true;
 }
@@ -414,24 +698,62 @@ bool QgsMemoryProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( *it );
+    QHash<QgsFeatureId, int>::iterator sit = mFeatureSlots.find( *it );
 
     // check whether such feature exists
-    if ( fit == mFeatures.end() )
+    if ( sit == mFeatureSlots.end() )
       continue;
 
+    QgsFeature& f = mFeatures[ *sit ];
+
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+      mSpatialIndex->deleteFeature( f );
 
-    mFeatures.erase( fit );
+    // update attribute indexes
+    for ( QMap<int, AttributeIndex>::iterator iit = mAttributeIndexes.begin(); iit != mAttributeIndexes.end(); ++iit )
+      iit->remove( *it, f.attributeMap().value( iit.key() ) );
+
+    // leave an invalid feature in the slot
+    f = QgsFeature();
+    mFeatureSlots.erase( sit );
   }
 
+  if ( mFeatureSlots.size() < mFeatures.size() / 2 )
+    compactFeatures();
+
   updateExtent();
+  mSubsetFeatureCount = -1;
+  clearMinMaxCache();
 
   return true;
 }
 
+void QgsMemoryProvider::compactFeatures()
+{
+  int slot = 0;
+  int selectSlot = -1;
+  for ( int i = 0; i < mFeatures.size(); ++i )
+  {
+    if ( i == mSelectSlot )
+      selectSlot = slot;
+
+    if ( !mFeatures[i].isValid() )
+      continue;
+
+    if ( i != slot )
+    {
+      mFeatures[slot] = mFeatures[i];
+      mFeatureSlots[ mFeatures[slot].id()] = slot;
+    }
+    ++slot;
+  }
+  mFeatures.resize( slot );
+
+  // an ongoing selection continues with the same feature
+  mSelectSlot = selectSlot < 0 ? slot : selectSlot;
+}
+
 bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
 {
   for ( QList<QgsField>::const_iterator it = attributes.begin(); it != attributes.end(); ++it )
@@ -460,7 +782,18 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
 bool QgsMemoryProvider::deleteAttributes( const QgsAttributeIds& attributes )
 {
   for ( QgsAttributeIds::const_iterator it = attributes.begin(); it != attributes.end(); ++it )
+  {
     mFields.remove( *it );
+    mAttributeIndexes.remove( *it );
+  }
+
+  // a subset using a deleted field does not match any feature
+  if ( mSubsetExpression && !mSubsetExpression->prepare( mFields ) )
+  {
+    QgsDebugMsg( "subset refers to a deleted field: " + mSubsetString );
+  }
+  mSubsetFeatureCount = -1;
+
   return true;
 }
 
@@ -468,14 +801,28 @@ bool QgsMemoryProvider::changeAttributeValues( const QgsChangedAttributesMap & a
 {
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    QHash<QgsFeatureId, int>::const_iterator sit = mFeatureSlots.find( it.key() );
+    if ( sit == mFeatureSlots.constEnd() )
       continue;
 
+    QgsFeature& f = mFeatures[ *sit ];
     const QgsAttributeMap& attrs = it.value();
     for ( QgsAttributeMap::const_iterator it2 = attrs.begin(); it2 != attrs.end(); ++it2 )
-      fit->changeAttribute( it2.key(), it2.value() );
+    {
+      QMap<int, AttributeIndex>::iterator iit = mAttributeIndexes.find( it2.key() );
+      if ( iit != mAttributeIndexes.end() )
+      {
+        iit->remove( it.key(), f.attributeMap().value( it2.key() ) );
+        iit->insert( it.key(), it2.value() );
+      }
+
+      f.changeAttribute( it2.key(), it2.value() );
+    }
   }
+
+  mSubsetFeatureCount = -1;
+  clearMinMaxCache();
+
   return true;
 }
 
@@ -483,38 +830,167 @@ bool QgsMemoryProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 {
   for ( QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    QHash<QgsFeatureId, int>::const_iterator sit = mFeatureSlots.find( it.key() );
+    if ( sit == mFeatureSlots.constEnd() )
       continue;
 
+    QgsFeature& f = mFeatures[ *sit ];
+
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+      mSpatialIndex->deleteFeature( f );
 
-    fit->setGeometry( it.value() );
+    f.setGeometry( it.value() );
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( *fit );
+      mSpatialIndex->insertFeature( f );
   }
 
   updateExtent();
+  mSubsetFeatureCount = -1;
 
   return true;
 }
 
+// existing features of the provider, for bulk loading the spatial index
+class QgsMemoryFeatureSource : public QgsSpatialIndex::FeatureSource
+{
+  public:
+    QgsMemoryFeatureSource( const QVector<QgsFeature>& features )
+        : mFeatures( features ), mSlot( 0 ) {}
+
+    bool nextFeature( QgsFeature& f )
+    {
+      while ( mSlot < mFeatures.size() )
+      {
+        const QgsFeature& feature = mFeatures[ mSlot++ ];
+        if ( feature.isValid() )
+        {
+          f = feature;
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    const QVector<QgsFeature>& mFeatures;
+    int mSlot;
+};
+
 bool QgsMemoryProvider::createSpatialIndex()
 {
   if ( !mSpatialIndex )
   {
-    mSpatialIndex = new QgsSpatialIndex();
+    // pack the index from the existing features at once
+    QgsMemoryFeatureSource source( mFeatures );
+    mSpatialIndex = new QgsSpatialIndex( source );
+  }
+  return true;
+}
+
+bool QgsMemoryProvider::createAttributeIndex( int field )
+{
+  if ( !mFields.contains( field ) )
+    return false;
+
+  if ( mAttributeIndexes.contains( field ) )
+    return true;
+
+  AttributeIndex& index = mAttributeIndexes[ field ];
+  index.numeric = mFields[ field ].type() == QVariant::Int || mFields[ field ].type() == QVariant::Double;
+
+  for ( int i = 0; i < mFeatures.size(); ++i )
+  {
+    const QgsFeature& f = mFeatures[i];
+    if ( f.isValid() )
+      index.insert( f.id(), f.attributeMap().value( field ) );
+  }
+  return true;
+}
+
+QVariant QgsMemoryProvider::minimumValue( int index )
+{
+  QMap<int, AttributeIndex>::const_iterator it = mAttributeIndexes.find( index );
+  if ( it == mAttributeIndexes.constEnd() || !it->numeric || !it->strings.isEmpty() || it->numbers.isEmpty() || mSubsetExpression )
+    return QgsVectorDataProvider::minimumValue( index );
+
+  double min = it->numbers.constBegin().key();
+  return mFields[ index ].type() == QVariant::Int ? QVariant(( int ) min ) : QVariant( min );
+}
+
+QVariant QgsMemoryProvider::maximumValue( int index )
+{
+  QMap<int, AttributeIndex>::const_iterator it = mAttributeIndexes.find( index );
+  if ( it == mAttributeIndexes.constEnd() || !it->numeric || !it->strings.isEmpty() || it->numbers.isEmpty() || mSubsetExpression )
+    return QgsVectorDataProvider::maximumValue( index );
+
+  double max = ( --it->numbers.constEnd() ).key();
+  return mFields[ index ].type() == QVariant::Int ? QVariant(( int ) max ) : QVariant( max );
+}
+
+void QgsMemoryProvider::uniqueValues( int index, QList<QVariant> &values, int limit )
+{
+  QMap<int, AttributeIndex>::const_iterator it = mAttributeIndexes.find( index );
+  if ( it == mAttributeIndexes.constEnd() || mSubsetExpression )
+  {
+    QgsVectorDataProvider::uniqueValues( index, values, limit );
+    return;
+  }
+
+  QList<QVariant> candidates;
+  foreach( double number, it->numbers.uniqueKeys() )
+  {
+    if ( mFields[ index ].type() == QVariant::Int && number == ( int ) number )
+      candidates << QVariant(( int ) number );
+    else
+      candidates << QVariant( number );
+  }
+  foreach( QString string, it->strings.uniqueKeys() )
+    candidates << QVariant( string );
+  if ( !it->nulls.isEmpty() )
+    candidates << QVariant( mFields[ index ].type() );
+
+  // distinct by their string like in QgsVectorDataProvider
+  QSet<QString> set;
+  values.clear();
+  foreach( const QVariant& value, candidates )
+  {
+    if ( limit >= 0 && values.size() >= limit )
+      break;
 
-    // add existing features to index
-    for ( QgsFeatureMap::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
+    if ( !set.contains( value.toString() ) )
     {
-      mSpatialIndex->insertFeature( *it );
+      values.append( value );
+      set.insert( value.toString() );
     }
   }
+}
+
+bool QgsMemoryProvider::setSubsetString( QString theSQL, bool updateFeatureCount )
+{
+  // the features are counted when featureCount() is called
+  Q_UNUSED( updateFeatureCount );
+
+  QgsExpression* expression = NULL;
+  if ( !theSQL.trimmed().isEmpty() )
+  {
+    expression = new QgsExpression( theSQL );
+    if ( expression->hasParserError() || !expression->prepare( mFields ) )
+    {
+      QgsDebugMsg( "invalid subset: " + theSQL );
+      delete expression;
+      return false;
+    }
+  }
+
+  delete mSubsetExpression;
+  mSubsetExpression = expression;
+  mSubsetString = expression ? theSQL : QString();
+  mSubsetFeatureCount = -1;
+  clearMinMaxCache();
+
   return true;
 }
 
@@ -522,22 +998,27 @@ int QgsMemoryProvider::capabilities() const
 {
   return AddFeatures | DeleteFeatures | ChangeGeometries |
          ChangeAttributeValues | AddAttributes | DeleteAttributes | CreateSpatialIndex |
-         SelectAtId | SelectGeometryAtId;
+         CreateAttributeIndex | SelectAtId | SelectGeometryAtId;
 }
 
 
 void QgsMemoryProvider::updateExtent()
 {
-  if ( mFeatures.count() == 0 )
+  mExtent = QgsRectangle();
+  bool first = true;
+  for ( int i = 0; i < mFeatures.size(); ++i )
   {
-    mExtent = QgsRectangle();
-  }
-  else
-  {
-    mExtent = mFeatures.begin().value().geometry()->boundingBox();
-    for ( QgsFeatureMap::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
-      mExtent.unionRect( it.value().geometry()->boundingBox() );
+    QgsFeature& f = mFeatures[i];
+    if ( !f.isValid() || !f.geometry() )
+      continue;
+
+    if ( first )
+      mExtent = f.geometry()->boundingBox();
+    else
+      mExtent.unionRect( f.geometry()->boundingBox() );
+    first = false;
   }
+  mExtentValid = !first;
 }
 
 
@@ -16,11 +16,21 @@
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
 
+#include <QHash>
+#include <QMultiHash>
+#include <QMultiMap>
+#include <QSet>
+#include <QVector>
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
-
+class QgsExpression;
 class QgsSpatialIndex;
 
+/** Provider keeping its features in memory.
+ * Features are stored in a vector in the order they were added. A spatial index is
+ * created automatically the first time a layer with many features is selected with a
+ * rectangle. Attribute indexes (ordered for numeric fields, hashed for string fields)
+ * are used to answer subset strings, unique values and minimum / maximum values.
+ */
 class QgsMemoryProvider : public QgsVectorDataProvider
 {
     Q_OBJECT
@@ -65,6 +75,12 @@ class QgsMemoryProvider : public QgsVectorDataProvider
      */
     virtual bool nextFeature( QgsFeature& feature );
 
+    /**
+     * Get a batch of features resulting from a select operation.
+     * @note added in 1.9
+     */
+    virtual int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /**
       * Gets the feature at the given feature ID.
       * @param featureId id of the feature
@@ -154,6 +170,43 @@ class QgsMemoryProvider : public QgsVectorDataProvider
      */
     virtual bool createSpatialIndex();
 
+    /**
+     * Creates an index of the values of a field. It is kept up to date with the edits and
+     * used by subset strings comparing the field with literal values, by uniqueValues()
+     * and, for numeric fields, by minimumValue() and maximumValue()
+     * @note added in 1.9
+     */
+    virtual bool createAttributeIndex( int field );
+
+    /**
+     * Returns the minimum value of an attribute
+     * @note added in 1.9
+     */
+    virtual QVariant minimumValue( int index );
+
+    /**
+     * Returns the maximum value of an attribute
+     * @note added in 1.9
+     */
+    virtual QVariant maximumValue( int index );
+
+    /**
+     * Return unique values of an attribute
+     * @note added in 1.9
+     */
+    virtual void uniqueValues( int index, QList<QVariant> &uniqueValues, int limit = -1 );
+
+    /**
+     * Restricts the features to those matching an expression
+     * @return false if the expression is not valid for the fields of the layer
+     * @note added in 1.9
+     */
+    virtual bool setSubsetString( QString theSQL, bool updateFeatureCount = true );
+
+    virtual bool supportsSubsetString() { return true; }
+
+    virtual QString subsetString() { return mSubsetString; }
+
     /** Returns a bitmask containing the supported capabilities
     Note, some capabilities may change depending on whether
     a spatial filter is active on this provider, so it may
@@ -192,6 +245,32 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     void updateExtent();
 
   private:
+    // index of the values of a field
+    struct AttributeIndex
+    {
+      void insert( QgsFeatureId fid, const QVariant& value );
+      void remove( QgsFeatureId fid, const QVariant& value );
+
+      // true for int and double fields
+      bool numeric;
+      // values of numeric fields that are numbers, ordered
+      QMultiMap<double, QgsFeatureId> numbers;
+      // values of string fields and values of numeric fields that are not numbers
+      QMultiHash<QString, QgsFeatureId> strings;
+      // features with a null value
+      QSet<QgsFeatureId> nulls;
+    };
+
+    class IndexVisitor;
+    friend class IndexVisitor;
+
+    // next stored feature matching the selection or 0
+    QgsFeature* nextSelectedFeature();
+    // checks a stored feature against the selection rectangle and the subset
+    bool matchesSelection( QgsFeature& feature );
+    // removes the slots of deleted features from mFeatures
+    void compactFeatures();
+
     // Coordinate reference system
     QgsCoordinateReferenceSystem mCrs;
 
@@ -199,22 +278,36 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     QgsFieldMap mFields;
     QGis::WkbType mWkbType;
     QgsRectangle mExtent;
-
-    // features
-    QgsFeatureMap mFeatures;
+    // false until a feature with geometry was added, a null rectangle is a valid extent
+    bool mExtentValid;
+
+    // features in the order they were added. Deleted features leave an
+    // invalid feature behind until half of the slots are unused.
+    QVector<QgsFeature> mFeatures;
+    // slot in mFeatures of each feature
+    QHash<QgsFeatureId, int> mFeatureSlots;
     QgsFeatureId mNextFeatureId;
 
+    // subset
+    QString mSubsetString;
+    QgsExpression* mSubsetExpression;
+    // number of features matching the subset, -1 if not counted yet
+    long mSubsetFeatureCount;
+
     // selection
     QgsAttributeList mSelectAttrs;
     QgsRectangle mSelectRect;
     QgsGeometry* mSelectRectGeom;
     bool mSelectGeometry, mSelectUseIntersect;
-    QgsFeatureMap::iterator mSelectIterator;
+    int mSelectSlot;
+    // candidates of the selection found with the spatial or an attribute index
+    bool mSelectUsingIndex;
     bool mSelectUsingSpatialIndex;
-    QList<QgsFeatureId> mSelectSI_Features;
-    QList<QgsFeatureId>::iterator mSelectSI_Iterator;
+    QList<QgsFeatureId> mSelectCandidates;
+    QList<QgsFeatureId>::iterator mSelectCandidateIterator;
 
     // indexing
     QgsSpatialIndex* mSpatialIndex;
+    QMap<int, AttributeIndex> mAttributeIndexes;
 
 };
@@ -661,6 +661,43 @@ bool QgsOgrProvider::nextFeature( QgsFeature& feature )
     mRelevantFieldsForNextFeature = true;
   }
 
+  return readNextFeature( feature );
+}
+
+int QgsOgrProvider::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  if ( !valid )
+  {
+    QgsMessageLog::logMessage( tr( "Read attempt on an invalid OGR data source" ), tr( "OGR" ) );
+    return 0;
+  }
+
+  if ( !mRelevantFieldsForNextFeature )
+  {
+    // setting relevant fields has some overhead so set it only when necessary
+    setRelevantFields( mFetchGeom || mUseIntersect || !mFetchRect.isEmpty(),
+                       mAttributesToFetch );
+    mRelevantFieldsForNextFeature = true;
+  }
+
+  int count = 0;
+  while ( count < maxCount )
+  {
+    features.append( QgsFeature() );
+    if ( !readNextFeature( features.last() ) )
+    {
+      features.removeLast();
+      break;
+    }
+    ++count;
+  }
+  return count;
+}
+
+bool QgsOgrProvider::readNextFeature( QgsFeature& feature )
+{
+  feature.setValid( false );
+
   OGRFeatureH fet;
   QgsRectangle selectionRect;
 
@@ -950,6 +987,12 @@ void QgsOgrProvider::rewind()
   OGR_L_ResetReading( ogrLayer );
 }
 
+QgsVectorDataProvider* QgsOgrProvider::createConcurrentProvider()
+{
+  // the uri includes the subset string, the new provider opens the data source again
+  return new QgsOgrProvider( dataSourceUri() );
+}
+
 
 //TODO - add sanity check for shape file layers, to include cheking to
 //       see if the .shp, .dbf, .shx files are all present and the layer
@@ -102,6 +102,12 @@ class QgsOgrProvider : public QgsVectorDataProvider
      */
     virtual bool nextFeature( QgsFeature& feature );
 
+    /**
+     * Get a batch of features resulting from a select operation.
+     * @note added in 1.9
+     */
+    virtual int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /**
      * Gets the feature at the given feature ID.
      * @param featureId id of the feature
@@ -163,6 +169,10 @@ class QgsOgrProvider : public QgsVectorDataProvider
     /** Restart reading features from previous select operation */
     virtual void rewind();
 
+    /** Returns a provider reading the data source through a data source handle of its own
+     * @note added in 1.9 */
+    virtual QgsVectorDataProvider* createConcurrentProvider();
+
     /**Writes a list of features to the file*/
     virtual bool addFeatures( QgsFeatureList & flist );
 
@@ -296,6 +306,9 @@ class QgsOgrProvider : public QgsVectorDataProvider
     /** tell OGR, which fields to fetch in nextFeature/featureAtId (ie. which not to ignore) */
     void setRelevantFields( bool fetchGeometry, const QgsAttributeList& fetchAttributes );
 
+    /** read the next feature of the current selection, relevant fields must be set */
+    bool readNextFeature( QgsFeature& feature );
+
     /** convert a QgsField to work with OGR */
     static bool convertField( QgsField &field, const QTextCodec &encoding );
 
@@ -125,12 +125,12 @@ QMap<QString, QgsPostgresConn *> QgsPostgresConn::sConnectionsRO;
 QMap<QString, QgsPostgresConn *> QgsPostgresConn::sConnectionsRW;
 const int QgsPostgresConn::sGeomTypeSelectLimit = 100;
 
-QgsPostgresConn *QgsPostgresConn::connectDb( QString conninfo, bool readonly )
+QgsPostgresConn *QgsPostgresConn::connectDb( QString conninfo, bool readonly, bool shared )
 {
   QMap<QString, QgsPostgresConn *> &connections =
     readonly ? QgsPostgresConn::sConnectionsRO : QgsPostgresConn::sConnectionsRW;
 
-  if ( connections.contains( conninfo ) )
+  if ( shared && connections.contains( conninfo ) )
   {
     QgsDebugMsg( QString( "Using cached connection for %1" ).arg( conninfo ) );
     connections[conninfo]->mRef++;
@@ -145,7 +145,9 @@ QgsPostgresConn *QgsPostgresConn::connectDb( QString conninfo, bool readonly )
     return 0;
   }
 
-  connections.insert( conninfo, conn );
+  conn->mShared = shared;
+  if ( shared )
+    connections.insert( conninfo, conn );
 
   return conn;
 }
@@ -156,6 +158,7 @@ QgsPostgresConn::QgsPostgresConn( QString conninfo, bool readOnly )
     , mConnInfo( conninfo )
     , mGotPostgisVersion( false )
     , mReadOnly( readOnly )
+    , mShared( false )
 {
   QgsDebugMsg( QString( "New PostgreSQL connection for " ) + conninfo );
 
@@ -249,6 +252,14 @@ QgsPostgresConn::QgsPostgresConn( QString conninfo, bool readOnly )
 QgsPostgresConn::~QgsPostgresConn()
 {
   Q_ASSERT( mRef == 0 );
+
+  foreach( PGresult *res, mAsyncResults )
+  {
+    if ( res )
+      ::PQclear( res );
+  }
+  mAsyncResults.clear();
+
   if ( mConn )
     ::PQfinish( mConn );
   mConn = 0;
@@ -259,12 +270,15 @@ void QgsPostgresConn::disconnect()
   if ( --mRef > 0 )
     return;
 
-  QMap<QString, QgsPostgresConn *>& connections = mReadOnly ? sConnectionsRO : sConnectionsRW;
+  if ( mShared )
+  {
+    QMap<QString, QgsPostgresConn *>& connections = mReadOnly ? sConnectionsRO : sConnectionsRW;
 
-  QString key = connections.key( this, QString::null );
+    QString key = connections.key( this, QString::null );
 
-  Q_ASSERT( !key.isNull() );
-  connections.remove( key );
+    Q_ASSERT( !key.isNull() );
+    connections.remove( key );
+  }
 
   deleteLater();
 }
@@ -705,6 +719,8 @@ PGresult *QgsPostgresConn::PQexec( QString query, bool logError )
     return 0;
   }
 
+  finishAsyncQuery();
+
   QgsDebugMsgLevel( QString( "Executing SQL: %1" ).arg( query ), 3 );
   PGresult *res = ::PQexec( mConn, query.toUtf8() );
 
@@ -826,11 +842,14 @@ PGresult *QgsPostgresConn::PQgetResult()
 
 PGresult *QgsPostgresConn::PQprepare( QString stmtName, QString query, int nParams, const Oid *paramTypes )
 {
+  finishAsyncQuery();
   return ::PQprepare( mConn, stmtName.toUtf8(), query.toUtf8(), nParams, paramTypes );
 }
 
 PGresult *QgsPostgresConn::PQexecPrepared( QString stmtName, const QStringList &params )
 {
+  finishAsyncQuery();
+
   const char **param = new const char *[ params.size()];
   QList<QByteArray> qparam;
 
@@ -873,9 +892,70 @@ QString QgsPostgresConn::PQerrorMessage()
 int QgsPostgresConn::PQsendQuery( QString query )
 {
   Q_ASSERT( mConn );
+  finishAsyncQuery();
   return ::PQsendQuery( mConn, query.toUtf8() );
 }
 
+bool QgsPostgresConn::sendAsyncQuery( QString tag, QString query )
+{
+  Q_ASSERT( mConn );
+
+  discardAsyncResult( tag );
+  finishAsyncQuery();
+
+  QgsDebugMsgLevel( QString( "Sending SQL [%1]: %2" ).arg( tag ).arg( query ), 3 );
+  if ( ::PQsendQuery( mConn, query.toUtf8() ) == 0 )
+    return false;
+
+  mAsyncTag = tag;
+  return true;
+}
+
+bool QgsPostgresConn::isAsyncResultReady( QString tag )
+{
+  if ( mAsyncTag != tag )
+    return mAsyncResults.contains( tag );
+
+  if ( ::PQconsumeInput( mConn ) == 0 )
+    return true; // connection trouble - let takeAsyncResult() report it
+
+  return ::PQisBusy( mConn ) == 0;
+}
+
+PGresult *QgsPostgresConn::takeAsyncResult( QString tag )
+{
+  if ( mAsyncTag == tag )
+    finishAsyncQuery();
+
+  return mAsyncResults.take( tag );
+}
+
+void QgsPostgresConn::discardAsyncResult( QString tag )
+{
+  PGresult *res = takeAsyncResult( tag );
+  if ( res )
+    ::PQclear( res );
+}
+
+void QgsPostgresConn::finishAsyncQuery()
+{
+  if ( mAsyncTag.isNull() )
+    return;
+
+  // a single statement was sent, keep its result and skip the terminating NULL
+  PGresult *res = 0, *next;
+  while (( next = ::PQgetResult( mConn ) ) )
+  {
+    if ( res )
+      ::PQclear( next );
+    else
+      res = next;
+  }
+
+  mAsyncResults.insert( mAsyncTag, res );
+  mAsyncTag = QString::null;
+}
+
 qint64 QgsPostgresConn::getBinaryInt( QgsPostgresResult &queryResult, int row, int col )
 {
   qint64 oid;
@@ -950,10 +1030,92 @@ qint64 QgsPostgresConn::getBinaryInt( QgsPostgresResult &queryResult, int row, i
   return oid;
 }
 
-QString QgsPostgresConn::fieldExpression( const QgsField &fld )
+bool QgsPostgresConn::hasBinaryRepresentation( const QgsField &fld )
 {
   const QString &type = fld.typeName();
-  if ( type == "money" )
+  return type == "int2" || type == "int4" || type == "int8" || type == "oid" ||
+         type == "float4" || type == "float8";
+}
+
+QVariant QgsPostgresConn::getBinaryValue( QgsPostgresResult &queryResult, int row, int col, const QgsField &fld )
+{
+  if ( queryResult.PQgetisnull( row, col ) )
+    return QVariant( fld.type() );
+
+  const char *p = ::PQgetvalue( queryResult.result(), row, col );
+  int s = ::PQgetlength( queryResult.result(), row, col );
+
+  switch ( s )
+  {
+    case 2:
+    {
+      quint16 v;
+      memcpy( &v, p, sizeof( v ) );
+      if ( mSwapEndian )
+        v = ntohs( v );
+      return QVariant(( int )( qint16 ) v );
+    }
+
+    case 4:
+    {
+      quint32 v;
+      memcpy( &v, p, sizeof( v ) );
+      if ( mSwapEndian )
+        v = ntohl( v );
+
+      if ( fld.typeName() == "float4" )
+      {
+        float f;
+        memcpy( &f, &v, sizeof( f ) );
+        return QVariant(( double ) f );
+      }
+
+      // oids are unsigned, those above 2^31 must not turn negative
+      if ( fld.typeName() == "oid" )
+        return QVariant(( uint ) v );
+
+      return QVariant(( int )( qint32 ) v );
+    }
+
+    case 8:
+    {
+      quint64 v;
+      if ( mSwapEndian )
+      {
+        quint32 hi, lo;
+        memcpy( &hi, p, sizeof( hi ) );
+        memcpy( &lo, p + sizeof( hi ), sizeof( lo ) );
+        v = (( quint64 ) ntohl( hi ) << 32 ) | ntohl( lo );
+      }
+      else
+      {
+        memcpy( &v, p, sizeof( v ) );
+      }
+
+      if ( fld.typeName() == "float8" )
+      {
+        double d;
+        memcpy( &d, &v, sizeof( d ) );
+        return QVariant( d );
+      }
+
+      return QVariant(( qlonglong )( qint64 ) v );
+    }
+
+    default:
+      QgsDebugMsg( QString( "unexpected size %1 for field %2 of type %3" ).arg( s ).arg( fld.name() ).arg( fld.typeName() ) );
+      return QVariant( fld.type() );
+  }
+}
+
+QString QgsPostgresConn::fieldExpression( const QgsField &fld, bool binary )
+{
+  const QString &type = fld.typeName();
+  if ( binary && hasBinaryRepresentation( fld ) )
+  {
+    return quotedIdentifier( fld.name() );
+  }
+  else if ( type == "money" )
   {
     return QString( "cash_out(%1)" ).arg( quotedIdentifier( fld.name() ) );
   }
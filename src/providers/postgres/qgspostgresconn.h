@@ -81,7 +81,10 @@ class QgsPostgresConn : public QObject
 {
     Q_OBJECT;
   public:
-    static QgsPostgresConn *connectDb( QString connInfo, bool readOnly );
+    /** Returns the connection for the connection info, shared by the callers unless
+     * shared is false. Unshared connections may be used in another thread than the
+     * shared one. Release it with disconnect() */
+    static QgsPostgresConn *connectDb( QString connInfo, bool readOnly, bool shared = true );
     void disconnect();
 
     //! get postgis version string
@@ -133,6 +136,26 @@ class QgsPostgresConn : public QObject
     PGresult *PQprepare( QString stmtName, QString query, int nParams, const Oid *paramTypes );
     PGresult *PQexecPrepared( QString stmtName, const QStringList &params );
 
+    //
+    // asynchronous queries
+    //
+    // Only one query can be in flight on a connection.  If another query is
+    // issued meanwhile, the pending result is collected first and kept
+    // until it is taken by its owner.
+    //
+
+    //! send a query without waiting for its result
+    bool sendAsyncQuery( QString tag, QString query );
+
+    //! check without blocking whether the result of an asynchronous query has arrived
+    bool isAsyncResultReady( QString tag );
+
+    //! wait for and return the result of an asynchronous query (caller owns the result)
+    PGresult *takeAsyncResult( QString tag );
+
+    //! drop the (pending) result of an asynchronous query
+    void discardAsyncResult( QString tag );
+
     /** Double quote a PostgreSQL identifier for placement in a SQL string.
      */
     static QString quotedIdentifier( QString ident, bool isGeography = false );
@@ -157,7 +180,17 @@ class QgsPostgresConn : public QObject
 
     qint64 getBinaryInt( QgsPostgresResult &queryResult, int row, int col );
 
-    QString fieldExpression( const QgsField &fld );
+    /** Returns the select expression for a field.
+     *  If binary is set, fields with a binary representation are
+     *  selected as is, so that binary cursors return them undecoded.
+     */
+    QString fieldExpression( const QgsField &fld, bool binary = false );
+
+    //! field values of the type can be decoded with getBinaryValue()
+    static bool hasBinaryRepresentation( const QgsField &fld );
+
+    //! decode a value of a binary cursor result
+    QVariant getBinaryValue( QgsPostgresResult &queryResult, int row, int col, const QgsField &fld );
 
     QString connInfo() const { return mConnInfo; }
 
@@ -227,6 +260,9 @@ class QgsPostgresConn : public QObject
 
     bool mReadOnly;
 
+    //! the connection is in sConnectionsRW or sConnectionsRO
+    bool mShared;
+
     static QMap<QString, QgsPostgresConn *> sConnectionsRW;
     static QMap<QString, QgsPostgresConn *> sConnectionsRO;
 
@@ -245,6 +281,15 @@ class QgsPostgresConn : public QObject
      */
     bool mSwapEndian;
     void deduceEndian();
+
+    //! collect the result of the asynchronous query in flight
+    void finishAsyncQuery();
+
+    //! tag of the asynchronous query in flight, null if there is none
+    QString mAsyncTag;
+
+    //! collected results of asynchronous queries
+    QMap<QString, PGresult *> mAsyncResults;
 };
 
 #endif
@@ -24,6 +24,8 @@
 #include <qgsrectangle.h>
 #include <qgscoordinatereferencesystem.h>
 
+#include <QSettings>
+
 #include "qgsvectorlayerimport.h"
 #include "qgsprovidercountcalcevent.h"
 #include "qgsproviderextentcalcevent.h"
@@ -38,8 +40,9 @@ const QString POSTGRES_DESCRIPTION = "PostgreSQL/PostGIS data provider";
 
 int QgsPostgresProvider::sProviderIds = 0;
 const int QgsPostgresProvider::sFeatureQueueSize = 2000;
+const int QgsPostgresProvider::sPrefetchDepth = 1;
 
-QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
+QgsPostgresProvider::QgsPostgresProvider( QString const & uri, bool sharedConnection )
     : QgsVectorDataProvider( uri )
     , mFetching( false )
     , mValid( false )
@@ -47,8 +50,11 @@ QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
     , mDetectedGeomType( QGis::UnknownGeometry )
     , mRequestedGeomType( QGis::UnknownGeometry )
     , mFeatureQueueSize( sFeatureQueueSize )
+    , mPrefetchDepth( sPrefetchDepth )
+    , mFetchPending( false )
     , mUseEstimatedMetadata( false )
     , mSelectAtIdDisabled( false )
+    , mUseBinaryFetch( false )
     , mConnectionRO( 0 )
     , mConnectionRW( 0 )
     , mFidCounter( 0 )
@@ -93,6 +99,11 @@ QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
 
   mUseEstimatedMetadata = mUri.useEstimatedMetadata();
   mSelectAtIdDisabled = mUri.selectAtIdDisabled();
+  mUseBinaryFetch = mUri.useBinaryFetch();
+
+  QSettings settings;
+  mFeatureQueueSize = qMax( 1, settings.value( "/PostgreSQL/featureQueueSize", sFeatureQueueSize ).toInt() );
+  mPrefetchDepth = qMax( 0, settings.value( "/PostgreSQL/prefetchDepth", sPrefetchDepth ).toInt() );
 
   QgsDebugMsg( QString( "Connection info is %1" ).arg( mUri.connectionInfo() ) );
   QgsDebugMsg( QString( "Geometry column is: %1" ).arg( mGeometryColumn ) );
@@ -107,7 +118,7 @@ QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
     return;
   }
 
-  mConnectionRO = QgsPostgresConn::connectDb( mUri.connectionInfo(), true );
+  mConnectionRO = QgsPostgresConn::connectDb( mUri.connectionInfo(), true, sharedConnection );
   if ( !mConnectionRO )
   {
     return;
@@ -214,6 +225,7 @@ void QgsPostgresProvider::disconnectDb()
 {
   if ( mFetching )
   {
+    clearFeatureQueue();
     mConnectionRO->closeCursor( QString( "qgisf%1" ).arg( mProviderId ) );
     mFetching = false;
   }
@@ -279,7 +291,7 @@ bool QgsPostgresProvider::declareCursor(
       case pktFidMap:
         foreach( int idx, mPrimaryKeyAttrs )
         {
-          query += delim + mConnectionRO->fieldExpression( field( idx ) );
+          query += delim + mConnectionRO->fieldExpression( field( idx ), mUseBinaryFetch );
           delim = ",";
         }
         break;
@@ -295,7 +307,7 @@ bool QgsPostgresProvider::declareCursor(
       if ( mPrimaryKeyAttrs.contains( idx ) )
         continue;
 
-      query += delim + mConnectionRO->fieldExpression( field( idx ) );
+      query += delim + mConnectionRO->fieldExpression( field( idx ), mUseBinaryFetch );
     }
 
     query += " FROM " + mQuery;
@@ -411,9 +423,19 @@ QgsFeatureId QgsPostgresProvider::lookupFid( const QVariant &v )
   return mFidCounter;
 }
 
+QVariant QgsPostgresProvider::fetchValue( QgsPostgresResult &queryResult, int row, int col, const QgsField &fld )
+{
+  if ( mUseBinaryFetch && QgsPostgresConn::hasBinaryRepresentation( fld ) )
+    return mConnectionRO->getBinaryValue( queryResult, row, col, fld );
+
+  return convertValue( fld.type(), queryResult.PQgetvalue( row, col ) );
+}
+
 bool QgsPostgresProvider::getFeature( QgsPostgresResult &queryResult, int row, bool fetchGeometry,
                                       QgsFeature &feature,
-                                      const QgsAttributeList &fetchAttributes )
+                                      const QgsAttributeList &fetchAttributes,
+                                      const QByteArray *wkbBlock,
+                                      int wkbOffset )
 {
   try
   {
@@ -424,7 +446,13 @@ bool QgsPostgresProvider::getFeature( QgsPostgresResult &queryResult, int row, b
     if ( fetchGeometry )
     {
       int returnedLength = ::PQgetlength( queryResult.result(), row, col );
-      if ( returnedLength > 0 )
+      if ( returnedLength > 0 && wkbBlock )
+      {
+        QgsGeometry *featureGeom = new QgsGeometry();
+        featureGeom->fromWkb( *wkbBlock, wkbOffset, returnedLength );
+        feature.setGeometry( featureGeom );
+      }
+      else if ( returnedLength > 0 )
       {
         unsigned char *featureGeom = new unsigned char[returnedLength + 1];
         memset( featureGeom, 0, returnedLength + 1 );
@@ -460,7 +488,7 @@ bool QgsPostgresProvider::getFeature( QgsPostgresResult &queryResult, int row, b
         {
           const QgsField &fld = field( idx );
 
-          QVariant v = convertValue( fld.type(), queryResult.PQgetvalue( row, col ) );
+          QVariant v = fetchValue( queryResult, row, col, fld );
           primaryKeyVals << v;
 
           if ( fetchAttributes.contains( idx ) )
@@ -489,7 +517,7 @@ bool QgsPostgresProvider::getFeature( QgsPostgresResult &queryResult, int row, b
 
       const QgsField &fld = field( idx );
 
-      QVariant v = convertValue( fld.type(), queryResult.PQgetvalue( row, col ) );
+      QVariant v = fetchValue( queryResult, row, col, fld );
       feature.addAttribute( idx, v );
 
       col++;
@@ -509,13 +537,9 @@ void QgsPostgresProvider::select( QgsAttributeList fetchAttributes, QgsRectangle
 
   if ( mFetching )
   {
+    clearFeatureQueue();
     mConnectionRO->closeCursor( cursorName );
     mFetching = false;
-
-    while ( !mFeatureQueue.empty() )
-    {
-      mFeatureQueue.dequeue();
-    }
   }
 
   QString whereClause;
@@ -606,45 +630,134 @@ bool QgsPostgresProvider::nextFeature( QgsFeature& feature )
     return false;
   }
 
-  QString cursorName = QString( "qgisf%1" ).arg( mProviderId );
+  if ( mFeatureQueue.empty() && !fetchFeatureQueue() )
+    return false;
 
-  if ( mFeatureQueue.empty() )
+  takeQueuedFeature( feature );
+
+  // don't poll the connection for every single feature
+  if ( mFetched % 100 == 0 )
+    prefetchFeatureQueue();
+
+  return true;
+}
+
+int QgsPostgresProvider::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  if ( !mValid )
   {
-    QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( cursorName );
-    QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 3 );
-    if ( mConnectionRO->PQsendQuery( fetch ) == 0 ) // fetch features asynchronously
+    QgsMessageLog::logMessage( tr( "Read attempt on an invalid postgresql data source" ), tr( "PostGIS" ) );
+    return 0;
+  }
+
+  if ( !mFetching )
+  {
+    QgsMessageLog::logMessage( tr( "nextFeatures() without select()" ), tr( "PostGIS" ) );
+    return 0;
+  }
+
+  int count = 0;
+  while ( count < maxCount )
+  {
+    if ( mFeatureQueue.empty() && !fetchFeatureQueue() )
+      break;
+
+    // hand out the queued rows without going through nextFeature()
+    while ( count < maxCount && !mFeatureQueue.empty() )
     {
-      QgsMessageLog::logMessage( tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( cursorName ).arg( mConnectionRO->PQerrorMessage() ), tr( "PostGIS" ) );
+      features.append( QgsFeature() );
+      takeQueuedFeature( features.last() );
+      ++count;
     }
+  }
 
-    QgsPostgresResult queryResult;
-    for ( ;; )
-    {
-      queryResult = mConnectionRO->PQgetResult();
-      if ( !queryResult.result() )
-        break;
+  prefetchFeatureQueue();
 
-      if ( queryResult.PQresultStatus() != PGRES_TUPLES_OK )
-      {
-        QgsMessageLog::logMessage( tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( cursorName ).arg( mConnectionRO->PQerrorMessage() ), tr( "PostGIS" ) );
-        break;
-      }
+  return count;
+}
 
-      int rows = queryResult.PQntuples();
-      if ( rows == 0 )
-        continue;
+bool QgsPostgresProvider::sendFetch()
+{
+  QString cursorName = QString( "qgisf%1" ).arg( mProviderId );
 
-      for ( int row = 0; row < rows; row++ )
-      {
-        mFeatureQueue.enqueue( QgsFeature() );
-        getFeature( queryResult, row, mFetchGeom, mFeatureQueue.back(), mAttributesToFetch );
-      } // for each row in queue
+  QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( cursorName );
+  QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 3 );
+  mFetchPending = mConnectionRO->sendAsyncQuery( cursorName, fetch ); // fetch features asynchronously
+  if ( !mFetchPending )
+  {
+    QgsMessageLog::logMessage( tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( cursorName ).arg( mConnectionRO->PQerrorMessage() ), tr( "PostGIS" ) );
+  }
+
+  return mFetchPending;
+}
+
+int QgsPostgresProvider::receiveFetch()
+{
+  QString cursorName = QString( "qgisf%1" ).arg( mProviderId );
+
+  QgsPostgresResult queryResult = mConnectionRO->takeAsyncResult( cursorName );
+  mFetchPending = false;
+
+  if ( !queryResult.result() )
+    return 0;
+
+  if ( queryResult.PQresultStatus() != PGRES_TUPLES_OK )
+  {
+    QgsMessageLog::logMessage( tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( cursorName ).arg( queryResult.PQresultErrorMessage() ), tr( "PostGIS" ) );
+    return 0;
+  }
+
+  int rows = queryResult.PQntuples();
+
+  // copy the geometries of the whole block into one buffer
+  // shared by the features instead of allocating one per feature
+  QByteArray wkbBlock;
+  QVector<int> wkbOffsets( rows, 0 );
+  if ( mFetchGeom )
+  {
+    int size = 0;
+    for ( int row = 0; row < rows; row++ )
+    {
+      wkbOffsets[row] = size;
+      size += ::PQgetlength( queryResult.result(), row, 0 );
+    }
+
+    wkbBlock.resize( size );
+    for ( int row = 0; row < rows; row++ )
+    {
+      memcpy( wkbBlock.data() + wkbOffsets[row], ::PQgetvalue( queryResult.result(), row, 0 ), ::PQgetlength( queryResult.result(), row, 0 ) );
     }
   }
 
+  for ( int row = 0; row < rows; row++ )
+  {
+    mFeatureQueue.enqueue( QgsFeature() );
+    getFeature( queryResult, row, mFetchGeom, mFeatureQueue.back(), mAttributesToFetch, mFetchGeom ? &wkbBlock : 0, wkbOffsets[row] );
+  } // for each row in queue
+
+  // a full block means there might be more - let the server
+  // produce the next one while the queued features are consumed
+  if ( rows == mFeatureQueueSize && mPrefetchDepth > 0 )
+  {
+    sendFetch();
+  }
+
+  return rows;
+}
+
+bool QgsPostgresProvider::fetchFeatureQueue()
+{
+  if ( !mFetchPending && !sendFetch() )
+    return false;
+
+  receiveFetch();
+
   if ( mFeatureQueue.empty() )
   {
+    QString cursorName = QString( "qgisf%1" ).arg( mProviderId );
+
     QgsDebugMsg( QString( "Finished after %1 features" ).arg( mFetched ) );
+    clearFeatureQueue();
     mConnectionRO->closeCursor( cursorName );
     mFetching = false;
     if ( mFeaturesCounted < mFetched )
@@ -655,24 +768,53 @@ bool QgsPostgresProvider::nextFeature( QgsFeature& feature )
     return false;
   }
 
-  // Now return the next feature from the queue
+  return true;
+}
+
+void QgsPostgresProvider::prefetchFeatureQueue()
+{
+  if ( !mFetchPending || mFeatureQueue.size() >= mPrefetchDepth * mFeatureQueueSize )
+    return;
+
+  // only take the block if it already arrived, never wait here
+  if ( mConnectionRO->isAsyncResultReady( QString( "qgisf%1" ).arg( mProviderId ) ) )
+  {
+    receiveFetch();
+  }
+}
+
+void QgsPostgresProvider::clearFeatureQueue()
+{
+  if ( mFetchPending )
+  {
+    mConnectionRO->discardAsyncResult( QString( "qgisf%1" ).arg( mProviderId ) );
+    mFetchPending = false;
+  }
+
+  mFeatureQueue.clear();
+}
+
+void QgsPostgresProvider::takeQueuedFeature( QgsFeature& feature )
+{
+  QgsFeature& queued = mFeatureQueue.front();
+
+  // pass the geometry on instead of copying it
   if ( mFetchGeom )
   {
-    QgsGeometry* featureGeom = mFeatureQueue.front().geometryAndOwnership();
+    QgsGeometry* featureGeom = queued.geometryAndOwnership();
     feature.setGeometry( featureGeom );
   }
   else
   {
     feature.setGeometryAndOwnership( 0, 0 );
   }
-  feature.setFeatureId( mFeatureQueue.front().id() );
-  feature.setAttributeMap( mFeatureQueue.front().attributeMap() );
+  feature.setFeatureId( queued.id() );
+  feature.setAttributeMap( queued.attributeMap() );
 
   mFeatureQueue.dequeue();
   mFetched++;
 
   feature.setValid( true );
-  return true;
 }
 
 QString QgsPostgresProvider::pkParamWhereClause( int offset ) const
@@ -947,12 +1089,19 @@ void QgsPostgresProvider::rewind()
   if ( mFetching )
   {
     //move cursor to first record
+    clearFeatureQueue();
     mConnectionRO->PQexecNR( QString( "move 0 in qgisf%1" ).arg( mProviderId ) );
   }
-  mFeatureQueue.empty();
+  mFeatureQueue.clear();
   loadFields();
 }
 
+QgsVectorDataProvider* QgsPostgresProvider::createConcurrentProvider()
+{
+  // the cursors of the shared connection must not be used from two threads
+  return new QgsPostgresProvider( dataSourceUri(), false );
+}
+
 /** @todo XXX Perhaps this should be promoted to QgsDataProvider? */
 QString QgsPostgresProvider::endianString()
 {
@@ -63,8 +63,10 @@ class QgsPostgresProvider : public QgsVectorDataProvider
      * host=localhost user=gsherman dbname=test password=xxx table=test.alaska (the_geom)
      * @param uri String containing the required parameters to connect to the database
      * and query the table.
+     * @param sharedConnection read through the connection shared by the layers of the same
+     * database, or through a connection of its own (added in 1.9)
      */
-    QgsPostgresProvider( QString const &uri = "" );
+    QgsPostgresProvider( QString const &uri = "", bool sharedConnection = true );
 
     //! Destructor
     virtual ~QgsPostgresProvider();
@@ -100,6 +102,13 @@ class QgsPostgresProvider : public QgsVectorDataProvider
      */
     virtual bool nextFeature( QgsFeature& feature );
 
+    /**
+     * Get a batch of features resulting from a select operation.
+     * The rows of the feature queue are handed out without copying the geometries.
+     * @note added in 1.9
+     */
+    virtual int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /**
       * Gets the feature at the given feature ID.
       * @param featureId id of the feature
@@ -179,6 +188,10 @@ class QgsPostgresProvider : public QgsVectorDataProvider
      */
     void rewind();
 
+    /** Returns a provider for the same table and subset reading through a connection of its own
+     * @note added in 1.9 */
+    QgsVectorDataProvider* createConcurrentProvider();
+
     /** Returns the minimum value of an attribute
      *  @param index the index of the attribute */
     QVariant minimumValue( int index );
@@ -328,11 +341,39 @@ class QgsPostgresProvider : public QgsVectorDataProvider
                         bool fetchGeometry,
                         QString whereClause );
 
+    /** Fetch the next block of rows from the cursor into the feature queue.
+     * Closes the cursor and returns false when there are no more rows */
+    bool fetchFeatureQueue();
+
+    /** Send the FETCH for the next block without waiting for the rows */
+    bool sendFetch();
+
+    /** Wait for the pending FETCH, queue its rows and prefetch the next block
+     * @return number of rows received */
+    int receiveFetch();
+
+    /** Queue an already arrived block while the queue is below the prefetch depth */
+    void prefetchFeatureQueue();
+
+    /** Drop queued features and the pending FETCH */
+    void clearFeatureQueue();
+
+    /** Move the first feature of the queue to the given feature */
+    void takeQueuedFeature( QgsFeature& feature );
+
+    /** Decode an attribute value, either from its binary or its text representation */
+    QVariant fetchValue( QgsPostgresResult &queryResult, int row, int col, const QgsField &fld );
+
+    /** Read a feature from a result row.
+     * If wkbBlock is given, the geometry references the WKB at wkbOffset in it
+     * instead of a copy of its own */
     bool getFeature( QgsPostgresResult &queryResult,
                      int row,
                      bool fetchGeometry,
                      QgsFeature &feature,
-                     const QgsAttributeList &fetchAttributes );
+                     const QgsAttributeList &fetchAttributes,
+                     const QByteArray *wkbBlock = 0,
+                     int wkbOffset = 0 );
 
     QString pkParamWhereClause( int offset ) const;
     QString whereClause( QgsFeatureId featureId ) const;
@@ -432,7 +473,11 @@ class QgsPostgresProvider : public QgsVectorDataProvider
      */
     QQueue<QgsFeature> mFeatureQueue;
 
-    int mFeatureQueueSize;  //! Maximal size of the feature queue
+    int mFeatureQueueSize;  //! Number of rows requested per FETCH
+
+    int mPrefetchDepth;     //! Number of blocks to keep queued ahead, 0 disables prefetching
+
+    bool mFetchPending;     //! A FETCH was sent and its rows not received yet
 
     bool getGeometryDetails();
 
@@ -441,6 +486,9 @@ class QgsPostgresProvider : public QgsVectorDataProvider
 
     bool mSelectAtIdDisabled; //! Disable support for SelectAtId
 
+    /* Fetch numeric attributes in binary form instead of parsing their text representation */
+    bool mUseBinaryFetch;
+
     struct PGFieldNotFound {}; //! Exception to throw
 
     struct PGException
@@ -497,6 +545,7 @@ class QgsPostgresProvider : public QgsVectorDataProvider
 
     static int sProviderIds;
     static const int sFeatureQueueSize;
+    static const int sPrefetchDepth;
 
     QMap<QVariant, QgsFeatureId> mKeyToFid;  // map key values to feature id
     QMap<QgsFeatureId, QVariant> mFidToKey;  // map feature back to fea
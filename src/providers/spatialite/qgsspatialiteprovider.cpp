@@ -30,6 +30,8 @@ email                : a.furieri@lqt.it
 
 #include <QFileInfo>
 #include <QDir>
+#include <QMutexLocker>
+#include <QSettings>
 
 #ifdef _MSC_VER
 #define strcasecmp(a,b) stricmp(a,b)
@@ -38,6 +40,13 @@ email                : a.furieri@lqt.it
 const QString SPATIALITE_KEY = "spatialite";
 const QString SPATIALITE_DESCRIPTION = "SpatiaLite data provider";
 
+// idle prepared statements kept per connection
+static const int STATEMENT_CACHE_SIZE = 32;
+// rows inserted by one multi-row INSERT statement
+static const int INSERT_BATCH_ROWS = 50;
+// default SQLITE_MAX_VARIABLE_NUMBER
+static const int MAX_BOUND_PARAMETERS = 999;
+
 QMap < QString, QgsSpatiaLiteProvider::SqliteHandles * >QgsSpatiaLiteProvider::SqliteHandles::handles;
 
 
@@ -679,7 +688,7 @@ bool QgsSpatiaLiteProvider::featureAtId( QgsFeatureId featureId, QgsFeature & fe
   feature.setValid( false );
 
   QString primaryKey = !isQuery ? "ROWID" : quotedIdentifier( mPrimaryKey );
-  QString whereClause = QString( "%1=%2" ).arg( primaryKey ).arg( featureId );
+  QString whereClause = QString( "%1=?" ).arg( primaryKey );
 
   if ( !mSubsetString.isEmpty() )
   {
@@ -694,14 +703,15 @@ bool QgsSpatiaLiteProvider::featureAtId( QgsFeatureId featureId, QgsFeature & fe
     // some error occurred
     return false;
   }
+  sqlite3_bind_int64( stmt, 1, FID_TO_NUMBER( featureId ) );
 
   if ( !getFeature( stmt, fetchGeometry, feature, fetchAttributes ) )
   {
-    sqlite3_finalize( stmt );
+    handle->releaseStatement( stmt );
     return false;
   }
 
-  sqlite3_finalize( stmt );
+  handle->releaseStatement( stmt );
 
   feature.setValid( true );
   return true;
@@ -724,7 +734,7 @@ bool QgsSpatiaLiteProvider::nextFeature( QgsFeature & feature )
 
   if ( !getFeature( sqliteStatement, mFetchGeom, feature, mAttributesToFetch ) )
   {
-    sqlite3_finalize( sqliteStatement );
+    handle->releaseStatement( sqliteStatement );
     sqliteStatement = NULL;
     return false;
   }
@@ -733,6 +743,39 @@ bool QgsSpatiaLiteProvider::nextFeature( QgsFeature & feature )
   return true;
 }
 
+int QgsSpatiaLiteProvider::nextFeatures( QgsFeatureList& features, int maxCount )
+{
+  if ( !valid )
+  {
+    QgsDebugMsg( "Read attempt on an invalid SpatiaLite data source" );
+    return 0;
+  }
+
+  if ( sqliteStatement == NULL )
+  {
+    QgsDebugMsg( "Invalid current SQLite statement" );
+    return 0;
+  }
+
+  int count = 0;
+  while ( count < maxCount )
+  {
+    features.append( QgsFeature() );
+    QgsFeature& feature = features.last();
+    if ( !getFeature( sqliteStatement, mFetchGeom, feature, mAttributesToFetch ) )
+    {
+      features.removeLast();
+      handle->releaseStatement( sqliteStatement );
+      sqliteStatement = NULL;
+      break;
+    }
+    feature.setValid( true );
+    ++count;
+  }
+
+  return count;
+}
+
 bool QgsSpatiaLiteProvider::getFeature( sqlite3_stmt *stmt, bool fetchGeometry,
                                         QgsFeature &feature,
                                         const QgsAttributeList &fetchAttributes )
@@ -3159,43 +3202,40 @@ void QgsSpatiaLiteProvider::select( QgsAttributeList fetchAttributes, QgsRectang
 
   if ( sqliteStatement != NULL )
   {
-    // finalizing the current SQLite statement
-    sqlite3_finalize( sqliteStatement );
+    // giving the current SQLite statement back to the cache
+    handle->releaseStatement( sqliteStatement );
     sqliteStatement = NULL;
   }
 
+  // the rectangle is bound to the statement, so the SQL is the same for every extent
   QString whereClause;
+  QList<double> mbrValues;
 
   if ( !rect.isEmpty() && !mGeometryColumn.isNull() )
   {
     // some kind of MBR spatial filtering is required
+    QList<double> mbr;
+    mbr << rect.xMinimum() << rect.yMinimum() << rect.xMaximum() << rect.yMaximum();
+
     if ( useIntersect )
     {
       // we are requested to evaluate a true INTERSECT relationship
-      QString mbr = QString( "%1, %2, %3, %4" ).
-                    arg( QString::number( rect.xMinimum(), 'f', 6 ) ).
-                    arg( QString::number( rect.yMinimum(), 'f', 6 ) ).
-                    arg( QString::number( rect.xMaximum(), 'f', 6 ) ).arg( QString::number( rect.yMaximum(), 'f', 6 ) );
-      whereClause += QString( "Intersects(%1, BuildMbr(%2)) AND " ).arg( quotedIdentifier( mGeometryColumn ) ).arg( mbr );
+      whereClause += QString( "Intersects(%1, BuildMbr(?, ?, ?, ?)) AND " ).arg( quotedIdentifier( mGeometryColumn ) );
+      mbrValues << mbr;
     }
     if ( mVShapeBased )
     {
       // handling a VirtualShape layer
-      QString mbr = QString( "%1, %2, %3, %4" ).
-                    arg( QString::number( rect.xMinimum(), 'f', 6 ) ).
-                    arg( QString::number( rect.yMinimum(), 'f', 6 ) ).
-                    arg( QString::number( rect.xMaximum(), 'f', 6 ) ).arg( QString::number( rect.yMaximum(), 'f', 6 ) );
-      whereClause += QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( quotedIdentifier( mGeometryColumn ) ).arg( mbr );
+      whereClause += QString( "MbrIntersects(%1, BuildMbr(?, ?, ?, ?))" ).arg( quotedIdentifier( mGeometryColumn ) );
+      mbrValues << mbr;
     }
     else
     {
       if ( spatialIndexRTree )
       {
         // using the RTree spatial index
-        QString mbrFilter = QString( "xmin <= %1 AND " ).arg( QString::number( rect.xMaximum(), 'f', 6 ) );
-        mbrFilter += QString( "xmax >= %1 AND " ).arg( QString::number( rect.xMinimum(), 'f', 6 ) );
-        mbrFilter += QString( "ymin <= %1 AND " ).arg( QString::number( rect.yMaximum(), 'f', 6 ) );
-        mbrFilter += QString( "ymax >= %1" ).arg( QString::number( rect.yMinimum(), 'f', 6 ) );
+        QString mbrFilter = "xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?";
+        mbrValues << rect.xMaximum() << rect.xMinimum() << rect.yMaximum() << rect.yMinimum();
         QString idxName = QString( "idx_%1_%2" ).arg( mIndexTable ).arg( mIndexGeometry );
         whereClause += QString( "%1 IN (SELECT pkid FROM %2 WHERE %3)" )
                        .arg( quotedIdentifier( primaryKey ) )
@@ -3205,24 +3245,17 @@ void QgsSpatiaLiteProvider::select( QgsAttributeList fetchAttributes, QgsRectang
       else if ( spatialIndexMbrCache )
       {
         // using the MbrCache spatial index
-        QString mbr = QString( "%1, %2, %3, %4" ).
-                      arg( QString::number( rect.xMinimum(), 'f', 6 ) ).
-                      arg( QString::number( rect.yMinimum(), 'f', 6 ) ).
-                      arg( QString::number( rect.xMaximum(), 'f', 6 ) ).arg( QString::number( rect.yMaximum(), 'f', 6 ) );
         QString idxName = QString( "cache_%1_%2" ).arg( mIndexTable ).arg( mIndexGeometry );
-        whereClause += QString( "%1 IN (SELECT rowid FROM %2 WHERE mbr = FilterMbrIntersects(%3))" )
+        whereClause += QString( "%1 IN (SELECT rowid FROM %2 WHERE mbr = FilterMbrIntersects(?, ?, ?, ?))" )
                        .arg( quotedIdentifier( primaryKey ) )
-                       .arg( quotedIdentifier( idxName ) )
-                       .arg( mbr );
+                       .arg( quotedIdentifier( idxName ) );
+        mbrValues << mbr;
       }
       else
       {
         // using simple MBR filtering
-        QString mbr = QString( "%1, %2, %3, %4" ).
-                      arg( QString::number( rect.xMinimum(), 'f', 6 ) ).
-                      arg( QString::number( rect.yMinimum(), 'f', 6 ) ).
-                      arg( QString::number( rect.xMaximum(), 'f', 6 ) ).arg( QString::number( rect.yMaximum(), 'f', 6 ) );
-        whereClause += QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( quotedIdentifier( mGeometryColumn ) ).arg( mbr );
+        whereClause += QString( "MbrIntersects(%1, BuildMbr(?, ?, ?, ?))" ).arg( quotedIdentifier( mGeometryColumn ) );
+        mbrValues << mbr;
       }
     }
   }
@@ -3245,6 +3278,11 @@ void QgsSpatiaLiteProvider::select( QgsAttributeList fetchAttributes, QgsRectang
     sqliteStatement = NULL;
     return;
   }
+
+  for ( int i = 0; i < mbrValues.size(); i++ )
+  {
+    sqlite3_bind_double( sqliteStatement, i + 1, mbrValues[i] );
+  }
 }
 
 bool QgsSpatiaLiteProvider::prepareStatement(
@@ -3285,7 +3323,8 @@ bool QgsSpatiaLiteProvider::prepareStatement(
   if ( !whereClause.isEmpty() )
     sql += QString( " WHERE %1" ).arg( whereClause );
 
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  stmt = handle->cachedStatement( sql );
+  if ( !stmt )
   {
     // some error occurred
     QgsMessageLog::logMessage( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ), tr( "SpatiaLite" ) );
@@ -3295,6 +3334,37 @@ bool QgsSpatiaLiteProvider::prepareStatement(
   return true;
 }
 
+void QgsSpatiaLiteProvider::bindValue( sqlite3_stmt *stmt, int idx, const QVariant &value, QVariant::Type type )
+{
+  if ( value.toString().isEmpty() )
+  {
+    // assuming to be a NULL value
+    type = QVariant::Invalid;
+  }
+
+  if ( type == QVariant::Int || type == QVariant::LongLong )
+  {
+    // binding an INTEGER value
+    sqlite3_bind_int64( stmt, idx, value.toLongLong() );
+  }
+  else if ( type == QVariant::Double )
+  {
+    // binding a DOUBLE value
+    sqlite3_bind_double( stmt, idx, value.toDouble() );
+  }
+  else if ( type == QVariant::Invalid )
+  {
+    // binding a NULL value
+    sqlite3_bind_null( stmt, idx );
+  }
+  else
+  {
+    // binding a TEXT value
+    QByteArray ba = value.toString().toUtf8();
+    sqlite3_bind_text( stmt, idx, ba.constData(), ba.size(), SQLITE_TRANSIENT );
+  }
+}
+
 
 QgsRectangle QgsSpatiaLiteProvider::extent()
 {
@@ -3341,12 +3411,19 @@ void QgsSpatiaLiteProvider::rewind()
 {
   if ( sqliteStatement )
   {
-    sqlite3_finalize( sqliteStatement );
+    handle->releaseStatement( sqliteStatement );
     sqliteStatement = NULL;
   }
   loadFields();
 }
 
+QgsVectorDataProvider* QgsSpatiaLiteProvider::createConcurrentProvider()
+{
+  // the database handle is shared, it is opened in serialized mode.
+  // The new provider has statements of its own
+  return new QgsSpatiaLiteProvider( dataSourceUri() );
+}
+
 QgsCoordinateReferenceSystem QgsSpatiaLiteProvider::crs()
 {
   QgsCoordinateReferenceSystem srs;
@@ -3578,9 +3655,12 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
   char *errMsg = NULL;
   bool toCommit = false;
   QString sql;
+  QString insert;
   QString values;
   QString separator;
-  int ia, ret;
+  QgsAttributeList attributeIds;
+  QgsFeatureList::iterator features;
+  int rowsPerInsert, paramsPerRow, ia, ret;
 
   if ( flist.size() == 0 )
     return true;
@@ -3594,24 +3674,25 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
   }
   toCommit = true;
 
-  sql = QString( "INSERT INTO %1(" ).arg( quotedIdentifier( mTableName ) );
-  values = QString( ") VALUES (" );
+  insert = QString( "INSERT INTO %1(" ).arg( quotedIdentifier( mTableName ) );
+  values = QString( "(" );
   separator = "";
 
   if ( !mPrimaryKey.isEmpty() )
   {
-    sql += separator + quotedIdentifier( mPrimaryKey );
+    insert += separator + quotedIdentifier( mPrimaryKey );
     values += separator + "NULL";
     separator = ",";
   }
 
   if ( !mGeometryColumn.isNull() )
   {
-    sql += separator + quotedIdentifier( mGeometryColumn );
+    insert += separator + quotedIdentifier( mGeometryColumn );
     values += separator + QString( "GeomFromWKB(?, %2)" ).arg( mSrid );
     separator = ",";
   }
 
+  // the attributes of the first feature are inserted for all features
   for ( QgsAttributeMap::const_iterator it = attributevec.begin(); it != attributevec.end(); it++ )
   {
     QgsFieldMap::const_iterator fit = attributeFields.find( it.key() );
@@ -3622,85 +3703,73 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
     if ( fieldname.isEmpty() || fieldname == mGeometryColumn || fieldname == mPrimaryKey )
       continue;
 
-    sql += separator + quotedIdentifier( fieldname );
+    insert += separator + quotedIdentifier( fieldname );
     values += separator + "?";
+    separator = ",";
+    attributeIds << it.key();
   }
 
-  sql += values;
-  sql += ")";
+  insert += ") VALUES ";
+  values += ")";
 
-  // SQLite prepared statement
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  // one statement inserts several rows if SQLite supports multi-row VALUES (3.7.11)
+  paramsPerRow = attributeIds.size() + ( mGeometryColumn.isNull() ? 0 : 1 );
+  rowsPerInsert = 1;
+  if ( sqlite3_libversion_number() >= 3007011 )
   {
-    // some error occurred
-    QgsMessageLog::logMessage( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ), tr( "SpatiaLite" ) );
-    return false;
+    rowsPerInsert = qMax( 1, qMin( INSERT_BATCH_ROWS, MAX_BOUND_PARAMETERS / qMax( 1, paramsPerRow ) ) );
   }
 
-  for ( QgsFeatureList::iterator features = flist.begin(); features != flist.end(); features++ )
+  features = flist.begin();
+  while ( features != flist.end() )
   {
-    // looping on each feature to insert
-    const QgsAttributeMap & attributevec = features->attributeMap();
+    int rows = qMin( rowsPerInsert, ( int )( flist.end() - features ) );
 
-    // resetting Prepared Statement and bindings
-    sqlite3_reset( stmt );
-    sqlite3_clear_bindings( stmt );
-
-    // initializing the column counter
-    ia = 0;
-
-    if ( !mGeometryColumn.isNull() )
+    sql = insert + values;
+    for ( int i = 1; i < rows; i++ )
     {
-      // binding GEOMETRY to Prepared Statement
-      unsigned char *wkb = NULL;
-      size_t wkb_size;
-      convertFromGeosWKB( features->geometry()->asWkb(),
-                          features->geometry()->wkbSize(),
-                          &wkb, &wkb_size, nDims );
-      if ( !wkb )
-        sqlite3_bind_null( stmt, ++ia );
-      else
-        sqlite3_bind_blob( stmt, ++ia, wkb, wkb_size, free );
+      sql += "," + values;
     }
 
-    for ( QgsAttributeMap::const_iterator it = attributevec.begin(); it != attributevec.end(); it++ )
+    // SQLite prepared statement, reused for every full batch
+    stmt = handle->cachedStatement( sql );
+    if ( !stmt )
     {
-      // binding values for each attribute
-      QgsFieldMap::const_iterator fit = attributeFields.find( it.key() );
-      if ( fit == attributeFields.end() )
-        continue;
+      // some error occurred
+      const char *err = sqlite3_errmsg( sqliteHandle );
+      errMsg = ( char * ) sqlite3_malloc( strlen( err ) + 1 );
+      strcpy( errMsg, err );
+      goto abort;
+    }
 
-      QString fieldname = fit->name();
-      if ( fieldname.isEmpty() || fieldname == mGeometryColumn || fieldname == mPrimaryKey )
-        continue;
+    // initializing the column counter
+    ia = 0;
 
-      QVariant::Type type = fit->type();
-      if ( it->toString().isEmpty() )
+    for ( int i = 0; i < rows; i++, features++ )
+    {
+      // looping on each feature of the batch
+      if ( !mGeometryColumn.isNull() )
       {
-        // assuming to be a NULL value
-        type = QVariant::Invalid;
+        // binding GEOMETRY to Prepared Statement
+        unsigned char *wkb = NULL;
+        size_t wkb_size;
+        if ( features->geometry() )
+        {
+          convertFromGeosWKB( features->geometry()->asWkb(),
+                              features->geometry()->wkbSize(),
+                              &wkb, &wkb_size, nDims );
+        }
+        if ( !wkb )
+          sqlite3_bind_null( stmt, ++ia );
+        else
+          sqlite3_bind_blob( stmt, ++ia, wkb, wkb_size, free );
       }
 
-      if ( type == QVariant::Int )
-      {
-        // binding an INTEGER value
-        sqlite3_bind_int( stmt, ++ia, it->toInt() );
-      }
-      else if ( type == QVariant::Double )
-      {
-        // binding a DOUBLE value
-        sqlite3_bind_double( stmt, ++ia, it->toDouble() );
-      }
-      else if ( type == QVariant::String )
-      {
-        // binding a TEXT value
-        QByteArray ba = it->toString().toUtf8();
-        sqlite3_bind_text( stmt, ++ia, ba.constData(), ba.size(), SQLITE_TRANSIENT );
-      }
-      else
+      // binding values for each attribute, missing ones are NULL
+      const QgsAttributeMap & attrs = features->attributeMap();
+      foreach( int idx, attributeIds )
       {
-        // binding a NULL value
-        sqlite3_bind_null( stmt, ++ia );
+        bindValue( stmt, ++ia, attrs.value( idx ), field( idx ).type() );
       }
     }
 
@@ -3709,7 +3778,7 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
 
     if ( ret == SQLITE_DONE || ret == SQLITE_ROW )
     {
-      numberFeatures++;
+      numberFeatures += rows;
     }
     else
     {
@@ -3721,8 +3790,9 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
       goto abort;
     }
 
+    handle->releaseStatement( stmt );
+    stmt = NULL;
   }
-  sqlite3_finalize( stmt );
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
   if ( ret != SQLITE_OK )
@@ -3733,6 +3803,8 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
   return true;
 
 abort:
+  handle->releaseStatement( stmt );
+
   pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( errMsg ? errMsg : tr( "unknown cause" ) ) );
   if ( errMsg )
   {
@@ -3766,11 +3838,15 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
   sql = QString( "DELETE FROM %1 WHERE ROWID=?" ).arg( quotedIdentifier( mTableName ) );
 
   // SQLite prepared statement
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  stmt = handle->cachedStatement( sql );
+  if ( !stmt )
   {
     // some error occurred
-    pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ) );
-    return false;
+    const char *err = sqlite3_errmsg( sqliteHandle );
+    int len = strlen( err );
+    errMsg = ( char * ) sqlite3_malloc( len + 1 );
+    strcpy( errMsg, err );
+    goto abort;
   }
 
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
@@ -3799,7 +3875,8 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
       goto abort;
     }
   }
-  sqlite3_finalize( stmt );
+  handle->releaseStatement( stmt );
+  stmt = NULL;
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
   if ( ret != SQLITE_OK )
@@ -3811,6 +3888,8 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
   return true;
 
 abort:
+  handle->releaseStatement( stmt );
+
   pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( errMsg ? errMsg : tr( "unknown cause" ) ) );
   if ( errMsg )
   {
@@ -3884,6 +3963,7 @@ abort:
 
 bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap & attr_map )
 {
+  sqlite3_stmt *stmt = NULL;
   char *errMsg = NULL;
   bool toCommit = false;
   QString sql;
@@ -3904,10 +3984,13 @@ bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap
     if ( FID_IS_NEW( fid ) )
       continue;
 
-    QString sql = QString( "UPDATE %1 SET " ).arg( quotedIdentifier( mTableName ) );
-    bool first = true;
-
     const QgsAttributeMap & attrs = iter.value();
+    if ( attrs.isEmpty() )
+      continue;
+
+    // the values are bound, so features changing the same attributes share the statement
+    sql = QString( "UPDATE %1 SET " ).arg( quotedIdentifier( mTableName ) );
+    bool first = true;
 
     // cycle through the changed attributes of the feature
     for ( QgsAttributeMap::const_iterator siter = attrs.begin(); siter != attrs.end(); ++siter )
@@ -3919,37 +4002,42 @@ bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap
       else
         first = false;
 
-      QVariant::Type type = siter->type();
-      if ( siter->toString().isEmpty() )
-      {
-        // assuming to be a NULL value
-        type = QVariant::Invalid;
-      }
-
-      if ( type == QVariant::Invalid )
-      {
-        // binding a NULL value
-        sql += QString( "%1=NULL" ).arg( quotedIdentifier( fieldName ) );
-      }
-      else if ( type == QVariant::Int || type == QVariant::Double )
-      {
-        // binding a NUMERIC value
-        sql += QString( "%1=%2" ).arg( quotedIdentifier( fieldName ) ).arg( siter->toString() );
-      }
-      else
-      {
-        // binding a TEXT value
-        sql += QString( "%1=%2" ).arg( quotedIdentifier( fieldName ) ).arg( quotedValue( siter->toString() ) );
-      }
+      sql += QString( "%1=?" ).arg( quotedIdentifier( fieldName ) );
     }
-    sql += QString( " WHERE ROWID=%1" ).arg( fid );
+    sql += " WHERE ROWID=?";
 
-    ret = sqlite3_exec( sqliteHandle, sql.toUtf8().constData(), NULL, NULL, &errMsg );
-    if ( ret != SQLITE_OK )
+    stmt = handle->cachedStatement( sql );
+    if ( !stmt )
     {
       // some error occurred
+      const char *err = sqlite3_errmsg( sqliteHandle );
+      int len = strlen( err );
+      errMsg = ( char * ) sqlite3_malloc( len + 1 );
+      strcpy( errMsg, err );
       goto abort;
     }
+
+    int ia = 0;
+    for ( QgsAttributeMap::const_iterator siter = attrs.begin(); siter != attrs.end(); ++siter )
+    {
+      bindValue( stmt, ++ia, *siter, siter->type() );
+    }
+    sqlite3_bind_int64( stmt, ++ia, FID_TO_NUMBER( fid ) );
+
+    // performing actual row update
+    ret = sqlite3_step( stmt );
+    if ( ret != SQLITE_DONE && ret != SQLITE_ROW )
+    {
+      // some unexpected error occurred
+      const char *err = sqlite3_errmsg( sqliteHandle );
+      int len = strlen( err );
+      errMsg = ( char * ) sqlite3_malloc( len + 1 );
+      strcpy( errMsg, err );
+      goto abort;
+    }
+
+    handle->releaseStatement( stmt );
+    stmt = NULL;
   }
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
@@ -3962,6 +4050,8 @@ bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap
   return true;
 
 abort:
+  handle->releaseStatement( stmt );
+
   pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( errMsg ? errMsg : tr( "unknown cause" ) ) );
   if ( errMsg )
   {
@@ -3999,11 +4089,15 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
     .arg( mSrid );
 
   // SQLite prepared statement
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  stmt = handle->cachedStatement( sql );
+  if ( !stmt )
   {
     // some error occurred
-    QgsMessageLog::logMessage( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ), tr( "SpatiaLite" ) );
-    return false;
+    const char *err = sqlite3_errmsg( sqliteHandle );
+    int len = strlen( err );
+    errMsg = ( char * ) sqlite3_malloc( len + 1 );
+    strcpy( errMsg, err );
+    goto abort;
   }
 
   for ( QgsGeometryMap::iterator iter = geometry_map.begin(); iter != geometry_map.end(); ++iter )
@@ -4043,7 +4137,8 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
 
     }
   }
-  sqlite3_finalize( stmt );
+  handle->releaseStatement( stmt );
+  stmt = NULL;
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
   if ( ret != SQLITE_OK )
@@ -4054,6 +4149,8 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
   return true;
 
 abort:
+  handle->releaseStatement( stmt );
+
   pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( errMsg ? errMsg : tr( "unknown cause" ) ) );
   if ( errMsg )
   {
@@ -4079,7 +4176,7 @@ void QgsSpatiaLiteProvider::closeDb()
 // trying to close the SQLite DB
   if ( sqliteStatement )
   {
-    sqlite3_finalize( sqliteStatement );
+    handle->releaseStatement( sqliteStatement );
     sqliteStatement = NULL;
   }
   if ( handle )
@@ -4127,7 +4224,8 @@ QgsSpatiaLiteProvider::SqliteHandles * QgsSpatiaLiteProvider::SqliteHandles::ope
   }
 
   QgsDebugMsg( QString( "New sqlite connection for " ) + dbPath );
-  if ( sqlite3_open_v2( dbPath.toUtf8().constData(), &sqlite_handle, SQLITE_OPEN_READWRITE, NULL ) )
+  // the layers sharing the connection may be drawn in different threads
+  if ( sqlite3_open_v2( dbPath.toUtf8().constData(), &sqlite_handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL ) )
   {
     // failure
     QgsDebugMsg( QString( "Failure while connecting to: %1\n%2" )
@@ -4147,6 +4245,21 @@ QgsSpatiaLiteProvider::SqliteHandles * QgsSpatiaLiteProvider::SqliteHandles::ope
   // activating Foreign Key constraints
   sqlite3_exec( sqlite_handle, "PRAGMA foreign_keys = 1", NULL, 0, NULL );
 
+  // optional write-ahead log and memory mapped i/o, unknown pragmas are ignored by older SQLite versions
+  QSettings settings;
+  if ( settings.value( "/SpatiaLite/walJournal", false ).toBool() )
+  {
+    sqlite3_exec( sqlite_handle, "PRAGMA journal_mode = WAL", NULL, 0, NULL );
+    // commits do not sync the database file in WAL mode, only checkpoints do
+    sqlite3_exec( sqlite_handle, "PRAGMA synchronous = NORMAL", NULL, 0, NULL );
+  }
+  qint64 mmapSize = settings.value( "/SpatiaLite/mmapSize", 0 ).toLongLong();
+  if ( mmapSize > 0 )
+  {
+    QString sql = QString( "PRAGMA mmap_size = %1" ).arg( mmapSize * 1024 * 1024 );
+    sqlite3_exec( sqlite_handle, sql.toUtf8().constData(), NULL, 0, NULL );
+  }
+
   QgsDebugMsg( "Connection to the database was successful" );
 
   SqliteHandles *handle = new SqliteHandles( sqlite_handle );
@@ -4179,8 +4292,58 @@ void QgsSpatiaLiteProvider::SqliteHandles::closeDb( QMap < QString, SqliteHandle
   handle = NULL;
 }
 
+sqlite3_stmt *QgsSpatiaLiteProvider::SqliteHandles::cachedStatement( const QString &sql )
+{
+  QMutexLocker locker( &statementMutex );
+
+  sqlite3_stmt *stmt = statements.take( sql );
+  if ( stmt )
+  {
+    statementOrder.removeOne( stmt );
+    return stmt;
+  }
+
+  if ( sqlite3_prepare_v2( sqlite_handle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    return NULL;
+  }
+  return stmt;
+}
+
+void QgsSpatiaLiteProvider::SqliteHandles::releaseStatement( sqlite3_stmt *stmt )
+{
+  if ( !stmt )
+    return;
+
+  sqlite3_reset( stmt );
+  sqlite3_clear_bindings( stmt );
+
+  QMutexLocker locker( &statementMutex );
+
+  // sqlite3_sql() returns the text the statement was prepared from
+  statements.insert( QString::fromUtf8( sqlite3_sql( stmt ) ), stmt );
+  statementOrder.append( stmt );
+
+  while ( statementOrder.size() > STATEMENT_CACHE_SIZE )
+  {
+    sqlite3_stmt *oldest = statementOrder.takeFirst();
+    statements.remove( QString::fromUtf8( sqlite3_sql( oldest ) ), oldest );
+    sqlite3_finalize( oldest );
+  }
+}
+
 void QgsSpatiaLiteProvider::SqliteHandles::sqliteClose()
 {
+  {
+    QMutexLocker locker( &statementMutex );
+    foreach( sqlite3_stmt *stmt, statementOrder )
+    {
+      sqlite3_finalize( stmt );
+    }
+    statements.clear();
+    statementOrder.clear();
+  }
+
   if ( sqlite_handle )
   {
     sqlite3_close( sqlite_handle );
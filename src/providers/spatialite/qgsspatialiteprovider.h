@@ -25,6 +25,8 @@ extern "C"
 #include "qgsvectordataprovider.h"
 #include "qgsrectangle.h"
 #include "qgsvectorlayerimport.h"
+#include <QHash>
+#include <QMutex>
 #include <list>
 #include <queue>
 #include <fstream>
@@ -115,6 +117,13 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
      */
     virtual bool nextFeature( QgsFeature & feature );
 
+    /**
+     * Get a batch of features resulting from a select operation.
+     * Steps the current statement until the batch is full.
+     * @note added in 1.9
+     */
+    virtual int nextFeatures( QgsFeatureList& features, int maxCount );
+
     /** Get the feature type. This corresponds to
      * WKBPoint,
      * WKBLineString,
@@ -165,6 +174,10 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
     /** Reset the layer */
     void rewind();
 
+    /** Returns a provider for the same table and subset with statements of its own
+     * @note added in 1.9 */
+    QgsVectorDataProvider* createConcurrentProvider();
+
     /** Returns the minimum value of an attribute
      *  @param index the index of the attribute */
     QVariant minimumValue( int index );
@@ -409,10 +422,15 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
     bool getQueryGeometryDetails();
     bool getSridDetails();
     bool getTableSummary();
+    /** gets the select statement from the statement cache of the connection,
+     * the caller binds the parameters of whereClause and gives it back
+     * with SqliteHandles::releaseStatement() */
     bool prepareStatement( sqlite3_stmt *&stmt,
                            const QgsAttributeList &fetchAttributes,
                            bool fetchGeometry,
                            QString whereClause );
+    /** binds an attribute value, empty values are bound as NULL */
+    static void bindValue( sqlite3_stmt *stmt, int idx, const QVariant &value, QVariant::Type type );
     bool getFeature( sqlite3_stmt *stmt, bool fetchGeometry,
                      QgsFeature &feature,
                      const QgsAttributeList &fetchAttributes );
@@ -478,6 +496,34 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
         //
         void sqliteClose();
 
+        /**
+         * Returns an idle statement for sql from the statement cache of the
+         * connection or prepares a new one. The statement is reserved for
+         * the caller until it is given back with releaseStatement(), so
+         * layers sharing the connection never step the same statement.
+         * Thread safe, the connection itself is opened in serialized mode.
+         * @return NULL if sql could not be prepared
+         * @note added in 1.9
+         */
+        sqlite3_stmt *cachedStatement( const QString &sql );
+
+        /**
+         * Resets a statement returned by cachedStatement() and keeps it in
+         * the cache, finalizing the least recently used statements beyond
+         * the cache size.
+         * @note added in 1.9
+         */
+        void releaseStatement( sqlite3_stmt *stmt );
+
+        /**
+         * Opens the database or returns the shared connection to it.
+         * New connections use the write-ahead log if the setting
+         * /SpatiaLite/walJournal is true (with synchronous=NORMAL, changes
+         * are kept in the -wal file until a checkpoint; SQLite >= 3.7.0) and
+         * map up to /SpatiaLite/mmapSize MB of the file into memory
+         * (SQLite >= 3.7.17). Both are off by default and ignored by older
+         * SQLite versions.
+         */
         static SqliteHandles *openDb( const QString & dbPath );
         static bool checkMetadata( sqlite3 * handle );
         static void closeDb( SqliteHandles * &handle );
@@ -487,6 +533,14 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
         int ref;
         sqlite3 *sqlite_handle;
 
+        //! idle prepared statements by their sql
+        QMultiHash < QString, sqlite3_stmt * > statements;
+        //! idle prepared statements, least recently released first
+        QList < sqlite3_stmt * > statementOrder;
+        //! guards statements and statementOrder, layers of the
+        //! connection may be drawn in different threads
+        QMutex statementMutex;
+
         static QMap < QString, SqliteHandles * >handles;
     };
 
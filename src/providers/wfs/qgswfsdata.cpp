@@ -19,16 +19,189 @@
 #include "qgslogger.h"
 #include "qgsnetworkaccessmanager.h"
 #include <QBuffer>
+#include <QFile>
 #include <QList>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QProgressDialog>
 #include <QSet>
 #include <QSettings>
+#include <QThread>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 const char NS_SEPARATOR = '?';
 const QString GML_NAMESPACE = "http://www.opengis.net/gml";
+//size of the chunks of feature members parsed by worker threads
+const int GML_CHUNK_SIZE = 1024 * 1024;
+
+static bool isNameChar( char c )
+{
+  return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' )
+         || c == '_' || c == '-' || c == '.' || c == ':' || ( c & 0x80 );
+}
+
+//returns the position after the start tag of the root element and its qualified name,
+//or -1 if the start tag is not complete yet
+static int rootStartTagEnd( const QByteArray& data, QByteArray& rootName )
+{
+  int pos = 0;
+  while ( true )
+  {
+    pos = data.indexOf( '<', pos );
+    if ( pos < 0 || pos + 1 >= data.size() )
+    {
+      return -1;
+    }
+
+    if ( data[pos + 1] == '?' ) //xml declaration or processing instruction
+    {
+      pos = data.indexOf( "?>", pos );
+      if ( pos < 0 )
+      {
+        return -1;
+      }
+    }
+    else if ( data.mid( pos, 4 ) == "<!--" )
+    {
+      pos = data.indexOf( "-->", pos );
+      if ( pos < 0 )
+      {
+        return -1;
+      }
+    }
+    else if ( data[pos + 1] == '!' ) //doctype, possibly with an internal subset
+    {
+      int end = data.indexOf( '>', pos );
+      int subset = data.indexOf( '[', pos );
+      if ( subset >= 0 && subset < end )
+      {
+        end = data.indexOf( "]>", subset );
+      }
+      if ( end < 0 )
+      {
+        return -1;
+      }
+      pos = end;
+    }
+    else
+    {
+      int nameEnd = pos + 1;
+      while ( nameEnd < data.size() && isNameChar( data[nameEnd] ) )
+      {
+        ++nameEnd;
+      }
+      rootName = data.mid( pos + 1, nameEnd - pos - 1 );
+
+      //find the end of the tag, '>' may be part of attribute values
+      char quote = 0;
+      for ( int i = nameEnd; i < data.size(); ++i )
+      {
+        char c = data[i];
+        if ( quote )
+        {
+          if ( c == quote )
+            quote = 0;
+        }
+        else if ( c == '"' || c == '\'' )
+        {
+          quote = c;
+        }
+        else if ( c == '>' )
+        {
+          return i + 1;
+        }
+      }
+      return -1;
+    }
+    ++pos;
+  }
+}
+
+//checks whether the featureMember found at pos is the local name of a start or end tag
+//and returns the position of its '<' or -1
+static int featureMemberTag( const QByteArray& data, int pos, bool endTag )
+{
+  int after = pos + 13; //strlen( "featureMember" )
+  if ( after >= data.size() || isNameChar( data[after] ) )
+  {
+    return -1;
+  }
+
+  int start = pos - 1;
+  if ( start >= 0 && data[start] == ':' )
+  {
+    --start;
+    while ( start >= 0 && isNameChar( data[start] ) && data[start] != ':' )
+    {
+      --start;
+    }
+  }
+  if ( endTag )
+  {
+    return start >= 1 && data[start] == '/' && data[start - 1] == '<' ? start - 1 : -1;
+  }
+  return start >= 0 && data[start] == '<' ? start : -1;
+}
+
+//returns the position of the first start tag of a feature member at or after from, or -1
+static int firstFeatureMemberStart( const QByteArray& data, int from )
+{
+  int pos = data.indexOf( "featureMember", from );
+  while ( pos >= 0 )
+  {
+    int start = featureMemberTag( data, pos, false );
+    if ( start >= 0 )
+    {
+      return start;
+    }
+    pos = data.indexOf( "featureMember", pos + 1 );
+  }
+  return -1;
+}
+
+//returns the position after the last end tag of a feature member, or -1.
+//data starts with a feature member, so the markup is scanned forward from there:
+//end tags in CDATA sections and comments do not count
+static int lastFeatureMemberEnd( const QByteArray& data )
+{
+  const char* d = data.constData();
+  int last = -1;
+  int pos = data.indexOf( '<' );
+  while ( pos >= 0 )
+  {
+    if ( qstrncmp( d + pos, "<![CDATA[", 9 ) == 0 )
+    {
+      pos = data.indexOf( "]]>", pos );
+    }
+    else if ( qstrncmp( d + pos, "<!--", 4 ) == 0 )
+    {
+      pos = data.indexOf( "-->", pos );
+    }
+    else if ( d[pos + 1] == '/' )
+    {
+      int nameEnd = pos + 2;
+      while ( nameEnd < data.size() && isNameChar( d[nameEnd] ) )
+      {
+        ++nameEnd;
+      }
+      int end = nameEnd > pos + 2 && nameEnd < data.size() ? data.indexOf( '>', nameEnd ) : -1;
+      if ( end >= 0 && nameEnd - pos - 2 >= 13 && qstrncmp( d + nameEnd - 13, "featureMember", 13 ) == 0
+           && featureMemberTag( data, nameEnd - 13, true ) == pos )
+      {
+        last = end + 1;
+      }
+      pos = end;
+    }
+
+    if ( pos < 0 )
+    {
+      break; //incomplete markup, the rest follows with the next data
+    }
+    pos = data.indexOf( '<', pos + 1 );
+  }
+  return last;
+}
 
 QgsWFSData::QgsWFSData(
   const QString& uri,
@@ -47,7 +220,12 @@ QgsWFSData::QgsWFSData(
     mThematicAttributes( thematicAttributes ),
     mWkbType( wkbType ),
     mFinished( false ),
-    mFeatureCount( 0 )
+    mShowProgressDialog( true ),
+    mFeatureCount( 0 ),
+    mCurrentWKB( 0 ),
+    mCurrentWKBSize( 0 ),
+    mInFeatureMembers( false ),
+    mParseError( false )
 {
   //find out mTypeName from uri
   QStringList arguments = uri.split( "&" );
@@ -99,7 +277,7 @@ int QgsWFSData::getWFSData()
   QProgressDialog* progressDialog = 0;
   QWidget* mainWindow = findMainWindow();
 
-  if ( mainWindow )
+  if ( mainWindow && mShowProgressDialog )
   {
     progressDialog = new QProgressDialog( tr( "Loading WFS data\n%1" ).arg( mTypeName ), tr( "Abort" ), 0, 0, mainWindow );
     progressDialog->setWindowModality( Qt::ApplicationModal );
@@ -117,13 +295,15 @@ int QgsWFSData::getWFSData()
       atEnd = 1;
     }
     QByteArray readData = reply->readAll();
-    if ( readData.size() > 0 )
+    if ( readData.size() > 0 || atEnd )
     {
-      XML_Parse( p, readData.constData(), readData.size(), atEnd );
+      parseData( p, readData, atEnd );
     }
     QCoreApplication::processEvents();
   }
 
+  //features of failed requests are incomplete
+  bool failed = reply->error() != QNetworkReply::NoError;
   delete reply;
   delete progressDialog;
 
@@ -136,10 +316,228 @@ int QgsWFSData::getWFSData()
     }
   }
 
+  XML_ParserFree( p );
+  if ( failed )
+  {
+    return 1;
+  }
+  return mParseError ? 2 : 0;
+}
+
+int QgsWFSData::getFileData()
+{
+  QFile file( mUri );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    return 1;
+  }
+
+  XML_Parser p = XML_ParserCreateNS( NULL, NS_SEPARATOR );
+  XML_SetUserData( p, this );
+  XML_SetElementHandler( p, QgsWFSData::start, QgsWFSData::end );
+  XML_SetCharacterDataHandler( p, QgsWFSData::chars );
+
+  if ( mExtent )
+  {
+    mExtent->set( 0, 0, 0, 0 );
+  }
+
+  bool atEnd = false;
+  while ( !atEnd && !mParseError )
+  {
+    QByteArray data = file.read( GML_CHUNK_SIZE );
+    atEnd = data.isEmpty() || file.atEnd();
+    parseData( p, data, atEnd );
+  }
+
+  if ( mParseError )
+  {
+    mergeChunks( 0 );
+    XML_ParserFree( p );
+    return 2;
+  }
+
+  if ( mExtent && mExtent->isEmpty() )
+  {
+    calculateExtentFromFeatures();
+  }
+
   XML_ParserFree( p );
   return 0;
 }
 
+void QgsWFSData::parseData( XML_Parser p, const QByteArray& data, bool atEnd )
+{
+  if ( mParseError )
+  {
+    if ( atEnd )
+    {
+      mergeChunks( 0 );
+    }
+    return; //the features would be incomplete anyway
+  }
+
+  int scanFrom = qMax( 0, mBuffer.size() - 256 ); //a tag may have been cut by the previous data
+  mBuffer.append( data );
+
+  if ( !mInFeatureMembers )
+  {
+    if ( mDocumentHeader.isEmpty() )
+    {
+      QByteArray rootName;
+      int headerEnd = rootStartTagEnd( mBuffer, rootName );
+      if ( headerEnd >= 0 )
+      {
+        mDocumentHeader = mBuffer.left( headerEnd );
+        mDocumentFooter = "</" + rootName + ">";
+        scanFrom = headerEnd;
+      }
+    }
+
+    int firstMember = -1;
+    if ( !mDocumentHeader.isEmpty() )
+    {
+      firstMember = firstFeatureMemberStart( mBuffer, qMax( scanFrom, mDocumentHeader.size() ) );
+    }
+
+    if ( firstMember < 0 )
+    {
+      if ( atEnd ) //not a feature collection with feature members, e.g. an exception report
+      {
+        parse( p, mBuffer, mBuffer.size(), true );
+        mBuffer.clear();
+      }
+      return;
+    }
+
+    //the bounding box of the collection and everything else before the feature members
+    parse( p, mBuffer, firstMember, false );
+    mBuffer.remove( 0, firstMember );
+    mInFeatureMembers = true;
+  }
+
+  if ( mBuffer.size() >= GML_CHUNK_SIZE || atEnd )
+  {
+    int chunkEnd = lastFeatureMemberEnd( mBuffer );
+    if ( chunkEnd > 0 )
+    {
+      mChunks << QtConcurrent::run( QgsWFSData::parseChunk, mDocumentHeader + mBuffer.left( chunkEnd ) + mDocumentFooter,
+                                    mTypeName, mGeometryAttribute, mThematicAttributes );
+      mBuffer.remove( 0, chunkEnd );
+    }
+  }
+
+  if ( atEnd )
+  {
+    mergeChunks( 0 );
+    //the rest of the document after the last feature member
+    parse( p, mBuffer, mBuffer.size(), true );
+    mBuffer.clear();
+  }
+  else
+  {
+    //limit the memory held by parsed chunks waiting for their predecessors
+    mergeChunks( qMax( 2, 2 * QThread::idealThreadCount() ) );
+  }
+}
+
+void QgsWFSData::parse( XML_Parser p, const QByteArray& data, int size, bool atEnd )
+{
+  if ( XML_Parse( p, data.constData(), size, atEnd ) == XML_STATUS_ERROR )
+  {
+    QgsDebugMsg( QString( "GML parse error at line %1: %2" )
+                 .arg( XML_GetCurrentLineNumber( p ) ).arg( XML_ErrorString( XML_GetErrorCode( p ) ) ) );
+    mParseError = true;
+  }
+}
+
+void QgsWFSData::mergeChunks( int maxPending )
+{
+  while ( !mChunks.isEmpty() && ( mChunks.size() > maxPending || mChunks.first().isFinished() ) )
+  {
+    ChunkResult result = mChunks.takeFirst().result();
+    if ( result.parseError )
+    {
+      mParseError = true;
+    }
+
+    //renumber the features after the ones of the previous chunks
+    QMap<QgsFeatureId, QgsFeature* >::const_iterator it = result.features.constBegin();
+    for ( ; it != result.features.constEnd(); ++it )
+    {
+      QgsFeature* f = it.value();
+      f->setFeatureId( mFeatureCount );
+      mFeatures.insert( mFeatureCount, f );
+
+      QMap<QgsFeatureId, QString >::const_iterator idIt = result.idMap.find( it.key() );
+      if ( idIt != result.idMap.constEnd() )
+      {
+        mIdMap.insert( mFeatureCount, idIt.value() );
+      }
+
+      if ( f->geometry() )
+      {
+        mergeWkbType( f->geometry()->wkbType() );
+      }
+      ++mFeatureCount;
+    }
+  }
+}
+
+void QgsWFSData::mergeWkbType( QGis::WkbType type )
+{
+  switch ( type )
+  {
+    case QGis::WKBPoint:
+      if ( *mWkbType != QGis::WKBMultiPoint ) //keep multitype in case of geometry type mix
+      {
+        *mWkbType = type;
+      }
+      break;
+    case QGis::WKBLineString:
+      if ( *mWkbType != QGis::WKBMultiLineString )
+      {
+        *mWkbType = type;
+      }
+      break;
+    case QGis::WKBPolygon:
+      if ( *mWkbType != QGis::WKBMultiPolygon )
+      {
+        *mWkbType = type;
+      }
+      break;
+    case QGis::WKBMultiPoint:
+    case QGis::WKBMultiLineString:
+    case QGis::WKBMultiPolygon:
+      *mWkbType = type;
+      break;
+    default:
+      break;
+  }
+}
+
+QgsWFSData::ChunkResult QgsWFSData::parseChunk( QByteArray document, QString typeName, QString geometryAttribute, QMap<QString, QPair<int, QgsField> > thematicAttributes )
+{
+  ChunkResult result;
+  result.parseError = false;
+  QGis::WkbType wkbType = QGis::WKBUnknown;
+  QgsWFSData chunkReader( QString(), 0, result.features, result.idMap, geometryAttribute, thematicAttributes, &wkbType );
+  chunkReader.mTypeName = typeName;
+
+  XML_Parser p = XML_ParserCreateNS( NULL, NS_SEPARATOR );
+  XML_SetUserData( p, &chunkReader );
+  XML_SetElementHandler( p, QgsWFSData::start, QgsWFSData::end );
+  XML_SetCharacterDataHandler( p, QgsWFSData::chars );
+  if ( XML_Parse( p, document.constData(), document.size(), 1 ) == XML_STATUS_ERROR )
+  {
+    QgsDebugMsg( QString( "GML chunk parse error: %1" ).arg( XML_ErrorString( XML_GetErrorCode( p ) ) ) );
+    result.parseError = true;
+  }
+  XML_ParserFree( p );
+
+  return result;
+}
+
 void QgsWFSData::setFinished( )
 {
   mFinished = true;
@@ -195,6 +593,7 @@ void QgsWFSData::startElement( const XML_Char* el, const XML_Char** attr )
   else if ( elementName == GML_NAMESPACE + NS_SEPARATOR + "Box" && mParseModeStack.top() == QgsWFSData::boundingBox )
   {
     //read attribute srsName="EPSG:26910"
+    mSrsName = readAttribute( "srsName", attr );
     int epsgNr;
     if ( readEpsgFromAttribute( epsgNr, attr ) != 0 )
     {
@@ -318,6 +717,8 @@ void QgsWFSData::endElement( const XML_Char* el )
 
 
     mCurrentFeature->setGeometryAndOwnership( mCurrentWKB, mCurrentWKBSize );
+    mCurrentWKB = 0; //owned by the feature now
+    mCurrentWKBSize = 0;
     mFeatures.insert( mCurrentFeature->id(), mCurrentFeature );
     if ( !mCurrentFeatureId.isEmpty() )
     {
@@ -821,7 +1222,7 @@ int QgsWFSData::totalWKBFragmentSize() const
   return result;
 }
 
-QWidget* QgsWFSData::findMainWindow() const
+QWidget* QgsWFSData::findMainWindow()
 {
   QWidget* mainWindow = 0;
 
@@ -25,12 +25,16 @@
 #include <list>
 #include <set>
 #include <stack>
+#include <QByteArray>
+#include <QFuture>
+#include <QList>
 #include <QPair>
 class QgsRectangle;
 class QgsCoordinateReferenceSystem;
 
 
-/**This class reads data from a WFS server or alternatively from a GML file. It uses the expat XML parser and an event based model to keep performance high. The parsing starts when the first data arrives, it does not wait until the request is finished*/
+/**This class reads data from a WFS server or alternatively from a GML file. It uses the expat XML parser and an event based model to keep performance high. The parsing starts when the first data arrives, it does not wait until the request is finished.
+  The feature members are cut into chunks of about 1 MB which are parsed by worker threads, the features of the chunks are added in the order of the document*/
 class QgsWFSData: public QObject
 {
     Q_OBJECT
@@ -50,9 +54,23 @@ class QgsWFSData: public QObject
        @param extent the extent of the WFS layer
        @param srs the reference system of the layer
        @param features the features of the layer
-    @return 0 in case of success*/
+    @return 0 in case of success, 1 if the server could not be read, 2 if the response is not well-formed*/
     int getWFSData();
 
+    /**Reads the features from the GML file given as uri instead of a server
+    @return 0 in case of success, 1 if the file could not be opened, 2 if it is not well-formed*/
+    int getFileData();
+
+    /**Returns the srsName of the bounding box of the feature collection or an empty string*/
+    QString srsName() const { return mSrsName; }
+
+    /**Sets whether getWFSData() shows a modal progress dialog in the main window (the default).
+      Small requests like the tiles of a layer only report their progress through the signals*/
+    void setShowProgressDialog( bool show ) { mShowProgressDialog = show; }
+
+    /**Returns pointer to main window or 0 if it does not exist*/
+    static QWidget* findMainWindow();
+
   private slots:
     void setFinished();
 
@@ -82,8 +100,32 @@ class QgsWFSData: public QObject
       multiPolygon
     };
 
+    /**Features and WFS ids parsed from a chunk by a worker thread, keyed by their position in the chunk*/
+    struct ChunkResult
+    {
+      QMap<QgsFeatureId, QgsFeature* > features;
+      QMap<QgsFeatureId, QString > idMap;
+      /**True if the chunk is not well-formed*/
+      bool parseError;
+    };
+
     QgsWFSData();
 
+    /**Feeds the next data of the document. The part before the first feature member and the part after the last one
+      go to the parser p, the feature members are collected and parsed in chunks by worker threads
+      @param atEnd true for the last data of the document*/
+    void parseData( XML_Parser p, const QByteArray& data, bool atEnd );
+    /**Passes the first size bytes of data to the parser p and sets mParseError if they are not well-formed*/
+    void parse( XML_Parser p, const QByteArray& data, int size, bool atEnd );
+    /**Moves the features of finished chunks to mFeatures, in the order of the chunks
+      @param maxPending waits until no more than maxPending chunks are left*/
+    void mergeChunks( int maxPending );
+    /**Updates mWkbType with the geometry type of a feature read by a chunk parser, the same way the parser does*/
+    void mergeWkbType( QGis::WkbType type );
+    /**Parses a document made of the document header, a chunk of feature members and the closing tag of the root element.
+      Runs in a worker thread*/
+    static ChunkResult parseChunk( QByteArray document, QString typeName, QString geometryAttribute, QMap<QString, QPair<int, QgsField> > thematicAttributes );
+
     /**XML handler methods*/
     void startElement( const XML_Char* el, const XML_Char** attr );
     void endElement( const XML_Char* el );
@@ -132,8 +174,6 @@ class QgsWFSData: public QObject
     /**Adds all the integers contained in mCurrentWKBFragmentSizes*/
     int totalWKBFragmentSize() const;
 
-    /**Returns pointer to main window or 0 if it does not exist*/
-    QWidget* findMainWindow() const;
     /**This function evaluates the layer bounding box from the features and sets it to mExtent.
     Less efficient compared to reading the bbox from the provider, so it is only done if the wfs server
     does not provider extent information.*/
@@ -153,6 +193,8 @@ class QgsWFSData: public QObject
     QGis::WkbType* mWkbType;
     /**True if the request is finished*/
     bool mFinished;
+    /**True if a progress dialog is shown during the request*/
+    bool mShowProgressDialog;
     /**Keep track about the most important nested elements*/
     std::stack<parseMode> mParseModeStack;
     /**This contains the character data if an important element has been encountered*/
@@ -175,6 +217,20 @@ class QgsWFSData: public QObject
     QString mCoordinateSeparator;
     /**Tuple separator for coordinate strings. Usually " " */
     QString mTupleSeparator;
+    /**srsName of the bounding box of the feature collection*/
+    QString mSrsName;
+    /**Data not passed to a parser yet*/
+    QByteArray mBuffer;
+    /**Start of the document up to the end of the start tag of the root element. It precedes the feature members of every chunk*/
+    QByteArray mDocumentHeader;
+    /**Closing tag of the root element, it ends every chunk*/
+    QByteArray mDocumentFooter;
+    /**True after the first feature member has been found*/
+    bool mInFeatureMembers;
+    /**Chunks being parsed by worker threads, in document order*/
+    QList< QFuture<ChunkResult> > mChunks;
+    /**True if a part of the document was not well-formed. The features are incomplete then*/
+    bool mParseError;
 };
 
 #endif
@@ -16,6 +16,10 @@
  ***************************************************************************/
 
 #define WFS_THRESHOLD 200
+//GetRenderedOnly: maximal number of tiles fetched for one view, larger views are fetched with one request
+#define WFS_MAX_VIEW_TILES 64
+//GetRenderedOnly: number of tiles whose features are kept in memory
+#define WFS_MAX_LOADED_TILES 64
 
 #include "qgis.h"
 #include "qgsapplication.h"
@@ -26,6 +30,7 @@
 #include "qgscoordinatereferencesystem.h"
 #include "qgswfsdata.h"
 #include "qgswfsprovider.h"
+#include "qgswfstilecache.h"
 #include "qgsspatialindex.h"
 #include "qgslogger.h"
 #include "qgsnetworkaccessmanager.h"
@@ -38,7 +43,10 @@
 #include <QUrl>
 #include <QWidget>
 #include <QPair>
+#include <QProgressDialog>
+#include <QThread>
 #include <cfloat>
+#include <cmath>
 
 static const QString TEXT_PROVIDER_KEY = "WFS";
 static const QString TEXT_PROVIDER_DESCRIPTION = "WFS data provider";
@@ -57,7 +65,10 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
     mValid( true ),
     mLayer( 0 ),
     mGetRenderedOnly( false ),
-    mInitGro( false )
+    mInitGro( false ),
+    mTileLevel( 0 ),
+    mTileCache( 0 ),
+    mNextFeatureId( 0 )
 {
   mSpatialIndex = 0;
   if ( uri.isEmpty() )
@@ -110,6 +121,7 @@ QgsWFSProvider::~QgsWFSProvider()
 {
   deleteData();
   delete mSpatialIndex;
+  delete mTileCache;
 }
 
 void QgsWFSProvider::reloadData()
@@ -123,11 +135,12 @@ void QgsWFSProvider::reloadData()
 void QgsWFSProvider::deleteData()
 {
   mSelectedFeatures.clear();
-  for ( int i = 0; i < mFeatures.size(); i++ )
-  {
-    delete mFeatures[i];
-  }
+  qDeleteAll( mFeatures );
   mFeatures.clear();
+  mTileOrder.clear();
+  mTileFeatures.clear();
+  mTileRefs.clear();
+  mServerIds.clear();
 }
 
 void QgsWFSProvider::copyFeature( QgsFeature* f, QgsFeature& feature, bool fetchGeometry, QgsAttributeList fetchAttributes )
@@ -274,6 +287,12 @@ void QgsWFSProvider::select( QgsAttributeList fetchAttributes,
     mSpatialFilter = mExtent;
     mSelectedFeatures = mFeatures.keys();
   }
+  else if ( QThread::currentThread() != QCoreApplication::instance()->thread() )
+  { //rendering thread: the network requests belong to the main thread, which has
+    //loaded the features of the view before, see QgsMapRendererJob::prefetchLayers()
+    mSpatialFilter = rect;
+    mSelectedFeatures = mSpatialIndex ? mSpatialIndex->intersects( mSpatialFilter ) : QList<QgsFeatureId>();
+  }
   else
   { //select features intersecting caller's extent
     QString dsURI = dataSourceUri();
@@ -298,8 +317,10 @@ void QgsWFSProvider::select( QgsAttributeList fetchAttributes,
       mInitGro = true;
     }
 
-    if ( mGetRenderedOnly )
-    { //"Cache Features" was not selected for this layer
+    //"Cache Features" was not selected for this layer: load the tiles of the view
+    //or, if the view needs too many tiles, the features of the whole view with one request
+    if ( mGetRenderedOnly && !loadTiles( rect ) )
+    {
       //has rendered extent expanded beyond last-retrieved WFS extent?
       //NB: "intersect" instead of "contains" tolerates rounding errors;
       //    avoids unnecessary second fetch on zoom-in/zoom-out sequences
@@ -322,12 +343,7 @@ void QgsWFSProvider::select( QgsAttributeList fetchAttributes,
         }
         QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: fetching extent %2" )
                      .arg( mLayer->name(), mGetExtent.asWktCoordinates() ) );
-        dsURI = dsURI.replace( QRegExp( "BBOX=[^&]*" ),
-                               QString( "BBOX=%1,%2,%3,%4" )
-                               .arg( mGetExtent.xMinimum(), 0, 'f' )
-                               .arg( mGetExtent.yMinimum(), 0, 'f' )
-                               .arg( mGetExtent.xMaximum(), 0, 'f' )
-                               .arg( mGetExtent.yMaximum(), 0, 'f' ) );
+        dsURI = uriWithBBox( mGetExtent );
         //TODO: BBOX may not be combined with FILTER. WFS spec v. 1.1.0, sec. 14.7.3 ff.
         //      if a FILTER is present, the BBOX must be merged into it, capabilities permitting.
         //      Else one criterion must be abandoned and the user warned.  [WBC 111221]
@@ -421,6 +437,7 @@ bool QgsWFSProvider::addFeatures( QgsFeatureList &flist )
 
   if ( transactionSuccess( serverResponse ) )
   {
+    invalidateTiles();
     //transaction successful. Add the features to mSpatialIndex
     if ( mSpatialIndex )
     {
@@ -434,6 +451,7 @@ bool QgsWFSProvider::addFeatures( QgsFeatureList &flist )
         featureIt->setFeatureId( newId );
         mFeatures.insert( newId, new QgsFeature( *featureIt ) );
         mIdMap.insert( newId, *idIt );
+        mServerIds.insert( *idIt, newId );
         mSpatialIndex->insertFeature( *featureIt );
         mFeatureCount = mFeatures.size();
       }
@@ -497,6 +515,7 @@ bool QgsWFSProvider::deleteFeatures( const QgsFeatureIds &id )
 
   if ( transactionSuccess( serverResponse ) )
   {
+    invalidateTiles();
     idIt = id.constBegin();
     for ( ; idIt != id.constEnd(); ++idIt )
     {
@@ -577,6 +596,7 @@ bool QgsWFSProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 
   if ( transactionSuccess( serverResponse ) )
   {
+    invalidateTiles();
     geomIt = geometry_map.begin();
     for ( ; geomIt != geometry_map.end(); ++geomIt )
     {
@@ -681,6 +701,7 @@ bool QgsWFSProvider::changeAttributeValues( const QgsChangedAttributesMap &attr_
 
   if ( transactionSuccess( serverResponse ) )
   {
+    invalidateTiles();
     //change attributes in mFeatures
     attIt = attr_map.constBegin();
     for ( ; attIt != attr_map.constEnd(); ++attIt )
@@ -790,36 +811,32 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
 
 int QgsWFSProvider::getFeatureFILE( const QString& uri, const QString& geometryAttribute )
 {
-  QFile gmlFile( uri );
-  if ( !gmlFile.open( QIODevice::ReadOnly ) )
+  //the file is read with the same parser as the server responses
+  QMap<QString, QPair<int, QgsField> > thematicAttributes;
+  for ( QgsFieldMap::const_iterator it = mFields.begin(); it != mFields.end(); ++it )
   {
-    mValid = false;
-    return 1;
+    thematicAttributes.insert( it.value().name(), qMakePair( it.key(), it.value() ) );
   }
 
-  QDomDocument gmlDoc;
-  QString errorMsg;
-  int errorLine, errorColumn;
-  if ( !gmlDoc.setContent( &gmlFile, true, &errorMsg, &errorLine, &errorColumn ) )
+  QgsWFSData dataReader( uri, &mExtent, mFeatures, mIdMap, geometryAttribute, thematicAttributes, &mWKBType );
+  if ( dataReader.getFileData() != 0 )
   {
     mValid = false;
-    return 2;
+    return 1;
   }
 
-  QDomElement featureCollectionElement = gmlDoc.documentElement();
-  //get and set Extent
-  if ( getExtentFromGML2( &mExtent, featureCollectionElement ) != 0 )
+  if ( !dataReader.srsName().isEmpty() )
   {
-    return 3;
+    setCRSFromSrsName( dataReader.srsName() );
   }
 
-  setCRSFromGML2( featureCollectionElement );
-
-  if ( getFeaturesFromGML2( featureCollectionElement, geometryAttribute ) != 0 )
+  for ( QMap<QgsFeatureId, QgsFeature*>::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
   {
-    return 4;
+    mSpatialIndex->insertFeature( *( it.value() ) );
   }
 
+  mFeatureCount = mFeatures.size();
+
   return 0;
 }
 
@@ -1074,120 +1091,8 @@ int QgsWFSProvider::guessAttributesFromFile( const QString& uri, QString& geomet
   return 0;
 }
 
-int QgsWFSProvider::getExtentFromGML2( QgsRectangle* extent, const QDomElement& wfsCollectionElement ) const
+int QgsWFSProvider::setCRSFromSrsName( QString srsName )
 {
-  QDomNodeList boundedByList = wfsCollectionElement.elementsByTagNameNS( GML_NAMESPACE, "boundedBy" );
-  if ( boundedByList.length() < 1 )
-  {
-    return 1;
-  }
-  QDomElement boundedByElement = boundedByList.at( 0 ).toElement();
-  QDomNode childNode = boundedByElement.firstChild();
-  if ( childNode.isNull() )
-  {
-    return 2;
-  }
-
-  //support <gml:Box>, <gml:coordinates> and <gml:Envelope>,<gml::lowerCorner>,<gml::upperCorner>. What
-  //about <gml:Envelope>, <gml:pos>?
-  QString bboxName = childNode.localName();
-  if ( bboxName != "Box" )
-  {
-    return 3;
-  }
-
-  QDomNode coordinatesNode = childNode.firstChild();
-  if ( coordinatesNode.localName() == "coordinates" )
-  {
-    std::list<QgsPoint> boundingPoints;
-    if ( readGML2Coordinates( boundingPoints, coordinatesNode.toElement() ) != 0 )
-    {
-      return 5;
-    }
-
-    if ( boundingPoints.size() != 2 )
-    {
-      return 6;
-    }
-
-    std::list<QgsPoint>::const_iterator it = boundingPoints.begin();
-    extent->setXMinimum( it->x() );
-    extent->setYMinimum( it->y() );
-    ++it;
-    extent->setXMaximum( it->x() );
-    extent->setYMaximum( it->y() );
-    return 0;
-  }
-  else if ( coordinatesNode.localName() == "coord" )
-  {
-    //first <coord> element
-    QDomElement xElement, yElement;
-    bool conversion1, conversion2; //string->double conversion success
-    xElement = coordinatesNode.firstChild().toElement();
-    yElement = xElement.nextSibling().toElement();
-    if ( xElement.isNull() || yElement.isNull() )
-    {
-      return 7;
-    }
-    double x1 = xElement.text().toDouble( &conversion1 );
-    double y1 = yElement.text().toDouble( &conversion2 );
-    if ( !conversion1 || !conversion2 )
-    {
-      return 8;
-    }
-
-    //second <coord> element
-    coordinatesNode = coordinatesNode.nextSibling();
-    xElement = coordinatesNode.firstChild().toElement();
-    yElement = xElement.nextSibling().toElement();
-    if ( xElement.isNull() || yElement.isNull() )
-    {
-      return 9;
-    }
-    double x2 = xElement.text().toDouble( &conversion1 );
-    double y2 = yElement.text().toDouble( &conversion2 );
-    if ( !conversion1 || !conversion2 )
-    {
-      return 10;
-    }
-    extent->setXMinimum( x1 );
-    extent->setYMinimum( y1 );
-    extent->setXMaximum( x2 );
-    extent->setYMaximum( y2 );
-    return 0;
-  }
-  else
-  {
-    return 11; //no valid tag for the bounding box
-  }
-}
-
-int QgsWFSProvider::setCRSFromGML2( const QDomElement& wfsCollectionElement )
-{
-  QgsDebugMsg( "entering." );
-  //search <gml:boundedBy>
-  QDomNodeList boundedByList = wfsCollectionElement.elementsByTagNameNS( GML_NAMESPACE, "boundedBy" );
-  if ( boundedByList.size() < 1 )
-  {
-    QgsDebugMsg( "Error, could not find boundedBy element" );
-    return 1;
-  }
-  //search <gml:Envelope>
-  QDomElement boundedByElem = boundedByList.at( 0 ).toElement();
-  QDomNodeList boxList = boundedByElem.elementsByTagNameNS( GML_NAMESPACE, "Box" );
-  if ( boxList.size() < 1 )
-  {
-    QgsDebugMsg( "Error, could not find Envelope element" );
-    return 2;
-  }
-  QDomElement boxElem = boxList.at( 0 ).toElement();
-  //getAttribute 'srsName'
-  QString srsName = boxElem.attribute( "srsName" );
-  if ( srsName.isEmpty() )
-  {
-    QgsDebugMsg( "Error, srsName is empty" );
-    return 3;
-  }
   QgsDebugMsg( "srsName is: " + srsName );
 
 
@@ -1213,642 +1118,6 @@ int QgsWFSProvider::setCRSFromGML2( const QDomElement& wfsCollectionElement )
   return 0;
 }
 
-int QgsWFSProvider::getFeaturesFromGML2( const QDomElement& wfsCollectionElement, const QString& geometryAttribute )
-{
-  QDomNodeList featureTypeNodeList = wfsCollectionElement.elementsByTagNameNS( GML_NAMESPACE, "featureMember" );
-  QDomElement currentFeatureMemberElem;
-  QDomElement layerNameElem;
-  QDomNode currentAttributeChild;
-  QDomElement currentAttributeElement;
-  int counter = 0;
-  QgsFeature* f = 0;
-  unsigned char* wkb = 0;
-  int wkbSize = 0;
-  QGis::WkbType currentType;
-  mFeatureCount = 0;
-
-  for ( int i = 0; i < featureTypeNodeList.size(); ++i )
-  {
-    f = new QgsFeature( counter );
-    currentFeatureMemberElem = featureTypeNodeList.at( i ).toElement();
-    //the first child element is always <namespace:layer>
-    layerNameElem = currentFeatureMemberElem.firstChild().toElement();
-    //the children are the attributes
-    currentAttributeChild = layerNameElem.firstChild();
-    int attr = 0;
-    bool numeric = false;
-
-    while ( !currentAttributeChild.isNull() )
-    {
-      currentAttributeElement = currentAttributeChild.toElement();
-
-      if ( currentAttributeElement.localName() != "boundedBy" )
-      {
-        currentAttributeElement.text().toDouble( &numeric );
-        if (( currentAttributeElement.localName() ) != geometryAttribute ) //a normal attribute
-        {
-          if ( numeric )
-          {
-            f->addAttribute( attr++, QVariant( currentAttributeElement.text().toDouble() ) );
-          }
-          else
-          {
-            f->addAttribute( attr++, QVariant( currentAttributeElement.text() ) );
-          }
-        }
-        else //a geometry attribute
-        {
-          getWkbFromGML2( currentAttributeElement, &wkb, &wkbSize, &currentType );
-          mWKBType = currentType; //a more sophisticated method is necessary
-          f->setGeometryAndOwnership( wkb, wkbSize );
-        }
-      }
-      currentAttributeChild = currentAttributeChild.nextSibling();
-    }
-    if ( wkb && wkbSize > 0 )
-    {
-      //insert bbox and pointer to feature into search tree
-      mSpatialIndex->insertFeature( *f );
-      mFeatures.insert( f->id(), f );
-      ++mFeatureCount;
-    }
-    ++counter;
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2( const QDomNode& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  QDomNode geometryChild = geometryElement.firstChild();
-  if ( geometryChild.isNull() )
-  {
-    return 1;
-  }
-  QDomElement geometryTypeElement = geometryChild.toElement();
-  QString geomType = geometryTypeElement.localName();
-  if ( geomType == "Point" )
-  {
-    return getWkbFromGML2Point( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else if ( geomType == "LineString" )
-  {
-    return getWkbFromGML2LineString( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else if ( geomType == "Polygon" )
-  {
-    return getWkbFromGML2Polygon( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else if ( geomType == "MultiPoint" )
-  {
-    return getWkbFromGML2MultiPoint( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else if ( geomType == "MultiLineString" )
-  {
-    return getWkbFromGML2MultiLineString( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else if ( geomType == "MultiPolygon" )
-  {
-    return getWkbFromGML2MultiPolygon( geometryTypeElement, wkb, wkbSize, type );
-  }
-  else //unknown type
-  {
-    *wkb = 0;
-    *wkbSize = 0;
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2Point( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  QDomNodeList coordList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-  if ( coordList.size() < 1 )
-  {
-    return 1;
-  }
-  QDomElement coordElement = coordList.at( 0 ).toElement();
-  std::list<QgsPoint> pointCoordinate;
-  if ( readGML2Coordinates( pointCoordinate, coordElement ) != 0 )
-  {
-    return 2;
-  }
-
-  if ( pointCoordinate.size() < 1 )
-  {
-    return 3;
-  }
-
-  std::list<QgsPoint>::const_iterator point_it = pointCoordinate.begin();
-  char e = QgsApplication::endian();
-  double x = point_it->x();
-  double y = point_it->y();
-  int size = 1 + sizeof( int ) + 2 * sizeof( double );
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBPoint;
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-  wkbPosition += sizeof( double );
-  memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2Polygon( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  //read all the coordinates (as QgsPoint) into memory. Each linear ring has an entry in the vector
-  std::vector<std::list<QgsPoint> > ringCoordinates;
-
-  //read coordinates for outer boundary
-  QDomNodeList outerBoundaryList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "outerBoundaryIs" );
-  if ( outerBoundaryList.size() < 1 ) //outer ring is necessary
-  {
-    return 1;
-  }
-  QDomElement coordinatesElement = outerBoundaryList.at( 0 ).firstChild().firstChild().toElement();
-  if ( coordinatesElement.isNull() )
-  {
-    return 2;
-  }
-  std::list<QgsPoint> exteriorPointList;
-  if ( readGML2Coordinates( exteriorPointList, coordinatesElement ) != 0 )
-  {
-    return 3;
-  }
-  ringCoordinates.push_back( exteriorPointList );
-
-  //read coordinates for inner boundary
-  QDomNodeList innerBoundaryList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "innerBoundaryIs" );
-  for ( int i = 0; i < innerBoundaryList.size(); ++i )
-  {
-    std::list<QgsPoint> interiorPointList;
-    QDomElement coordinatesElement = innerBoundaryList.at( i ).firstChild().firstChild().toElement();
-    if ( coordinatesElement.isNull() )
-    {
-      return 4;
-    }
-    if ( readGML2Coordinates( interiorPointList, coordinatesElement ) != 0 )
-    {
-      return 5;
-    }
-    ringCoordinates.push_back( interiorPointList );
-  }
-
-  //calculate number of bytes to allocate
-  int nrings = ringCoordinates.size();
-  int npoints = 0;//total number of points
-  for ( std::vector<std::list<QgsPoint> >::const_iterator it = ringCoordinates.begin(); it != ringCoordinates.end(); ++it )
-  {
-    npoints += it->size();
-  }
-  int size = 1 + 2 * sizeof( int ) + nrings * sizeof( int ) + 2 * npoints * sizeof( double );
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBPolygon;
-  char e = QgsApplication::endian();
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  int nPointsInRing = 0;
-  double x, y;
-
-  //fill the contents into *wkb
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &nrings, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  for ( std::vector<std::list<QgsPoint> >::const_iterator it = ringCoordinates.begin(); it != ringCoordinates.end(); ++it )
-  {
-    nPointsInRing = it->size();
-    memcpy( &( *wkb )[wkbPosition], &nPointsInRing, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    //iterate through the string list converting the strings to x-/y- doubles
-    std::list<QgsPoint>::const_iterator iter;
-    for ( iter = it->begin(); iter != it->end(); ++iter )
-    {
-      x = iter->x();
-      y = iter->y();
-      //qWarning("currentCoordinate: " + QString::number(x) + " // " + QString::number(y));
-      memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-      wkbPosition += sizeof( double );
-      memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-      wkbPosition += sizeof( double );
-    }
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2LineString( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  QDomNodeList coordinatesList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-  if ( coordinatesList.size() < 1 )
-  {
-    return 1;
-  }
-  QDomElement coordinatesElement = coordinatesList.at( 0 ).toElement();
-  std::list<QgsPoint> lineCoordinates;
-  if ( readGML2Coordinates( lineCoordinates, coordinatesElement ) != 0 )
-  {
-    return 2;
-  }
-
-  char e = QgsApplication::endian();
-  int size = 1 + 2 * sizeof( int ) + lineCoordinates.size() * 2 * sizeof( double );
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBLineString;
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  double x, y;
-  int nPoints = lineCoordinates.size();
-
-  //fill the contents into *wkb
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &nPoints, sizeof( int ) );
-  wkbPosition += sizeof( int );
-
-  std::list<QgsPoint>::const_iterator iter;
-  for ( iter = lineCoordinates.begin(); iter != lineCoordinates.end(); ++iter )
-  {
-    x = iter->x();
-    y = iter->y();
-    memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-    wkbPosition += sizeof( double );
-    memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-    wkbPosition += sizeof( double );
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2MultiPoint( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  std::list<QgsPoint> pointList;
-  std::list<QgsPoint> currentPoint;
-  QDomNodeList pointMemberList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "pointMember" );
-  if ( pointMemberList.size() < 1 )
-  {
-    return 1;
-  }
-  QDomNodeList pointNodeList;
-  QDomNodeList coordinatesList;
-  for ( int i = 0; i < pointMemberList.size(); ++i )
-  {
-    //<Point> element
-    pointNodeList = pointMemberList.at( i ).toElement().elementsByTagNameNS( GML_NAMESPACE, "Point" );
-    if ( pointNodeList.size() < 1 )
-    {
-      continue;
-    }
-    //<coordinates> element
-    coordinatesList = pointNodeList.at( 0 ).toElement().elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-    if ( coordinatesList.size() < 1 )
-    {
-      continue;
-    }
-    currentPoint.clear();
-    if ( readGML2Coordinates( currentPoint, coordinatesList.at( 0 ).toElement() ) != 0 )
-    {
-      continue;
-    }
-    if ( currentPoint.size() < 1 )
-    {
-      continue;
-    }
-    pointList.push_back(( *currentPoint.begin() ) );
-  }
-
-  //calculate the required wkb size
-  int size = 1 + 2 * sizeof( int ) + pointList.size() * ( 2 * sizeof( double ) + 1 + sizeof( int ) );
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBMultiPoint;
-
-  //fill the wkb content
-  char e = QgsApplication::endian();
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  int nPoints = pointList.size(); //number of points
-  double x, y;
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &nPoints, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  for ( std::list<QgsPoint>::const_iterator it = pointList.begin(); it != pointList.end(); ++it )
-  {
-    memcpy( &( *wkb )[wkbPosition], &e, 1 );
-    wkbPosition += 1;
-    memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    x = it->x();
-    memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-    wkbPosition += sizeof( double );
-    y = it->y();
-    memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-    wkbPosition += sizeof( double );
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2MultiLineString( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  //geoserver has
-  //<gml:MultiLineString>
-  //<gml:lineStringMember>
-  //<gml:LineString>
-
-  //mapserver has directly
-  //<gml:MultiLineString
-  //<gml:LineString
-
-  std::list<std::list<QgsPoint> > lineCoordinates; //first list: lines, second list: points of one line
-  QDomElement currentLineStringElement;
-  QDomNodeList currentCoordList;
-
-  QDomNodeList lineStringMemberList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "lineStringMember" );
-  if ( lineStringMemberList.size() > 0 ) //geoserver
-  {
-    for ( int i = 0; i < lineStringMemberList.size(); ++i )
-    {
-      QDomNodeList lineStringNodeList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "LineString" );
-      if ( lineStringNodeList.size() < 1 )
-      {
-        return 1;
-      }
-      currentLineStringElement = lineStringNodeList.at( 0 ).toElement();
-      currentCoordList = currentLineStringElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-      if ( currentCoordList.size() < 1 )
-      {
-        return 2;
-      }
-      std::list<QgsPoint> currentPointList;
-      if ( readGML2Coordinates( currentPointList, currentCoordList.at( 0 ).toElement() ) != 0 )
-      {
-        return 3;
-      }
-      lineCoordinates.push_back( currentPointList );
-    }
-  }
-  else
-  {
-    QDomNodeList lineStringList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "LineString" );
-    if ( lineStringList.size() > 0 ) //mapserver
-    {
-      for ( int i = 0; i < lineStringList.size(); ++i )
-      {
-        currentLineStringElement = lineStringList.at( i ).toElement();
-        currentCoordList = currentLineStringElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-        if ( currentCoordList.size() < 1 )
-        {
-          return 4;
-        }
-        std::list<QgsPoint> currentPointList;
-        if ( readGML2Coordinates( currentPointList, currentCoordList.at( 0 ).toElement() ) != 0 )
-        {
-          return 5;
-        }
-        lineCoordinates.push_back( currentPointList );
-      }
-    }
-    else
-    {
-      return 6;
-    }
-  }
-
-
-  //calculate the required wkb size
-  int size = ( lineCoordinates.size() + 1 ) * ( 1 + 2 * sizeof( int ) );
-  for ( std::list<std::list<QgsPoint> >::const_iterator it = lineCoordinates.begin(); it != lineCoordinates.end(); ++it )
-  {
-    size += it->size() * 2 * sizeof( double );
-  }
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBMultiLineString;
-
-  //fill the wkb content
-  char e = QgsApplication::endian();
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  int nLines = lineCoordinates.size();
-  int nPoints; //number of points in a line
-  double x, y;
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &nLines, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  for ( std::list<std::list<QgsPoint> >::const_iterator it = lineCoordinates.begin(); it != lineCoordinates.end(); ++it )
-  {
-    memcpy( &( *wkb )[wkbPosition], &e, 1 );
-    wkbPosition += 1;
-    memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    nPoints = it->size();
-    memcpy( &( *wkb )[wkbPosition], &nPoints, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    for ( std::list<QgsPoint>::const_iterator iter = it->begin(); iter != it->end(); ++iter )
-    {
-      x = iter->x();
-      //qWarning("x is: " + QString::number(x));
-      y = iter->y();
-      //qWarning("y is: " + QString::number(y));
-      memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-      wkbPosition += sizeof( double );
-      memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-      wkbPosition += sizeof( double );
-    }
-  }
-  return 0;
-}
-
-int QgsWFSProvider::getWkbFromGML2MultiPolygon( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const
-{
-  //first list: different polygons, second list: different rings, third list: different points
-  std::list<std::list<std::list<QgsPoint> > > multiPolygonPoints;
-  QDomElement currentPolygonMemberElement;
-  QDomNodeList polygonList;
-  QDomElement currentPolygonElement;
-  QDomNodeList outerBoundaryList;
-  QDomElement currentOuterBoundaryElement;
-  QDomElement currentInnerBoundaryElement;
-  QDomNodeList innerBoundaryList;
-  QDomNodeList linearRingNodeList;
-  QDomElement currentLinearRingElement;
-  QDomNodeList currentCoordinateList;
-
-  QDomNodeList polygonMemberList = geometryElement.elementsByTagNameNS( GML_NAMESPACE, "polygonMember" );
-  for ( int i = 0; i < polygonMemberList.size(); ++i )
-  {
-    std::list<std::list<QgsPoint> > currentPolygonList;
-    currentPolygonMemberElement = polygonMemberList.at( i ).toElement();
-    polygonList = currentPolygonMemberElement.elementsByTagNameNS( GML_NAMESPACE, "Polygon" );
-    if ( polygonList.size() < 1 )
-    {
-      continue;
-    }
-    currentPolygonElement = polygonList.at( 0 ).toElement();
-
-    //find exterior ring
-    outerBoundaryList = currentPolygonElement.elementsByTagNameNS( GML_NAMESPACE, "outerBoundaryIs" );
-    if ( outerBoundaryList.size() < 1 )
-    {
-      continue;
-    }
-
-    currentOuterBoundaryElement = outerBoundaryList.at( 0 ).toElement();
-    std::list<QgsPoint> ringCoordinates;
-
-    linearRingNodeList = currentOuterBoundaryElement.elementsByTagNameNS( GML_NAMESPACE, "LinearRing" );
-    if ( linearRingNodeList.size() < 1 )
-    {
-      continue;
-    }
-    currentLinearRingElement = linearRingNodeList.at( 0 ).toElement();
-    currentCoordinateList = currentLinearRingElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-    if ( currentCoordinateList.size() < 1 )
-    {
-      continue;
-    }
-    if ( readGML2Coordinates( ringCoordinates, currentCoordinateList.at( 0 ).toElement() ) != 0 )
-    {
-      continue;
-    }
-    currentPolygonList.push_back( ringCoordinates );
-
-    //find interior rings
-    QDomNodeList innerBoundaryList = currentPolygonElement.elementsByTagNameNS( GML_NAMESPACE, "innerBoundaryIs" );
-    for ( int j = 0; j < innerBoundaryList.size(); ++j )
-    {
-      std::list<QgsPoint> ringCoordinates;
-      currentInnerBoundaryElement = innerBoundaryList.at( j ).toElement();
-      linearRingNodeList = currentInnerBoundaryElement.elementsByTagNameNS( GML_NAMESPACE, "LinearRing" );
-      if ( linearRingNodeList.size() < 1 )
-      {
-        continue;
-      }
-      currentLinearRingElement = linearRingNodeList.at( 0 ).toElement();
-      currentCoordinateList = currentLinearRingElement.elementsByTagNameNS( GML_NAMESPACE, "coordinates" );
-      if ( currentCoordinateList.size() < 1 )
-      {
-        continue;
-      }
-      if ( readGML2Coordinates( ringCoordinates, currentCoordinateList.at( 0 ).toElement() ) != 0 )
-      {
-        continue;
-      }
-      currentPolygonList.push_back( ringCoordinates );
-    }
-    multiPolygonPoints.push_back( currentPolygonList );
-  }
-
-  int size = 1 + 2 * sizeof( int );
-  //calculate the wkb size
-  for ( std::list<std::list<std::list<QgsPoint> > >::const_iterator it = multiPolygonPoints.begin(); it != multiPolygonPoints.end(); ++it )
-  {
-    size += 1 + 2 * sizeof( int );
-    for ( std::list<std::list<QgsPoint> >::const_iterator iter = it->begin(); iter != it->end(); ++iter )
-    {
-      size += sizeof( int ) + 2 * iter->size() * sizeof( double );
-    }
-  }
-  *wkb = new unsigned char[size];
-  *wkbSize = size;
-  *type = QGis::WKBMultiPolygon;
-  int polygonType = QGis::WKBPolygon;
-  char e = QgsApplication::endian();
-  int wkbPosition = 0; //current offset from wkb beginning (in bytes)
-  double x, y;
-  int nPolygons = multiPolygonPoints.size();
-  int nRings;
-  int nPointsInRing;
-
-  //fill the contents into *wkb
-  memcpy( &( *wkb )[wkbPosition], &e, 1 );
-  wkbPosition += 1;
-  memcpy( &( *wkb )[wkbPosition], type, sizeof( int ) );
-  wkbPosition += sizeof( int );
-  memcpy( &( *wkb )[wkbPosition], &nPolygons, sizeof( int ) );
-  wkbPosition += sizeof( int );
-
-  for ( std::list<std::list<std::list<QgsPoint> > >::const_iterator it = multiPolygonPoints.begin(); it != multiPolygonPoints.end(); ++it )
-  {
-    memcpy( &( *wkb )[wkbPosition], &e, 1 );
-    wkbPosition += 1;
-    memcpy( &( *wkb )[wkbPosition], &polygonType, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    nRings = it->size();
-    memcpy( &( *wkb )[wkbPosition], &nRings, sizeof( int ) );
-    wkbPosition += sizeof( int );
-    for ( std::list<std::list<QgsPoint> >::const_iterator iter = it->begin(); iter != it->end(); ++iter )
-    {
-      nPointsInRing = iter->size();
-      memcpy( &( *wkb )[wkbPosition], &nPointsInRing, sizeof( int ) );
-      wkbPosition += sizeof( int );
-      for ( std::list<QgsPoint>::const_iterator iterator = iter->begin(); iterator != iter->end(); ++iterator )
-      {
-        x = iterator->x();
-        y = iterator->y();
-        memcpy( &( *wkb )[wkbPosition], &x, sizeof( double ) );
-        wkbPosition += sizeof( double );
-        memcpy( &( *wkb )[wkbPosition], &y, sizeof( double ) );
-        wkbPosition += sizeof( double );
-      }
-    }
-  }
-  return 0;
-}
-
-int QgsWFSProvider::readGML2Coordinates( std::list<QgsPoint>& coords, const QDomElement elem ) const
-{
-  QString coordSeparator = ",";
-  QString tupelSeparator = " ";
-  //"decimal" has to be "."
-
-  coords.clear();
-
-  if ( elem.hasAttribute( "cs" ) )
-  {
-    coordSeparator = elem.attribute( "cs" );
-  }
-  if ( elem.hasAttribute( "ts" ) )
-  {
-    tupelSeparator = elem.attribute( "ts" );
-  }
-
-  QStringList tupels = elem.text().split( tupelSeparator, QString::SkipEmptyParts );
-  QStringList tupel_coords;
-  double x, y;
-  bool conversionSuccess;
-
-  QStringList::const_iterator it;
-  for ( it = tupels.constBegin(); it != tupels.constEnd(); ++it )
-  {
-    tupel_coords = ( *it ).split( coordSeparator, QString::SkipEmptyParts );
-    if ( tupel_coords.size() < 2 )
-    {
-      continue;
-    }
-    x = tupel_coords.at( 0 ).toDouble( &conversionSuccess );
-    if ( !conversionSuccess )
-    {
-      return 1;
-    }
-    y = tupel_coords.at( 1 ).toDouble( &conversionSuccess );
-    if ( !conversionSuccess )
-    {
-      return 1;
-    }
-    coords.push_back( QgsPoint( x, y ) );
-  }
-  return 0;
-}
-
 void QgsWFSProvider::handleWFSProgressMessage( int done, int total )
 {
   QString totalString;
@@ -2250,16 +1519,17 @@ QStringList QgsWFSProvider::insertedFeatureIds( const QDomDocument& serverRespon
 
 QgsFeatureId QgsWFSProvider::findNewKey() const
 {
+  //ids of unloaded tile features are not reused
   if ( mFeatures.isEmpty() )
   {
-    return 0;
+    return mNextFeatureId;
   }
 
   //else return highest key + 1
   QMap<QgsFeatureId, QgsFeature*>::const_iterator lastIt = mFeatures.end();
   lastIt--;
   QgsFeatureId id = lastIt.key();
-  return ++id;
+  return qMax( id + 1, mNextFeatureId );
 }
 
 void QgsWFSProvider::getLayerCapabilities()
@@ -2380,6 +1650,259 @@ bool QgsWFSProvider::initGetRenderedOnly( const QgsRectangle rect )
   return true;
 }
 
+bool QgsWFSProvider::loadTiles( const QgsRectangle& rect )
+{
+  if ( !mTileCache )
+  {
+    //the tile cache is shared by all BBOX values
+    mTileCache = new QgsWFSTileCache( QString( dataSourceUri() ).remove( QRegExp( "&?BBOX=[^&]*" ) ) );
+  }
+
+  //tiles of about half the size of the view
+  int level = ( int ) ceil( log( qMax( rect.width(), rect.height() ) / 2.0 ) / log( 2.0 ) );
+  double tileSize = ldexp( 1.0, level );
+  int xMin = ( int ) floor( rect.xMinimum() / tileSize );
+  int yMin = ( int ) floor( rect.yMinimum() / tileSize );
+  int xMax = ( int ) floor( rect.xMaximum() / tileSize );
+  int yMax = ( int ) floor( rect.yMaximum() / tileSize );
+  int viewTiles = ( xMax - xMin + 1 ) * ( yMax - yMin + 1 );
+  if ( viewTiles > WFS_MAX_VIEW_TILES )
+  {
+    QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: %2 tiles needed, fetching the view at once" ).arg( mLayer->name() ).arg( viewTiles ) );
+    return false;
+  }
+
+  if ( !mSpatialIndex || !mGetExtent.isEmpty() )
+  { //replace the features of an earlier request for the whole view
+    deleteData();
+    delete mSpatialIndex;
+    mSpatialIndex = new QgsSpatialIndex();
+    mGetExtent = QgsRectangle();
+  }
+
+  if ( level != mTileLevel )
+  { //tiles of different levels overlap, features without WFS id would be loaded twice
+    while ( !mTileOrder.isEmpty() )
+    {
+      unloadTile( mTileOrder.first() );
+    }
+    mTileLevel = level;
+  }
+
+  QgsRectangle oldExtent = mExtent;
+  QProgressDialog* progressDialog = 0;
+  int tileCount = 0;
+  for ( int y = yMin; y <= yMax; ++y )
+  {
+    for ( int x = xMin; x <= xMax; ++x, ++tileCount )
+    {
+      QString tile = QString( "%1_%2_%3" ).arg( mTileLevel ).arg( x ).arg( y );
+      if ( mTileFeatures.contains( tile ) )
+      {
+        mTileOrder.removeOne( tile );
+        mTileOrder << tile;
+        continue;
+      }
+
+      QList<QgsFeature*> features;
+      QStringList serverIds;
+      if ( !mTileCache->readTile( tile, features, serverIds ) )
+      {
+        if ( progressDialog && progressDialog->wasCanceled() )
+        {
+          continue; //the remaining tiles are requested by the next select
+        }
+
+        QWidget* mainWindow = QgsWFSData::findMainWindow();
+        if ( !progressDialog && mainWindow )
+        { //shown if the requests take longer than the minimum duration of the dialog
+          progressDialog = new QProgressDialog( tr( "Loading WFS data\n%1" ).arg( mLayer->name() ), tr( "Abort" ), 0, viewTiles, mainWindow );
+          progressDialog->setWindowModality( Qt::ApplicationModal );
+        }
+        if ( progressDialog )
+        {
+          progressDialog->setValue( tileCount );
+        }
+
+        QgsRectangle tileRect( x * tileSize, y * tileSize, ( x + 1 ) * tileSize, ( y + 1 ) * tileSize );
+        QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: fetching tile %2" ).arg( mLayer->name(), tile ) );
+        if ( fetchTile( tileRect, features, serverIds, progressDialog ) != 0 )
+        {
+          continue; //try again with the next select
+        }
+        mTileCache->writeTile( tile, features, serverIds );
+      }
+
+      addTileFeatures( tile, features, serverIds );
+      mTileOrder << tile;
+    }
+  }
+  delete progressDialog;
+
+  //keep the tiles of this view and the most recently used other ones in memory
+  while ( mTileOrder.size() > qMax( viewTiles, WFS_MAX_LOADED_TILES ) )
+  {
+    unloadTile( mTileOrder.first() );
+  }
+
+  mFeatureCount = mFeatures.size();
+  if ( mExtent != oldExtent )
+  {
+    mLayer->updateExtents();
+  }
+  return true;
+}
+
+int QgsWFSProvider::fetchTile( const QgsRectangle& tileRect, QList<QgsFeature*>& features, QStringList& serverIds, QProgressDialog* progressDialog )
+{
+  QMap<QString, QPair<int, QgsField> > thematicAttributes;
+  for ( QgsFieldMap::const_iterator it = mFields.begin(); it != mFields.end(); ++it )
+  {
+    thematicAttributes.insert( it.value().name(), qMakePair( it.key(), it.value() ) );
+  }
+
+  QMap<QgsFeatureId, QgsFeature* > tileFeatures;
+  QMap<QgsFeatureId, QString > idMap;
+  QgsRectangle extent;
+
+  //the features are parsed while the response arrives
+  QgsWFSData dataReader( uriWithBBox( tileRect ), &extent, tileFeatures, idMap, mGeometryAttribute, thematicAttributes, &mWKBType );
+  dataReader.setShowProgressDialog( false );
+  QObject::connect( &dataReader, SIGNAL( dataProgressAndSteps( int , int ) ), this, SLOT( handleWFSProgressMessage( int, int ) ) );
+  if ( progressDialog )
+  {
+    QObject::connect( progressDialog, SIGNAL( canceled() ), &dataReader, SLOT( setFinished() ) );
+  }
+
+  if ( dataReader.getWFSData() != 0 )
+  {
+    QgsDebugMsg( "getWFSData returned with error" );
+    qDeleteAll( tileFeatures );
+    return 1;
+  }
+
+  //the features of an aborted request are incomplete and must not be cached
+  if ( progressDialog && progressDialog->wasCanceled() )
+  {
+    QgsDebugMsg( "tile request aborted" );
+    qDeleteAll( tileFeatures );
+    return 1;
+  }
+
+  for ( QMap<QgsFeatureId, QgsFeature*>::const_iterator it = tileFeatures.constBegin(); it != tileFeatures.constEnd(); ++it )
+  {
+    features << it.value();
+    serverIds << idMap.value( it.key() );
+  }
+  return 0;
+}
+
+void QgsWFSProvider::addTileFeatures( const QString& tile, const QList<QgsFeature*>& features, const QStringList& serverIds )
+{
+  QList<QgsFeatureId>& tileIds = mTileFeatures[tile];
+
+  for ( int i = 0; i < features.size(); ++i )
+  {
+    QgsFeature* f = features[i];
+    QString serverId = serverIds.value( i );
+
+    //features crossing tile borders are part of several tiles and keep the id they got first
+    QgsFeatureId id;
+    QHash<QString, QgsFeatureId>::const_iterator idIt = mServerIds.constEnd();
+    if ( !serverId.isEmpty() )
+    {
+      idIt = mServerIds.constFind( serverId );
+    }
+    if ( idIt != mServerIds.constEnd() )
+    {
+      id = idIt.value();
+    }
+    else
+    {
+      id = findNewKey();
+      mNextFeatureId = id + 1;
+      if ( !serverId.isEmpty() )
+      {
+        mServerIds.insert( serverId, id );
+      }
+    }
+
+    if ( mFeatures.contains( id ) )
+    {
+      delete f;
+    }
+    else
+    {
+      f->setFeatureId( id );
+      if ( f->geometry() )
+      {
+        QgsRectangle bbox = f->geometry()->boundingBox();
+        if ( mFeatures.isEmpty() )
+        {
+          mExtent = bbox;
+        }
+        else
+        {
+          mExtent.combineExtentWith( &bbox );
+        }
+      }
+      mFeatures.insert( id, f );
+      if ( !serverId.isEmpty() )
+      {
+        mIdMap.insert( id, serverId );
+      }
+      mSpatialIndex->insertFeature( *f );
+    }
+
+    tileIds << id;
+    mTileRefs[id]++;
+  }
+}
+
+void QgsWFSProvider::unloadTile( const QString& tile )
+{
+  QList<QgsFeatureId> ids = mTileFeatures.take( tile );
+  mTileOrder.removeOne( tile );
+
+  foreach( QgsFeatureId id, ids )
+  {
+    QHash<QgsFeatureId, int>::iterator refIt = mTileRefs.find( id );
+    if ( refIt == mTileRefs.end() || --refIt.value() > 0 )
+    {
+      continue;
+    }
+    mTileRefs.erase( refIt );
+
+    //the id stays in mServerIds, so that the feature gets it again when it is loaded again
+    QgsFeature* f = mFeatures.take( id );
+    if ( f )
+    {
+      mSpatialIndex->deleteFeature( *f );
+      delete f;
+    }
+    mIdMap.remove( id );
+  }
+}
+
+QString QgsWFSProvider::uriWithBBox( const QgsRectangle& rect ) const
+{
+  return QString( dataSourceUri() ).replace( QRegExp( "BBOX=[^&]*" ),
+         QString( "BBOX=%1,%2,%3,%4" )
+         .arg( rect.xMinimum(), 0, 'f' )
+         .arg( rect.yMinimum(), 0, 'f' )
+         .arg( rect.xMaximum(), 0, 'f' )
+         .arg( rect.yMaximum(), 0, 'f' ) );
+}
+
+void QgsWFSProvider::invalidateTiles()
+{
+  //loaded tiles are kept, they were changed like the features on the server
+  if ( mTileCache )
+  {
+    mTileCache->clear();
+  }
+}
+
 QGis::WkbType QgsWFSProvider::geomTypeFromPropertyType( QString attName, QString propType )
 {
   Q_UNUSED( attName );
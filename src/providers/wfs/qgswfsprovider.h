@@ -19,6 +19,8 @@
 #define QGSWFSPROVIDER_H
 
 #include <QDomElement>
+#include <QHash>
+#include <QStringList>
 #include "qgis.h"
 #include "qgsrectangle.h"
 #include "qgscoordinatereferencesystem.h"
@@ -28,6 +30,8 @@
 
 class QgsRectangle;
 class QgsSpatialIndex;
+class QgsWFSTileCache;
+class QProgressDialog;
 
 /**A provider reading features from a WFS server*/
 class QgsWFSProvider: public QgsVectorDataProvider
@@ -202,6 +206,21 @@ class QgsWFSProvider: public QgsVectorDataProvider
     bool mInitGro;
     /**if GetRenderedOnly, extent specified in WFS getFeatures; else empty (no constraint)*/
     QgsRectangle mGetExtent;
+    /**GetRenderedOnly: edge length of the loaded tiles as power of two exponent. Every view
+      uses tiles of about half its size, aligned to multiples of their size*/
+    int mTileLevel;
+    /**GetRenderedOnly: disk cache of the fetched tiles (0 until the first tiled select)*/
+    QgsWFSTileCache *mTileCache;
+    /**GetRenderedOnly: loaded tiles, least recently used first*/
+    QStringList mTileOrder;
+    /**GetRenderedOnly: ids of the features of each loaded tile*/
+    QHash<QString, QList<QgsFeatureId> > mTileFeatures;
+    /**GetRenderedOnly: number of loaded tiles each feature is part of*/
+    QHash<QgsFeatureId, int> mTileRefs;
+    /**GetRenderedOnly: provider ids of the WFS server ids seen so far, so that features keep their id in all tiles*/
+    QHash<QString, QgsFeatureId> mServerIds;
+    /**Smallest id not used by any feature seen so far*/
+    QgsFeatureId mNextFeatureId;
 
     //encoding specific methods of getFeature
     int getFeatureGET( const QString& uri, const QString& geometryAttribute );
@@ -222,31 +241,8 @@ class QgsWFSProvider: public QgsVectorDataProvider
     /**Copies feature attributes / geometry from f to feature*/
     void copyFeature( QgsFeature* f, QgsFeature& feature, bool fetchGeometry, QgsAttributeList fetchAttributes );
 
-    //GML2 specific methods
-    int getExtentFromGML2( QgsRectangle* extent, const QDomElement& wfsCollectionElement ) const;
-
-    int getFeaturesFromGML2( const QDomElement& wfsCollectionElement, const QString& geometryAttribute );
-
-    int getWkbFromGML2( const QDomNode& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <Point> element*/
-    int getWkbFromGML2Point( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <Polygon> element*/
-    int getWkbFromGML2Polygon( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <LineString> element*/
-    int getWkbFromGML2LineString( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <MultiPoint> element*/
-    int getWkbFromGML2MultiPoint( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <MultiLineString> element*/
-    int getWkbFromGML2MultiLineString( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Creates WKB from a <MultiPolygon> element*/
-    int getWkbFromGML2MultiPolygon( const QDomElement& geometryElement, unsigned char** wkb, int* wkbSize, QGis::WkbType* type ) const;
-    /**Reads the <gml:coordinates> element and extracts the coordinates as points
-       @param coords list where the found coordinates are appended
-       @param elem the <gml:coordinates> element
-       @return 0 in case of success*/
-    int readGML2Coordinates( std::list<QgsPoint>& coords, const QDomElement elem ) const;
-    /**Tries to create a QgsCoordinateReferenceSystem object and assign it to mSourceCRS. Returns 0 in case of success*/
-    int setCRSFromGML2( const QDomElement& wfsCollectionElement );
+    /**Tries to create a QgsCoordinateReferenceSystem object from the srsName of a GML bounding box and assign it to mSourceCRS. Returns 0 in case of success*/
+    int setCRSFromSrsName( QString srsName );
 
 
     //methods to write GML2
@@ -297,6 +293,22 @@ class QgsWFSProvider: public QgsVectorDataProvider
     void handleException( const QDomDocument& serverResponse ) const;
     /**Initializes "Cache Features" inactive processing*/
     bool initGetRenderedOnly( QgsRectangle );
+    /**Loads the tiles covering rect from the tile cache or the server and unloads tiles not used
+      recently. The requests can be aborted with a progress dialog in the main window, the missing
+      tiles are requested again by the next select. Returns false without loading anything if rect needs too many tiles*/
+    bool loadTiles( const QgsRectangle& rect );
+    /**Requests the features of a tile from the server. The features are parsed while they arrive.
+      @param progressDialog aborts the request when it is canceled (may be 0)
+      @return 0 in case of success*/
+    int fetchTile( const QgsRectangle& tileRect, QList<QgsFeature*>& features, QStringList& serverIds, QProgressDialog* progressDialog );
+    /**Adds the features of a tile to mFeatures and the spatial index. Takes ownership of the features*/
+    void addTileFeatures( const QString& tile, const QList<QgsFeature*>& features, const QStringList& serverIds );
+    /**Removes the features only used by a tile*/
+    void unloadTile( const QString& tile );
+    /**Returns the data source uri with BBOX set to rect*/
+    QString uriWithBBox( const QgsRectangle& rect ) const;
+    /**Removes the cached tiles after the features were changed on the server*/
+    void invalidateTiles();
     /**Converts DescribeFeatureType schema geometry property type to WKBType*/
     QGis::WkbType geomTypeFromPropertyType( QString attName, QString propType );
 
@@ -0,0 +1,238 @@
+/***************************************************************************
+     qgswfstilecache.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgswfstilecache.h"
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QSettings>
+
+static const quint32 TILE_FILE_MAGIC = 0x51574653; // "QWFS"
+static const qint32 TILE_FILE_VERSION = 1;
+
+QStringList QgsWFSTileCache::sFiles;
+QHash<QString, qint64> QgsWFSTileCache::sSizes;
+qint64 QgsWFSTileCache::sTotalSize = 0;
+bool QgsWFSTileCache::sInitialized = false;
+
+static QString cacheDirectory()
+{
+  return QgsApplication::qgisSettingsDirPath() + "wfscache";
+}
+
+QgsWFSTileCache::QgsWFSTileCache( const QString& uri )
+{
+  QByteArray hash = QCryptographicHash::hash( uri.toUtf8(), QCryptographicHash::Md5 ).toHex();
+  mDirectory = cacheDirectory() + "/" + QString::fromAscii( hash );
+  init();
+}
+
+QString QgsWFSTileCache::tileFileName( const QString& tile ) const
+{
+  return mDirectory + "/" + tile + ".tile";
+}
+
+bool QgsWFSTileCache::readTile( const QString& tile, QList<QgsFeature*>& features, QStringList& serverIds )
+{
+  QString fileName = tileFileName( tile );
+  QFileInfo info( fileName );
+  if ( !info.exists() )
+  {
+    return false;
+  }
+  if ( isStale( info ) )
+  {
+    QFile::remove( fileName );
+    forget( fileName );
+    return false;
+  }
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    return false;
+  }
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_4 );
+
+  quint32 magic;
+  qint32 version, count;
+  in >> magic >> version >> count;
+  if ( magic != TILE_FILE_MAGIC || version != TILE_FILE_VERSION )
+  {
+    return false;
+  }
+
+  for ( int i = 0; i < count && in.status() == QDataStream::Ok; ++i )
+  {
+    QString serverId;
+    QgsAttributeMap attributes;
+    QByteArray wkb;
+    in >> serverId >> attributes >> wkb;
+
+    QgsFeature* f = new QgsFeature();
+    f->setAttributeMap( attributes );
+    if ( !wkb.isEmpty() )
+    {
+      unsigned char* geom = new unsigned char[wkb.size()];
+      memcpy( geom, wkb.constData(), wkb.size() );
+      f->setGeometryAndOwnership( geom, wkb.size() );
+    }
+    features << f;
+    serverIds << serverId;
+  }
+
+  if ( in.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( "could not read tile file " + fileName );
+    qDeleteAll( features );
+    features.clear();
+    serverIds.clear();
+    return false;
+  }
+
+  touch( fileName, file.size() );
+  return true;
+}
+
+void QgsWFSTileCache::writeTile( const QString& tile, const QList<QgsFeature*>& features, const QStringList& serverIds )
+{
+  QString fileName = tileFileName( tile );
+  QDir().mkpath( mDirectory );
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    QgsDebugMsg( "could not write tile file " + fileName );
+    return;
+  }
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_4 );
+  out << TILE_FILE_MAGIC << TILE_FILE_VERSION << ( qint32 ) features.size();
+  for ( int i = 0; i < features.size(); ++i )
+  {
+    QgsFeature* f = features[i];
+    QByteArray wkb;
+    if ( f->geometry() )
+    {
+      wkb = QByteArray(( const char* ) f->geometry()->asWkb(), f->geometry()->wkbSize() );
+    }
+    out << serverIds.value( i ) << f->attributeMap() << wkb;
+  }
+  file.close();
+
+  if ( out.status() != QDataStream::Ok )
+  {
+    QFile::remove( fileName );
+    forget( fileName );
+    return;
+  }
+
+  touch( fileName, file.size() );
+  expire();
+}
+
+void QgsWFSTileCache::clear()
+{
+  QDir dir( mDirectory );
+  foreach( QString entry, dir.entryList( QDir::Files ) )
+  {
+    QString fileName = mDirectory + "/" + entry;
+    QFile::remove( fileName );
+    forget( fileName );
+  }
+}
+
+void QgsWFSTileCache::touch( const QString& fileName, qint64 size )
+{
+  forget( fileName );
+  sFiles << fileName;
+  sSizes.insert( fileName, size );
+  sTotalSize += size;
+}
+
+void QgsWFSTileCache::forget( const QString& fileName )
+{
+  QHash<QString, qint64>::iterator it = sSizes.find( fileName );
+  if ( it == sSizes.end() )
+  {
+    return;
+  }
+
+  sTotalSize -= it.value();
+  sSizes.erase( it );
+  sFiles.removeOne( fileName );
+}
+
+void QgsWFSTileCache::expire()
+{
+  QSettings settings;
+  qint64 maxSize = settings.value( "/qgis/wfsTileCacheSize", 50 * 1024 * 1024 ).toLongLong();
+
+  while ( sTotalSize > maxSize && !sFiles.isEmpty() )
+  {
+    QString fileName = sFiles.first();
+    QFile::remove( fileName );
+    forget( fileName );
+  }
+}
+
+bool QgsWFSTileCache::isStale( const QFileInfo& info )
+{
+  QSettings settings;
+  int maxAge = settings.value( "/qgis/wfsTileCacheMaxAge", 3600 ).toInt();
+  return info.lastModified().secsTo( QDateTime::currentDateTime() ) >= maxAge;
+}
+
+void QgsWFSTileCache::init()
+{
+  if ( sInitialized )
+  {
+    return;
+  }
+  sInitialized = true;
+
+  //files of earlier sessions count as least recently used in the order they were written
+  QMap<QDateTime, QFileInfo> files;
+  QDir root( cacheDirectory() );
+  foreach( QFileInfo layerDir, root.entryInfoList( QDir::Dirs | QDir::NoDotAndDotDot ) )
+  {
+    foreach( QFileInfo info, QDir( layerDir.filePath() ).entryInfoList( QStringList( "*.tile" ), QDir::Files ) )
+    {
+      if ( isStale( info ) )
+      {
+        QFile::remove( info.filePath() );
+        continue;
+      }
+      files.insertMulti( info.lastModified(), info );
+    }
+  }
+
+  foreach( QFileInfo info, files )
+  {
+    touch( info.filePath(), info.size() );
+  }
+  expire();
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+     qgswfstilecache.h
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSWFSTILECACHE_H
+#define QGSWFSTILECACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+class QgsFeature;
+class QFileInfo;
+
+/**Disk cache for the features of the tiles a WFS layer fetched with BBOX requests.
+  Every layer gets a directory below the cache directory, every tile a file. All layers
+  share one size limit (setting /qgis/wfsTileCacheSize in bytes, 50 MB by default) and the
+  least recently used tiles are removed when it is exceeded. Tiles older than
+  /qgis/wfsTileCacheMaxAge seconds (one hour by default, 0 disables reusing tiles) are
+  fetched again, the layers do not cache their features because they may change on the server.
+  The cache is only used from the main thread, like the WFS provider.*/
+class QgsWFSTileCache
+{
+  public:
+    /**Creates the cache for the layer with GetFeature url uri (without BBOX)*/
+    QgsWFSTileCache( const QString& uri );
+
+    /**Reads the features of a tile. The caller takes ownership of the features
+      @param serverIds receives the WFS ids of the features (or empty strings)
+      @return false if the tile is not in the cache or has expired*/
+    bool readTile( const QString& tile, QList<QgsFeature*>& features, QStringList& serverIds );
+
+    /**Stores the features of a tile*/
+    void writeTile( const QString& tile, const QList<QgsFeature*>& features, const QStringList& serverIds );
+
+    /**Removes all tiles of the layer, e.g. after the features were changed on the server*/
+    void clear();
+
+  private:
+    QString tileFileName( const QString& tile ) const;
+
+    /**Marks a file as most recently used, size is the size of the file*/
+    static void touch( const QString& fileName, qint64 size );
+    /**Forgets a removed file*/
+    static void forget( const QString& fileName );
+    /**Removes least recently used files until the cache is within its size limit*/
+    static void expire();
+    /**Returns true if the file was written longer than the maximum age ago*/
+    static bool isStale( const QFileInfo& info );
+    /**Reads the files already in the cache directory, oldest first*/
+    static void init();
+
+    /**Directory of the layer*/
+    QString mDirectory;
+
+    /**Files of all layers, least recently used first*/
+    static QStringList sFiles;
+    /**Size of the files in sFiles*/
+    static QHash<QString, qint64> sSizes;
+    static qint64 sTotalSize;
+    static bool sInitialized;
+};
+
+#endif
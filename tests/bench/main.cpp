@@ -83,6 +83,12 @@ void usage( std::string const & appName )
             << "\t[--configpath path]\tuse the given path for all user configuration\n"
             << "\t[--prefix path]\tpath to a different build of qgis, may be used to test old versions\n"
             << "\t[--quality]\trenderer hint(s), comma separated, possible values: Antialiasing,TextAntialiasing,SmoothPixmapTransform,NonCosmeticDefaultPen\n"
+            << "\t[--pgfetch uri]\tcompare text and binary attribute fetching of the given PostgreSQL layer uri\n"
+            << "\t[--rasterdraw file]\tmeasure megapixels per second of each drawing style of the given raster\n"
+            << "\t[--gmlread file]\tmeasure features per second of loading the given GML file with the WFS provider\n"
+            << "\t[--spatialiteimport count]\tmeasure features per second of importing count generated points into a new SpatiaLite database\n"
+            << "\t[--crs authid]\trender reprojected to the given CRS, e.g. EPSG:3857\n"
+            << "\t[--labelthreads counts]\tmeasure labeling times with each number of threads, comma separated, e.g. 1,2,4\n"
             << "\t[--help]\t\tthis text\n\n"
             << "  FILES:\n"
             << "    Files specified on the command line can include rasters,\n"
@@ -137,6 +143,12 @@ int main( int argc, char *argv[] )
   int mySnapshotWidth = 800;
   int mySnapshotHeight = 600;
   QString myQuality = "";
+  QString myPgFetchUri = "";
+  QString myRasterDrawFileName = "";
+  QString myGmlReadFileName = "";
+  int mySpatiaLiteImportCount = 0;
+  QString myCrsAuthId = "";
+  QString myLabelThreads = "";
 
   // This behaviour will set initial extent of map canvas, but only if
   // there are no command line arguments. This gives a usable map
@@ -175,13 +187,19 @@ int main( int argc, char *argv[] )
       {"configpath", required_argument, 0, 'c'},
       {"prefix", required_argument, 0, 'r'},
       {"quality", required_argument, 0, 'q'},
+      {"pgfetch", required_argument, 0, 'f'},
+      {"rasterdraw", required_argument, 0, 'd'},
+      {"crs", required_argument, 0, 't'},
+      {"labelthreads", required_argument, 0, 'n'},
+      {"gmlread", required_argument, 0, 'g'},
+      {"spatialiteimport", required_argument, 0, 'a'},
       {0, 0, 0, 0}
     };
 
     /* getopt_long stores the option index here. */
     int option_index = 0;
 
-    optionChar = getopt_long( argc, argv, "islwhpeocrq",
+    optionChar = getopt_long( argc, argv, "islwhpeocrqfdtnga",
                               long_options, &option_index );
 
     /* Detect the end of the options. */
@@ -244,6 +262,30 @@ int main( int argc, char *argv[] )
         myQuality = optarg;
         break;
 
+      case 'f':
+        myPgFetchUri = optarg;
+        break;
+
+      case 'd':
+        myRasterDrawFileName = QDir::convertSeparators( QFileInfo( QFile::decodeName( optarg ) ).absoluteFilePath() );
+        break;
+
+      case 't':
+        myCrsAuthId = optarg;
+        break;
+
+      case 'n':
+        myLabelThreads = optarg;
+        break;
+
+      case 'g':
+        myGmlReadFileName = QDir::convertSeparators( QFileInfo( QFile::decodeName( optarg ) ).absoluteFilePath() );
+        break;
+
+      case 'a':
+        mySpatiaLiteImportCount = QString( optarg ).toInt();
+        break;
+
       case '?':
         usage( argv[0] );
         return 2;   // XXX need standard exit codes
@@ -324,6 +366,30 @@ int main( int argc, char *argv[] )
     {
       myQuality = argv[++i];
     }
+    else if ( i + 1 < argc && ( arg == "--pgfetch" || arg == "-f" ) )
+    {
+      myPgFetchUri = argv[++i];
+    }
+    else if ( i + 1 < argc && ( arg == "--rasterdraw" || arg == "-d" ) )
+    {
+      myRasterDrawFileName = QDir::convertSeparators( QFileInfo( QFile::decodeName( argv[++i] ) ).absoluteFilePath() );
+    }
+    else if ( i + 1 < argc && ( arg == "--crs" || arg == "-t" ) )
+    {
+      myCrsAuthId = argv[++i];
+    }
+    else if ( i + 1 < argc && ( arg == "--labelthreads" || arg == "-n" ) )
+    {
+      myLabelThreads = argv[++i];
+    }
+    else if ( i + 1 < argc && ( arg == "--gmlread" || arg == "-g" ) )
+    {
+      myGmlReadFileName = QDir::convertSeparators( QFileInfo( QFile::decodeName( argv[++i] ) ).absoluteFilePath() );
+    }
+    else if ( i + 1 < argc && ( arg == "--spatialiteimport" || arg == "-a" ) )
+    {
+      mySpatiaLiteImportCount = QString( argv[++i] ).toInt();
+    }
     else
     {
       myFileList.append( QDir::convertSeparators( QFileInfo( QFile::decodeName( argv[i] ) ).absoluteFilePath() ) );
@@ -531,7 +597,52 @@ int main( int argc, char *argv[] )
     }
   }
 
-  qbench->render();
+  if ( ! myCrsAuthId.isEmpty() )
+  {
+    qbench->setDestinationCrs( myCrsAuthId );
+  }
+
+  if ( ! myLabelThreads.isEmpty() )
+  {
+    QList<int> counts;
+    foreach( QString count, myLabelThreads.split( ',' ) )
+    {
+      bool ok;
+      int n = count.toInt( &ok );
+      if ( !ok || n < 1 )
+      {
+        fprintf( stderr, "Invalid number of labeling threads\n" );
+        return 1;
+      }
+      counts << n;
+    }
+    qbench->setLabelingThreads( counts );
+  }
+
+  if ( ! myPgFetchUri.isEmpty() )
+  {
+    qbench->fetchPostgres( myPgFetchUri );
+  }
+
+  if ( ! myRasterDrawFileName.isEmpty() )
+  {
+    qbench->drawRaster( myRasterDrawFileName );
+  }
+
+  if ( ! myGmlReadFileName.isEmpty() )
+  {
+    qbench->readGml( myGmlReadFileName );
+  }
+
+  if ( mySpatiaLiteImportCount > 0 )
+  {
+    qbench->importSpatiaLite( mySpatiaLiteImportCount );
+  }
+
+  if ( ( myPgFetchUri.isEmpty() && myRasterDrawFileName.isEmpty() && myGmlReadFileName.isEmpty() && mySpatiaLiteImportCount <= 0 ) || ! myProjectFileName.isEmpty() )
+  {
+    qbench->render();
+  }
 
   if ( mySnapshotFileName != "" )
   {
@@ -26,18 +26,32 @@
 #include <time.h>
 #include <math.h>
 
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QImage>
+#include <QLibrary>
 #include <QPainter>
 #include <QSettings>
 #include <QString>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QTime>
 
 #include "qgsbench.h"
+#include "qgscrscache.h"
+#include "qgsdatasourceuri.h"
+#include "qgsgeometry.h"
 #include "qgslogger.h"
 #include "qgsmaplayerregistry.h"
+#include "qgspallabeling.h"
 #include "qgsproject.h"
+#include "qgsproviderregistry.h"
+#include "qgsrasterlayer.h"
+#include "qgsrendercontext.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgsvectorlayerimport.h"
 
 #ifdef Q_OS_WIN
 // slightly adapted from http://anoncvs.postgresql.org/cvsweb.cgi/pgsql/src/port/getrusage.c?rev=1.18;content-type=text%2Fplain
@@ -163,6 +177,11 @@ void QgsBench::setExtent( const QgsRectangle & extent )
   mSetExtent = true;
 }
 
+void QgsBench::setDestinationCrs( const QString & authId )
+{
+  mCrsAuthId = authId;
+}
+
 void QgsBench::render()
 {
   QgsDebugMsg( "entered" );
@@ -180,16 +199,30 @@ void QgsBench::render()
     mMapRenderer->setExtent( mExtent );
   }
 
-  // Maybe in future
-  //outputCRS = QgsCRSCache::instance()->crsByAuthId( crsId );
-  //mMapRenderer->setMapUnits( outputCRS.mapUnits() );
-  //mMapRenderer->setDestinationCrs( outputCRS );
+  if ( !mCrsAuthId.isEmpty() )
+  {
+    // the extent is transformed to the new CRS by the renderer
+    const QgsCoordinateReferenceSystem& outputCRS = QgsCRSCache::instance()->crsByAuthId( mCrsAuthId );
+    if ( outputCRS.isValid() )
+    {
+      mMapRenderer->setMapUnits( outputCRS.mapUnits() );
+      mMapRenderer->setDestinationCrs( outputCRS );
+      mLogMap.insert( "crs", mCrsAuthId );
+    }
+    else
+    {
+      fprintf( stderr, "Invalid CRS %s\n", mCrsAuthId.toLocal8Bit().constData() );
+    }
+  }
 
   // TODO: this should be probably set according to project
   mMapRenderer->setProjectionsEnabled( true );
 
-  // Necessary?
-  //mMapRenderer->setLabelingEngine( new QgsPalLabeling() );
+  // labels are placed by the labeling engine like in the application, but all
+  // of them in every iteration as the extent does not change
+  QgsPalLabeling* labeling = new QgsPalLabeling();
+  labeling->setCachingPlacements( false );
+  mMapRenderer->setLabelingEngine( labeling );
 
   mImage = new QImage( mWidth, mHeight, QImage::Format_ARGB32_Premultiplied );
   mImage->fill( 0 );
@@ -200,15 +233,364 @@ void QgsBench::render()
 
   painter.setRenderHints( mRendererHints );
 
+  // wall clock ms spent preparing, placing and drawing labels, summed over all iterations
+  double labelingTimes[3] = { 0, 0, 0 };
+
   for ( int i = 0; i < mIterations; i++ )
   {
     start();
     mMapRenderer->render( &painter );
     elapsed();
+
+    labelingTimes[0] += labeling->preparationTime();
+    labelingTimes[1] += labeling->placementTime();
+    labelingTimes[2] += labeling->drawingTime();
+  }
+
+  mLogMap.insert( "iterations", mTimes.size() );
+  mLogMap.insert( "times", timesStats() );
+
+  if ( mIterations > 0 )
+  {
+    mLogMap.insert( "labeling", labelingStats( labelingTimes ) );
+
+    // labeling times for each number of threads
+    QMap<QString, QVariant> threadsMap;
+    foreach( int count, mLabelingThreads )
+    {
+      labeling->setThreadCount( count );
+
+      double times[3] = { 0, 0, 0 };
+      for ( int i = 0; i < mIterations; i++ )
+      {
+        mMapRenderer->render( &painter );
+
+        times[0] += labeling->preparationTime();
+        times[1] += labeling->placementTime();
+        times[2] += labeling->drawingTime();
+      }
+      threadsMap.insert( QString::number( count ), labelingStats( times ) );
+    }
+    if ( !threadsMap.isEmpty() )
+      mLogMap.insert( "labeling_threads", threadsMap );
+  }
+}
+
+QMap<QString, QVariant> QgsBench::labelingStats( double times[3] )
+{
+  QMap<QString, QVariant> labelingMap;
+  labelingMap.insert( "prepare", times[0] / mIterations );
+  labelingMap.insert( "placement", times[1] / mIterations );
+  labelingMap.insert( "draw", times[2] / mIterations );
+  labelingMap.insert( "total", ( times[0] + times[1] + times[2] ) / mIterations );
+  return labelingMap;
+}
+
+void QgsBench::fetchPostgres( const QString & uri )
+{
+  QgsDataSourceURI dsUri( uri );
+
+  dsUri.setUseBinaryFetch( false );
+  mLogMap.insert( "fetch_text", fetch( "postgres", dsUri.uri() ) );
+
+  dsUri.setUseBinaryFetch( true );
+  mLogMap.insert( "fetch_binary", fetch( "postgres", dsUri.uri() ) );
+}
+
+void QgsBench::drawRaster( const QString & fileName )
+{
+  QgsDebugMsg( "entered" );
+
+  QgsRasterLayer layer( fileName, "bench" );
+  if ( !layer.isValid() )
+  {
+    fprintf( stderr, "Cannot open raster %s\n", fileName.toLocal8Bit().constData() );
+    return;
+  }
+
+  QSettings settings;
+  bool tileCache = settings.value( "/qgis/raster_tile_cache", true ).toBool();
+  settings.setValue( "/qgis/raster_tile_cache", false );
+
+  QList< QPair<QString, QgsRasterLayer::DrawingStyle> > styles;
+  if ( layer.bandCount() > 1 )
+  {
+    styles << qMakePair( QString( "gray" ), QgsRasterLayer::MultiBandSingleBandGray );
+    styles << qMakePair( QString( "pseudocolor" ), QgsRasterLayer::MultiBandSingleBandPseudoColor );
+    styles << qMakePair( QString( "multiband" ), QgsRasterLayer::MultiBandColor );
+  }
+  else
+  {
+    styles << qMakePair( QString( "gray" ), QgsRasterLayer::SingleBandGray );
+    styles << qMakePair( QString( "pseudocolor" ), QgsRasterLayer::SingleBandPseudoColor );
   }
+  layer.setColorShadingAlgorithm( QgsRasterLayer::PseudoColorShader );
+
+  // fit the whole raster into the image
+  QgsRectangle extent = layer.extent();
+  double mupp = qMax( extent.width() / mWidth, extent.height() / mHeight );
 
+  QImage image( mWidth, mHeight, QImage::Format_ARGB32_Premultiplied );
+  QPainter painter( &image );
+  painter.setRenderHints( mRendererHints );
+
+  QgsRenderContext context;
+  context.setPainter( &painter );
+  context.setExtent( QgsRectangle( extent.xMinimum(), extent.yMinimum(),
+                                   extent.xMinimum() + mWidth * mupp, extent.yMinimum() + mHeight * mupp ) );
+  context.setMapToPixel( QgsMapToPixel( mupp, mHeight, extent.yMinimum(), extent.xMinimum() ) );
+
+  QMap<QString, QVariant> drawMap;
+  for ( int s = 0; s < styles.size(); s++ )
+  {
+    layer.setDrawingStyle( styles[s].second );
+
+    foreach( double *t, mTimes )
+    {
+      delete [] t;
+    }
+    mTimes.clear();
+
+    for ( int i = 0; i < mIterations; i++ )
+    {
+      image.fill( 0 );
+      start();
+      layer.draw( context );
+      elapsed();
+    }
+
+    QMap<QString, QVariant> map;
+    map.insert( "times", timesStats() );
+    double total = map["times"].toMap()["total"].toMap()["avg"].toDouble();
+    if ( total > 0 )
+    {
+      map.insert( "mpix_per_sec", mWidth * mHeight / 1000000. / total );
+    }
+    drawMap.insert( styles[s].first, map );
+  }
   mLogMap.insert( "iterations", mTimes.size() );
+  mLogMap.insert( "raster_draw", drawMap );
 
+  settings.setValue( "/qgis/raster_tile_cache", tileCache );
+}
+
+void QgsBench::readGml( const QString & fileName )
+{
+  QgsDebugMsg( "entered" );
+
+  // the parser uses the global thread pool for its chunks
+  QThreadPool *pool = QThreadPool::globalInstance();
+  int maxThreads = pool->maxThreadCount();
+  QList<int> threadCounts;
+  threadCounts << 1;
+  if ( maxThreads > 1 )
+    threadCounts << maxThreads;
+
+  QMap<QString, QVariant> readMap;
+  foreach( int threads, threadCounts )
+  {
+    pool->setMaxThreadCount( threads );
+
+    foreach( double *t, mTimes )
+    {
+      delete [] t;
+    }
+    mTimes.clear();
+
+    // cpu times add up the threads, features per second are calculated from the wall clock
+    double wall = 0;
+    int features = 0;
+    for ( int i = 0; i < mIterations; i++ )
+    {
+      QTime time;
+      time.start();
+      start();
+      QgsVectorLayer layer( fileName, "bench", "WFS" );
+      elapsed();
+      wall += time.elapsed() / 1000.;
+
+      if ( !layer.isValid() )
+      {
+        fprintf( stderr, "Cannot open GML file %s\n", fileName.toLocal8Bit().constData() );
+        pool->setMaxThreadCount( maxThreads );
+        return;
+      }
+      features = layer.featureCount();
+    }
+
+    QMap<QString, QVariant> map;
+    map.insert( "features", features );
+    map.insert( "times", timesStats() );
+    if ( mIterations > 0 )
+    {
+      map.insert( "wall", wall / mIterations );
+    }
+    if ( wall > 0 )
+    {
+      map.insert( "features_per_sec", features * mIterations / wall );
+    }
+    readMap.insert( QString::number( threads ), map );
+  }
+  pool->setMaxThreadCount( maxThreads );
+
+  mLogMap.insert( "iterations", mTimes.size() );
+  mLogMap.insert( "gml_read", readMap );
+}
+
+static void removeSqliteFiles( const QString & dbPath )
+{
+  QFile::remove( dbPath );
+  QFile::remove( dbPath + "-wal" );
+  QFile::remove( dbPath + "-shm" );
+}
+
+void QgsBench::importSpatiaLite( int count )
+{
+  QgsDebugMsg( "entered" );
+
+  // new databases are created by the provider like in the new SpatiaLite layer dialog
+  QLibrary lib( QgsProviderRegistry::instance()->library( "spatialite" ) );
+  typedef bool ( *createDbProc )( const QString&, QString& );
+  createDbProc createDb = ( createDbProc ) cast_to_fptr( lib.resolve( "createDb" ) );
+  if ( !createDb )
+  {
+    fprintf( stderr, "Cannot load the SpatiaLite provider\n" );
+    return;
+  }
+
+  QgsVectorLayer source( "Point?crs=epsg:4326&field=id:integer&field=value:double&field=name:string(20)", "bench", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < count; i++ )
+  {
+    QgsFeature f;
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( -180 + ( i % 3600 ) * 0.1, -90 + ( i / 3600 % 1800 ) * 0.1 ) ) );
+    f.addAttribute( 0, i );
+    f.addAttribute( 1, i * 0.5 );
+    f.addAttribute( 2, QString( "feature %1" ).arg( i ) );
+    features << f;
+  }
+  source.dataProvider()->addFeatures( features );
+  features.clear();
+
+  QString dbPath = QDir::temp().filePath( "qgis_bench_import.sqlite" );
+  QgsDataSourceURI uri;
+  uri.setDatabase( dbPath );
+  uri.setDataSource( "", "bench", "geometry" );
+
+  // connection options read by the provider when it opens a database
+  QSettings settings;
+  QVariant walJournal = settings.value( "/SpatiaLite/walJournal" );
+  QVariant mmapSize = settings.value( "/SpatiaLite/mmapSize" );
+
+  QMap<QString, QVariant> importMap;
+  for ( int wal = 0; wal < 2; wal++ )
+  {
+    settings.setValue( "/SpatiaLite/walJournal", wal == 1 );
+    settings.setValue( "/SpatiaLite/mmapSize", wal == 1 ? 256 : 0 );
+
+    foreach( double *t, mTimes )
+    {
+      delete [] t;
+    }
+    mTimes.clear();
+
+    // features per second are calculated from the wall clock as most of the time may be spent waiting for the disk
+    double wall = 0;
+    for ( int i = 0; i < mIterations; i++ )
+    {
+      QString errCause;
+      removeSqliteFiles( dbPath );
+      if ( !createDb( dbPath, errCause ) )
+      {
+        fprintf( stderr, "Cannot create %s: %s\n", dbPath.toLocal8Bit().constData(), errCause.toLocal8Bit().constData() );
+        break;
+      }
+
+      QTime time;
+      time.start();
+      start();
+      QgsVectorLayerImport::ImportError err = QgsVectorLayerImport::importLayer( &source, uri.uri(), "spatialite", 0, false, &errCause );
+      elapsed();
+      wall += time.elapsed() / 1000.;
+
+      if ( err != QgsVectorLayerImport::NoError )
+      {
+        fprintf( stderr, "Import failed: %s\n", errCause.toLocal8Bit().constData() );
+        break;
+      }
+    }
+
+    QMap<QString, QVariant> map;
+    map.insert( "features", count );
+    map.insert( "times", timesStats() );
+    if ( mTimes.size() > 0 )
+    {
+      map.insert( "wall", wall / mTimes.size() );
+    }
+    if ( wall > 0 )
+    {
+      map.insert( "features_per_sec", count * mTimes.size() / wall );
+    }
+    importMap.insert( wal == 1 ? "wal_mmap" : "default", map );
+  }
+  removeSqliteFiles( dbPath );
+
+  if ( walJournal.isNull() )
+    settings.remove( "/SpatiaLite/walJournal" );
+  else
+    settings.setValue( "/SpatiaLite/walJournal", walJournal );
+  if ( mmapSize.isNull() )
+    settings.remove( "/SpatiaLite/mmapSize" );
+  else
+    settings.setValue( "/SpatiaLite/mmapSize", mmapSize );
+
+  mLogMap.insert( "iterations", mTimes.size() );
+  mLogMap.insert( "spatialite_import", importMap );
+}
+
+QMap<QString, QVariant> QgsBench::fetch( const QString & providerKey, const QString & uri )
+{
+  QgsDebugMsg( "entered" );
+
+  QMap<QString, QVariant> map;
+
+  QgsVectorLayer layer( uri, "bench", providerKey );
+  if ( !layer.isValid() )
+  {
+    fprintf( stderr, "Cannot open layer %s\n", uri.toLocal8Bit().constData() );
+    return map;
+  }
+
+  foreach( double *t, mTimes )
+  {
+    delete [] t;
+  }
+  mTimes.clear();
+
+  int features = 0;
+  for ( int i = 0; i < mIterations; i++ )
+  {
+    start();
+    layer.select( layer.pendingAllAttributesList(), QgsRectangle(), true, false );
+
+    QgsFeatureList batch;
+    features = 0;
+    while ( int n = layer.nextFeatures( batch, 1000 ) )
+    {
+      features += n;
+      batch.clear();
+    }
+    elapsed();
+  }
+
+  mLogMap.insert( "iterations", mTimes.size() );
+  map.insert( "features", features );
+  map.insert( "times", timesStats() );
+  return map;
+}
+
+QMap<QString, QVariant> QgsBench::timesStats()
+{
   // Calc stats: user, sys, total
   double min[3], max[3];
   double stdev[3] = {0.};
@@ -254,7 +636,7 @@ void QgsBench::render()
 
     timesMap.insert( pre[t], map );
   }
-  mLogMap.insert( "times", timesMap );
+  return timesMap;
 }
 
 void QgsBench::saveSnapsot( const QString & fileName )
@@ -267,12 +649,39 @@ void QgsBench::printLog()
 {
   std::cout << "iterations: " << mLogMap["iterations"].toString().toAscii().constData() << std::endl;
 
-  QMap<QString, QVariant> timesMap = mLogMap["times"].toMap();
+  printTimes( "", mLogMap["times"].toMap() );
+
+  const char *fetches[] = { "fetch_text", "fetch_binary" };
+  for ( int f = 0; f < 2; f++ )
+  {
+    if ( !mLogMap.contains( fetches[f] ) )
+      continue;
+
+    QMap<QString, QVariant> fetchMap = mLogMap[ fetches[f] ].toMap();
+    QString prefix = QString( fetches[f] ) + "_";
+    std::cout << ( prefix + "features: " + fetchMap["features"].toString() ).toAscii().constData() << std::endl;
+    printTimes( prefix, fetchMap["times"].toMap() );
+  }
+
+  QMap<QString, QVariant> drawMap = mLogMap["raster_draw"].toMap();
+  QMap<QString, QVariant>::iterator d = drawMap.begin();
+  while ( d != drawMap.end() )
+  {
+    QMap<QString, QVariant> styleMap = d.value().toMap();
+    QString prefix = "raster_draw_" + d.key() + "_";
+    std::cout << ( prefix + "mpix_per_sec: " + styleMap["mpix_per_sec"].toString() ).toAscii().constData() << std::endl;
+    printTimes( prefix, styleMap["times"].toMap() );
+    ++d;
+  }
+}
+
+void QgsBench::printTimes( const QString & prefix, const QMap<QString, QVariant> & timesMap )
+{
   QMap<QString, QVariant> totalMap = timesMap["total"].toMap();
   QMap<QString, QVariant>::iterator i = totalMap.begin();
   while ( i != totalMap.end() )
   {
-    QString s = "total_" + i.key() + ": " + i.value().toString();
+    QString s = prefix + "total_" + i.key() + ": " + i.value().toString();
     std::cout << s.toAscii().constData() << std::endl;
     ++i;
   }
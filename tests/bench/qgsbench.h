@@ -43,12 +43,33 @@ class QgsBench :  public QObject
 
     void render();
 
+    // fetch all features of a PostgreSQL layer, once with text and once
+    // with binary decoding of attributes
+    void fetchPostgres( const QString & uri );
+
+    // draw a raster layer with each drawing style applicable to it and
+    // measure megapixels per second, the tile cache is disabled meanwhile
+    void drawRaster( const QString & fileName );
+
+    // load a GML file with the WFS provider and measure features per
+    // second, once with one parser thread and once with all of them
+    void readGml( const QString & fileName );
+
+    // import count generated points into a new SpatiaLite database with
+    // QgsVectorLayerImport and measure features per second, once with the
+    // default journal and once with the write-ahead log and memory mapping
+    void importSpatiaLite( int count );
+
     void printLog();
 
     bool openProject( const QString & fileName );
 
     void setExtent( const QgsRectangle & extent );
 
+    // render reprojected to the CRS with the given authority identifier
+    // instead of the project CRS
+    void setDestinationCrs( const QString & authId );
+
     void saveSnapsot( const QString & fileName );
 
     void saveLog( const QString & fileName );
@@ -57,10 +78,25 @@ class QgsBench :  public QObject
 
     void  setRenderHints( QPainter::RenderHints hints ) { mRendererHints = hints; }
 
+    // after the rendering cycles, render the same cycles with each number
+    // of labeling threads and log the labeling times
+    void setLabelingThreads( const QList<int> & counts ) { mLabelingThreads = counts; }
+
   public slots:
     void readProject( const QDomDocument &doc );
 
   private:
+    // fetch all features of a vector layer in each iteration
+    QMap<QString, QVariant> fetch( const QString & providerKey, const QString & uri );
+
+    // average labeling times per iteration from the times summed over all iterations
+    QMap<QString, QVariant> labelingStats( double times[3] );
+
+    // calc stats of mTimes: user, sys, total
+    QMap<QString, QVariant> timesStats();
+
+    void printTimes( const QString & prefix, const QMap<QString, QVariant> & timesMap );
+
     // snapshot image width
     int mWidth;
 
@@ -74,6 +110,10 @@ class QgsBench :  public QObject
     QgsRectangle mExtent;
     bool mSetExtent;
 
+    QString mCrsAuthId;
+
+    QList<int> mLabelingThreads;
+
     QPainter::RenderHints mRendererHints;
 
     // log map
@@ -0,0 +1,181 @@
+/***************************************************************************
+     testqgsninecellfilter.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <gdal.h>
+
+//header for class being tested
+#include <qgsninecellfilter.h>
+
+static const float InputNodata = -9999.0f;
+
+/** Filter whose result depends on the position of every value in the window,
+ * so rows or columns mixed up between blocks change the result */
+class QgsWeightedSumFilter: public QgsNineCellFilter
+{
+  public:
+    QgsWeightedSumFilter( const QString& inputFile, const QString& outputFile )
+        : QgsNineCellFilter( inputFile, outputFile, "GTiff" )
+    {}
+
+    float processNineCellWindow( float* x11, float* x21, float* x31,
+                                 float* x12, float* x22, float* x32,
+                                 float* x13, float* x23, float* x33 )
+    {
+      if ( *x22 == mInputNodataValue )
+      {
+        return mOutputNodataValue;
+      }
+      float* window[9] = { x11, x21, x31, x12, x22, x32, x13, x23, x33 };
+      float sum = 0;
+      for ( int i = 0; i < 9; ++i )
+      {
+        if ( *window[i] != mInputNodataValue )
+        {
+          sum += ( i + 1 ) * *window[i];
+        }
+      }
+      return sum;
+    }
+};
+
+/** \ingroup UnitTests
+ * Compares the nine cell filters processed in parallel blocks with the
+ * row by row processing they replaced.
+ */
+class TestQgsNineCellFilter: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init();// will be called before each testfunction is executed.
+    void cleanup();// will be called after every testfunction.
+
+    void severalBlocks();
+    void oneBlock();
+    void narrowRaster();
+  private:
+    /** Filters a generated raster and compares the result with the sequential calculation */
+    void checkRaster( int xSize, int ySize );
+
+    QString mInputFile;
+    QString mOutputFile;
+};
+
+void TestQgsNineCellFilter::initTestCase()
+{
+  GDALAllRegister();
+  mInputFile = QDir::tempPath() + "/ninecellfilter_input.tif";
+  mOutputFile = QDir::tempPath() + "/ninecellfilter_output.tif";
+}
+
+void TestQgsNineCellFilter::cleanupTestCase()
+{
+}
+
+void TestQgsNineCellFilter::init()
+{
+}
+
+void TestQgsNineCellFilter::cleanup()
+{
+  QFile::remove( mInputFile );
+  QFile::remove( mOutputFile );
+}
+
+void TestQgsNineCellFilter::checkRaster( int xSize, int ySize )
+{
+  // input with distinct values and a few nodata cells
+  QVector<float> input( xSize * ySize );
+  for ( int i = 0; i < input.size(); ++i )
+  {
+    input[i] = i % 97 == 0 ? InputNodata : ( i % 1013 ) * 0.25f;
+  }
+
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  QVERIFY( driver );
+  GDALDatasetH inputDataset = GDALCreate( driver, mInputFile.toLocal8Bit().data(), xSize, ySize, 1, GDT_Float32, NULL );
+  QVERIFY( inputDataset );
+  double geotransform[6] = { 0, 1, 0, ySize, 0, -1 };
+  GDALSetGeoTransform( inputDataset, geotransform );
+  GDALRasterBandH inputBand = GDALGetRasterBand( inputDataset, 1 );
+  GDALSetRasterNoDataValue( inputBand, InputNodata );
+  QVERIFY( GDALRasterIO( inputBand, GF_Write, 0, 0, xSize, ySize, input.data(), xSize, ySize, GDT_Float32, 0, 0 ) == CE_None );
+  GDALClose( inputDataset );
+
+  QgsWeightedSumFilter filter( mInputFile, mOutputFile );
+  QCOMPARE( filter.processRaster( 0 ), 0 );
+
+  QVector<float> output( xSize * ySize );
+  GDALDatasetH outputDataset = GDALOpen( mOutputFile.toLocal8Bit().data(), GA_ReadOnly );
+  QVERIFY( outputDataset );
+  GDALRasterBandH outputBand = GDALGetRasterBand( outputDataset, 1 );
+  QVERIFY( GDALRasterIO( outputBand, GF_Read, 0, 0, xSize, ySize, output.data(), xSize, ySize, GDT_Float32, 0, 0 ) == CE_None );
+  GDALClose( outputDataset );
+
+  // sequential calculation, one row after the other with nodata outside of the raster
+  float nodata = InputNodata;
+  QVector<float> nodataLine( xSize, InputNodata );
+  for ( int i = 0; i < ySize; ++i )
+  {
+    const float* line1 = i == 0 ? nodataLine.constData() : input.constData() + ( i - 1 ) * xSize;
+    const float* line2 = input.constData() + i * xSize;
+    const float* line3 = i == ySize - 1 ? nodataLine.constData() : input.constData() + ( i + 1 ) * xSize;
+    for ( int j = 0; j < xSize; ++j )
+    {
+      float w[9];
+      for ( int k = 0; k < 3; ++k )
+      {
+        int x = j + k - 1;
+        bool inside = x >= 0 && x < xSize;
+        w[k] = inside ? line1[x] : nodata;
+        w[k + 3] = inside ? line2[x] : nodata;
+        w[k + 6] = inside ? line3[x] : nodata;
+      }
+      float expected = filter.processNineCellWindow( &w[0], &w[1], &w[2], &w[3], &w[4], &w[5], &w[6], &w[7], &w[8] );
+      if ( output[i * xSize + j] != expected )
+      {
+        QFAIL( qPrintable( QString( "row %1, column %2: expected %3, got %4" )
+                           .arg( i ).arg( j ).arg( expected ).arg( output[i * xSize + j] ) ) );
+      }
+    }
+  }
+}
+
+void TestQgsNineCellFilter::severalBlocks()
+{
+  // more rows than fit into one block, and a last block with fewer rows
+  checkRaster( 2048, 1100 );
+}
+
+void TestQgsNineCellFilter::oneBlock()
+{
+  // the only block contains the first and the last row
+  checkRaster( 300, 7 );
+}
+
+void TestQgsNineCellFilter::narrowRaster()
+{
+  // blocks of many short rows, the last one with fewer rows
+  checkRaster( 3, 400000 );
+}
+
+QTEST_MAIN( TestQgsNineCellFilter )
+#include "moc_testqgsninecellfilter.cxx"
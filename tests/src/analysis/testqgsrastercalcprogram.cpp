@@ -0,0 +1,233 @@
+/***************************************************************************
+     testqgsrastercalcprogram.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <cmath>
+#include <cstring>
+
+//header for class being tested
+#include <qgsrastercalcprogram.h>
+#include <qgsrastercalcnode.h>
+#include <qgsrastermatrix.h>
+
+static const int ValueCount = 12;
+static const double NodataA = -9999.0;
+static const double NodataB = -1.0;
+static const float OutputNodata = -12345.0f;
+
+/** \ingroup UnitTests
+ * Compares the raster calculator programs with the evaluation of the expression trees
+ * by QgsRasterCalcNode::calculate(), which was used before the programs.
+ */
+class TestQgsRasterCalcProgram: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init();// will be called before each testfunction is executed.
+    void cleanup();// will be called after every testfunction.
+
+    void twoArgumentOperators();
+    void oneArgumentOperators();
+    void numbersAndRasters();
+    void nestedExpressions();
+    void nodata();
+    void constantExpressions();
+    void unknownRaster();
+  private:
+    /** Runs the program of the expression and compares it with QgsRasterCalcNode::calculate() */
+    void checkExpression( const QString& expression );
+
+    QVector<float> mA;
+    QVector<float> mB;
+};
+
+void TestQgsRasterCalcProgram::initTestCase()
+{
+  // zeros, negative values, values outside [-1, 1] and nodata cells
+  float a[ValueCount] = { 1.0f, 2.5f, -3.0f, 0.0f, 4.0f, 0.5f, -0.5f, 9.0f, ( float ) NodataA, 16.0f, 1.0f, -1.0f };
+  float b[ValueCount] = { 2.0f, 0.0f, 3.0f, -2.0f, 0.5f, ( float ) NodataB, 1.0f, 3.0f, 5.0f, -0.5f, 1.0f, 4.0f };
+  for ( int i = 0; i < ValueCount; ++i )
+  {
+    mA << a[i];
+    mB << b[i];
+  }
+}
+
+void TestQgsRasterCalcProgram::cleanupTestCase()
+{
+}
+
+void TestQgsRasterCalcProgram::init()
+{
+}
+
+void TestQgsRasterCalcProgram::cleanup()
+{
+}
+
+void TestQgsRasterCalcProgram::checkExpression( const QString& expression )
+{
+  QString errorMessage;
+  QgsRasterCalcNode* node = QgsRasterCalcNode::parseRasterCalcString( expression, errorMessage );
+  QVERIFY2( node, qPrintable( expression + ": " + errorMessage ) );
+
+  // expected values from the expression tree
+  float* aData = new float[ValueCount];
+  float* bData = new float[ValueCount];
+  memcpy( aData, mA.constData(), ValueCount * sizeof( float ) );
+  memcpy( bData, mB.constData(), ValueCount * sizeof( float ) );
+  QgsRasterMatrix aMatrix( ValueCount, 1, aData, NodataA );
+  QgsRasterMatrix bMatrix( ValueCount, 1, bData, NodataB );
+  QMap<QString, QgsRasterMatrix*> rasterData;
+  rasterData.insert( "a@1", &aMatrix );
+  rasterData.insert( "b@1", &bMatrix );
+
+  QgsRasterMatrix expected;
+  QVERIFY2( node->calculate( rasterData, expected ), qPrintable( expression ) );
+
+  // values of the program
+  QMap<QString, double> nodataValues;
+  nodataValues.insert( "a@1", NodataA );
+  nodataValues.insert( "b@1", NodataB );
+  QgsRasterCalcProgram program( node, nodataValues );
+  delete node;
+  QVERIFY2( program.isValid(), qPrintable( expression ) );
+
+  QVector<float*> inputs;
+  foreach( QString rasterRef, program.rasterRefs() )
+  {
+    QVERIFY( rasterRef == "a@1" || rasterRef == "b@1" );
+    inputs << ( rasterRef == "a@1" ? mA.data() : mB.data() );
+  }
+  QVector<float> scratch( program.scratchSize( ValueCount ) );
+  QVector<float> result( ValueCount );
+  program.run( inputs, ValueCount, result.data(), OutputNodata, scratch.data() );
+
+  // the inputs must not be changed
+  QVERIFY( memcmp( mA.constData(), aMatrix.data(), ValueCount * sizeof( float ) ) == 0 );
+  QVERIFY( memcmp( mB.constData(), bMatrix.data(), ValueCount * sizeof( float ) ) == 0 );
+
+  // a number is the result for all cells
+  QVERIFY( expected.isNumber() || expected.nColumns() * expected.nRows() == ValueCount );
+  for ( int i = 0; i < ValueCount; ++i )
+  {
+    double value = expected.isNumber() ? expected.number() : expected.data()[i];
+    float expectedValue = value == expected.nodataValue() ? OutputNodata : static_cast<float>( value );
+    float actualValue = result[i];
+
+    bool equal = ( std::isnan( expectedValue ) && std::isnan( actualValue ) ) ||
+                 expectedValue == actualValue ||
+                 fabs( expectedValue - actualValue ) <= 1e-6 * qMax( 1.0, fabs( expectedValue ) );
+    QVERIFY2( equal, qPrintable( QString( "%1, cell %2: expected %3, got %4" )
+                                 .arg( expression ).arg( i ).arg( expectedValue ).arg( actualValue ) ) );
+  }
+}
+
+void TestQgsRasterCalcProgram::twoArgumentOperators()
+{
+  QStringList operators;
+  operators << "+" << "-" << "*" << "/" << "^" << "=" << "!=" << ">" << "<" << ">=" << "<=" << "AND" << "OR";
+  foreach( QString op, operators )
+  {
+    checkExpression( QString( "a@1 %1 b@1" ).arg( op ) );
+    checkExpression( QString( "b@1 %1 a@1" ).arg( op ) );
+    checkExpression( QString( "a@1 %1 a@1" ).arg( op ) );
+  }
+}
+
+void TestQgsRasterCalcProgram::oneArgumentOperators()
+{
+  QStringList functions;
+  functions << "sqrt" << "sin" << "cos" << "tan" << "asin" << "acos" << "atan";
+  foreach( QString function, functions )
+  {
+    checkExpression( QString( "%1( a@1 )" ).arg( function ) );
+    checkExpression( QString( "%1( b@1 )" ).arg( function ) );
+  }
+  checkExpression( "-a@1" );
+  checkExpression( "-b@1" );
+}
+
+void TestQgsRasterCalcProgram::numbersAndRasters()
+{
+  QStringList operators;
+  operators << "+" << "-" << "*" << "/" << "^" << "=" << "!=" << ">" << "<" << ">=" << "<=" << "AND" << "OR";
+  foreach( QString op, operators )
+  {
+    checkExpression( QString( "a@1 %1 2" ).arg( op ) );
+    checkExpression( QString( "2 %1 a@1" ).arg( op ) );
+    checkExpression( QString( "b@1 %1 0" ).arg( op ) );
+    checkExpression( QString( "0.5 %1 b@1" ).arg( op ) );
+  }
+}
+
+void TestQgsRasterCalcProgram::nestedExpressions()
+{
+  // results of subexpressions are kept in registers which are reused
+  checkExpression( "( a@1 + 1 ) * ( b@1 - 2 ) / sqrt( a@1 )" );
+  checkExpression( "a@1 + a@1 * b@1 - b@1 / a@1" );
+  checkExpression( "( a@1 > 0 AND b@1 > 0 ) OR a@1 = b@1" );
+  checkExpression( "sin( a@1 ) ^ 2 + cos( a@1 ) ^ 2" );
+  checkExpression( "-( a@1 - b@1 ) * -( 2 + 3 )" );
+  checkExpression( "( ( a@1 + b@1 ) * ( a@1 - b@1 ) ) / ( ( a@1 * b@1 ) + ( b@1 * 2 ) )" );
+}
+
+void TestQgsRasterCalcProgram::nodata()
+{
+  // undefined results are nodata, nodata cells stay nodata
+  checkExpression( "a@1 / 0" );
+  checkExpression( "sqrt( -a@1 )" );
+  checkExpression( "a@1 ^ -0.5" );
+  checkExpression( "b@1 ^ 0.5" );
+  checkExpression( "0 ^ b@1" );
+  checkExpression( "b@1 * 0 + 1" );
+  checkExpression( "( a@1 / b@1 ) + 1" );
+}
+
+void TestQgsRasterCalcProgram::constantExpressions()
+{
+  checkExpression( "3" );
+  checkExpression( "1 + 2 * 3" );
+  checkExpression( "sqrt( 16 ) - 2 ^ 3" );
+  checkExpression( "-( 3 )" );
+  checkExpression( "5 / 0" );
+  checkExpression( "sqrt( -4 )" );
+  checkExpression( "1 > 2 OR 3 >= 3" );
+
+  // constant subexpressions of raster expressions
+  checkExpression( "a@1 * ( 2 + 3 )" );
+  checkExpression( "( 1 / 0 ) + a@1" );
+}
+
+void TestQgsRasterCalcProgram::unknownRaster()
+{
+  QString errorMessage;
+  QgsRasterCalcNode* node = QgsRasterCalcNode::parseRasterCalcString( "a@1 + c@1", errorMessage );
+  QVERIFY( node );
+  QMap<QString, double> nodataValues;
+  nodataValues.insert( "a@1", NodataA );
+  QgsRasterCalcProgram program( node, nodataValues );
+  delete node;
+  QVERIFY( !program.isValid() );
+}
+
+QTEST_MAIN( TestQgsRasterCalcProgram )
+#include "moc_testqgsrastercalcprogram.cxx"
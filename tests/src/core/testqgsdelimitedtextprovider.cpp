@@ -0,0 +1,275 @@
+/***************************************************************************
+     testqgsdelimitedtextprovider.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QUrl>
+
+#ifdef Q_OS_WIN
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsproviderregistry.h>
+#include <qgsrectangle.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+/** \ingroup UnitTests
+ * This is a unit test for the rows, feature ids and index file of delimited text layers.
+ */
+class TestQgsDelimitedTextProvider: public QObject
+{
+    Q_OBJECT;
+  private:
+    QString mDir;
+
+    QString writeFile( const QString& name, const QByteArray& text )
+    {
+      QString fileName = mDir + name;
+      QFile file( fileName );
+      file.open( QIODevice::WriteOnly | QIODevice::Truncate );
+      file.write( text );
+      file.close();
+      return fileName;
+    }
+
+    QgsVectorLayer* createLayer( const QString& fileName, bool index )
+    {
+      QUrl url = QUrl::fromLocalFile( fileName );
+      url.addQueryItem( "delimiter", "," );
+      url.addQueryItem( "delimiterType", "plain" );
+      url.addQueryItem( "xField", "x" );
+      url.addQueryItem( "yField", "y" );
+      if ( index )
+        url.addQueryItem( "index", "yes" );
+      return new QgsVectorLayer( QString::fromAscii( url.toEncoded() ), "delimitedtext", "delimitedtext" );
+    }
+
+    //names of the features in the rectangle by feature id
+    QMap<QgsFeatureId, QString> featureNames( QgsVectorLayer* layer, const QgsRectangle& rect = QgsRectangle() )
+    {
+      QgsVectorDataProvider* provider = layer->dataProvider();
+      int nameIndex = provider->fieldNameIndex( "name" );
+      QMap<QgsFeatureId, QString> names;
+      provider->select( provider->attributeIndexes(), rect, true, false );
+      QgsFeature f;
+      while ( provider->nextFeature( f ) )
+      {
+        names.insert( f.id(), f.attributeMap().value( nameIndex ).toString() );
+      }
+      return names;
+    }
+
+    //sets the modification time of the file
+    void setModified( const QString& fileName, const QDateTime& modified )
+    {
+      struct utimbuf times;
+      times.actime = modified.toTime_t();
+      times.modtime = modified.toTime_t();
+      utime( QFile::encodeName( fileName ).constData(), &times );
+    }
+
+  private slots:
+
+    // will be called before the first testfunction is executed.
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+      // Instantiate the plugin directory so that providers are loaded
+      QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+      mDir = QDir::tempPath() + "/qgis_delimitedtextprovidertest/";
+      QDir().mkpath( mDir );
+    }
+    // will be called after the last testfunction was executed.
+    void cleanupTestCase()
+    {
+      QDir dir( mDir );
+      foreach( QString file, dir.entryList( QDir::Files ) )
+      {
+        dir.remove( file );
+      }
+      QDir().rmdir( mDir );
+    }
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void quotedDelimiters();
+    void embeddedNewlines();
+    void featureIdsAreStable();
+    void staleIndexFile();
+    void corruptIndexFile();
+};
+
+void TestQgsDelimitedTextProvider::quotedDelimiters()
+{
+  QString fileName = writeFile( "quoted.csv",
+                                "name,x,y\n"
+                                "\"a,b\",1,2\n"
+                                "'c,d',3,4\n"
+                                "\"e\",5,6\n"
+                                "plain,7,8\n" );
+  QgsVectorLayer* layer = createLayer( fileName, false );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "a,b" << "c,d" << "e" << "plain" );
+  delete layer;
+}
+
+void TestQgsDelimitedTextProvider::embeddedNewlines()
+{
+  //a quote that is not closed only extends to the end of its line
+  QString fileName = writeFile( "newlines.csv",
+                                "name,x,y\n"
+                                "\"first\nsecond\",1,2\n"
+                                "\"crlf\r\n,\",3,4\r\n"
+                                "next,5,6\n"
+                                "\"open,7,8\n"
+                                "last,9,10\n" );
+  QgsVectorLayer* layer = createLayer( fileName, false );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( layer->featureCount(), 5L );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "first\nsecond" << "crlf\r\n," << "next" << "\"open" << "last" );
+
+  //rows are also found by id
+  QgsFeature f;
+  QVERIFY( layer->dataProvider()->featureAtId( 2, f, false, layer->dataProvider()->attributeIndexes() ) );
+  QCOMPARE( f.attributeMap().value( 0 ).toString(), QString( "crlf\r\n," ) );
+  delete layer;
+}
+
+void TestQgsDelimitedTextProvider::featureIdsAreStable()
+{
+  //rows without coordinates get no feature id
+  QString fileName = writeFile( "fids.csv",
+                                "name,x,y\n"
+                                "a,1,1\n"
+                                "invalid,,\n"
+                                "b,2,2\n"
+                                "\n"
+                                "c,3,3\n"
+                                "d,4,4\n" );
+  QFile::remove( fileName + ".dtx" );
+
+  QMap<QgsFeatureId, QString> expected;
+  expected.insert( 1, "a" );
+  expected.insert( 2, "b" );
+  expected.insert( 3, "c" );
+  expected.insert( 4, "d" );
+
+  QgsVectorLayer* layer = createLayer( fileName, false );
+  QCOMPARE( featureNames( layer ), expected );
+  QCOMPARE( featureNames( layer ), expected );
+  QVERIFY( layer->dataProvider()->createSpatialIndex() );
+  QCOMPARE( featureNames( layer ), expected );
+  delete layer;
+
+  //the ids of the scanned file, of the index file and of a spatial select are the same
+  for ( int pass = 0; pass < 2; pass++ )
+  {
+    layer = createLayer( fileName, true );
+    QVERIFY( layer->isValid() );
+    QVERIFY( QFile::exists( fileName + ".dtx" ) );
+    QCOMPARE( featureNames( layer ), expected );
+
+    QMap<QgsFeatureId, QString> selected;
+    selected.insert( 2, "b" );
+    selected.insert( 3, "c" );
+    QCOMPARE( featureNames( layer, QgsRectangle( 1.5, 1.5, 3.5, 3.5 ) ), selected );
+
+    QgsFeature f;
+    QVERIFY( layer->dataProvider()->featureAtId( 4, f, false, layer->dataProvider()->attributeIndexes() ) );
+    QCOMPARE( f.attributeMap().value( 0 ).toString(), QString( "d" ) );
+    QVERIFY( !layer->dataProvider()->featureAtId( 5, f, false, layer->dataProvider()->attributeIndexes() ) );
+    delete layer;
+  }
+}
+
+void TestQgsDelimitedTextProvider::staleIndexFile()
+{
+  QString fileName = writeFile( "stale.csv", "name,x,y\naaaa,1,1\nbbbb,2,2\n" );
+  QFile::remove( fileName + ".dtx" );
+  QgsVectorLayer* layer = createLayer( fileName, true );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "aaaa" << "bbbb" );
+  delete layer;
+  QVERIFY( QFile::exists( fileName + ".dtx" ) );
+
+  //a change that keeps the size and the modification time is found by the checksum
+  QDateTime modified = QFileInfo( fileName ).lastModified();
+  writeFile( "stale.csv", "name,x,y\ncccc,3,3\ndddd,4,4\n" );
+  setModified( fileName, modified );
+  QCOMPARE( QFileInfo( fileName ).lastModified(), modified );
+
+  layer = createLayer( fileName, true );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "cccc" << "dddd" );
+  QCOMPARE( layer->extent(), QgsRectangle( 3, 3, 4, 4 ) );
+  delete layer;
+
+  //a file with other rows is scanned again
+  writeFile( "stale.csv", "name,x,y\ne,5,5\n" );
+  layer = createLayer( fileName, true );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "e" );
+  delete layer;
+}
+
+void TestQgsDelimitedTextProvider::corruptIndexFile()
+{
+  QString fileName = writeFile( "corrupt.csv", "name,x,y\na,1,1\nb,2,2\nc,3,3\n" );
+  QFile::remove( fileName + ".dtx" );
+  delete createLayer( fileName, true );
+
+  QFile index( fileName + ".dtx" );
+  QVERIFY( index.open( QIODevice::ReadOnly ) );
+  QByteArray contents = index.readAll();
+  index.close();
+
+  //a damaged byte in the row offsets or boxes
+  QByteArray damaged = contents;
+  damaged[damaged.size() - 40] = damaged[damaged.size() - 40] ^ 0x55;
+  QVERIFY( index.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+  index.write( damaged );
+  index.close();
+
+  QgsVectorLayer* layer = createLayer( fileName, true );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "a" << "b" << "c" );
+  delete layer;
+
+  //a truncated index file
+  QVERIFY( index.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+  index.write( contents.left( contents.size() / 2 ) );
+  index.close();
+
+  layer = createLayer( fileName, true );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ).values(), QStringList() << "a" << "b" << "c" );
+  QCOMPARE( featureNames( layer, QgsRectangle( 2.5, 2.5, 3.5, 3.5 ) ).values(), QStringList() << "c" );
+  delete layer;
+}
+
+QTEST_MAIN( TestQgsDelimitedTextProvider )
+#include "moc_testqgsdelimitedtextprovider.cxx"
@@ -55,6 +55,7 @@ class TestQgsGeometry: public QObject
     void differenceCheck1();
     void differenceCheck2();
     void bufferCheck();
+    void sharedWkbCheck();
   private:
     /** A helper method to do a render check to see if the geometry op is as expected */
     bool renderCheck( QString theTestName, QString theComment = "" );
@@ -306,6 +307,45 @@ void TestQgsGeometry::bufferCheck()
   delete mypBufferGeometry;
   QVERIFY( renderCheck( "geometry_bufferCheck", "Checking buffer(10,10) of B" ) );
 }
+
+void TestQgsGeometry::sharedWkbCheck()
+{
+  // two geometries backed by one buffer
+  QgsGeometry *myPoint = QgsGeometry::fromPoint( mPoint1 );
+  QByteArray myBlock;
+  myBlock.append(( const char * ) myPoint->asWkb(), myPoint->wkbSize() );
+  myBlock.append(( const char * ) myPoint->asWkb(), myPoint->wkbSize() );
+
+  QgsGeometry myFirst, mySecond;
+  myFirst.fromWkb( myBlock, 0, myPoint->wkbSize() );
+  mySecond.fromWkb( myBlock, myPoint->wkbSize(), myPoint->wkbSize() );
+  QVERIFY( myFirst.asPoint() == mPoint1 );
+  QVERIFY( mySecond.asPoint() == mPoint1 );
+
+  // reading does not copy the WKB, asWkb() does as the caller may write to it
+  const unsigned char *mySecondWkb = ( const unsigned char * ) myBlock.constData() + myPoint->wkbSize();
+  QVERIFY( mySecond.constWkb() == mySecondWkb );
+  QgsGeometry myThird;
+  myThird.fromWkb( myBlock, myPoint->wkbSize(), myPoint->wkbSize() );
+  QVERIFY( myThird.asWkb() != mySecondWkb );
+  QVERIFY( myThird.asPoint() == mPoint1 );
+  QVERIFY( mySecond.constWkb() == mySecondWkb );
+
+  // modifying one must neither touch the buffer nor the other geometry
+  QVERIFY( myFirst.translate( 10.0, 10.0 ) == 0 );
+  QVERIFY( myFirst.asPoint() == QgsPoint( 30.0, 30.0 ) );
+  QVERIFY( mySecond.asPoint() == mPoint1 );
+
+  // copies own their WKB
+  QgsGeometry myCopy( mySecond );
+  myBlock.clear();
+  mySecond = myFirst;
+  QVERIFY( myCopy.asPoint() == mPoint1 );
+  QVERIFY( mySecond.asPoint() == QgsPoint( 30.0, 30.0 ) );
+
+  delete myPoint;
+}
+
 bool TestQgsGeometry::renderCheck( QString theTestName, QString theComment )
 {
   mReport += "<h2>" + theTestName + "</h2>\n";
@@ -41,6 +41,8 @@
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
 #include <qgsmaplayerregistry.h>
+#include <qgspallabeling.h>
+#include <qgsvectordataprovider.h>
 
 //qgs unit test utility class
 #include "qgsrenderchecker.h"
@@ -62,7 +64,15 @@ class TestQgsMapRenderer: public QObject
     /** This method tests render perfomance */
     void performanceTest();
 
+    /** This method tests that parallel rendering gives the same result */
+    void parallelRenderTest();
+
+    /** This method tests that the label placement does not depend on the number of threads */
+    void labelThreadsTest();
+
   private:
+    QImage renderLabels( QgsMapLayer* layer, int threadCount );
+
     QString mEncoding;
     QgsVectorFileWriter::WriterError mError;
     QgsCoordinateReferenceSystem mCRS;
@@ -205,6 +215,71 @@ void TestQgsMapRenderer::performanceTest()
   QVERIFY( myResultFlag );
 }
 
+void TestQgsMapRenderer::parallelRenderTest()
+{
+  mpMapRenderer->setExtent( mpPolysLayer->extent() );
+  mpMapRenderer->setParallelRenderingEnabled( true );
+  QString myDataDir( TEST_DATA_DIR ); //defined in CmakeLists.txt
+  QString myTestDataDir = myDataDir + QDir::separator();
+  QgsRenderChecker myChecker;
+  myChecker.setExpectedImage( myTestDataDir + "expected_maprender.png" );
+  myChecker.setMapRenderer( mpMapRenderer );
+  bool myResultFlag = myChecker.runTest( "maprender_parallel" );
+  mpMapRenderer->setParallelRenderingEnabled( false );
+  mReport += myChecker.report();
+  QVERIFY( myResultFlag );
+}
+
+QImage TestQgsMapRenderer::renderLabels( QgsMapLayer* layer, int threadCount )
+{
+  QgsPalLabeling* labeling = new QgsPalLabeling();
+  labeling->setSearchMethod( QgsPalLabeling::Popmusic_Tabu );
+  labeling->setThreadCount( threadCount );
+
+  QgsMapRenderer renderer;
+  renderer.setLabelingEngine( labeling ); //renderer takes ownership
+  renderer.setLayerSet( QStringList() << layer->id() );
+  renderer.setOutputSize( QSize( 400, 400 ), 96 );
+  renderer.setExtent( QgsRectangle( 0, 0, 20, 20 ) );
+
+  QImage image( 400, 400, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+  QPainter painter( &image );
+  renderer.render( &painter );
+  painter.end();
+  return image;
+}
+
+void TestQgsMapRenderer::labelThreadsTest()
+{
+  //points close enough for many of their labels to conflict
+  QgsVectorLayer* layer = new QgsVectorLayer( "point?field=name:string", "labels", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < 400; i++ )
+  {
+    QgsFeature f;
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint(( i * 37 ) % 200 / 10.0, ( i * 91 ) % 200 / 10.0 ) ) );
+    f.addAttribute( 0, QString( "label %1" ).arg( i ) );
+    features << f;
+  }
+  QVERIFY( layer->dataProvider()->addFeatures( features ) );
+  layer->updateExtents();
+
+  QgsPalLayerSettings settings;
+  settings.fieldName = "name";
+  settings.enabled = true;
+  settings.writeToLayer( layer );
+  QgsMapLayerRegistry::instance()->addMapLayer( layer );
+
+  QImage sequential = renderLabels( layer, 1 );
+  QImage empty( sequential.size(), sequential.format() );
+  empty.fill( 0 );
+  QVERIFY( sequential != empty );
+  QVERIFY( renderLabels( layer, 4 ) == sequential );
+  QVERIFY( renderLabels( layer, 8 ) == sequential );
+
+  QgsMapLayerRegistry::instance()->removeMapLayer( layer->id() );
+}
 
 QTEST_MAIN( TestQgsMapRenderer )
 #include "moc_testqgsmaprenderer.cxx"
@@ -35,6 +35,7 @@
 #include <qgsapplication.h>
 #include <qgsmaprenderer.h>
 #include <qgsmaplayerregistry.h>
+#include <qgsrastertilecache.h>
 
 //qgis unit test includes
 #include <qgsrenderchecker.h>
@@ -60,8 +61,10 @@ class TestQgsRasterLayer: public QObject
     void checkStats();
     void buildExternalOverviews();
     void registry();
+    void tileCache();
   private:
     bool render( QString theFileName );
+    void renderImage();
     bool setQml( QString theType );
     QString mTestDataDir;
     QgsRasterLayer * mpRasterLayer;
@@ -248,6 +251,42 @@ void TestQgsRasterLayer::registry()
 //
 
 
+void TestQgsRasterLayer::tileCache()
+{
+  QSettings mySettings;
+  mySettings.setValue( "/qgis/raster_tile_cache", true );
+  QgsRasterTileCache* myCache = QgsRasterTileCache::instance();
+  myCache->clear();
+
+  mpRasterLayer->setDrawingStyle( QgsRasterLayer::SingleBandGray );
+  mpRasterLayer->setContrastEnhancementAlgorithm( QgsContrastEnhancement::StretchToMinimumMaximum, false );
+  renderImage();
+  int myTileCount = myCache->tileCount();
+  QVERIFY( myTileCount > 0 );
+
+  //the same view is drawn from the cached tiles
+  renderImage();
+  QCOMPARE( myCache->tileCount(), myTileCount );
+
+  //a changed style doesn't use the tiles drawn before
+  mpRasterLayer->setInvertHistogram( !mpRasterLayer->invertHistogram() );
+  renderImage();
+  QCOMPARE( myCache->tileCount(), 2 * myTileCount );
+  mpRasterLayer->setInvertHistogram( !mpRasterLayer->invertHistogram() );
+  myCache->clear();
+}
+
+void TestQgsRasterLayer::renderImage()
+{
+  QImage myImage( 200, 200, QImage::Format_ARGB32_Premultiplied );
+  myImage.fill( 0 );
+  mpMapRenderer->setOutputSize( myImage.size(), myImage.logicalDpiX() );
+  mpMapRenderer->setExtent( mpRasterLayer->extent() );
+  QPainter myPainter( &myImage );
+  mpMapRenderer->render( &myPainter );
+  myPainter.end();
+}
+
 bool TestQgsRasterLayer::render( QString theTestType )
 {
   mReport += "<h2>" + theTestType + "</h2>\n";
@@ -0,0 +1,260 @@
+/***************************************************************************
+     testqgssnappingindex.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+#include <cmath>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsgeometry.h>
+#include <qgspoint.h>
+#include <qgssnapper.h>
+#include <qgssnappingindex.h>
+
+//snapping result of QgsVectorLayer::snapToGeometry(), which looks at one geometry at a time
+static void snapToGeometry( const QgsPoint& startPoint, QgsFeatureId fid, QgsGeometry* geom, double snappingTolerance,
+                            QMultiMap<double, QgsSnappingResult>& snappingResults, QgsSnapper::SnappingType snap_to )
+{
+  double sqrSnappingTolerance = snappingTolerance * snappingTolerance;
+  int atVertex, beforeVertex, afterVertex;
+  double sqrDist;
+  QgsSnappingResult result;
+  result.snappedAtGeometry = fid;
+  result.layer = 0;
+
+  if ( snap_to == QgsSnapper::SnapToVertex || snap_to == QgsSnapper::SnapToVertexAndSegment )
+  {
+    QgsPoint snappedPoint = geom->closestVertex( startPoint, atVertex, beforeVertex, afterVertex, sqrDist );
+    if ( sqrDist < sqrSnappingTolerance )
+    {
+      result.snappedVertex = snappedPoint;
+      result.snappedVertexNr = atVertex;
+      result.beforeVertexNr = beforeVertex;
+      if ( beforeVertex != -1 )
+        result.beforeVertex = geom->vertexAt( beforeVertex );
+      result.afterVertexNr = afterVertex;
+      if ( afterVertex != -1 )
+        result.afterVertex = geom->vertexAt( afterVertex );
+      snappingResults.insert( sqrt( sqrDist ), result );
+      return;
+    }
+  }
+
+  if (( snap_to == QgsSnapper::SnapToSegment || snap_to == QgsSnapper::SnapToVertexAndSegment ) && geom->type() != QGis::Point )
+  {
+    QgsPoint snappedPoint;
+    sqrDist = geom->closestSegmentWithContext( startPoint, snappedPoint, afterVertex );
+    if ( sqrDist < sqrSnappingTolerance )
+    {
+      result.snappedVertex = snappedPoint;
+      result.snappedVertexNr = -1;
+      result.beforeVertexNr = afterVertex - 1;
+      result.beforeVertex = geom->vertexAt( afterVertex - 1 );
+      result.afterVertexNr = afterVertex;
+      result.afterVertex = geom->vertexAt( afterVertex );
+      snappingResults.insert( sqrt( sqrDist ), result );
+    }
+  }
+}
+
+//one line per result, sorted by geometry
+static QStringList describe( const QMultiMap<double, QgsSnappingResult>& results )
+{
+  QStringList lines;
+  QMultiMap<double, QgsSnappingResult>::const_iterator it = results.constBegin();
+  for ( ; it != results.constEnd(); ++it )
+  {
+    const QgsSnappingResult& r = it.value();
+    lines << QString( "%1: dist %2 vertex %3 %4 before %5 %6 after %7 %8" )
+    .arg( r.snappedAtGeometry ).arg( it.key(), 0, 'g', 15 )
+    .arg( r.snappedVertexNr ).arg( r.snappedVertex.toString( 12 ) )
+    .arg( r.beforeVertexNr ).arg( r.beforeVertexNr == -1 ? QString() : r.beforeVertex.toString( 12 ) )
+    .arg( r.afterVertexNr ).arg( r.afterVertexNr == -1 ? QString() : r.afterVertex.toString( 12 ) );
+  }
+  lines.sort();
+  return lines;
+}
+
+/** \ingroup UnitTests
+ * This is a unit test for the snapping index of the cached geometries of vector layers.
+ */
+class TestQgsSnappingIndex: public QObject
+{
+    Q_OBJECT;
+  private:
+    QgsGeometryMap mGeometries;
+
+    QgsGeometry randomLine( int vertices )
+    {
+      QgsPolyline line;
+      QgsPoint p( qrand() % 1000 / 10.0, qrand() % 1000 / 10.0 );
+      for ( int i = 0; i < vertices; i++ )
+      {
+        line << p;
+        p = QgsPoint( p.x() + ( qrand() % 200 - 100 ) / 10.0, p.y() + ( qrand() % 200 - 100 ) / 10.0 );
+      }
+      QgsGeometry* g = QgsGeometry::fromPolyline( line );
+      QgsGeometry geom( *g );
+      delete g;
+      return geom;
+    }
+
+    void addWkt( QgsFeatureId fid, const QString& wkt )
+    {
+      QgsGeometry* g = QgsGeometry::fromWkt( wkt );
+      QVERIFY( g );
+      mGeometries.insert( fid, *g );
+      delete g;
+    }
+
+    //compares the index with the geometries for random points around them
+    void compareRandomPoints( QgsSnappingIndex& index, const QgsGeometryMap& geometries )
+    {
+      QgsSnapper::SnappingType types[3] = { QgsSnapper::SnapToVertex, QgsSnapper::SnapToSegment, QgsSnapper::SnapToVertexAndSegment };
+      double tolerances[3] = { 0.5, 3.0, 15.0 };
+
+      for ( int i = 0; i < 300; i++ )
+      {
+        QgsPoint point( qrand() % 12000 / 100.0 - 10.0, qrand() % 12000 / 100.0 - 10.0 );
+        for ( int t = 0; t < 3; t++ )
+        {
+          for ( int s = 0; s < 3; s++ )
+          {
+            QMultiMap<double, QgsSnappingResult> expected;
+            QgsGeometryMap::const_iterator it = geometries.constBegin();
+            for ( ; it != geometries.constEnd(); ++it )
+            {
+              QgsGeometry geom( it.value() );
+              snapToGeometry( point, it.key(), &geom, tolerances[t], expected, types[s] );
+            }
+
+            QMultiMap<double, QgsSnappingResult> results;
+            index.snap( point, tolerances[t], results, types[s], 0 );
+            QCOMPARE( describe( results ), describe( expected ) );
+          }
+        }
+      }
+    }
+
+  private slots:
+
+    // will be called before the first testfunction is executed.
+    void initTestCase()
+    {
+      QgsApplication::init();
+
+      qsrand( 1 );
+      for ( int i = 0; i < 20; i++ )
+      {
+        mGeometries.insert( i, randomLine( 2 + qrand() % 8 ) );
+      }
+
+      addWkt( 20, "MULTILINESTRING((10 10, 20 20, 30 10), (30 10, 40 20), (50 50, 60 50, 60 60))" );
+      addWkt( 21, "POLYGON((0 0, 40 0, 40 40, 0 40, 0 0), (10 10, 10 20, 20 20, 20 10, 10 10))" );
+      addWkt( 22, "MULTIPOLYGON(((60 60, 80 60, 80 80, 60 80, 60 60)), ((85 85, 95 85, 95 95, 85 85), (88 87, 92 87, 92 91, 88 87)))" );
+      addWkt( 23, "POINT(50 50)" );
+      addWkt( 24, "MULTIPOINT(5 95, 50 50, 95 5)" );
+    }
+    void cleanupTestCase() {};// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void bulkLoadedIndex();
+    void editedIndex();
+    void toleranceBoundary();
+};
+
+void TestQgsSnappingIndex::bulkLoadedIndex()
+{
+  QgsGeometryMap geometries = mGeometries;
+  QgsSnappingIndex index( geometries );
+  QCOMPARE( index.geometryCount(), mGeometries.size() );
+  compareRandomPoints( index, mGeometries );
+}
+
+void TestQgsSnappingIndex::editedIndex()
+{
+  QgsSnappingIndex index;
+  QgsGeometryMap geometries = mGeometries;
+  QgsGeometryMap::iterator it = geometries.begin();
+  for ( ; it != geometries.end(); ++it )
+  {
+    index.addGeometry( it.key(), &it.value() );
+  }
+
+  //removed and replaced geometries
+  index.removeGeometry( 3 );
+  geometries.remove( 3 );
+  QgsGeometry* moved = QgsGeometry::fromWkt( "LINESTRING(0 100, 100 0)" );
+  geometries[21] = *moved;
+  delete moved;
+  index.addGeometry( 21, &geometries[21] );
+
+  QCOMPARE( index.geometryCount(), geometries.size() );
+  compareRandomPoints( index, geometries );
+}
+
+void TestQgsSnappingIndex::toleranceBoundary()
+{
+  QgsGeometryMap geometries;
+  QgsGeometry* line = QgsGeometry::fromWkt( "LINESTRING(0 0, 10 0, 10 10)" );
+  geometries.insert( 1, *line );
+  delete line;
+  QgsSnappingIndex index( geometries );
+
+  //3-4-5 triangle: the vertex 10 0 is at a distance of exactly 5
+  QMultiMap<double, QgsSnappingResult> results;
+  index.snap( QgsPoint( 13, -4 ), 5.0, results, QgsSnapper::SnapToVertex, 0 );
+  QVERIFY( results.isEmpty() );
+  index.snap( QgsPoint( 13, -4 ), 5.0001, results, QgsSnapper::SnapToVertex, 0 );
+  QCOMPARE( results.size(), 1 );
+  QCOMPARE( results.begin().value().snappedVertexNr, 1 );
+  QCOMPARE( results.begin().value().beforeVertexNr, 0 );
+  QCOMPARE( results.begin().value().afterVertexNr, 2 );
+
+  //the first segment is at a distance of exactly 2
+  results.clear();
+  index.snap( QgsPoint( 5, 2 ), 2.0, results, QgsSnapper::SnapToSegment, 0 );
+  QVERIFY( results.isEmpty() );
+  index.snap( QgsPoint( 5, 2 ), 2.0001, results, QgsSnapper::SnapToSegment, 0 );
+  QCOMPARE( results.size(), 1 );
+  QCOMPARE( results.begin().key(), 2.0 );
+  QCOMPARE( results.begin().value().snappedVertex, QgsPoint( 5, 0 ) );
+  QCOMPARE( results.begin().value().afterVertexNr, 1 );
+
+  //a vertex within the tolerance wins over a closer segment
+  results.clear();
+  index.snap( QgsPoint( 9, 1 ), 2.0, results, QgsSnapper::SnapToVertexAndSegment, 0 );
+  QCOMPARE( results.size(), 1 );
+  QCOMPARE( results.begin().value().snappedVertexNr, 1 );
+
+  //the same as the geometry for points just inside and outside of the tolerance
+  for ( int i = 0; i < 100; i++ )
+  {
+    QgsPoint point( 13 + ( i - 50 ) * 1e-9, -4 );
+    QMultiMap<double, QgsSnappingResult> expected;
+    snapToGeometry( point, 1, &geometries[1], 5.0, expected, QgsSnapper::SnapToVertexAndSegment );
+    results.clear();
+    index.snap( point, 5.0, results, QgsSnapper::SnapToVertexAndSegment, 0 );
+    QCOMPARE( describe( results ), describe( expected ) );
+  }
+}
+
+QTEST_MAIN( TestQgsSnappingIndex )
+#include "moc_testqgssnappingindex.cxx"
@@ -0,0 +1,203 @@
+/***************************************************************************
+     testqgsspatialindex.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+
+#include <stdexcept>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsgeometry.h>
+#include <qgspoint.h>
+#include <qgsrectangle.h>
+//header for class being tested
+#include <qgsspatialindex.h>
+
+// features on a 100 x 100 grid of unit squares with half size boxes
+class GridFeatureSource : public QgsSpatialIndex::FeatureSource
+{
+  public:
+    GridFeatureSource() : mNext( 0 ) {}
+
+    bool nextFeature( QgsFeature& f )
+    {
+      if ( mNext == 10000 )
+        return false;
+
+      double x = mNext % 100, y = mNext / 100;
+      f.setFeatureId( mNext++ );
+      f.setGeometry( QgsGeometry::fromRect( QgsRectangle( x, y, x + 0.5, y + 0.5 ) ) );
+      return true;
+    }
+
+  private:
+    int mNext;
+};
+
+// entries of the grid, failing once in the middle like a broken data source
+class FailingEntrySource : public QgsSpatialIndex::EntrySource
+{
+  public:
+    FailingEntrySource() : mNext( 0 ), mFailed( false ) {}
+
+    bool nextEntry( QgsFeatureId& id, QgsRectangle& rect )
+    {
+      if ( mNext == 5000 && !mFailed )
+      {
+        mFailed = true;
+        throw std::runtime_error( "read error" );
+      }
+      if ( mNext == 10000 )
+        return false;
+
+      double x = mNext % 100, y = mNext / 100;
+      id = mNext++;
+      rect = QgsRectangle( x, y, x + 0.5, y + 0.5 );
+      return true;
+    }
+
+  private:
+    int mNext;
+    bool mFailed;
+};
+
+class TestQgsSpatialIndex: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void bulkLoad();
+    void batchQueries();
+    void saveAndLoad();
+    void smallCapacity();
+    void failedBulkLoad();
+};
+
+void TestQgsSpatialIndex::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+}
+
+void TestQgsSpatialIndex::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+void TestQgsSpatialIndex::bulkLoad()
+{
+  GridFeatureSource source;
+  QgsSpatialIndex index( source, 32, 32 );
+
+  QList<QgsFeatureId> ids = index.intersects( QgsRectangle( 10.1, 10.1, 12.2, 11.2 ) );
+  QCOMPARE( ids.size(), 6 );
+  QVERIFY( ids.contains( 10 * 100 + 10 ) );
+  QVERIFY( ids.contains( 11 * 100 + 12 ) );
+
+  // bulk loaded indexes accept further features
+  QgsFeature f;
+  f.setFeatureId( 10000 );
+  f.setGeometry( QgsGeometry::fromRect( QgsRectangle( 200, 200, 201, 201 ) ) );
+  QVERIFY( index.insertFeature( f ) );
+  QCOMPARE( index.intersects( QgsRectangle( 150, 150, 250, 250 ) ), QList<QgsFeatureId>() << 10000 );
+
+  // empty sources give empty indexes
+  class EmptySource : public QgsSpatialIndex::FeatureSource
+  {
+    public:
+      bool nextFeature( QgsFeature& f ) { Q_UNUSED( f ); return false; }
+  } empty;
+  QgsSpatialIndex emptyIndex( empty );
+  QVERIFY( emptyIndex.intersects( QgsRectangle( 0, 0, 100, 100 ) ).isEmpty() );
+}
+
+void TestQgsSpatialIndex::batchQueries()
+{
+  GridFeatureSource source;
+  QgsSpatialIndex index( source );
+
+  QList<QgsRectangle> rects;
+  rects << QgsRectangle( 10.1, 10.1, 12.2, 11.2 ) << QgsRectangle( -10, -10, -5, -5 );
+  QList< QList<QgsFeatureId> > result = index.intersects( rects );
+  QCOMPARE( result.size(), 2 );
+  QCOMPARE( result[0].size(), 6 );
+  QVERIFY( result[1].isEmpty() );
+
+  QList<QgsPoint> points;
+  points << QgsPoint( 0.1, 0.1 ) << QgsPoint( 99.4, 99.4 );
+  QList< QList<QgsFeatureId> > neighbors = index.nearestNeighbor( points, 1 );
+  QCOMPARE( neighbors.size(), 2 );
+  QCOMPARE( neighbors[0], QList<QgsFeatureId>() << 0 );
+  QCOMPARE( neighbors[1], QList<QgsFeatureId>() << 9999 );
+}
+
+void TestQgsSpatialIndex::saveAndLoad()
+{
+  GridFeatureSource source;
+  QgsSpatialIndex index( source, 16, 24 );
+
+  QString fileName = QDir::tempPath() + QDir::separator() + "testqgsspatialindex.idx";
+  QVERIFY( index.save( fileName ) );
+
+  QgsSpatialIndex* loaded = QgsSpatialIndex::load( fileName );
+  QVERIFY( loaded );
+  QgsRectangle rect( 10.1, 10.1, 12.2, 11.2 );
+  QList<QgsFeatureId> expected = index.intersects( rect );
+  QList<QgsFeatureId> actual = loaded->intersects( rect );
+  qSort( expected );
+  qSort( actual );
+  QCOMPARE( actual, expected );
+  delete loaded;
+
+  // files that are not indexes are refused
+  QFile file( fileName );
+  QVERIFY( file.open( QIODevice::WriteOnly ) );
+  file.write( "not an index" );
+  file.close();
+  QVERIFY( !QgsSpatialIndex::load( fileName ) );
+  QFile::remove( fileName );
+}
+
+void TestQgsSpatialIndex::smallCapacity()
+{
+  // capacities below 4 are raised instead of failing in the R-tree
+  GridFeatureSource source;
+  QgsSpatialIndex index( source, 2, 0 );
+  QCOMPARE( index.intersects( QgsRectangle( 10.1, 10.1, 12.2, 11.2 ) ).size(), 6 );
+
+  QgsSpatialIndex emptyIndex( 1, 1 );
+  QgsFeature f;
+  f.setFeatureId( 1 );
+  f.setGeometry( QgsGeometry::fromRect( QgsRectangle( 0, 0, 1, 1 ) ) );
+  QVERIFY( emptyIndex.insertFeature( f ) );
+  QCOMPARE( emptyIndex.intersects( QgsRectangle( 0.5, 0.5, 2, 2 ) ), QList<QgsFeatureId>() << 1 );
+}
+
+void TestQgsSpatialIndex::failedBulkLoad()
+{
+  // the entries read before the failure are inserted with the remaining ones
+  FailingEntrySource source;
+  QgsSpatialIndex index( source );
+  QCOMPARE( index.intersects( QgsRectangle( -1, -1, 101, 101 ) ).size(), 10000 );
+  QCOMPARE( index.intersects( QgsRectangle( 10.1, 10.1, 12.2, 11.2 ) ).size(), 6 );
+  QCOMPARE( index.intersects( QgsRectangle( 0.1, 50.1, 0.2, 50.2 ) ), QList<QgsFeatureId>() << 5000 );
+}
+
+QTEST_MAIN( TestQgsSpatialIndex )
+#include "moc_testqgsspatialindex.cxx"
@@ -21,6 +21,13 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QDesktopServices>
+#include <QDateTime>
+
+#ifdef Q_OS_WIN
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
 
 #include <iostream>
 //qgis includes...
@@ -29,6 +36,8 @@
 #include <qgsvectordataprovider.h>
 #include <qgsvectorlayer.h>
 #include <qgsapplication.h>
+#include <qgsexpression.h>
+#include <qgsgeometry.h>
 #include <qgsproviderregistry.h>
 #include <qgsmaplayerregistry.h>
 //qgis test includes
@@ -642,6 +651,129 @@ class TestQgsVectorLayer: public QObject
     {
 
     };
+    void QgsVectorLayergeneralizedCache()
+    {
+      QgsVectorLayer * myLayer = qobject_cast<QgsVectorLayer *>( mpLinesLayer );
+      QVERIFY( !qobject_cast<QgsVectorLayer *>( mpPointsLayer )->buildGeneralizedCache( QList<double>() << 1.0 ) );
+      QVERIFY( myLayer->buildGeneralizedCache( QList<double>() << 0.5 << 2.0 ) );
+      QVERIFY( myLayer->hasGeneralizedCache() );
+
+      QString myFileName = QDir::tempPath() + QDir::separator() + "generalizedcache.qgc";
+      QVERIFY( myLayer->saveGeneralizedCache( myFileName ) );
+      myLayer->clearGeneralizedCache();
+      QVERIFY( !myLayer->hasGeneralizedCache() );
+      QVERIFY( myLayer->loadGeneralizedCache( myFileName ) );
+      QVERIFY( myLayer->hasGeneralizedCache() );
+      // a cache must not be used for another data source
+      QVERIFY( !qobject_cast<QgsVectorLayer *>( mpPolysLayer )->loadGeneralizedCache( myFileName ) );
+      QFile::remove( myFileName );
+
+      // nor for the data source after it changed
+      QString myCopyBase = QDir::tempPath() + QDir::separator() + "generalizedcache_lines";
+      foreach( QString mySuffix, QStringList() << ".shp" << ".shx" << ".dbf" << ".prj" )
+      {
+        QFile::remove( myCopyBase + mySuffix );
+        QVERIFY( QFile::copy( mTestDataDir + "lines" + mySuffix, myCopyBase + mySuffix ) );
+      }
+      QgsVectorLayer * myCopy = new QgsVectorLayer( myCopyBase + ".shp", "lines", "ogr" );
+      QVERIFY( myCopy->buildGeneralizedCache( QList<double>() << 0.5 ) );
+      QVERIFY( myCopy->saveGeneralizedCache( myFileName ) );
+      delete myCopy;
+      myCopy = new QgsVectorLayer( myCopyBase + ".shp", "lines", "ogr" );
+      QVERIFY( myCopy->loadGeneralizedCache( myFileName ) );
+      delete myCopy;
+      struct utimbuf myTimes;
+      myTimes.actime = myTimes.modtime = QFileInfo( myCopyBase + ".shp" ).lastModified().toTime_t() + 60;
+      utime( QFile::encodeName( myCopyBase + ".shp" ).constData(), &myTimes );
+      myCopy = new QgsVectorLayer( myCopyBase + ".shp", "lines", "ogr" );
+      QVERIFY( !myCopy->loadGeneralizedCache( myFileName ) );
+      delete myCopy;
+      QFile::remove( myFileName );
+      foreach( QString mySuffix, QStringList() << ".shp" << ".shx" << ".dbf" << ".prj" )
+      {
+        QFile::remove( myCopyBase + mySuffix );
+      }
+
+      // edits drop the cache
+      QgsFeature myFeature;
+      myLayer->select( QgsAttributeList(), QgsRectangle(), false );
+      QVERIFY( myLayer->nextFeature( myFeature ) );
+      myLayer->startEditing();
+      myLayer->deleteFeature( myFeature.id() );
+      QVERIFY( !myLayer->hasGeneralizedCache() );
+      myLayer->rollBack();
+      myLayer->clearGeneralizedCache();
+    };
+    void QgsVectorLayermemoryIndexes()
+    {
+      QgsVectorLayer myLayer( "point?field=cls:integer&field=name:string", "memory", "memory" );
+      QVERIFY( myLayer.isValid() );
+      QgsVectorDataProvider* myProvider = myLayer.dataProvider();
+
+      // enough features for an automatic spatial index
+      QgsFeatureList myFeatures;
+      for ( int i = 0; i < 2000; ++i )
+      {
+        QgsFeature myFeature;
+        myFeature.setGeometry( QgsGeometry::fromPoint( QgsPoint( i, i ) ) );
+        myFeature.addAttribute( 0, i % 10 );
+        myFeature.addAttribute( 1, QString( "n%1" ).arg( i % 4 ) );
+        myFeatures << myFeature;
+      }
+      QVERIFY( myProvider->addFeatures( myFeatures ) );
+      // the first feature is at the origin
+      QCOMPARE( myProvider->extent(), QgsRectangle( 0, 0, 1999, 1999 ) );
+      QVERIFY( myProvider->createAttributeIndex( 0 ) );
+      QVERIFY( myProvider->createAttributeIndex( 1 ) );
+
+      QList<QVariant> myValues;
+      myProvider->uniqueValues( 0, myValues );
+      QCOMPARE( myValues.size(), 10 );
+      QCOMPARE( myProvider->minimumValue( 0 ).toInt(), 0 );
+      QCOMPARE( myProvider->maximumValue( 0 ).toInt(), 9 );
+
+      // the same features with and without the indexes
+      QStringList mySubsets;
+      mySubsets << "cls = 3" << "cls >= 8 AND name = 'n1'" << "name IN ('n0', 'n2') OR cls < 1" << "cls + 1 = 4";
+      foreach( QString mySubset, mySubsets )
+      {
+        QVERIFY( myProvider->setSubsetString( mySubset ) );
+        int myCount = 0;
+        QgsFeature myFeature;
+        myProvider->select( myProvider->attributeIndexes(), QgsRectangle( 100, 100, 899.5, 899.5 ) );
+        while ( myProvider->nextFeature( myFeature ) )
+        {
+          QgsExpression myExpression( mySubset );
+          QVERIFY( myExpression.evaluate( &myFeature, myProvider->fields() ).toInt() );
+          QVERIFY( myFeature.geometry()->asPoint().x() >= 100 && myFeature.geometry()->asPoint().x() < 900 );
+          ++myCount;
+        }
+
+        int myExpected = 0;
+        for ( int i = 100; i < 900; ++i )
+        {
+          QgsFeature myCopy( myFeatures[i] );
+          QgsExpression myExpression( mySubset );
+          if ( myExpression.evaluate( &myCopy, myProvider->fields() ).toInt() )
+            ++myExpected;
+        }
+        QCOMPARE( myCount, myExpected );
+      }
+
+      // indexes follow the edits
+      QVERIFY( myProvider->setSubsetString( "cls = 3" ) );
+      long myCount = myProvider->featureCount();
+      QgsChangedAttributesMap myChanges;
+      myChanges[ myFeatures[0].id()][0] = 3;
+      QVERIFY( myProvider->changeAttributeValues( myChanges ) );
+      QCOMPARE( myProvider->featureCount(), myCount + 1 );
+      QVERIFY( myProvider->deleteFeatures( QgsFeatureIds() << myFeatures[3].id() << myFeatures[13].id() ) );
+      QCOMPARE( myProvider->featureCount(), myCount - 1 );
+      QVERIFY( !myProvider->setSubsetString( "nofield = 1" ) );
+      QCOMPARE( myProvider->subsetString(), QString( "cls = 3" ) );
+      QVERIFY( myProvider->setSubsetString( "" ) );
+      QCOMPARE( myProvider->featureCount(), 1998L );
+    };
 
 };
 
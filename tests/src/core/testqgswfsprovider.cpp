@@ -0,0 +1,432 @@
+/***************************************************************************
+     testqgswfsprovider.cpp
+     --------------------------------------
+    Date                 : 18.10.2012
+    Copyright            : (C) 2012 by the QGIS project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QSettings>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsgeometry.h>
+#include <qgsmaplayerregistry.h>
+#include <qgsproviderregistry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+//size of the parts of GML documents parsed at once, GML_CHUNK_SIZE in qgswfsdata.cpp
+static const int GML_CHUNK_SIZE = 1024 * 1024;
+
+//schema of the test features with a point geometry and a name
+static QByteArray testSchema()
+{
+  return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         "<schema targetNamespace=\"http://example.org/test\" xmlns:test=\"http://example.org/test\" "
+         "xmlns=\"http://www.w3.org/2001/XMLSchema\" xmlns:gml=\"http://www.opengis.net/gml\">\n"
+         "  <element name=\"test\" type=\"test:testType\" substitutionGroup=\"gml:_Feature\"/>\n"
+         "  <complexType name=\"testType\">\n"
+         "    <complexContent>\n"
+         "      <extension base=\"gml:AbstractFeatureType\">\n"
+         "        <sequence>\n"
+         "          <element name=\"geometry\" type=\"gml:PointPropertyType\"/>\n"
+         "          <element name=\"name\" type=\"string\"/>\n"
+         "        </sequence>\n"
+         "      </extension>\n"
+         "    </complexContent>\n"
+         "  </complexType>\n"
+         "</schema>\n";
+}
+
+//start of a GML2 feature collection of test features
+static const char* GML2_HEADER =
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+  "<!-- <gml:featureMember> in a comment -->\n"
+  "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" "
+  "xmlns:gml=\"http://www.opengis.net/gml\" xmlns:test=\"http://example.org/test\">\n"
+  "<gml:boundedBy><gml:Box srsName=\"EPSG:4326\"><gml:coordinates>0,0 10,10</gml:coordinates></gml:Box></gml:boundedBy>\n";
+
+//a GML2 feature member named name
+static QByteArray gml2Feature( int id, const QString& name )
+{
+  return QString( "<gml:featureMember><test:test fid=\"test.%1\">"
+                  "<test:geometry><gml:Point><gml:coordinates>%1,%1</gml:coordinates></gml:Point></test:geometry>"
+                  "<test:name>%2</test:name></test:test></gml:featureMember>\n" ).arg( id ).arg( name ).toUtf8();
+}
+
+/**Local stand-in for a WFS server. Answers DescribeFeatureType, GetCapabilities and
+  GetFeature requests with canned documents, the features are the points (x + 0.5, y + 0.5)
+  for x and y from 0 to 7 and GetFeature only returns the ones inside the BBOX*/
+class TestWFSServer: public QTcpServer
+{
+    Q_OBJECT
+  public:
+    TestWFSServer(): getFeatureRequests( 0 )
+    {
+      connect( this, SIGNAL( newConnection() ), this, SLOT( acceptConnections() ) );
+    }
+
+    int getFeatureRequests;
+
+  private slots:
+    void acceptConnections()
+    {
+      while ( hasPendingConnections() )
+      {
+        QTcpSocket* socket = nextPendingConnection();
+        connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+        connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater() ) );
+      }
+    }
+
+    void readRequest()
+    {
+      QTcpSocket* socket = qobject_cast<QTcpSocket*>( sender() );
+      if ( !socket || !socket->canReadLine() )
+      {
+        return;
+      }
+      disconnect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+
+      //GET <path> HTTP/1.1
+      QString path = QString::fromAscii( socket->readLine() ).section( ' ', 1, 1 );
+      QUrl url( "http://localhost" + path );
+      QString request = url.queryItemValue( "REQUEST" );
+
+      QByteArray body;
+      if ( request == "DescribeFeatureType" )
+      {
+        body = testSchema();
+      }
+      else if ( request == "GetCapabilities" )
+      {
+        body = "<WFS_Capabilities xmlns=\"http://www.opengis.net/wfs\"><FeatureTypeList/></WFS_Capabilities>";
+      }
+      else if ( request == "GetFeature" )
+      {
+        ++getFeatureRequests;
+        QStringList bbox = url.queryItemValue( "BBOX" ).split( "," );
+        body = getFeature( QgsRectangle( bbox.value( 0 ).toDouble(), bbox.value( 1 ).toDouble(),
+                                         bbox.value( 2 ).toDouble(), bbox.value( 3 ).toDouble() ) );
+      }
+
+      socket->write( "HTTP/1.0 200 OK\r\nContent-Type: text/xml\r\nConnection: close\r\nContent-Length: " );
+      socket->write( QByteArray::number( body.size() ) + "\r\n\r\n" + body );
+      socket->disconnectFromHost();
+    }
+
+  private:
+    QByteArray getFeature( const QgsRectangle& bbox ) const
+    {
+      QByteArray gml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                       "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" "
+                       "xmlns:gml=\"http://www.opengis.net/gml\" xmlns:test=\"http://example.org/test\">\n";
+      for ( int y = 0; y < 8; ++y )
+      {
+        for ( int x = 0; x < 8; ++x )
+        {
+          if ( !bbox.contains( QgsPoint( x + 0.5, y + 0.5 ) ) )
+          {
+            continue;
+          }
+          QString id = QString( "test.%1" ).arg( y * 8 + x );
+          gml += QString( "<gml:featureMember><test:test fid=\"%1\">"
+                          "<test:geometry><gml:Point><gml:coordinates>%2,%3</gml:coordinates></gml:Point></test:geometry>"
+                          "<test:name>%1</test:name></test:test></gml:featureMember>\n" )
+                 .arg( id ).arg( x + 0.5 ).arg( y + 0.5 ).toUtf8();
+        }
+      }
+      gml += "</wfs:FeatureCollection>\n";
+      return gml;
+    }
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the tiles of WFS layers without "Cache Features".
+ */
+class TestQgsWFSProvider: public QObject
+{
+    Q_OBJECT;
+  private:
+    TestWFSServer mServer;
+    QString mUri;
+
+    QgsVectorLayer* createLayer()
+    {
+      QgsVectorLayer* layer = new QgsVectorLayer( mUri, "wfs", "WFS" );
+      QgsMapLayerRegistry::instance()->addMapLayer( layer );
+      return layer;
+    }
+
+    /**Returns the number of features the layer selects in rect*/
+    int featureCount( QgsVectorLayer* layer, const QgsRectangle& rect )
+    {
+      layer->select( layer->pendingAllAttributesList(), rect, true, false );
+      int count = 0;
+      QgsFeature f;
+      while ( layer->nextFeature( f ) )
+      {
+        ++count;
+      }
+      return count;
+    }
+
+    /**Writes the GML file and the schema of the test features next to it
+      and returns a layer reading the file*/
+    QgsVectorLayer* createFileLayer( const QString& name, const QByteArray& gml )
+    {
+      QString baseName = QDir::tempPath() + "/qgis_wfsprovidertest/" + name;
+      QDir().mkpath( QFileInfo( baseName ).path() );
+
+      QFile gmlFile( baseName + ".gml" );
+      gmlFile.open( QIODevice::WriteOnly );
+      gmlFile.write( gml );
+      gmlFile.close();
+
+      QFile schemaFile( baseName + ".xsd" );
+      schemaFile.open( QIODevice::WriteOnly );
+      schemaFile.write( testSchema() );
+      schemaFile.close();
+
+      return new QgsVectorLayer( gmlFile.fileName(), name, "WFS" );
+    }
+
+    /**Returns the names of the features in the order of their ids*/
+    QStringList featureNames( QgsVectorLayer* layer )
+    {
+      int nameIndex = layer->fieldNameIndex( "name" );
+      QMap<QgsFeatureId, QString> names;
+      layer->select( layer->pendingAllAttributesList(), QgsRectangle(), false, false );
+      QgsFeature f;
+      while ( layer->nextFeature( f ) )
+      {
+        names.insert( f.id(), f.attributeMap().value( nameIndex ).toString() );
+      }
+      return names.values();
+    }
+
+  private slots:
+
+    // will be called before the first testfunction is executed.
+    void initTestCase()
+    {
+      //keep the tile cache of the test apart from the one of the user
+      QString configPath = QDir::tempPath() + "/qgis_wfsprovidertest/";
+      QgsApplication::init( configPath );
+      QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+      // Instantiate the plugin directory so that providers are loaded
+      QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+      QDir cacheDir( QgsApplication::qgisSettingsDirPath() + "wfscache" );
+      foreach( QFileInfo layerDir, cacheDir.entryInfoList( QDir::Dirs | QDir::NoDotAndDotDot ) )
+      {
+        QDir dir( layerDir.filePath() );
+        foreach( QString entry, dir.entryList( QDir::Files ) )
+        {
+          dir.remove( entry );
+        }
+        cacheDir.rmdir( layerDir.fileName() );
+      }
+
+      QVERIFY( mServer.listen( QHostAddress::LocalHost ) );
+      mUri = QString( "http://127.0.0.1:%1/wfs?SERVICE=WFS&VERSION=1.0.0&REQUEST=GetFeature&TYPENAME=test&SRSNAME=EPSG:4326&BBOX=0,0,8,8" ).arg( mServer.serverPort() );
+    }
+    // will be called after the last testfunction was executed.
+    void cleanupTestCase()
+    {
+      QSettings().remove( "/qgis/wfsTileCacheMaxAge" );
+      QgsMapLayerRegistry::instance()->removeAllMapLayers();
+    }
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void tilesFromServerAndCache();
+    void tileLevelFollowsView();
+    void staleTilesAreFetchedAgain();
+    void featureMembersGml2();
+    void featureMembersNamespaces();
+    void featureMembersGml3();
+    void featureMembersAcrossChunks();
+    void notWellFormed();
+};
+
+void TestQgsWFSProvider::tilesFromServerAndCache()
+{
+  QSettings().setValue( "/qgis/wfsTileCacheMaxAge", 3600 );
+  QgsRectangle view( 0.1, 0.1, 7.9, 7.9 );
+
+  //the view is covered by 2 x 2 tiles of size 4
+  QgsVectorLayer* layer = createLayer();
+  QVERIFY( layer->isValid() );
+  int requests = mServer.getFeatureRequests;
+  QCOMPARE( featureCount( layer, view ), 64 );
+  QCOMPARE( mServer.getFeatureRequests - requests, 4 );
+
+  //loaded tiles are not requested again
+  requests = mServer.getFeatureRequests;
+  QCOMPARE( featureCount( layer, view ), 64 );
+  QCOMPARE( mServer.getFeatureRequests, requests );
+
+  //another layer of the same source reads the tiles from the disk cache
+  QgsVectorLayer* other = createLayer();
+  QCOMPARE( featureCount( other, view ), 64 );
+  QCOMPARE( mServer.getFeatureRequests, requests );
+}
+
+void TestQgsWFSProvider::tileLevelFollowsView()
+{
+  QSettings().setValue( "/qgis/wfsTileCacheMaxAge", 3600 );
+  QgsVectorLayer* layer = createLayer();
+  QCOMPARE( featureCount( layer, QgsRectangle( 0.1, 0.1, 7.9, 7.9 ) ), 64 );
+
+  //zoomed in, the view uses 2 x 2 tiles of size 1 instead of the tiles of the first view
+  int requests = mServer.getFeatureRequests;
+  QCOMPARE( featureCount( layer, QgsRectangle( 0.1, 0.1, 1.9, 1.9 ) ), 4 );
+  QCOMPARE( mServer.getFeatureRequests - requests, 4 );
+}
+
+void TestQgsWFSProvider::staleTilesAreFetchedAgain()
+{
+  QgsRectangle view( 0.1, 0.1, 7.9, 7.9 );
+  QSettings().setValue( "/qgis/wfsTileCacheMaxAge", 3600 );
+  QgsVectorLayer* layer = createLayer();
+  QCOMPARE( featureCount( layer, view ), 64 );
+
+  //with a maximum age of 0 the disk cache is not used
+  QSettings().setValue( "/qgis/wfsTileCacheMaxAge", 0 );
+  int requests = mServer.getFeatureRequests;
+  QgsVectorLayer* other = createLayer();
+  QCOMPARE( featureCount( other, view ), 64 );
+  QCOMPARE( mServer.getFeatureRequests - requests, 4 );
+}
+
+void TestQgsWFSProvider::featureMembersGml2()
+{
+  QByteArray gml = GML2_HEADER;
+  gml += gml2Feature( 0, "n0" );
+  gml += "<!-- </gml:featureMember> in a comment -->\n";
+  gml += gml2Feature( 1, "n1" );
+  gml += gml2Feature( 2, "n2" );
+  gml += "</wfs:FeatureCollection>\n";
+
+  QgsVectorLayer* layer = createFileLayer( "gml2", gml );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ), QStringList() << "n0" << "n1" << "n2" );
+  delete layer;
+}
+
+void TestQgsWFSProvider::featureMembersNamespaces()
+{
+  //default namespace for the root, other prefixes and a feature member in the default namespace
+  QByteArray gml =
+    "<FeatureCollection xmlns=\"http://www.opengis.net/wfs\" xmlns:g=\"http://www.opengis.net/gml\" "
+    "xmlns:t=\"http://example.org/test\" title=\"a > b\">\n"
+    "<g:featureMember><t:test fid=\"test.0\"><t:geometry><g:Point><g:coordinates>0,0</g:coordinates></g:Point></t:geometry>"
+    "<t:name>n0</t:name></t:test></g:featureMember>\n"
+    "<featureMember xmlns=\"http://www.opengis.net/gml\"><t:test fid=\"test.1\"><t:geometry><Point><coordinates>1,1</coordinates></Point></t:geometry>"
+    "<t:name>n1</t:name></t:test></featureMember>\n"
+    "</FeatureCollection>\n";
+
+  QgsVectorLayer* layer = createFileLayer( "namespaces", gml );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ), QStringList() << "n0" << "n1" );
+  delete layer;
+}
+
+void TestQgsWFSProvider::featureMembersGml3()
+{
+  QByteArray gml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" xmlns:gml=\"http://www.opengis.net/gml\" "
+    "xmlns:test=\"http://example.org/test\" numberOfFeatures=\"2\">\n"
+    "<gml:boundedBy><gml:Envelope srsName=\"urn:ogc:def:crs:EPSG::4326\">"
+    "<gml:lowerCorner>0 0</gml:lowerCorner><gml:upperCorner>1 1</gml:upperCorner></gml:Envelope></gml:boundedBy>\n"
+    "<gml:featureMember><test:test gml:id=\"test.0\"><test:geometry><gml:Point><gml:coordinates>0,0</gml:coordinates></gml:Point></test:geometry>"
+    "<test:name>n0</test:name></test:test></gml:featureMember>\n"
+    "<gml:featureMember><test:test gml:id=\"test.1\"><test:geometry><gml:Point><gml:coordinates>1,1</gml:coordinates></gml:Point></test:geometry>"
+    "<test:name>n1</test:name></test:test></gml:featureMember>\n"
+    "</wfs:FeatureCollection>\n";
+
+  QgsVectorLayer* layer = createFileLayer( "gml3", gml );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ), QStringList() << "n0" << "n1" );
+  delete layer;
+}
+
+void TestQgsWFSProvider::featureMembersAcrossChunks()
+{
+  //the file is read in parts of GML_CHUNK_SIZE and from the second part on, the feature members
+  //are split at the end of every part: the end of the second part is just after an end tag in a
+  //CDATA section, the end of the third one in the middle of a real end tag
+  QString cdata = "<![CDATA[%1</gml:featureMember><gml:featureMember>]]>";
+  QByteArray gml = GML2_HEADER;
+  QStringList expected;
+  bool cdataSplit = false, tagSplit = false;
+  for ( int i = 0; gml.size() < 4 * GML_CHUNK_SIZE; ++i )
+  {
+    QByteArray feature = gml2Feature( i, cdata.arg( i ) );
+    if ( !cdataSplit && gml.size() + feature.size() > 2 * GML_CHUNK_SIZE - 1000 )
+    {
+      int split = feature.indexOf( "</gml:featureMember>" ) + 21;
+      gml += QByteArray( 2 * GML_CHUNK_SIZE - split - gml.size(), ' ' );
+      cdataSplit = true;
+    }
+    else if ( !tagSplit && gml.size() + feature.size() > 3 * GML_CHUNK_SIZE - 1000 )
+    {
+      int split = feature.lastIndexOf( "featureMember" ) + 7;
+      gml += QByteArray( 3 * GML_CHUNK_SIZE - split - gml.size(), ' ' );
+      tagSplit = true;
+    }
+    gml += feature;
+    expected << QString( "%1</gml:featureMember><gml:featureMember>" ).arg( i );
+  }
+  gml += "</wfs:FeatureCollection>\n";
+
+  QgsVectorLayer* layer = createFileLayer( "chunks", gml );
+  QVERIFY( layer->isValid() );
+  QCOMPARE( featureNames( layer ), expected );
+  delete layer;
+}
+
+void TestQgsWFSProvider::notWellFormed()
+{
+  //in a feature member
+  QByteArray gml = GML2_HEADER;
+  gml += gml2Feature( 0, "n0" );
+  gml += "<gml:featureMember><test:test fid=\"test.1\"><test:name>n1</test:nam></test:test></gml:featureMember>\n";
+  gml += "</wfs:FeatureCollection>\n";
+  QgsVectorLayer* layer = createFileLayer( "invalidmember", gml );
+  QVERIFY( !layer->isValid() );
+  delete layer;
+
+  //after the last feature member
+  gml = GML2_HEADER;
+  gml += gml2Feature( 0, "n0" );
+  gml += "</wfs:FeatureCollections>\n";
+  layer = createFileLayer( "invalidend", gml );
+  QVERIFY( !layer->isValid() );
+  delete layer;
+}
+
+QTEST_MAIN( TestQgsWFSProvider )
+#include "moc_testqgswfsprovider.cxx"
+